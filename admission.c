@@ -0,0 +1,153 @@
+#include <stddef.h>
+
+#include "admission.h"
+#include "custom.h"
+
+#define TOKEN 1000 // one request, in the buckets' thousandths
+
+typedef struct
+{
+    uint32_t tokens;
+    uint32_t refill_ms;
+} Bucket;
+
+typedef struct
+{
+    bool used;
+    uint32_t client;
+    uint8_t inflight;
+    Bucket bucket;
+} AdmissionClient;
+
+AdmissionStats admission_stats;
+bool admission_enabled = ADMISSION_CONTROL;
+
+static AdmissionClient clients[ADMISSION_MAX_CLIENTS];
+static Bucket newcomers; // clients not in the table yet
+
+static void fill(Bucket *b, uint32_t burst, uint32_t now_ms)
+{
+    b->tokens = burst * TOKEN;
+    b->refill_ms = now_ms;
+}
+
+static void refill(Bucket *b, uint32_t rate, uint32_t burst, uint32_t now_ms)
+{
+    // Clamped before it is multiplied, so a long silence only fills the bucket
+    uint32_t elapsed = now_ms - b->refill_ms;
+    if (elapsed > burst * TOKEN / rate)
+        elapsed = burst * TOKEN / rate;
+    b->tokens += elapsed * rate;
+    if (b->tokens > burst * TOKEN)
+        b->tokens = burst * TOKEN;
+    b->refill_ms = now_ms;
+}
+
+void admission_init(void)
+{
+    for (int i = 0; i < ADMISSION_MAX_CLIENTS; i++)
+        clients[i].used = false;
+    fill(&newcomers, ADMISSION_NEW_BURST, 0);
+    admission_stats = (AdmissionStats){0};
+}
+
+static AdmissionClient *find(uint32_t client)
+{
+    for (int i = 0; i < ADMISSION_MAX_CLIENTS; i++)
+    {
+        if (clients[i].used && clients[i].client == client)
+            return &clients[i];
+    }
+    return NULL;
+}
+
+// Take a free entry for a new client, or the longest quiet one with nothing in flight
+static AdmissionClient *add(uint32_t client, uint32_t now_ms)
+{
+    AdmissionClient *c = NULL;
+    for (int i = 0; i < ADMISSION_MAX_CLIENTS; i++)
+    {
+        if (!clients[i].used)
+        {
+            c = &clients[i];
+            break;
+        }
+        if (clients[i].inflight == 0 &&
+            (c == NULL || (int32_t)(clients[i].bucket.refill_ms - c->bucket.refill_ms) < 0))
+            c = &clients[i];
+    }
+    if (c == NULL)
+        return NULL;
+    if (c->used)
+        admission_stats.evicted++;
+
+    c->used = true;
+    c->client = client;
+    c->inflight = 0;
+    fill(&c->bucket, ADMISSION_BURST, now_ms);
+    return c;
+}
+
+AdmissionResult admission_check(uint32_t client, bool priority, uint32_t now_ms)
+{
+    if (priority)
+    {
+        admission_stats.priority++;
+        return ADMISSION_PRIORITY;
+    }
+    if (!admission_enabled)
+    {
+        admission_stats.admitted++;
+        return ADMISSION_OK;
+    }
+
+    AdmissionClient *c = find(client);
+    if (c == NULL)
+    {
+        // A new client starts with a full bucket, so new ones draw on a bucket of their
+        // own too; otherwise every made-up id would be worth another burst
+        refill(&newcomers, ADMISSION_NEW_RATE, ADMISSION_NEW_BURST, now_ms);
+        if (newcomers.tokens < TOKEN)
+        {
+            admission_stats.rate_limited++;
+            return ADMISSION_LIMITED;
+        }
+        // With every entry busy sending, there is nowhere to count its replies
+        c = add(client, now_ms);
+        if (c == NULL)
+        {
+            admission_stats.busy++;
+            return ADMISSION_BUSY;
+        }
+        newcomers.tokens -= TOKEN;
+    }
+    if (c->inflight >= ADMISSION_MAX_INFLIGHT)
+    {
+        admission_stats.busy++;
+        return ADMISSION_BUSY;
+    }
+
+    refill(&c->bucket, ADMISSION_RATE, ADMISSION_BURST, now_ms);
+    if (c->bucket.tokens < TOKEN)
+    {
+        admission_stats.rate_limited++;
+        return ADMISSION_LIMITED;
+    }
+    c->bucket.tokens -= TOKEN;
+    admission_stats.admitted++;
+    return ADMISSION_OK;
+}
+
+void admission_open(uint32_t client)
+{
+    AdmissionClient *c = find(client);
+    if (c != NULL)
+        c->inflight++;
+}
+
+void admission_close(uint32_t client)
+{
+    AdmissionClient *c = find(client);
+    if (c != NULL && c->inflight > 0)
+        c->inflight--;
+}
@@ -0,0 +1,57 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+// Admission control of the HTTP command endpoints.
+//
+// Every CGI request costs lwIP a connection, its pbufs and a reply slot, and with the
+// heap sized for the slots (lwipopts.h) a few extra tabs or one misbehaving client can take them all and hold
+// up a STOP behind them. So before a request is parsed, its client (the page's id
+// parameter) has to have a token in its bucket and may only have ADMISSION_MAX_INFLIGHT
+// replies still being sent. A request that does not pass is answered with a constant 429
+// reply, without a slot, a session or the control loop. STOP and the driving client's
+// release skip all of it, and the last free reply slot is kept for STOP (http_control.c).
+//
+// Buckets hold thousandths of a request and refill at ADMISSION_RATE per second, so a
+// client can burst ADMISSION_BURST requests and then keep to the rate. Clients not seen
+// before also take a token from a bucket they share, so made-up ids do not buy bursts.
+// A refused heartbeat is safe: the command lease stops the robot if they all go missing.
+//
+// Network side (core 0, lwIP context) only.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    ADMISSION_OK,       // admitted, one token taken
+    ADMISSION_PRIORITY, // admitted ahead of everything: STOP, the driver's release
+    ADMISSION_LIMITED,  // refused: the client's or the shared bucket is empty
+    ADMISSION_BUSY,     // refused: too many of the client's replies in flight
+} AdmissionResult;
+
+typedef struct
+{
+    uint32_t admitted;
+    uint32_t priority;
+    uint32_t rate_limited;
+    uint32_t busy;
+    uint32_t evicted; // clients forgotten to make room for a new one
+} AdmissionStats;
+
+extern AdmissionStats admission_stats;
+
+// On by default (ADMISSION_CONTROL); settable at run time
+extern bool admission_enabled;
+
+// Forget all clients and fill the buckets
+void admission_init(void);
+
+// Decide on one request of a client. Does not count it in flight: that starts when its
+// reply is opened.
+AdmissionResult admission_check(uint32_t client, bool priority, uint32_t now_ms);
+
+// A reply of the client was opened / closed by httpd
+void admission_open(uint32_t client);
+void admission_close(uint32_t client);
+
+#endif // ADMISSION_H
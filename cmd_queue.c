@@ -0,0 +1,40 @@
+#include "cmd_queue.h"
+
+void cmd_queue_init(CmdQueue *q)
+{
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+bool cmd_queue_push(CmdQueue *q, const VehicleCommand *cmd)
+{
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    // Indices run freely and wrap modulo 2^32; the difference is the fill level
+    if (head - tail >= CMD_QUEUE_SIZE)
+        return false;
+
+    q->slots[head & (CMD_QUEUE_SIZE - 1)] = *cmd;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool cmd_queue_pop(CmdQueue *q, VehicleCommand *cmd)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    *cmd = q->slots[tail & (CMD_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool cmd_queue_empty(CmdQueue *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) ==
+           atomic_load_explicit(&q->tail, memory_order_relaxed);
+}
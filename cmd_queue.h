@@ -0,0 +1,35 @@
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+// Single-producer/single-consumer lock-free ring of commands.
+// The producer is the network side on core 0 (httpd, WebSocket and UDP callbacks all run
+// in the lwIP context, so there is only ever one), the consumer the control loop on core 1.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "vehicle.h"
+
+#if (CMD_QUEUE_SIZE & (CMD_QUEUE_SIZE - 1)) != 0
+#error "CMD_QUEUE_SIZE must be a power of two"
+#endif
+
+typedef struct
+{
+    atomic_uint head; // next slot to write, only the producer stores it
+    atomic_uint tail; // next slot to read, only the consumer stores it
+    VehicleCommand slots[CMD_QUEUE_SIZE];
+} CmdQueue;
+
+void cmd_queue_init(CmdQueue *q);
+
+// Producer side. Returns false if the queue is full.
+bool cmd_queue_push(CmdQueue *q, const VehicleCommand *cmd);
+
+// Consumer side. Returns false if the queue is empty.
+bool cmd_queue_pop(CmdQueue *q, VehicleCommand *cmd);
+
+// Consumer side: nothing to pop
+bool cmd_queue_empty(CmdQueue *q);
+
+#endif // CMD_QUEUE_H
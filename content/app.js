@@ -0,0 +1,289 @@
+// Control page script, loaded deferred so the DOM is ready when it runs.
+// tools/makefsdata.py minifies it and serves it gzipped under a content-hashed name.
+(function () {
+    // A command is sent when it changes; while it is held, a heartbeat keeps it alive.
+    // The robot releases it on its own COMMAND_LEASE_MS (1 s) after the last one.
+    const heartbeat_period = 300; // milliseconds
+    // A refused (429) or lost release is sent again, or the robot would drive on until
+    // its lease ran out
+    const release_retries = 3;
+    const release_retry_delay = 100; // milliseconds
+
+    // Active send state
+    const active = {
+        intervalId: null, // heartbeat interval while a command is held
+        command: null,
+        pointerId: null,
+        keyboard: false
+    };
+
+    // Identifies this page to the robot's session arbitration (session.h)
+    const client_id = Math.floor(Math.random() * 0xfffffffe) + 1;
+
+    const ws_port = 8080; // WS_PORT in custom.h
+    let ws = null; // persistent control channel, /control.cgi is the fallback
+
+    // GET a CGI endpoint with query parameters; resolves to the response text
+    function get(path, params) {
+        return fetch(path + '?' + new URLSearchParams(params)).then(function (response) {
+            if (!response.ok) throw new Error(response.status);
+            return response.text();
+        });
+    }
+
+    function connectWebSocket() {
+        if (!('WebSocket' in window)) return;
+        const socket = new WebSocket('ws://' + location.hostname + ':' + ws_port + '/');
+        socket.onopen = function () {
+            console.log('WebSocket control channel open');
+            ws = socket;
+        };
+        socket.onmessage = function (event) {
+            console.log('Response:', event.data);
+        };
+        socket.onclose = function () {
+            // Fall back to HTTP polling and retry in the background
+            if (ws === socket) ws = null;
+            setTimeout(connectWebSocket, 2000);
+        };
+    }
+
+    // Resolves once the robot has taken the command, rejects if it was refused or lost
+    function sendCommand(command) {
+        // Keep a console log for debugging
+        console.log('Command sent:', command);
+
+        if (ws !== null && ws.readyState === WebSocket.OPEN) {
+            ws.send(command);
+            return Promise.resolve();
+        }
+
+        // Use the existing CGI endpoint used by the project
+        return get('/control.cgi', { command: command, id: client_id })
+            .then(function (response) {
+                console.log('Response:', response);
+            })
+            .catch(function (err) {
+                console.error('Failed to send command:', command);
+                throw err;
+            });
+    }
+
+    // Send NON, again on failure, unless something else has been started meanwhile
+    function sendRelease(retries) {
+        sendCommand('NON').catch(function () {
+            if (retries > 0) {
+                setTimeout(function () {
+                    if (active.command === null && drive.pointerId === null) sendRelease(retries - 1);
+                }, release_retry_delay);
+            }
+        });
+    }
+
+    function startSendingCommand(command, opts = {}) {
+        // If already sending same command from same source, do nothing
+        if (active.command === command && active.intervalId !== null) return;
+
+        // Clear any previous interval
+        if (active.intervalId !== null) {
+            clearInterval(active.intervalId);
+            active.intervalId = null;
+        }
+
+        // Set active state
+        active.command = command;
+        active.pointerId = opts.pointerId !== undefined ? opts.pointerId : null;
+        active.keyboard = !!opts.keyboard;
+
+        // Send the change once, then only heartbeats while it is held
+        // Failures are logged; a refused heartbeat is followed by the next one
+        const ignore = function () { };
+        sendCommand(command).catch(ignore);
+        active.intervalId = setInterval(() => sendCommand('HBT').catch(ignore), heartbeat_period);
+    }
+
+    function stopSendingCommand(opts = {}) {
+        // If pointerId is provided, only stop if it matches the active one
+        if (opts.pointerId !== undefined) {
+            if (active.pointerId === null || active.pointerId !== opts.pointerId) return;
+        }
+
+        // If keyboard stop requested but active wasn't keyboard-sourced, ignore
+        if (opts.keyboard && !active.keyboard) return;
+
+
+        if (active.intervalId !== null) {
+            clearInterval(active.intervalId);
+            active.intervalId = null;
+        }
+
+        sendRelease(release_retries);
+
+        // Reset active state
+        active.command = null;
+        active.pointerId = null;
+        active.keyboard = false;
+    }
+
+    // Attach pointer and keyboard handlers to each control button
+    document.querySelectorAll('.control-button').forEach(btn => {
+        const command = btn.getAttribute('data-command');
+
+        // Pointer events cover mouse, touch and pen
+        btn.addEventListener('pointerdown', (e) => {
+            e.preventDefault();
+            try { btn.setPointerCapture(e.pointerId); } catch (err) { /* ignore */ }
+            startSendingCommand(command, { pointerId: e.pointerId, keyboard: false });
+        });
+
+        btn.addEventListener('pointerup', (e) => {
+            try { btn.releasePointerCapture(e.pointerId); } catch (err) { /* ignore */ }
+            stopSendingCommand({ pointerId: e.pointerId });
+        });
+
+        btn.addEventListener('pointercancel', (e) => {
+            stopSendingCommand({ pointerId: e.pointerId });
+        });
+
+        // Keyboard: start on keydown (Space or Enter), stop on keyup
+        btn.addEventListener('keydown', (e) => {
+            if (e.repeat) return; // ignore auto-repeat keydown
+            if (e.code === 'Space' || e.code === 'Enter') {
+                e.preventDefault();
+                startSendingCommand(command, { keyboard: true });
+            }
+        });
+
+        btn.addEventListener('keyup', (e) => {
+            if (e.code === 'Space' || e.code === 'Enter') {
+                e.preventDefault();
+                stopSendingCommand({ keyboard: true });
+            }
+        });
+    });
+
+    // Joystick pad: streams a (throttle, turn) vector while it is held
+    const drive_scale = 1000; // DRIVE_SCALE in vehicle.h
+    const drive_period = 50; // send changes at most this often, in milliseconds
+    const pad = document.getElementById('joystick');
+    const knob = document.getElementById('joystick-knob');
+    const drive = {
+        vector: null, sent: null, pointerId: null, intervalId: null, lastSend: 0, inFlight: false
+    };
+
+    // Resolves once the robot has taken the vector, rejects if it was refused or lost
+    function sendDrive(vector) {
+        if (ws !== null && ws.readyState === WebSocket.OPEN) {
+            ws.send('DRV ' + vector.throttle + ' ' + vector.turn);
+            return Promise.resolve();
+        }
+        return get('/drive.cgi', { throttle: vector.throttle, turn: vector.turn, id: client_id })
+            .catch(function (err) {
+                console.error('Failed to send drive vector:', vector);
+                throw err;
+            });
+    }
+
+    function padVector(e) {
+        const rect = pad.getBoundingClientRect();
+        const radius = rect.width / 2;
+        let x = (e.clientX - rect.left - radius) / radius;
+        let y = (e.clientY - rect.top - radius) / radius;
+        const len = Math.hypot(x, y);
+        if (len > 1) {
+            x /= len;
+            y /= len;
+        }
+        knob.style.transform = 'translate(' + x * (radius - 30) + 'px, ' + y * (radius - 30) + 'px)';
+        // Up is forward, right turns toward RGT
+        return { throttle: Math.round(-y * drive_scale), turn: Math.round(x * drive_scale) };
+    }
+
+    function driveTick() {
+        // One vector at a time; the next tick sends whatever the pad says by then
+        if (drive.inFlight) return;
+        const now = Date.now();
+        const changed = drive.sent === null || drive.sent.throttle !== drive.vector.throttle ||
+            drive.sent.turn !== drive.vector.turn;
+        // Changes go out right away, an unchanged vector is kept alive with heartbeats. A
+        // vector only counts as sent once the robot took it, so a refused one goes again.
+        if (changed) {
+            const vector = drive.vector;
+            drive.inFlight = true;
+            drive.lastSend = now;
+            sendDrive(vector)
+                .then(function () { drive.sent = vector; }, function () { /* sent again */ })
+                .finally(function () { drive.inFlight = false; });
+        } else if (now - drive.lastSend >= heartbeat_period) {
+            sendCommand('HBT').catch(function () { /* the next one may get through */ });
+            drive.lastSend = now;
+        }
+    }
+
+    pad.addEventListener('pointerdown', (e) => {
+        e.preventDefault();
+        try { pad.setPointerCapture(e.pointerId); } catch (err) { /* ignore */ }
+        if (active.intervalId !== null) {
+            clearInterval(active.intervalId);
+            active.intervalId = null;
+            active.command = null;
+        }
+        drive.pointerId = e.pointerId;
+        drive.vector = padVector(e);
+        drive.sent = null;
+        driveTick();
+        drive.intervalId = setInterval(driveTick, drive_period);
+    });
+
+    pad.addEventListener('pointermove', (e) => {
+        if (drive.pointerId === e.pointerId) drive.vector = padVector(e);
+    });
+
+    function releasePad(e) {
+        if (drive.pointerId !== e.pointerId) return;
+        clearInterval(drive.intervalId);
+        drive.intervalId = null;
+        drive.pointerId = null;
+        knob.style.transform = '';
+        stopSendingCommand();
+    }
+    pad.addEventListener('pointerup', releasePad);
+    pad.addEventListener('pointercancel', releasePad);
+
+    // Live state pushed by the robot (/events), shared by every open page
+    const command_names = ['FLT', 'FRT', 'FWD', 'LFT', 'RGT', 'BLT', 'BWD', 'BRT', 'STP', 'NON', 'DRV',
+        'SCR', 'HBT', 'SLT', 'SRT'];
+    const state = document.getElementById('state');
+    const strafe = document.getElementById('strafe');
+
+    function connectEvents() {
+        if (!('EventSource' in window)) return;
+        const events = new EventSource('/events');
+        events.onmessage = function (event) {
+            const s = JSON.parse(event.data);
+            strafe.hidden = !s.strafe; // mecanum chassis only
+            state.textContent = (command_names[s.command] || s.command) + '  speed ' + s.vehicle_speed +
+                '  duty ' + s.duty.join(' ') + (s.script ? '  script step ' + s.script : '');
+        };
+        events.onerror = function () {
+            state.textContent = 'Disconnected';
+        };
+    }
+
+    // Scripts run on the robot: steps are CMD:ms[:speed], comma separated (script.h)
+    const script = document.getElementById('script');
+    document.getElementById('script-run').addEventListener('click', () => {
+        // Sent unencoded: httpd does not decode URLs and the syntax needs no escaping
+        const steps = script.value.toUpperCase().replace(/[^A-Z0-9:,]/g, '');
+        fetch('/script.cgi?steps=' + steps + '&id=' + client_id)
+            .then(response => response.json())
+            .then(result => {
+                state.textContent = result.status ? 'Script: ' + result.steps + ' steps, ' +
+                    result.duration_ms / 1000 + ' s' : 'Script error at step ' + result.step + ': ' + result.error;
+            })
+            .catch(() => console.error('Failed to send script'));
+    });
+
+    connectWebSocket();
+    connectEvents();
+})();
@@ -0,0 +1,246 @@
+#include <stdatomic.h>
+
+#include "cmd_queue.h"
+#include "control_loop.h"
+#include "custom.h"
+#include "encoder.h"
+#include "event_log.h"
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+#include "pwm_ramp.h"
+#include "script.h"
+#include "speed_control.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "vehicle.h"
+
+#define CONTROL_LOOP_PERIOD_US (1000000 / CONTROL_LOOP_HZ)
+#define CONTROL_LOOP_IDLE_US (1000000 / CONTROL_LOOP_IDLE_HZ)
+#define COMMAND_LEASE_TICKS (COMMAND_LEASE_MS * CONTROL_LOOP_HZ / 1000)
+
+ControlLoopStats control_loop_stats;
+
+static CmdQueue command_queue;
+
+// Set by the producer when a STOP could not be queued
+static atomic_bool stop_overflow;
+
+// Ticks the current command is still held without a new command or heartbeat. Counted in
+// ticks rather than time, so a replayed trace expires on the same tick.
+static uint32_t lease_ticks;
+
+// Published by core 1 after every tick (control_loop_idle())
+static atomic_bool idle;
+
+void control_loop_init(void)
+{
+    cmd_queue_init(&command_queue);
+    atomic_init(&stop_overflow, false);
+    lease_ticks = 0;
+    atomic_init(&idle, false);
+    encoder_init();
+    speed_control_init();
+}
+
+// A movement or drive vector that keeps the wheels going until it is released
+static bool holding_movement(void)
+{
+    return vehicle_is_movement(last_command) || last_command == CMD_DRIVE;
+}
+
+// Nothing for the wheels to do: no command or script holds them, every profile has
+// settled at rest and no ramp is playing. The lease only guards a held movement, so a
+// STOP or a heartbeat alone does not keep the loop awake.
+static bool at_rest(void)
+{
+    if (holding_movement() || script_running() || pwm_ramp_playing())
+        return false;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        const MotionProfile *p = &wheels[i].profile;
+        if (p->velocity != 0.0f || p->target != 0.0f || p->accel != 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool control_loop_idle(void)
+{
+    return atomic_load_explicit(&idle, memory_order_relaxed);
+}
+
+bool control_loop_post(CommandType cmd)
+{
+    VehicleCommand entry = {(uint8_t)cmd, 0, 0, time_us_32()};
+    bool posted = true;
+
+    control_loop_stats.posted++;
+    if (!cmd_queue_push(&command_queue, &entry))
+    {
+        control_loop_stats.queue_full++;
+        if (cmd == CMD_STOP)
+            atomic_store_explicit(&stop_overflow, true, memory_order_release);
+        else
+            posted = false;
+    }
+    __sev(); // wakes core 1 if it is sleeping idle
+    return posted;
+}
+
+bool control_loop_post_drive(int throttle, int turn)
+{
+    VehicleCommand entry = {CMD_DRIVE, (int16_t)throttle, (int16_t)turn, time_us_32()};
+
+    control_loop_stats.posted++;
+    if (!cmd_queue_push(&command_queue, &entry))
+    {
+        control_loop_stats.queue_full++;
+        return false;
+    }
+    __sev();
+    return true;
+}
+
+void control_loop_tick(void)
+{
+    uint32_t start_us = time_us_32();
+    uint32_t posted_us[CMD_QUEUE_SIZE];
+    int applied = 0;
+
+    uint32_t targets = vehicle_target_seq();
+
+    trace_begin_tick(control_loop_stats.ticks, start_us);
+
+    VehicleCommand cmd;
+    while (cmd_queue_pop(&command_queue, &cmd))
+    {
+        if (cmd.type == CMD_SCRIPT)
+        {
+            script_start();
+        }
+        else if (cmd.type == CMD_STOP)
+        {
+            script_abort();
+            vehicle_command(CMD_STOP);
+            trace_command(CMD_STOP, DRIVE_SCALE, 0);
+        }
+        else if (cmd.type == CMD_HEARTBEAT)
+        {
+            lease_ticks = COMMAND_LEASE_TICKS;
+            control_loop_stats.heartbeats++;
+            continue;
+        }
+        else if (script_running())
+        {
+            script_stats.ignored++; // the script holds the wheels until it ends or a STOP
+            continue;
+        }
+        else if (cmd.type == CMD_DRIVE)
+        {
+            vehicle_drive(cmd.throttle, cmd.turn);
+            trace_command(CMD_DRIVE, cmd.throttle, cmd.turn);
+        }
+        else
+        {
+            vehicle_command((CommandType)cmd.type);
+            trace_command(cmd.type, DRIVE_SCALE, 0);
+        }
+        lease_ticks = COMMAND_LEASE_TICKS;
+        control_loop_stats.commands++;
+        if (applied < CMD_QUEUE_SIZE)
+            posted_us[applied++] = cmd.posted_us;
+    }
+
+    // The overflowed STOP is newer than anything that was in the queue, so it goes last
+    if (atomic_exchange_explicit(&stop_overflow, false, memory_order_acquire))
+    {
+        script_abort();
+        vehicle_command(CMD_STOP);
+        trace_command(CMD_STOP, DRIVE_SCALE, 0);
+        control_loop_stats.commands++;
+    }
+
+    // Deadman: the sender stopped renewing a held movement
+    if (lease_ticks > 0)
+        lease_ticks--;
+    else if (holding_movement() && !script_running())
+    {
+        vehicle_command(CMD_NONE);
+        trace_command(CMD_NONE, DRIVE_SCALE, 0);
+        control_loop_stats.lease_expired++;
+        EVENT_LOG(EV_CONTROL_LEASE_EXPIRED, 0, 0, 0);
+    }
+
+    script_tick();
+
+    // New targets take the outputs back from a DMA ramp before this tick's step is applied
+    bool retarget = vehicle_target_seq() != targets;
+    if (retarget)
+        pwm_ramp_stop();
+    else
+        pwm_ramp_sync();
+
+    // Ramps advance by the nominal period; a late tick is caught up by the next ones
+    vehicle_step(1.0f / CONTROL_LOOP_HZ);
+    speed_control_step(1.0f / CONTROL_LOOP_HZ);
+    apply_vehicle();
+    if (retarget)
+        pwm_ramp_start();
+    trace_end_tick();
+    control_loop_stats.ticks++;
+    atomic_store_explicit(&idle, at_rest(), memory_order_relaxed);
+
+    uint32_t end_us = time_us_32();
+    for (int i = 0; i < applied; i++)
+        telemetry_record(&telemetry.cmd_to_pwm, end_us - posted_us[i]);
+    telemetry_record(&telemetry.tick, end_us - start_us);
+}
+
+// Something for the next tick to apply
+static bool command_waiting(void)
+{
+    return !cmd_queue_empty(&command_queue) ||
+           atomic_load_explicit(&stop_overflow, memory_order_acquire);
+}
+
+static void control_loop_core1(void)
+{
+    absolute_time_t next = get_absolute_time();
+
+    while (true)
+    {
+        control_loop_tick();
+
+        next = delayed_by_us(next, CONTROL_LOOP_PERIOD_US);
+        if (control_loop_idle())
+        {
+            // Sleep until a command is posted (its SEV wakes the core) or the slow tick is
+            // due, and start the tick grid over from there
+            absolute_time_t until =
+                delayed_by_us(next, CONTROL_LOOP_IDLE_US - CONTROL_LOOP_PERIOD_US);
+            while (!command_waiting() && !best_effort_wfe_or_timeout(until))
+                ;
+            control_loop_stats.idle_sleeps++;
+            next = get_absolute_time();
+            continue;
+        }
+        sleep_until(next);
+
+        int64_t late_us = absolute_time_diff_us(next, get_absolute_time());
+        if (late_us > (int64_t)control_loop_stats.max_late_us)
+            control_loop_stats.max_late_us = (uint32_t)late_us;
+        if (late_us >= CONTROL_LOOP_PERIOD_US)
+        {
+            // Do not try to catch up with a burst of ticks
+            control_loop_stats.overruns++;
+            EVENT_LOG(EV_CONTROL_OVERRUN, late_us, 0, 0);
+            next = get_absolute_time();
+        }
+    }
+}
+
+void control_loop_start(void)
+{
+    multicore_launch_core1(control_loop_core1);
+}
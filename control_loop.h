@@ -0,0 +1,59 @@
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+// Fixed-rate motor control loop. Core 1 owns wheels[] and vehicle_speed and runs
+// control_loop_tick() every 1/CONTROL_LOOP_HZ seconds; the network side only posts
+// commands, so motor timing no longer depends on Wi-Fi or httpd timing.
+//
+// While the wheels are at rest and nothing holds them, core 1 sleeps instead: until a
+// command is posted, which wakes it at once, or for at most 1/CONTROL_LOOP_IDLE_HZ. The
+// first tick then has nothing to catch up, since every profile had already settled.
+//
+// Clients send a command when it changes and CMD_HEARTBEAT while they keep holding it.
+// A movement command or drive vector is held for COMMAND_LEASE_MS after the last command
+// or heartbeat; then the loop itself releases it (CMD_NONE) and the wheels ramp to a
+// stop, however much or little traffic arrives. A running script needs no heartbeat.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vehicle.h"
+
+typedef struct
+{
+    // written by core 1
+    uint32_t ticks;
+    uint32_t commands;    // commands applied
+    uint32_t max_late_us; // worst wake-up lateness of a tick
+    uint32_t overruns;    // ticks that started a full period late
+    uint32_t heartbeats;
+    uint32_t lease_expired; // held commands released because the sender went quiet
+    uint32_t idle_sleeps;   // waits for a command or the slow tick with the wheels at rest
+    // written by the network side
+    uint32_t posted;
+    uint32_t queue_full;  // commands dropped because the queue was full
+} ControlLoopStats;
+
+extern ControlLoopStats control_loop_stats;
+
+void control_loop_init(void);
+
+// Queue a command for the next tick. Network side (core 0) only.
+// A STOP that does not fit in the queue is still applied on the next tick.
+bool control_loop_post(CommandType cmd);
+
+// Queue a drive vector (see vehicle_drive()) for the next tick. Network side only.
+bool control_loop_post_drive(int throttle, int turn);
+
+// Drain the queue and apply the result to the motors. Runs on core 1; the host harness
+// calls it directly.
+void control_loop_tick(void);
+
+// True if, as of the last tick, the wheels are at rest with nothing holding them. Readable
+// from core 0.
+bool control_loop_idle(void);
+
+// Launch the loop on core 1. Call after setup_pwms().
+void control_loop_start(void);
+
+#endif // CONTROL_LOOP_H
@@ -10,8 +10,23 @@
 #define LWIP_HTTPD_DYNAMIC_FILE_READ  1
 #define LWIP_HTTPD_DYNAMIC_HEADERS 1
 #define LWIP_HTTPD_CUSTOM_FILES 1
+#define LWIP_HTTPD_FS_ASYNC_READ 1  // custom files may wait for data: /events
 
-#define JSON_BUFFER_SIZE 1024
+// httpd reads a file without data in flash (an event stream, /trace.bin) through a send
+// buffer it allocates from the lwIP heap and holds while the file is open; by default
+// 2 * TCP_MSS. Capped here so the heap can be sized for all of them (lwipopts.h).
+#define HTTPD_WRITE_LEN 1024
+#define HTTPD_LIMIT_SENDING_TO_2MSS 0
+#define HTTPD_MAX_WRITE_LEN(pcb) ((u16_t)HTTPD_WRITE_LEN)
+
+#define JSON_BUFFER_SIZE 128  // one status reply, with encoder counts
+#define HTTP_RESPONSE_SLOTS 5  // replies httpd can be sending at once; the last free one is kept for STOP
+#define STATS_BUFFER_SIZE 2560  // the /stats reply, see telemetry.h
+
+// Server-Sent Events stream of the vehicle state at /events (event_stream.c)
+#define EVENT_STREAM_HZ 10  // state pushes per second; keep above 1 or httpd times out idle streams
+#define EVENT_STREAM_MAX_CLIENTS 3  // each open stream also holds an httpd send buffer, see lwipopts.h
+#define EVENT_STREAM_BUFFER_SIZE 128  // one event, or the stream header
 
 //LWIP_DBG_OFF LWIP_DBG_OFF
 #define LWIP_DEBUG LWIP_DBG_OFF
@@ -51,9 +66,29 @@
  * 
  */
 
-#define NUM_OF_WHEELS 4
+// Chassis layout (drivetrain.h), which also sets NUM_OF_WHEELS and the wheels[] order
+#ifndef DRIVETRAIN
+#define DRIVETRAIN DRIVETRAIN_SKID_4WD
+#endif
+#include "drivetrain.h"
+
+#define MAX_VEHICLE_SPEED 10  // Maximum speed magnitude reported in the status
+
+#define SPEED_SCALE 1000  // Full scale of Wheel.speed, the commanded speed as reported
+
+// ENA outputs (motor_pwm.c): the divider and wrap are picked for this frequency
+#define PWM_FREQUENCY_HZ 20000  // above hearing; the L298N is specified up to 40 kHz
+#define PWM_PHASE_CORRECT 0     // 1: centre-aligned pulses, at half the duty steps
+// Per-wheel compensation, in wheels[] order (drivetrain.h): front right, front left, then
+// back right, back left on four wheels. Entries past NUM_OF_WHEELS are ignored.
+#define MOTOR_TRIM {1000, 1000, 1000, 1000}  // per mille of the commanded duty
+#define MOTOR_DEADBAND {0, 0, 0, 0}          // per mille duty a nonzero speed starts from
 
-#define MAX_VEHICLE_SPEED 10  // Maximum speed magnitude
+// DMA ramp playback (pwm_ramp.c): ramps precomputed and streamed to the ENA slices
+#define PWM_DMA_RAMP 0            // 1: on at boot
+#define PWM_RAMP_HZ 500           // duty updates per second during a ramp
+#define PWM_RAMP_STEPS 2048       // 4 s at 500 Hz, 32 KB of compare values
+#define PWM_RAMP_PACER_SLICE 11   // a slice the ENA pins do not use; it needs no pin
 
 #define MOTOR_FRONT_RIGHT_ENA 2
 #define MOTOR_FRONT_RIGHT_IN1 3
@@ -71,4 +106,95 @@
 #define MOTOR_BACK_LEFT_IN1 14
 #define MOTOR_BACK_LEFT_IN2 15
 
+// Quadrature encoders (encoder.c), decoded by the four state machines of ENCODER_PIO.
+// Each encoder takes two consecutive pins, A and A + 1.
+#define WHEEL_ENCODERS 0  // 1: encoders fitted
+#define ENCODER_PIO pio2  // a whole PIO block: the program must load at offset 0
+#define ENCODER_FRONT_RIGHT_A 16
+#define ENCODER_FRONT_LEFT_A 18
+#define ENCODER_BACK_RIGHT_A 20
+#define ENCODER_BACK_LEFT_A 26
+#define ENCODER_SIGN {1, 1, 1, 1}      // wheels[] order; -1 for one counting down going forward
+#define ENCODER_FULL_SPEED_CPS 4400    // counts/s at full duty, no load: 1320/rev at 200 rpm
+
+// Closed-loop wheel speed (speed_control.c): a PID per wheel on top of the open-loop duty
+#define SPEED_CONTROL 0          // 1: on at boot, when the encoders are fitted
+#define SPEED_CONTROL_KP 1.0f    // duty per unit of speed error (both full scale)
+#define SPEED_CONTROL_KI 6.0f    // per second
+#define SPEED_CONTROL_KD 0.0f    // seconds, on the measurement
+#define SPEED_FILTER 0.3f        // weight of each new speed sample, 0..1
+
+
+// Background Wi-Fi connection (wifi_link.c): the robot is drivable over the network as soon
+// as the join completes, and rejoins on its own when the link drops
+#define WIFI_CONNECT_TIMEOUT_MS 15000  // join plus DHCP
+#define WIFI_BACKOFF_MIN_MS 500        // first retry, and rejoin after a drop
+#define WIFI_BACKOFF_MAX_MS 30000
+// Fixed address instead of DHCP, which saves the DHCP exchange on every join:
+// #define WIFI_STATIC_IP "192.168.1.50"
+// #define WIFI_STATIC_NETMASK "255.255.255.0"
+// #define WIFI_STATIC_GATEWAY "192.168.1.1"
+
+// WebSocket control channel (ws_server.c), served next to httpd on its own port
+#define WS_PORT 8080
+#define WS_MAX_CLIENTS 2
+#define WS_RX_BUFFER_SIZE 512  // must hold the HTTP upgrade request
+#define WS_TX_BUFFER_SIZE 160  // largest frame we send: status JSON or a pong
+
+// Binary UDP control protocol (udp_control.c)
+#define UDP_CONTROL_PORT 4210
+#define UDP_MAX_PACKET_AGE_MS 200  // drop commands delayed longer than this in flight
+// Fleet mode: one multicast packet per command, applied by every robot at its target time
+#define UDP_FLEET_GROUP "239.255.42.10"  // joined on UDP_CONTROL_PORT; comment out to disable
+#define UDP_FLEET_SYNC_WINDOW_MS 30000   // clock offset: fastest path of the last two windows
+#define UDP_FLEET_MAX_LEAD_MS 5000       // refuse target times further ahead than this
+
+// Motor control loop on core 1 (control_loop.c)
+#define CONTROL_LOOP_HZ 200
+#define CONTROL_LOOP_IDLE_HZ 10  // with the wheels at rest, unless a command wakes core 1 first
+#define CMD_QUEUE_SIZE 32  // power of two
+#define COMMAND_LEASE_MS 1000  // a held movement ramps to a stop this long after its last command or heartbeat
+
+// Deferred event log (event_log.c), drained to stdio from the main loop
+#define EVENT_LOG_SIZE 128  // entries, power of two
+#define EVENT_LOG_LEVEL EVENT_LOG_INFO  // EVENT_LOG_DEBUG also logs every command
+#define EVENT_LOG_DRAIN_MS 20
+
+// Power management (power.c): the radio's power mode and the main loop's wake-ups follow
+// the command traffic. The POWER_PM_ values are cyw43 power modes, used in pico_httpd.c.
+#define POWER_IDLE_AFTER_MS 10000  // no commands and nothing moving: radio to power save
+#define POWER_PARKED_AFTER_MS 300000  // then its longest sleep
+#define POWER_IDLE_WAIT_MS 250  // main loop wake-up without interrupts, IDLE
+#define POWER_PARKED_WAIT_MS 1000  // and PARKED; ACTIVE drains every EVENT_LOG_DRAIN_MS
+#define POWER_PM_ACTIVE CYW43_PERFORMANCE_PM
+#define POWER_PM_IDLE CYW43_DEFAULT_PM  // wakes for every beacon: ~100 ms on the first command
+#define POWER_PM_PARKED CYW43_AGGRESSIVE_PM
+
+// Command trace (trace.c), downloaded from /trace.bin and replayed by robot_bench --replay
+#define TRACE_SIZE 1024  // records, power of two; 24 bytes each with four wheels
+
+// Control sessions (session.c): one driver holds the lease, other clients observe
+#define SESSION_MAX_CLIENTS 8
+#define SESSION_LEASE_MS 1000  // lease lapses this long after the driver's last movement
+
+// Admission control of the HTTP command endpoints (admission.c): a token bucket per client,
+// one for clients not seen before, a cap on each client's replies in flight; STOP always
+// passes
+#define ADMISSION_CONTROL 1  // default of admission_enabled
+#define ADMISSION_MAX_CLIENTS 8
+#define ADMISSION_RATE 25  // requests per second per client; the drive pad sends up to 20
+#define ADMISSION_BURST 10
+#define ADMISSION_NEW_RATE 2  // new client ids per second, after a burst of
+#define ADMISSION_NEW_BURST 8
+#define ADMISSION_MAX_INFLIGHT 1  // a client's replies httpd may be sending at once
+
+// On-device command scripts (script.c), uploaded with /script.cgi
+#define SCRIPT_MAX_STEPS 32
+#define SCRIPT_MAX_STEP_MS 60000
 
+// Motion profiles (motion_profile.c): wheel speeds ramp toward their targets in time, not
+// per request. Speeds are in full scale (1.0 = 100 % duty) per second.
+#define MOTION_PROFILE_SCURVE 1  // 1: jerk-limited S-curve, 0: trapezoidal (constant accel)
+#define MOTION_MAX_ACCEL 0.4f    // 0 -> full speed in 2.5 s
+#define MOTION_MAX_DECEL 1.0f    // used while slowing down or reversing
+#define MOTION_MAX_JERK 2.0f     // full scale per second^2, S-curve only
@@ -0,0 +1,51 @@
+#ifndef DRIVETRAIN_H
+#define DRIVETRAIN_H
+
+// Chassis layouts. DRIVETRAIN picks one at compile time (custom.h, or ROBOT_DRIVETRAIN in
+// CMake), and everything that depends on the wheels is expanded from its table: the wheel
+// count, the pins of each wheel and how the drive vector is mixed into wheel speeds. The
+// same sources build every chassis, and each build only carries its own wheels, with the
+// pins as constants.
+//
+// DRIVETRAIN_WHEELS(X) calls X(NAME, throttle, turn, strafe) once per wheel, in wheels[]
+// order. NAME selects the MOTOR_<NAME>_ENA/IN1/IN2 and ENCODER_<NAME>_A pins; the other
+// three are the wheel's share of each drive vector component, -1, 0 or 1 (vehicle.c).
+
+#define DRIVETRAIN_DIFF_2WD 1 // two driven wheels and a caster, the FRONT_ pins
+#define DRIVETRAIN_SKID_4WD 2 // four fixed wheels, turned by driving the sides apart
+#define DRIVETRAIN_MECANUM 3  // four mecanum wheels, rollers in an X seen from above
+
+#if DRIVETRAIN == DRIVETRAIN_DIFF_2WD
+#define DRIVETRAIN_NAME "diff_2wd"
+#define NUM_OF_WHEELS 2
+#define DRIVETRAIN_HAS_STRAFE 0
+#define DRIVETRAIN_WHEELS(X)                                                              \
+    X(FRONT_RIGHT, 1, 1, 0)                                                               \
+    X(FRONT_LEFT, 1, -1, 0)
+
+#elif DRIVETRAIN == DRIVETRAIN_SKID_4WD
+#define DRIVETRAIN_NAME "skid_4wd"
+#define NUM_OF_WHEELS 4
+#define DRIVETRAIN_HAS_STRAFE 0
+#define DRIVETRAIN_WHEELS(X)                                                              \
+    X(FRONT_RIGHT, 1, 1, 0)                                                               \
+    X(FRONT_LEFT, 1, -1, 0)                                                               \
+    X(BACK_RIGHT, 1, 1, 0)                                                                \
+    X(BACK_LEFT, 1, -1, 0)
+
+#elif DRIVETRAIN == DRIVETRAIN_MECANUM
+// Strafing right pushes the front left and back right wheels forward, the other two back
+#define DRIVETRAIN_NAME "mecanum"
+#define NUM_OF_WHEELS 4
+#define DRIVETRAIN_HAS_STRAFE 1
+#define DRIVETRAIN_WHEELS(X)                                                              \
+    X(FRONT_RIGHT, 1, 1, -1)                                                              \
+    X(FRONT_LEFT, 1, -1, 1)                                                               \
+    X(BACK_RIGHT, 1, 1, 1)                                                                \
+    X(BACK_LEFT, 1, -1, -1)
+
+#else
+#error "DRIVETRAIN must be DRIVETRAIN_DIFF_2WD, DRIVETRAIN_SKID_4WD or DRIVETRAIN_MECANUM"
+#endif
+
+#endif // DRIVETRAIN_H
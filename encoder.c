@@ -0,0 +1,48 @@
+#include "custom.h"
+#include "encoder.h"
+#include "hardware/pio.h"
+#include "pico/stdlib.h"
+#include "quadrature_encoder.pio.h"
+
+#if NUM_OF_WHEELS > 4
+#error "one PIO block decodes at most four encoders"
+#endif
+
+#define WHEEL_ENCODER_PIN(name, throttle, turn, strafe) ENCODER_##name##_A,
+static const uint encoder_pins[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(WHEEL_ENCODER_PIN)};
+static const int8_t encoder_sign[] = ENCODER_SIGN;
+_Static_assert(sizeof(encoder_sign) >= NUM_OF_WHEELS, "ENCODER_SIGN needs an entry per wheel");
+
+static bool present;
+
+void encoder_init(void)
+{
+    if (!WHEEL_ENCODERS || present)
+        return;
+
+    // The jump table needs offset 0, and one state machine per wheel
+    if (!pio_can_add_program_at_offset(ENCODER_PIO, &quadrature_encoder_program, 0))
+    {
+        printf("Encoders: PIO offset 0 in use, running open loop\n");
+        return;
+    }
+    pio_add_program_at_offset(ENCODER_PIO, &quadrature_encoder_program, 0);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        pio_sm_claim(ENCODER_PIO, i);
+        quadrature_encoder_program_init(ENCODER_PIO, i, encoder_pins[i]);
+    }
+    present = true;
+}
+
+bool encoder_present(void)
+{
+    return present;
+}
+
+int32_t encoder_count(int wheel)
+{
+    if (!present)
+        return 0;
+    return encoder_sign[wheel] * quadrature_encoder_get_count(ENCODER_PIO, wheel);
+}
@@ -0,0 +1,20 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+// Wheel encoder counts. On the robot each quadrature encoder is decoded by a PIO state
+// machine (quadrature_encoder.pio), which keeps the count itself at any step rate the
+// motors reach, so the CPU only reads it once per control loop tick. The host build
+// implements this interface with a simulated motor (host/motor_plant.c).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void encoder_init(void);
+
+// False when no encoders are fitted (WHEEL_ENCODERS 0); the counts are then 0
+bool encoder_present(void);
+
+// Signed count since encoder_init(), positive going forward (see ENCODER_SIGN). Core 1.
+int32_t encoder_count(int wheel);
+
+#endif // ENCODER_H
@@ -0,0 +1,124 @@
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "custom.h"
+#include "event_log.h"
+#include "hardware/timer.h"
+
+#if (EVENT_LOG_SIZE & (EVENT_LOG_SIZE - 1)) != 0
+#error "EVENT_LOG_SIZE must be a power of two"
+#endif
+
+// Bounded multi-producer ring: each slot carries a sequence number saying whose turn it
+// is. A writer owns slot pos once it has moved head past pos, and publishes it by setting
+// seq to pos + 1; the reader hands it back to the writer of pos + EVENT_LOG_SIZE.
+typedef struct
+{
+    atomic_uint seq;
+    EventLogEntry entry;
+} EventLogSlot;
+
+static EventLogSlot ring[EVENT_LOG_SIZE];
+static atomic_uint head;
+static unsigned tail; // reader only
+static atomic_uint written;
+static atomic_uint dropped;
+static unsigned reported_dropped; // reader only
+
+static const char *const event_formats[EVENT_LOG_NUM_EVENTS] = {
+#define EVENT_LOG_FORMAT(id, level, format) [id] = format,
+    EVENT_LOG_EVENTS(EVENT_LOG_FORMAT)
+#undef EVENT_LOG_FORMAT
+};
+
+void event_log_init(void)
+{
+    for (unsigned i = 0; i < EVENT_LOG_SIZE; i++)
+        atomic_init(&ring[i].seq, i);
+    atomic_init(&head, 0);
+    atomic_init(&written, 0);
+    atomic_init(&dropped, 0);
+    tail = 0;
+    reported_dropped = 0;
+}
+
+bool event_log_write(EventLogId id, int32_t a, int32_t b, int32_t c)
+{
+    unsigned pos = atomic_load_explicit(&head, memory_order_relaxed);
+    EventLogSlot *e;
+
+    while (true)
+    {
+        e = &ring[pos & (EVENT_LOG_SIZE - 1)];
+        int diff = (int)(atomic_load_explicit(&e->seq, memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // The reader has not freed this slot yet: the ring is full
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+
+    e->entry.id = (uint8_t)id;
+    e->entry.time_us = time_us_32();
+    e->entry.args[0] = a;
+    e->entry.args[1] = b;
+    e->entry.args[2] = c;
+    atomic_store_explicit(&e->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+    return true;
+}
+
+bool event_log_read(EventLogEntry *entry)
+{
+    EventLogSlot *e = &ring[tail & (EVENT_LOG_SIZE - 1)];
+    if (atomic_load_explicit(&e->seq, memory_order_acquire) != tail + 1)
+        return false;
+
+    // Copy out so the slot can be handed back before the slow formatting
+    *entry = e->entry;
+    atomic_store_explicit(&e->seq, tail + EVENT_LOG_SIZE, memory_order_release);
+    tail++;
+    return true;
+}
+
+int event_log_drain(int max)
+{
+    EventLogEntry entry;
+    int printed = 0;
+
+    while (printed < max && event_log_read(&entry))
+    {
+        const char *format = entry.id < EVENT_LOG_NUM_EVENTS ? event_formats[entry.id]
+                                                             : "event %ld %ld %ld";
+        char line[96];
+        snprintf(line, sizeof(line), format, (long)entry.args[0], (long)entry.args[1],
+                 (long)entry.args[2]);
+        printf("[%10lu] %s\n", (unsigned long)entry.time_us, line);
+        printed++;
+    }
+
+    unsigned now_dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (now_dropped != reported_dropped)
+    {
+        printf("log: %u entries dropped\n", now_dropped - reported_dropped);
+        reported_dropped = now_dropped;
+    }
+    return printed;
+}
+
+void event_log_get_stats(EventLogStats *stats)
+{
+    stats->written = atomic_load_explicit(&written, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+}
@@ -0,0 +1,83 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+// Deferred binary event log. Hot paths record a fixed-size entry (event id, timestamp,
+// three integer arguments) into a lock-free ring; event_log_drain(), called from the idle
+// loop in main, formats the entries and prints them. Events below EVENT_LOG_LEVEL (see
+// custom.h) compile to nothing.
+//
+// Any context on either core may write; only one context may drain.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EVENT_LOG_ERROR 0
+#define EVENT_LOG_WARN 1
+#define EVENT_LOG_INFO 2
+#define EVENT_LOG_DEBUG 3
+
+// X(id, level, format); the format is given the three arguments as longs and may ignore
+// trailing ones
+#define EVENT_LOG_EVENTS(X)                                                                 \
+    X(EV_HTTP_COMMAND, EVENT_LOG_DEBUG, "http: command %ld from client %ld, speed %ld")     \
+    X(EV_HTTP_DRIVE, EVENT_LOG_DEBUG, "http: drive throttle %ld turn %ld from client %ld")  \
+    X(EV_HTTP_NO_SLOT, EVENT_LOG_WARN, "http: no free response slot")                       \
+    X(EV_HTTP_SCRIPT, EVENT_LOG_INFO, "http: script result %ld, %ld steps, %ld ms")         \
+    X(EV_HTTP_REFUSED, EVENT_LOG_DEBUG, "http: client %ld refused, admission %ld")          \
+    X(EV_WS_UPGRADED, EVENT_LOG_INFO, "ws: client %ld upgraded")                            \
+    X(EV_WS_NO_SLOT, EVENT_LOG_WARN, "ws: no free client slot")                             \
+    X(EV_WS_RX_OVERFLOW, EVENT_LOG_WARN, "ws: client %ld rx overflow, closing")             \
+    X(EV_CONTROL_OVERRUN, EVENT_LOG_WARN, "control: tick %ld us late")                      \
+    X(EV_CONTROL_LEASE_EXPIRED, EVENT_LOG_WARN, "control: lease expired, stopping")
+
+typedef enum
+{
+#define EVENT_LOG_ENUM(id, level, format) id,
+    EVENT_LOG_EVENTS(EVENT_LOG_ENUM)
+#undef EVENT_LOG_ENUM
+    EVENT_LOG_NUM_EVENTS
+} EventLogId;
+
+// id##_LEVEL constants, so EVENT_LOG() can drop disabled events at compile time
+enum
+{
+#define EVENT_LOG_LEVEL_ENUM(id, level, format) id##_LEVEL = level,
+    EVENT_LOG_EVENTS(EVENT_LOG_LEVEL_ENUM)
+#undef EVENT_LOG_LEVEL_ENUM
+};
+
+typedef struct
+{
+    uint8_t id; // EventLogId
+    uint32_t time_us;
+    int32_t args[3];
+} EventLogEntry;
+
+typedef struct
+{
+    uint32_t written;
+    uint32_t dropped; // entries lost because the ring was full
+} EventLogStats;
+
+#define EVENT_LOG(id, a, b, c)                                                             \
+    do                                                                                     \
+    {                                                                                      \
+        if (id##_LEVEL <= EVENT_LOG_LEVEL)                                                 \
+            event_log_write(id, (int32_t)(a), (int32_t)(b), (int32_t)(c));                 \
+    } while (0)
+
+void event_log_init(void);
+
+// Record an entry; a few stores and one compare-and-swap. Returns false if it was dropped.
+bool event_log_write(EventLogId id, int32_t a, int32_t b, int32_t c);
+
+// Take the oldest entry out of the ring. Returns false if there is none.
+bool event_log_read(EventLogEntry *entry);
+
+// Print pending entries, at most max of them, and a line for any drops since the last
+// drain. Returns the number printed.
+int event_log_drain(int max);
+
+void event_log_get_stats(EventLogStats *stats);
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,199 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "custom.h"
+#include "event_stream.h"
+#include "lwip/timeouts.h"
+#include "motor_pwm.h"
+#include "script.h"
+#include "vehicle.h"
+
+#define EVENT_STREAM_PERIOD_MS (1000 / EVENT_STREAM_HZ)
+
+// Sent once when a stream opens: httpd sends custom files with their header included
+static const char stream_header[] = "HTTP/1.0 200 OK\r\n"
+                                    "Content-Type: text/event-stream\r\n"
+                                    "Cache-Control: no-cache\r\n"
+                                    "\r\n"
+                                    "retry: 1000\n\n";
+
+typedef struct
+{
+    bool used;
+    uint32_t seq;    // last event copied into buf
+    int len;         // of buf
+    int offset;      // of the next byte to send from buf
+    fs_wait_cb wake; // set while httpd waits for the next event
+    void *wake_arg;
+    char buf[EVENT_STREAM_BUFFER_SIZE];
+} StreamSlot;
+
+static StreamSlot streams[EVENT_STREAM_MAX_CLIENTS];
+static int clients;
+
+// The latest event, shared by all streams; each copies it when it starts sending it
+static char event[EVENT_STREAM_BUFFER_SIZE];
+static int event_len;
+static uint32_t event_seq;
+
+EventStreamStats event_stream_stats;
+
+void event_stream_init(void)
+{
+    memset(streams, 0, sizeof(streams));
+    memset(&event_stream_stats, 0, sizeof(event_stream_stats));
+    clients = 0;
+    event_len = 0;
+    event_seq = 0;
+}
+
+static void format_event(void)
+{
+    int len = snprintf(event, sizeof(event),
+                       "data: {\"seq\":%lu,\"command\":%d,\"vehicle_speed\":%d,\"duty\":[",
+                       (unsigned long)(event_seq + 1), (int)last_command, vehicle_speed);
+    // Duties in the per mille of SPEED_SCALE, as the page shows them
+    for (int i = 0; i < NUM_OF_WHEELS && len > 0 && len < (int)sizeof(event); i++)
+        len += snprintf(event + len, sizeof(event) - len, i ? ",%d" : "%d",
+                        (int)lroundf((float)wheels[i].duty * SPEED_SCALE / DUTY_ONE));
+    // The page shows the strafe buttons for a chassis that has them
+    if (len > 0 && len < (int)sizeof(event))
+        len += snprintf(event + len, sizeof(event) - len, "],\"script\":%d%s}\n\n",
+                        script_current_step(), DRIVETRAIN_HAS_STRAFE ? ",\"strafe\":1" : "");
+    if (len <= 0 || len >= (int)sizeof(event))
+        return; // keep the previous event rather than send a truncated one
+    event_len = len;
+    event_seq++;
+    event_stream_stats.events++;
+}
+
+static void stream_timer(void *arg)
+{
+    (void)arg;
+    event_stream_tick();
+    if (clients > 0)
+        sys_timeout(EVENT_STREAM_PERIOD_MS, stream_timer, NULL);
+}
+
+void event_stream_tick(void)
+{
+    if (clients == 0)
+        return;
+    format_event();
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+    {
+        StreamSlot *s = &streams[i];
+        if (s->used && s->wake != NULL)
+        {
+            // httpd may wait again from inside the callback
+            fs_wait_cb wake = s->wake;
+            s->wake = NULL;
+            event_stream_stats.pushes++;
+            wake(s->wake_arg);
+        }
+    }
+}
+
+static StreamSlot *stream_of(struct fs_file *file)
+{
+    StreamSlot *s = (StreamSlot *)file->pextension;
+    if (s < &streams[0] || s >= &streams[EVENT_STREAM_MAX_CLIENTS])
+        return NULL;
+    return s;
+}
+
+int event_stream_open(struct fs_file *file)
+{
+    StreamSlot *s = NULL;
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+    {
+        if (!streams[i].used)
+        {
+            s = &streams[i];
+            break;
+        }
+    }
+    if (s == NULL)
+    {
+        event_stream_stats.rejected++;
+        return 0;
+    }
+
+    if (clients++ == 0)
+    {
+        // First viewer: refresh the state it starts with and start the timer
+        format_event();
+        sys_timeout(EVENT_STREAM_PERIOD_MS, stream_timer, NULL);
+    }
+    memset(s, 0, sizeof(*s));
+    s->used = true;
+    s->seq = event_seq - 1; // the current state follows the header
+    memcpy(s->buf, stream_header, sizeof(stream_header) - 1);
+    s->len = sizeof(stream_header) - 1;
+
+    // No data and no end: httpd reads through event_stream_read() until the client leaves
+    file->data = NULL;
+    file->len = INT_MAX;
+    file->index = 0;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+    file->pextension = s;
+    return 1;
+}
+
+bool event_stream_can_read(struct fs_file *file)
+{
+    StreamSlot *s = stream_of(file);
+    return s != NULL && (s->offset < s->len || s->seq != event_seq);
+}
+
+bool event_stream_wait(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg)
+{
+    StreamSlot *s = stream_of(file);
+    if (s == NULL)
+        return false;
+    s->wake = callback_fn;
+    s->wake_arg = callback_arg;
+    return true;
+}
+
+int event_stream_read(struct fs_file *file, char *buffer, int count)
+{
+    StreamSlot *s = stream_of(file);
+    if (s == NULL)
+        return FS_READ_EOF;
+
+    if (s->offset == s->len)
+    {
+        if (s->seq == event_seq)
+            return FS_READ_DELAYED;
+        memcpy(s->buf, event, event_len);
+        s->len = event_len;
+        s->offset = 0;
+        s->seq = event_seq;
+    }
+    int n = s->len - s->offset < count ? s->len - s->offset : count;
+    memcpy(buffer, s->buf + s->offset, n);
+    s->offset += n;
+    file->index += n;
+    return n;
+}
+
+bool event_stream_close(struct fs_file *file)
+{
+    StreamSlot *s = stream_of(file);
+    if (s == NULL)
+        return false;
+    s->used = false;
+    s->wake = NULL;
+    file->pextension = NULL;
+    if (--clients == 0)
+        sys_untimeout(stream_timer, NULL);
+    return true;
+}
+
+int event_stream_clients(void)
+{
+    return clients;
+}
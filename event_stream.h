@@ -0,0 +1,44 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+// Server-Sent Events stream of the vehicle state at GET /events.
+//
+// Each viewer holds one connection open; httpd reads it as a custom file of unknown length
+// through the asynchronous file API (LWIP_HTTPD_FS_ASYNC_READ). A timer formats the state
+// once every 1/EVENT_STREAM_HZ seconds and wakes every viewer waiting for it, so N viewers
+// cost one format and N sends per tick instead of N polls through the control path.
+// The timer only runs while a stream is open.
+//
+// Network side (core 0, lwIP context) only.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lwip/apps/fs.h"
+
+typedef struct
+{
+    uint32_t events;   // states formatted
+    uint32_t pushes;   // viewers woken for an event
+    uint32_t rejected; // streams refused because every slot was in use
+} EventStreamStats;
+
+extern EventStreamStats event_stream_stats;
+
+void event_stream_init(void);
+
+// fs_*_custom back end of /events. The functions other than open return false (or
+// FS_READ_EOF) for files that are not an event stream.
+int event_stream_open(struct fs_file *file);
+bool event_stream_can_read(struct fs_file *file);
+bool event_stream_wait(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg);
+int event_stream_read(struct fs_file *file, char *buffer, int count);
+bool event_stream_close(struct fs_file *file);
+
+// Number of open streams
+int event_stream_clients(void);
+
+// Format the current state and wake the waiting viewers; called by the timer
+void event_stream_tick(void);
+
+#endif // EVENT_STREAM_H
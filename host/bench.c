@@ -0,0 +1,845 @@
+// Host benchmark harness for the controller hot path.
+//
+// Drives synthetic operator sessions through the same CGI / custom-file path httpd uses
+// on the device, and reports per-call latency percentiles plus the resulting GPIO/PWM
+// write trace. See README.md for usage.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+#include "bench.h"
+#include "control_loop.h"
+#include "event_log.h"
+#include "event_stream.h"
+#include "hal_shim.h"
+#include "http_control.h"
+#include "http_route.h"
+#include "httpd_shim.h"
+#include "motion_profile.h"
+#include "motor_plant.h"
+#include "power.h"
+#include "script.h"
+#include "session.h"
+#include "speed_control.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "udp_control.h"
+#include "vehicle.h"
+#include "ws_control.h"
+
+#define POLL_INTERVAL_US 300000 // heartbeat_period of content/app.js
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--iterations N] [--seed S] [--trace FILE] [--verbose] [--check]\n"
+            "       %s --replay FILE [--tolerance N]\n"
+            "       %s --plant [--load L] [--open-loop] [--kp P] [--ki I] [--kd D]\n"
+            "       %s --fleet N [--port P]\n"
+            "       %s --flood\n"
+            "  --iterations N  commands per benchmark (default 20000)\n"
+            "  --seed S        seed of the synthetic command generator\n"
+            "  --trace FILE    write the GPIO/PWM write trace of the request run as CSV\n"
+            "  --verbose       echo the firmware's printf output\n"
+            "  --check         run the behavioural checks instead of benchmarks\n"
+            "  --replay FILE   replay a command trace downloaded from /trace.bin and compare\n"
+            "                  the wheel outputs\n"
+            "  --tolerance N   PWM counts a replayed output may differ by (default 0)\n"
+            "  --plant         step response of the speed loop on the simulated motors\n"
+            "  --load L        duty lost to load on the front right wheel (default 0.3)\n"
+            "  --open-loop     the same step without the speed loop\n"
+            "  --kp/--ki/--kd  gains to try instead of custom.h's\n"
+            "  --fleet N       N robot processes on loopback driven in fleet mode\n"
+            "  --port P        their UDP port (default UDP_CONTROL_PORT)\n"
+            "  --flood         STOP latency while other clients flood /control.cgi\n",
+            prog, prog, prog, prog, prog);
+}
+
+static void reset_robot(void)
+{
+    hal_shim_reset();
+    setup_pwms();
+    script_init();
+    trace_init();
+    control_loop_init();
+    session_init();
+    admission_init();
+    power_init(time_us_32());
+    telemetry_init();
+    event_stream_init();
+    vehicle_command(CMD_STOP);
+    push_command(CMD_NONE);
+    push_command(CMD_NONE);
+    vehicle_speed = 0;
+}
+
+// Full request: URI parameter split, cgi_control, fs_open/read/close of the reply.
+static void bench_request(int iterations, uint32_t seed, const char *trace_path)
+{
+    LatencySamples lat, tick_lat;
+    char uri[64];
+    char body[JSON_BUFFER_SIZE];
+    uint32_t rng = seed;
+
+    reset_robot();
+    latency_init(&lat, iterations);
+    latency_init(&tick_lat, iterations);
+    uint64_t trace_start = hal_trace_count();
+    HalCounters before = hal_counters;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        snprintf(uri, sizeof(uri), "/control.cgi?command=%s", bench_next_command(&rng));
+        hal_shim_advance_us(POLL_INTERVAL_US);
+        uint64_t t0 = bench_now_ns();
+        httpd_shim_get(uri, body, sizeof(body));
+        uint64_t t1 = bench_now_ns();
+        control_loop_tick();
+        latency_add(&lat, t1 - t0);
+        latency_add(&tick_lat, bench_now_ns() - t1);
+    }
+    latency_print(stdout, "request", &lat);
+    latency_print(stdout, "control_loop_tick", &tick_lat);
+
+    HalCounters *c = &hal_counters;
+    fprintf(stdout, "  per request: %.2f gpio writes, %.2f pwm writes, %.1f stdio bytes in %.2f calls\n",
+           (double)(c->gpio_writes - before.gpio_writes) / iterations,
+           (double)(c->pwm_writes - before.pwm_writes) / iterations,
+           (double)(c->stdio_bytes - before.stdio_bytes) / iterations,
+           (double)(c->stdio_calls - before.stdio_calls) / iterations);
+
+    if (trace_path)
+    {
+        FILE *f = fopen(trace_path, "w");
+        if (!f)
+        {
+            perror(trace_path);
+        }
+        else
+        {
+            hal_trace_dump_csv(f);
+            fclose(f);
+            fprintf(stdout, "  trace: %llu writes (last %d kept) -> %s\n",
+                   (unsigned long long)(hal_trace_count() - trace_start), HAL_TRACE_CAPACITY,
+                   trace_path);
+        }
+    }
+    latency_free(&lat);
+    latency_free(&tick_lat);
+}
+
+// The lookup get_command_enum replaced, for comparison: one strcmp per name in turn, so
+// NON, the most frequent, takes all of them
+static CommandType strcmp_command_enum(const char *command)
+{
+    static const char *const names[] = {"FLT", "FRT", "FWD", "LFT", "RGT", "BLT",
+                                        "BWD", "BRT", "STP", "HBT", "SLT", "SRT"};
+    static const CommandType cmds[] = {CMD_FLT, CMD_FRT, CMD_FWD, CMD_LFT,
+                                       CMD_RGT, CMD_BLT, CMD_BWD, CMD_BRT,
+                                       CMD_STOP, CMD_HEARTBEAT, CMD_SLT, CMD_SRT};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(command, names[i]) == 0)
+            return cmds[i];
+    }
+    return CMD_NONE;
+}
+
+// And the parameter scans of the old cgi_control: the client id and the STOP check
+// before admission, then the command
+static CommandType scan_control_params(int n, char *names[], char *values[], uint32_t *client)
+{
+    volatile bool stop = false;
+    *client = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (strcmp(names[i], "id") == 0)
+        {
+            *client = (uint32_t)strtoul(values[i], NULL, 10);
+            break;
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (strcmp(names[i], "command") == 0)
+        {
+            stop = strcmp(values[i], "STP") == 0;
+            break;
+        }
+    }
+    (void)stop;
+    for (int i = 0; i < n; i++)
+    {
+        if (strcmp(names[i], "command") == 0 && values[i][0] != '\0')
+            return strcmp_command_enum(values[i]);
+    }
+    return CMD_NONE;
+}
+
+// Command names by the perfect hash against the strcmp chain, then the parameters of a
+// /control.cgi request through its route against the old scans
+static void bench_parse(int iterations, uint32_t seed)
+{
+    static const RouteParam control_params[] = {
+        ROUTE_PARAM_ID,
+        {"command", ROUTE_COMMAND},
+    };
+    static const Route control_route = {"/control.cgi", NULL, control_params, 2, NULL};
+    LatencySamples hashed, chained, routed, scanned;
+    uint32_t rng = seed;
+    volatile CommandType sink;
+    volatile uint32_t client_sink;
+
+    latency_init(&hashed, iterations);
+    latency_init(&chained, iterations);
+    latency_init(&routed, iterations);
+    latency_init(&scanned, iterations);
+    for (int i = 0; i < iterations; i++)
+    {
+        const char *command = bench_next_command(&rng);
+        uint64_t t0 = bench_now_ns();
+        sink = get_command_enum(command);
+        uint64_t t1 = bench_now_ns();
+        sink = strcmp_command_enum(command);
+        latency_add(&hashed, t1 - t0);
+        latency_add(&chained, bench_now_ns() - t1);
+
+        // The page puts the command first and its id last
+        char *names[] = {"command", "id"};
+        char *values[] = {(char *)command, "2718281828"};
+        RouteArgs args;
+        uint32_t client;
+        t0 = bench_now_ns();
+        http_route_parse(&control_route, 2, names, values, &args);
+        t1 = bench_now_ns();
+        sink = scan_control_params(2, names, values, &client);
+        latency_add(&routed, t1 - t0);
+        latency_add(&scanned, bench_now_ns() - t1);
+        client_sink = args.values[0].u + client;
+    }
+    latency_print(stdout, "get_command_enum", &hashed);
+    latency_print(stdout, "  strcmp chain", &chained);
+    latency_print(stdout, "route params", &routed);
+    latency_print(stdout, "  strcmp scans", &scanned);
+
+    // Each of those is mostly the clock read, so also the mean over one untimed run
+    const char **commands = malloc((size_t)iterations * sizeof(*commands));
+    rng = seed;
+    for (int i = 0; i < iterations; i++)
+        commands[i] = bench_next_command(&rng);
+    uint64_t t0 = bench_now_ns();
+    for (int i = 0; i < iterations; i++)
+        sink = get_command_enum(commands[i]);
+    uint64_t t1 = bench_now_ns();
+    for (int i = 0; i < iterations; i++)
+        sink = strcmp_command_enum(commands[i]);
+    uint64_t t2 = bench_now_ns();
+    fprintf(stdout, "  mean without the clock: %.1f ns hashed, %.1f ns strcmp chain\n",
+            (double)(t1 - t0) / iterations, (double)(t2 - t1) / iterations);
+    free(commands);
+    (void)sink;
+    (void)client_sink;
+    latency_free(&hashed);
+    latency_free(&chained);
+    latency_free(&routed);
+    latency_free(&scanned);
+}
+
+static void bench_update(int iterations, uint32_t seed)
+{
+    LatencySamples lat;
+    uint32_t rng = seed;
+
+    reset_robot();
+    latency_init(&lat, iterations);
+    for (int i = 0; i < iterations; i++)
+    {
+        CommandType cmd = get_command_enum(bench_next_command(&rng));
+        hal_shim_advance_us(POLL_INTERVAL_US);
+        uint64_t t0 = bench_now_ns();
+        push_command(cmd);
+        update_vehicle();
+        apply_vehicle();
+        latency_add(&lat, bench_now_ns() - t0);
+    }
+    latency_print(stdout, "update_vehicle", &lat);
+    latency_free(&lat);
+}
+
+// Setting wheel targets from a discrete command (command_vector lookup) versus mixing a
+// continuous drive vector, as the control loop does for each queued command.
+static void bench_mixer(int iterations, uint32_t seed)
+{
+    LatencySamples discrete, vector;
+    uint32_t rng = seed;
+
+    reset_robot();
+    latency_init(&discrete, iterations);
+    latency_init(&vector, iterations);
+    for (int i = 0; i < iterations; i++)
+    {
+        CommandType cmd = get_command_enum(bench_next_command(&rng));
+        uint32_t r = bench_rand(&rng);
+        int throttle = (int)(r % (2 * DRIVE_SCALE + 1)) - DRIVE_SCALE;
+        int turn = (int)((r >> 12) % (2 * DRIVE_SCALE + 1)) - DRIVE_SCALE;
+
+        uint64_t t0 = bench_now_ns();
+        vehicle_command(cmd);
+        uint64_t t1 = bench_now_ns();
+        vehicle_drive(throttle, turn);
+        latency_add(&discrete, t1 - t0);
+        latency_add(&vector, bench_now_ns() - t1);
+    }
+    latency_print(stdout, "vehicle_command", &discrete);
+    latency_print(stdout, "vehicle_drive", &vector);
+    latency_free(&discrete);
+    latency_free(&vector);
+}
+
+// One control loop step of the wheel ramps, under the synthetic session, for both shapes.
+// Also reports how long a held FWD takes to reach full speed, which no longer depends on
+// the poll interval.
+static void bench_motion(int iterations, uint32_t seed)
+{
+    static const char *shape_names[] = {"vehicle_step trapezoid", "vehicle_step s-curve"};
+    const MotionLimits configured = motion_limits;
+
+    for (int shape = MOTION_TRAPEZOIDAL; shape <= MOTION_SCURVE; shape++)
+    {
+        LatencySamples lat;
+        uint32_t rng = seed;
+
+        motion_limits.shape = (MotionShape)shape;
+        reset_robot();
+        latency_init(&lat, iterations);
+        for (int i = 0; i < iterations; i++)
+        {
+            // a new command every 60 ticks (300 ms), stepped in between
+            if (i % 60 == 0)
+                vehicle_command(get_command_enum(bench_next_command(&rng)));
+            uint64_t t0 = bench_now_ns();
+            vehicle_step(1.0f / CONTROL_LOOP_HZ);
+            latency_add(&lat, bench_now_ns() - t0);
+        }
+        latency_print(stdout, shape_names[shape], &lat);
+        latency_free(&lat);
+
+        reset_robot();
+        vehicle_command(CMD_FWD);
+        int ticks = 0;
+        while (vehicle_speed < MAX_VEHICLE_SPEED && ticks < 60 * CONTROL_LOOP_HZ)
+        {
+            vehicle_step(1.0f / CONTROL_LOOP_HZ);
+            ticks++;
+        }
+        fprintf(stdout, "  0 -> full speed: %d ms\n", ticks * 1000 / CONTROL_LOOP_HZ);
+    }
+    motion_limits = configured;
+}
+
+// Recording an entry on the hot path versus formatting and printing it from the idle loop,
+// which is what every request used to pay inline.
+static void bench_event_log(int iterations)
+{
+    LatencySamples write_lat, drain_lat;
+
+    event_log_init();
+    latency_init(&write_lat, iterations);
+    latency_init(&drain_lat, iterations);
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t t0 = bench_now_ns();
+        event_log_write(EV_HTTP_COMMAND, i % CMD_NONE, 0x1234, i % 11);
+        uint64_t t1 = bench_now_ns();
+        event_log_drain(1);
+        latency_add(&write_lat, t1 - t0);
+        latency_add(&drain_lat, bench_now_ns() - t1);
+    }
+    latency_print(stdout, "event_log_write", &write_lat);
+    latency_print(stdout, "event_log_drain (1)", &drain_lat);
+    latency_free(&write_lat);
+    latency_free(&drain_lat);
+}
+
+// One WebSocket command frame: unmask, decode, cgi-equivalent update, status frame encode.
+// Compare with "request", which is what every 300 ms poll costs before TCP setup.
+static void bench_websocket(int iterations, uint32_t seed)
+{
+    static const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+    LatencySamples lat;
+    uint8_t frame_buf[16];
+    uint8_t reply[WS_TX_BUFFER_SIZE];
+    uint32_t rng = seed;
+
+    reset_robot();
+    latency_init(&lat, iterations);
+    for (int i = 0; i < iterations; i++)
+    {
+        const char *command = bench_next_command(&rng);
+        frame_buf[0] = 0x80 | WS_OPCODE_TEXT;
+        frame_buf[1] = 0x80 | 3;
+        memcpy(frame_buf + 2, mask, 4);
+        for (int j = 0; j < 3; j++)
+            frame_buf[6 + j] = command[j] ^ mask[j];
+        hal_shim_advance_us(POLL_INTERVAL_US);
+
+        uint64_t t0 = bench_now_ns();
+        WsFrame frame;
+        int reply_len;
+        ws_decode_frame(frame_buf, 9, &frame);
+        ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len);
+        latency_add(&lat, bench_now_ns() - t0);
+        control_loop_tick();
+    }
+    latency_print(stdout, "websocket frame", &lat);
+    latency_free(&lat);
+}
+
+typedef struct
+{
+    uint32_t seq;
+    uint32_t sent_ms;
+    uint32_t arrival_ms;
+    uint8_t command;
+} UdpTracePacket;
+
+static int cmp_arrival(const void *a, const void *b)
+{
+    const UdpTracePacket *x = a, *y = b;
+    return (x->arrival_ms > y->arrival_ms) - (x->arrival_ms < y->arrival_ms);
+}
+
+// Replay a synthetic lossy Wi-Fi trace against the UDP protocol: a sender at 50 Hz, 4-12 ms
+// path, 5 % loss, 5 % reordered by up to 40 ms and 2 % stalled for 300 ms.
+static void bench_udp(int iterations, uint32_t seed)
+{
+    static const char *result_names[] = {"accepted", "dropped_old", "dropped_stale",
+                                         "dropped_peer", "malformed", "dropped_lease"};
+    LatencySamples lat;
+    UdpControlState state;
+    uint32_t rng = seed;
+    int counts[UDP_DROPPED_LEASE + 1] = {0};
+    int lost = 0;
+
+    UdpTracePacket *trace = malloc(iterations * sizeof(*trace));
+    int n = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        uint32_t r = bench_rand(&rng);
+        if (r % 100 < 5)
+        {
+            lost++;
+            continue;
+        }
+        UdpTracePacket *pkt = &trace[n++];
+        pkt->seq = (uint32_t)i + 1;
+        pkt->sent_ms = 1000000u + (uint32_t)i * 20;
+        pkt->arrival_ms = pkt->sent_ms + 4 + (r >> 8) % 9;
+        if ((r >> 16) % 100 < 5)
+            pkt->arrival_ms += (r >> 24) % 40;
+        else if ((r >> 16) % 100 < 7)
+            pkt->arrival_ms += 300;
+        pkt->command = get_command_enum(bench_next_command(&rng));
+    }
+    qsort(trace, n, sizeof(*trace), cmp_arrival);
+
+    reset_robot();
+    udp_control_reset(&state);
+    latency_init(&lat, n);
+    for (int i = 0; i < n; i++)
+    {
+        uint8_t packet[UDP_PACKET_SIZE];
+        uint8_t reply[UDP_PACKET_SIZE];
+        udp_control_encode_command(packet, i == 0 ? UDP_FLAG_SYNC : 0, trace[i].seq,
+                                   trace[i].sent_ms, trace[i].command, 0);
+        uint64_t t0 = bench_now_ns();
+        UdpResult result = udp_control_receive(&state, 1, packet, sizeof(packet),
+                                               trace[i].arrival_ms - 900000u, reply);
+        latency_add(&lat, bench_now_ns() - t0);
+        counts[result]++;
+        control_loop_tick();
+    }
+    latency_print(stdout, "udp packet", &lat);
+    fprintf(stdout, "  udp trace: %d sent, %d lost", iterations, lost);
+    for (int i = 0; i <= UDP_DROPPED_LEASE; i++)
+        fprintf(stdout, ", %d %s", counts[i], result_names[i]);
+    fprintf(stdout, "\n");
+    latency_free(&lat);
+    free(trace);
+}
+
+// --replay: run a captured trace through this build's vehicle code, as fast as it goes
+static int run_replay(const char *path, int tolerance)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? (size_t)size : 1);
+    size_t len = fread(data, 1, size > 0 ? (size_t)size : 0, f);
+    fclose(f);
+
+    reset_robot();
+    ReplayResult r;
+    uint64_t start = bench_now_ns();
+    bool ok = replay_trace(data, len, tolerance, &r, stdout);
+    uint64_t elapsed = bench_now_ns() - start;
+    free(data);
+    if (!ok)
+        return 2;
+
+    double seconds = elapsed / 1e9;
+    double simulated = (double)r.ticks / CONTROL_LOOP_HZ;
+    fprintf(stdout,
+            "%lu records: %lu compared, %lu skipped, %lu mismatches\n"
+            "%lu ticks (%.1f s of driving) replayed in %.3f ms, %.0fx real time\n",
+            (unsigned long)r.records, (unsigned long)r.compared, (unsigned long)r.skipped,
+            (unsigned long)r.mismatches, (unsigned long)r.ticks, simulated, seconds * 1e3,
+            seconds > 0 ? simulated / seconds : 0.0);
+    return r.mismatches ? 1 : 0;
+}
+
+// --plant: a drive step at 60 % on the simulated motors, one wheel loaded, with the speed
+// loop's gains; prints the measured speeds and each wheel's rise, overshoot and error
+#define PLANT_SETPOINT 0.6f
+#define PLANT_SECONDS 4
+
+static int run_plant(float load, bool closed)
+{
+    float rise[NUM_OF_WHEELS] = {0};
+    float peak[NUM_OF_WHEELS] = {0};
+    float t10[NUM_OF_WHEELS];
+
+    motor_plant_attach(true);
+    reset_robot();
+    motor_plant[0].load = load;
+    for (int i = 1; i < NUM_OF_WHEELS; i++)
+        motor_plant[i].load = 0.05f;
+    speed_control_enabled = closed;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        t10[i] = -1.0f;
+
+    fprintf(stdout, "%s, kp %.2f ki %.2f kd %.3f, load %.2f on wheel 0\n",
+            closed ? "closed loop" : "open loop", speed_gains.kp, speed_gains.ki, speed_gains.kd,
+            load);
+    fprintf(stdout, "%6s %8s", "t_s", "command");
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        fprintf(stdout, " %7s%d", "wheel", i);
+    fprintf(stdout, "\n");
+
+    control_loop_post_drive((int)(PLANT_SETPOINT * DRIVE_SCALE), 0);
+    for (int n = 1; n <= PLANT_SECONDS * CONTROL_LOOP_HZ; n++)
+    {
+        if (n % (POLL_INTERVAL_US * CONTROL_LOOP_HZ / 1000000) == 0)
+            control_loop_post(CMD_HEARTBEAT);
+        hal_shim_advance_us(1000000 / CONTROL_LOOP_HZ);
+        control_loop_tick();
+
+        float t = (float)n / CONTROL_LOOP_HZ;
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+        {
+            float v = motor_plant_speed(i);
+            if (t10[i] < 0 && v >= 0.1f * PLANT_SETPOINT)
+                t10[i] = t;
+            if (rise[i] == 0 && v >= 0.9f * PLANT_SETPOINT)
+                rise[i] = t - t10[i];
+            if (v > peak[i])
+                peak[i] = v;
+        }
+        if (n % (CONTROL_LOOP_HZ / 10) == 0)
+        {
+            fprintf(stdout, "%6.2f %8.3f", t, wheels[0].profile.velocity);
+            for (int i = 0; i < NUM_OF_WHEELS; i++)
+                fprintf(stdout, " %8.3f", motor_plant_speed(i));
+            fprintf(stdout, "\n");
+        }
+    }
+
+    fprintf(stdout, "%6s %10s %10s %10s\n", "wheel", "rise_s", "overshoot", "error");
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        float error = motor_plant_speed(i) - PLANT_SETPOINT;
+        fprintf(stdout, "%6d %10.2f %9.1f%% %+10.3f\n", i, rise[i],
+                100.0f * fmaxf(0.0f, peak[i] - PLANT_SETPOINT) / PLANT_SETPOINT, error);
+    }
+    motor_plant_attach(false);
+    speed_control_enabled = SPEED_CONTROL;
+    return 0;
+}
+
+// --flood: FLOOD_CLIENTS misbehaving clients each send FLOOD_PER_TICK requests every
+// control loop period and read their replies slowly, while the operator drives and hits
+// STOP every FLOOD_STOP_MS. A STOP is queued behind that period's flood, as lwIP would
+// hand it over. Between STOPs the operator also releases its FWD with NON while the reply
+// to one of its own heartbeats is still being read, which ADMISSION_MAX_INFLIGHT alone
+// would refuse. Run with admission control off for comparison, then on, where every STOP
+// has to be answered and have the wheels at rest one tick later, and every release of the
+// driving operator has to be answered and applied.
+#define FLOOD_CLIENTS 3
+#define FLOOD_PER_TICK 4
+#define FLOOD_HOLD_MS 200 // a slow reader keeps its reply this long
+#define FLOOD_STOP_MS 250
+#define FLOOD_SECONDS 5
+#define FLOOD_OPERATOR 1 // the operator's page id; the flood uses 100, 101, ...
+
+typedef struct
+{
+    struct fs_file file;
+    uint32_t close_ms;
+} FloodReply;
+
+static bool wheels_at_rest(void)
+{
+    bool rest = vehicle_speed == 0;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        rest &= hal_pwm_level(wheels[i].en_pin) == 0;
+    return rest;
+}
+
+static bool refused_reply(const struct fs_file *file)
+{
+    return file->pextension == NULL && strncmp(file->data, "HTTP/1.0 429 ", 13) == 0;
+}
+
+static int flood_run(bool admission)
+{
+    static const char *flood_commands[] = {"FWD", "LFT", "NON", "XYZ"};
+    const int tick_ms = 1000 / CONTROL_LOOP_HZ;
+    FloodReply held[HTTP_RESPONSE_SLOTS];
+    int held_count = 0;
+    int sent = 0, admitted = 0, refused = 0, no_slot = 0;
+    int stops = 0, answered = 0, applied = 0, operator_refused = 0;
+    int releases = 0, released = 0;
+    LatencySamples flood_lat, stop_lat;
+    char uri[64];
+
+    reset_robot();
+    http_control_init();
+    admission_enabled = admission;
+    latency_init(&flood_lat, FLOOD_SECONDS * CONTROL_LOOP_HZ * FLOOD_CLIENTS * FLOOD_PER_TICK);
+    latency_init(&stop_lat, FLOOD_SECONDS * 1000 / FLOOD_STOP_MS);
+
+    for (uint32_t t = tick_ms; t <= FLOOD_SECONDS * 1000; t += tick_ms)
+    {
+        hal_shim_advance_us(tick_ms * 1000);
+        for (int i = 0; i < held_count;)
+        {
+            if ((int32_t)(held[i].close_ms - t) > 0)
+            {
+                i++;
+                continue;
+            }
+            fs_close_custom(&held[i].file);
+            held[i] = held[--held_count];
+        }
+
+        uint64_t t0 = bench_now_ns();
+        for (int c = 0; c < FLOOD_CLIENTS; c++)
+        {
+            for (int k = 0; k < FLOOD_PER_TICK; k++)
+            {
+                struct fs_file file;
+                snprintf(uri, sizeof(uri), "/control.cgi?command=%s&id=%d",
+                         flood_commands[(sent + c) % 4], 100 + c);
+                uint64_t r0 = bench_now_ns();
+                bool opened = httpd_shim_open(uri, &file);
+                latency_add(&flood_lat, bench_now_ns() - r0);
+                sent++;
+                if (!opened)
+                    no_slot++;
+                else if (refused_reply(&file))
+                    refused++;
+                else if (file.pextension == NULL)
+                    admitted++; // a constant release reply, which holds nothing
+                else
+                {
+                    admitted++;
+                    held[held_count].file = file;
+                    held[held_count++].close_ms = t + FLOOD_HOLD_MS;
+                }
+            }
+        }
+
+        if (t % FLOOD_STOP_MS == 0)
+        {
+            struct fs_file file;
+            snprintf(uri, sizeof(uri), "/control.cgi?command=STP&id=%d", FLOOD_OPERATOR);
+            bool opened = httpd_shim_open(uri, &file);
+            latency_add(&stop_lat, bench_now_ns() - t0);
+            stops++;
+            if (opened && file.data != NULL &&
+                strncmp(file.data, "{\"status\":1, \"command\":\"8\"", 26) == 0)
+                answered++;
+            if (opened)
+                fs_close_custom(&file);
+            control_loop_tick();
+            applied += wheels_at_rest();
+            continue;
+        }
+        if (t % FLOOD_STOP_MS == FLOOD_STOP_MS / 2)
+        {
+            struct fs_file file;
+            snprintf(uri, sizeof(uri), "/control.cgi?command=FWD&id=%d", FLOOD_OPERATOR);
+            if (!httpd_shim_open(uri, &file) || file.pextension == NULL)
+                operator_refused++;
+            else
+                fs_close_custom(&file);
+        }
+        if (t % FLOOD_STOP_MS == FLOOD_STOP_MS * 3 / 5)
+        {
+            // A heartbeat read slowly, still in flight when the release goes out
+            struct fs_file file;
+            snprintf(uri, sizeof(uri), "/control.cgi?command=HBT&id=%d", FLOOD_OPERATOR);
+            if (httpd_shim_open(uri, &file) && file.pextension != NULL)
+            {
+                held[held_count].file = file;
+                held[held_count++].close_ms = t + FLOOD_HOLD_MS;
+            }
+        }
+        if (t % FLOOD_STOP_MS == FLOOD_STOP_MS * 4 / 5 &&
+            session_holds_movement(SESSION_HTTP, FLOOD_OPERATOR,
+                                   to_ms_since_boot(get_absolute_time())))
+        {
+            struct fs_file file;
+            snprintf(uri, sizeof(uri), "/control.cgi?command=NON&id=%d", FLOOD_OPERATOR);
+            bool opened = httpd_shim_open(uri, &file);
+            releases++;
+            control_loop_tick();
+            if (opened && !refused_reply(&file) && last_command == CMD_NONE)
+                released++;
+            if (opened)
+                fs_close_custom(&file);
+            continue;
+        }
+        control_loop_tick();
+    }
+    while (held_count > 0)
+        fs_close_custom(&held[--held_count].file);
+
+    fprintf(stdout, "admission control %s\n", admission ? "on" : "off");
+    latency_print(stdout, "flood request", &flood_lat);
+    latency_print(stdout, "stop behind flood", &stop_lat);
+    fprintf(stdout,
+            "  flood: %d sent, %d answered, %d refused with 429, %d without a slot\n"
+            "  operator: %d of %d FWD refused; STOP: %d sent, %d answered, %d at rest a tick "
+            "later\n"
+            "  operator: %d NON sent while driving, %d answered and applied\n",
+            sent, admitted, refused, no_slot, operator_refused, stops, stops, answered, applied,
+            releases, released);
+    latency_free(&flood_lat);
+    latency_free(&stop_lat);
+    admission_enabled = ADMISSION_CONTROL;
+
+    // The flood can have at most what its buckets hand out
+    int budget = FLOOD_CLIENTS * (ADMISSION_BURST + ADMISSION_RATE * FLOOD_SECONDS);
+    return answered == stops && applied == stops && releases > 0 && released == releases &&
+                   (!admission || admitted <= budget)
+               ? 0
+               : 1;
+}
+
+static int run_flood(void)
+{
+    fprintf(stdout, "%d clients x %d requests/s for %d s, STOP every %d ms\n", FLOOD_CLIENTS,
+            FLOOD_PER_TICK * CONTROL_LOOP_HZ, FLOOD_SECONDS, FLOOD_STOP_MS);
+    latency_print_header(stdout);
+    flood_run(false);
+    int failed = flood_run(true);
+    fprintf(stdout, "flood: %s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 20000;
+    uint32_t seed = 0x2545f491;
+    const char *trace_path = NULL;
+    const char *replay_path = NULL;
+    int tolerance = 0;
+    bool check = false;
+    bool plant = false;
+    bool open_loop = false;
+    float load = 0.3f;
+    int fleet = 0;
+    int port = UDP_CONTROL_PORT;
+    bool flood = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (strcmp(argv[i], "--verbose") == 0)
+            hal_shim_set_stdio_echo(true);
+        else if (strcmp(argv[i], "--check") == 0)
+            check = true;
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--plant") == 0)
+            plant = true;
+        else if (strcmp(argv[i], "--open-loop") == 0)
+            open_loop = true;
+        else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+            load = strtof(argv[++i], NULL);
+        else if (strcmp(argv[i], "--kp") == 0 && i + 1 < argc)
+            speed_gains.kp = strtof(argv[++i], NULL);
+        else if (strcmp(argv[i], "--ki") == 0 && i + 1 < argc)
+            speed_gains.ki = strtof(argv[++i], NULL);
+        else if (strcmp(argv[i], "--kd") == 0 && i + 1 < argc)
+            speed_gains.kd = strtof(argv[++i], NULL);
+        else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc)
+            fleet = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--flood") == 0)
+            flood = true;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0 || seed == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (check)
+        return run_checks() ? 1 : 0;
+    if (replay_path != NULL)
+        return run_replay(replay_path, tolerance);
+    if (plant)
+        return run_plant(load, !open_loop);
+    if (fleet)
+        return run_fleet(fleet, (uint16_t)port);
+    if (flood)
+        return run_flood();
+
+    http_control_init();
+
+    fprintf(stdout, "%d iterations, seed 0x%08lx\n", iterations, (unsigned long)seed);
+    latency_print_header(stdout);
+    bench_parse(iterations, seed);
+    bench_event_log(iterations);
+    bench_update(iterations, seed);
+    bench_mixer(iterations, seed);
+    bench_motion(iterations, seed);
+    bench_websocket(iterations, seed);
+    bench_udp(iterations, seed);
+    bench_request(iterations, seed, trace_path);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Shared pieces of the host benchmark harness.
+
+#include <stdio.h>
+
+#include "pico/types.h"
+
+typedef struct
+{
+    uint32_t *ns;
+    size_t count;
+    size_t capacity;
+} LatencySamples;
+
+void latency_init(LatencySamples *s, size_t capacity);
+void latency_free(LatencySamples *s);
+void latency_add(LatencySamples *s, uint64_t ns);
+void latency_print_header(FILE *out);
+void latency_print(FILE *out, const char *name, LatencySamples *s);
+
+// Wall clock of the host, for measuring; the firmware only ever sees the mock clock.
+uint64_t bench_now_ns(void);
+
+// xorshift32, so runs are reproducible from --seed
+uint32_t bench_rand(uint32_t *state);
+
+// Next command of a synthetic operator session: hold a direction for a few polls,
+// release (NON) for a few polls, and occasionally hit STP or send garbage.
+const char *bench_next_command(uint32_t *rng);
+
+// Result of replaying a command trace (trace.h) through the vehicle code
+typedef struct
+{
+    uint32_t records;    // records in the trace
+    uint32_t compared;   // records replayed and compared
+    uint32_t skipped;    // records before a point the replay could start from
+    uint32_t mismatches; // compared records whose outputs differ by more than the tolerance
+    uint32_t ticks;      // control loop ticks simulated
+} ReplayResult;
+
+// Replay a trace file (optionally still with its HTTP response header) from the first
+// record taken at rest, resyncing at the next one after a gap, and compare the wheel
+// outputs against the recorded ones. Differences are printed to diffs, if not NULL.
+// Returns false if data is not a trace this build can replay.
+bool replay_trace(const uint8_t *data, size_t len, int tolerance, ReplayResult *result,
+                  FILE *diffs);
+
+// Behavioural regression checks; returns the number of failures.
+int run_checks(void);
+
+// Fleet mode on loopback: fork robots, multicast a command sequence to them on port and
+// check that they applied it in step. Returns 0 if they did, 77 if the host has no
+// multicast on loopback.
+int run_fleet(int robots, uint16_t port);
+
+#endif // BENCH_H
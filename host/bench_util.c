@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+void latency_init(LatencySamples *s, size_t capacity)
+{
+    s->ns = malloc(capacity * sizeof(*s->ns));
+    s->count = 0;
+    s->capacity = capacity;
+}
+
+void latency_free(LatencySamples *s)
+{
+    free(s->ns);
+    s->ns = NULL;
+    s->count = s->capacity = 0;
+}
+
+void latency_add(LatencySamples *s, uint64_t ns)
+{
+    if (s->count < s->capacity)
+        s->ns[s->count++] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const LatencySamples *s, double p)
+{
+    size_t idx = (size_t)(p * (double)(s->count - 1) + 0.5);
+    return s->ns[idx];
+}
+
+void latency_print_header(FILE *out)
+{
+    fprintf(out, "%-24s %8s %9s %9s %9s %9s %9s %9s\n", "latency [ns]", "n", "mean", "p50",
+            "p90", "p99", "p99.9", "max");
+}
+
+void latency_print(FILE *out, const char *name, LatencySamples *s)
+{
+    if (s->count == 0)
+    {
+        fprintf(out, "%-24s %8d\n", name, 0);
+        return;
+    }
+    qsort(s->ns, s->count, sizeof(*s->ns), cmp_u32);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < s->count; i++)
+        sum += s->ns[i];
+    fprintf(out, "%-24s %8zu %9llu %9lu %9lu %9lu %9lu %9lu\n", name, s->count,
+            (unsigned long long)(sum / s->count), (unsigned long)percentile(s, 0.50),
+            (unsigned long)percentile(s, 0.90), (unsigned long)percentile(s, 0.99),
+            (unsigned long)percentile(s, 0.999), (unsigned long)s->ns[s->count - 1]);
+}
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t bench_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+const char *bench_next_command(uint32_t *rng)
+{
+    static const char *moves[] = {"FLT", "FRT", "FWD", "LFT", "RGT", "BLT", "BWD", "BRT"};
+    static const char *current = "NON";
+    static int remaining = 0;
+
+    if (remaining-- > 0)
+        return current;
+
+    uint32_t r = bench_rand(rng);
+    if (strcmp(current, "NON") != 0)
+    {
+        // released a button
+        current = "NON";
+        remaining = (int)(r % 10);
+    }
+    else if (r % 50 == 0)
+    {
+        current = "STP";
+        remaining = 0;
+    }
+    else if (r % 97 == 0)
+    {
+        current = "X!Z"; // unknown command, parsed as NON
+        remaining = 0;
+    }
+    else
+    {
+        current = moves[(r >> 8) % (sizeof(moves) / sizeof(moves[0]))];
+        remaining = (int)((r >> 16) % 20);
+    }
+    return current;
+}
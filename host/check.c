@@ -0,0 +1,1999 @@
+// Behavioural regression checks of the controller, run through the same request path
+// httpd uses on the device. Run with `robot_bench --check`.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+#include "bench.h"
+#include "cmd_queue.h"
+#include "control_loop.h"
+#include "event_log.h"
+#include "event_stream.h"
+#include "hal_shim.h"
+#include "hardware/pwm.h"
+#include "http_control.h"
+#include "http_route.h"
+#include "httpd_shim.h"
+#include "motion_profile.h"
+#include "motor_plant.h"
+#include "motor_pwm.h"
+#include "power.h"
+#include "pwm_ramp.h"
+#include "script.h"
+#include "session.h"
+#include "speed_control.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "udp_control.h"
+#include "vehicle.h"
+#include "wifi_link.h"
+#include "ws_control.h"
+
+static int failures;
+
+#define CHECK(cond)                                                                  \
+    do                                                                               \
+    {                                                                                \
+        if (!(cond))                                                                 \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+static char body[JSON_BUFFER_SIZE];
+
+static void reset_robot(void)
+{
+    hal_shim_reset();
+    setup_pwms();
+    script_init();
+    trace_init();
+    control_loop_init();
+    session_init();
+    admission_init();
+    power_init(time_us_32());
+    telemetry_init();
+    event_stream_init();
+    vehicle_command(CMD_STOP);
+    push_command(CMD_NONE);
+    push_command(CMD_NONE);
+    apply_vehicle();
+}
+
+// One control loop period later
+static void tick(void)
+{
+    hal_shim_advance_us(1000000 / CONTROL_LOOP_HZ);
+    control_loop_tick();
+}
+
+static void run_ms(int ms)
+{
+    for (int i = 0; i < ms * CONTROL_LOOP_HZ / 1000; i++)
+        tick();
+}
+
+// Keep holding the current command for ms, with a heartbeat every HEARTBEAT_MS like the page
+#define HEARTBEAT_MS 300
+static void hold_ms(int ms)
+{
+    for (int i = 0; i < ms * CONTROL_LOOP_HZ / 1000; i++)
+    {
+        if (i % (HEARTBEAT_MS * CONTROL_LOOP_HZ / 1000) == 0)
+            control_loop_post(CMD_HEARTBEAT);
+        tick();
+    }
+}
+
+// Request, then let the control loop pick the command up
+static int send(const char *command)
+{
+    char uri[64];
+    snprintf(uri, sizeof(uri), "/control.cgi?command=%s", command);
+    int len = httpd_shim_get(uri, body, sizeof(body) - 1);
+    tick();
+    return len;
+}
+
+// Send as one of several browsers: the page adds its random id to every request
+static void send_as(uint32_t id, const char *command)
+{
+    char uri[64];
+    snprintf(uri, sizeof(uri), "/control.cgi?command=%s&id=%lu", command, (unsigned long)id);
+    httpd_shim_get(uri, body, sizeof(body));
+}
+
+// Repeat a command every interval_ms for duration_ms, like a held button in index.html
+static void hold(const char *command, int interval_ms, int duration_ms)
+{
+    for (int t = 0; t < duration_ms; t += interval_ms)
+    {
+        send(command);
+        run_ms(interval_ms - 1000 / CONTROL_LOOP_HZ);
+    }
+}
+
+static bool wheel_forward(int i)
+{
+    return hal_gpio_out(wheels[i].in1_pin) && !hal_gpio_out(wheels[i].in2_pin);
+}
+
+static bool wheel_backward(int i)
+{
+    return !hal_gpio_out(wheels[i].in1_pin) && hal_gpio_out(wheels[i].in2_pin);
+}
+
+// Every layout has its right wheels at the even indices and its left wheels at the odd
+static bool side_forward(int side)
+{
+    bool all = true;
+    for (int i = side; i < NUM_OF_WHEELS; i += 2)
+        all &= wheel_forward(i);
+    return all;
+}
+
+static bool side_backward(int side)
+{
+    bool all = true;
+    for (int i = side; i < NUM_OF_WHEELS; i += 2)
+        all &= wheel_backward(i);
+    return all;
+}
+
+static bool side_speed(int side, int speed)
+{
+    bool all = true;
+    for (int i = side; i < NUM_OF_WHEELS; i += 2)
+        all &= wheels[i].speed == speed;
+    return all;
+}
+
+static void check_parse(void)
+{
+    CHECK(get_command_enum("FWD") == CMD_FWD);
+    CHECK(get_command_enum("BRT") == CMD_BRT);
+    CHECK(get_command_enum("STP") == CMD_STOP);
+    CHECK(get_command_enum("NON") == CMD_NONE);
+    CHECK(get_command_enum("FW") == CMD_NONE);
+    CHECK(get_command_enum("FWDX") == CMD_NONE);
+    CHECK(get_command_enum("") == CMD_NONE);
+    CHECK(get_command_enum("fwd") == CMD_NONE && get_command_enum("FWE") == CMD_NONE);
+
+    // Every name in its own slot of the perfect hash, and nothing else found there
+    static const struct
+    {
+        const char *name;
+        CommandType cmd;
+    } names[] = {
+        {"FLT", CMD_FLT}, {"FRT", CMD_FRT},  {"FWD", CMD_FWD},  {"LFT", CMD_LFT},
+        {"RGT", CMD_RGT}, {"BLT", CMD_BLT},  {"BWD", CMD_BWD},  {"BRT", CMD_BRT},
+        {"STP", CMD_STOP}, {"NON", CMD_NONE}, {"HBT", CMD_HEARTBEAT}, {"SLT", CMD_SLT},
+        {"SRT", CMD_SRT},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        CommandType cmd = CMD_DRIVE;
+        bool strafe = names[i].cmd == CMD_SLT || names[i].cmd == CMD_SRT;
+        CHECK(vehicle_parse_command(names[i].name, 3, &cmd) == (DRIVETRAIN_HAS_STRAFE || !strafe));
+        CHECK(cmd == (DRIVETRAIN_HAS_STRAFE || !strafe ? names[i].cmd : CMD_DRIVE));
+    }
+    CommandType cmd;
+    CHECK(!vehicle_parse_command("FWD", 2, &cmd) && !vehicle_parse_command("FWDX", 4, &cmd));
+    CHECK(!vehicle_parse_command("\0\0\0", 3, &cmd) && !vehicle_parse_command("", 0, &cmd));
+}
+
+static void check_setup(void)
+{
+    reset_robot();
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        uint slice = pwm_gpio_to_slice_num(wheels[i].en_pin);
+        CHECK(hal_pwm_wrap(slice) == motor_pwm_timing.wrap);
+        CHECK(hal_pwm_clkdiv16(slice) ==
+              motor_pwm_timing.div_int * 16 + motor_pwm_timing.div_frac);
+        CHECK(hal_pwm_phase_correct(slice) == PWM_PHASE_CORRECT);
+        CHECK(hal_pwm_level(wheels[i].en_pin) == 0);
+    }
+}
+
+// Divider and wrap per frequency, and the speed to level mapping with trim and deadband
+static void check_motor_pwm(void)
+{
+    MotorPwmTiming t;
+
+    // 20 kHz from 150 MHz fits the counter undivided: 7500 steps
+    CHECK(motor_pwm_plan(150000000, 20000, false, &t));
+    CHECK(t.wrap == 7499 && t.div_int == 1 && t.div_frac == 0 && t.frequency_hz == 20000);
+    CHECK(motor_pwm_plan(150000000, 20000, true, &t));
+    CHECK(t.wrap == 3749 && t.div_int == 1 && t.phase_correct && t.frequency_hz == 20000);
+    // Low enough for all 16 bits, then the divider takes over
+    CHECK(motor_pwm_plan(150000000, 2000, false, &t));
+    CHECK(t.div_int == 1 && t.div_frac == 3 && t.wrap > 60000);
+    CHECK(abs((int)t.frequency_hz - 2000) <= 1);
+    CHECK(motor_pwm_plan(150000000, 100, false, &t));
+    CHECK(t.div_int == 22 && t.div_frac == 15 && t.wrap > 65000);
+    // Out of reach both ways, clamped to the nearest timing
+    CHECK(!motor_pwm_plan(150000000, 5, false, &t));
+    CHECK(t.div_int == 255 && t.div_frac == 15 && t.wrap == 65535);
+    CHECK(!motor_pwm_plan(150000000, 5000000, false, &t));
+    CHECK(t.wrap == 29);
+    CHECK(!motor_pwm_plan(150000000, 0, false, &t));
+
+    reset_robot();
+    uint16_t full = motor_pwm_timing.wrap + 1;
+    CHECK(motor_pwm_level(0, 0) == 0);
+    CHECK(motor_pwm_level(0, DUTY_ONE) == full);
+    CHECK(motor_pwm_level(0, -DUTY_ONE) == full);
+    CHECK(motor_pwm_level(0, 2 * DUTY_ONE) == full);
+    CHECK(motor_pwm_level(0, DUTY_ONE / 2) == full / 2);
+    CHECK(motor_pwm_duty(0.5f) == DUTY_ONE / 2 && motor_pwm_duty(-2.0f) == -DUTY_ONE);
+    // Every counter step is reachable, not just the 1000 of SPEED_SCALE
+    int levels = 1;
+    for (int32_t d = 1; d <= DUTY_ONE; d++)
+        levels += motor_pwm_level(0, d) != motor_pwm_level(0, d - 1);
+    CHECK(levels == full + 1);
+    CHECK(motor_pwm_level(0, motor_pwm_duty(1.0f / full)) == 1);
+
+    CHECK(!motor_pwm_set_trim(NUM_OF_WHEELS, 1000, 0));
+    CHECK(!motor_pwm_set_trim(0, 1001, 0));
+    CHECK(!motor_pwm_set_trim(0, 1000, -1));
+    CHECK(motor_pwm_set_trim(1, 900, 0));
+    CHECK(motor_pwm_level(1, DUTY_ONE) == full * 9 / 10);
+    CHECK(motor_pwm_set_trim(0, 1000, 200));
+    CHECK(motor_pwm_level(0, 1) >= full / 5);
+    CHECK(motor_pwm_level(0, DUTY_ONE / 2) == full * 6 / 10);
+    CHECK(motor_pwm_level(0, DUTY_ONE) == full);
+    CHECK(motor_pwm_level(0, 0) == 0);
+
+    // The outputs follow the trimmed mapping; the logical speeds do not change
+    control_loop_post(CMD_FWD);
+    hold_ms(3000);
+    CHECK(wheels[0].speed == SPEED_SCALE && wheels[1].speed == SPEED_SCALE);
+    CHECK(hal_pwm_level(wheels[0].en_pin) == full);
+    CHECK(hal_pwm_level(wheels[1].en_pin) == full * 9 / 10);
+    reset_robot();
+    CHECK(motor_pwm_trim[1].trim == 1000 && motor_pwm_trim[0].deadband == 0);
+}
+
+// Ramps played by DMA: the CPU writes no levels while one plays, the samples come at the
+// pacer rate whatever the ticks do, and anything that retargets takes the outputs back
+static void check_pwm_ramp(void)
+{
+    reset_robot();
+    pwm_ramp_enabled = true;
+    uint16_t full = motor_pwm_timing.wrap + 1;
+
+    control_loop_post(CMD_FWD);
+    tick();
+    CHECK(pwm_ramp_playing() && pwm_ramp_stats.started == 1);
+    uint64_t cpu_writes = hal_counters.pwm_writes;
+    uint64_t first = hal_trace_count();
+
+    int max_off = 0;
+    int prev = 0;
+    bool monotonic = true;
+    bool quiet = true;
+    for (int i = 0; i < 3 * CONTROL_LOOP_HZ; i++)
+    {
+        if (i % (HEARTBEAT_MS * CONTROL_LOOP_HZ / 1000) == 0)
+            control_loop_post(CMD_HEARTBEAT);
+        // A late tick does not delay the samples
+        hal_shim_advance_us(i == 100 ? 7000 : 0);
+        tick();
+        int level = hal_pwm_level(wheels[0].en_pin);
+        int off = abs(level - motor_pwm_level(0, wheels[0].duty));
+        if (off > max_off)
+            max_off = off;
+        monotonic &= level >= prev;
+        prev = level;
+        quiet &= !pwm_ramp_owns_outputs() || hal_counters.pwm_writes == cpu_writes;
+    }
+    CHECK(quiet);
+    CHECK(monotonic && max_off <= full / 200);
+    CHECK(hal_counters.dma_transfers > 0);
+
+    // Every wheel on each pacer wrap, PWM_RAMP_HZ apart
+    uint64_t prev_us = 0;
+    int wraps = 0;
+    bool paced = true;
+    for (uint64_t seq = first; seq < hal_trace_count(); seq++)
+    {
+        const HalTraceEntry *e = hal_trace_at(seq);
+        if (e->kind != HAL_PWM_CC || e->pin != pwm_gpio_to_slice_num(wheels[0].en_pin))
+            continue;
+        if (wraps++ > 0)
+            paced &= abs((int)(e->t_us - prev_us) - 1000000 / PWM_RAMP_HZ) <= 1;
+        prev_us = e->t_us;
+    }
+    CHECK(paced && wraps > 2 * PWM_RAMP_HZ);
+
+    // Settled: the ramp's last sample is full duty, and the loop goes on from there
+    hold_ms(1000);
+    CHECK(!pwm_ramp_playing() && !pwm_ramp_owns_outputs() && pwm_ramp_stats.completed == 1);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == full);
+    CHECK(hal_counters.pwm_writes > cpu_writes);
+
+    // A trim change after the ramp reaches the output
+    CHECK(motor_pwm_set_trim(1, 900, 0));
+    tick();
+    CHECK(hal_pwm_level(wheels[1].en_pin) == full * 9 / 10);
+    CHECK(motor_pwm_set_trim(1, 1000, 0));
+    tick();
+
+    // A reversal goes through zero, which needs the direction pins: CPU path
+    control_loop_post(CMD_BWD);
+    tick();
+    CHECK(pwm_ramp_stats.fallbacks == 1 && !pwm_ramp_owns_outputs());
+    CHECK(hal_counters.pwm_writes > cpu_writes);
+    hold_ms(500);
+
+    // STOP mid-ramp cuts the DMA off and zeroes the outputs in the same tick
+    control_loop_post(CMD_STOP);
+    tick();
+    control_loop_post(CMD_FWD);
+    hold_ms(500);
+    CHECK(pwm_ramp_playing());
+    uint32_t aborted = pwm_ramp_stats.aborted;
+    control_loop_post(CMD_STOP);
+    tick();
+    CHECK(pwm_ramp_stats.aborted == aborted + 1 && !pwm_ramp_playing());
+    hal_shim_advance_us(100000);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == 0);
+
+    // With S-curves, which integrate differently at the pacer's and the loop's rates: the
+    // playback and the profile the loop takes over end at the same duty, and the CPU's
+    // first write keeps it
+    const MotionLimits configured = motion_limits;
+    motion_limits.shape = MOTION_SCURVE;
+    CHECK(control_loop_post_drive(600, 0));
+    tick();
+    CHECK(pwm_ramp_playing());
+    while (pwm_ramp_playing())
+        hal_shim_advance_us(1000);
+    uint16_t last[NUM_OF_WHEELS];
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        last[i] = hal_pwm_level(wheels[i].en_pin);
+    tick();
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        CHECK(wheels[i].profile.velocity == wheels[i].profile.target);
+        CHECK(hal_pwm_level(wheels[i].en_pin) == last[i]);
+        CHECK(last[i] == motor_pwm_level(i, wheels[i].duty) && wheels[i].speed == 600);
+    }
+    motion_limits = configured;
+
+    pwm_ramp_enabled = false;
+    reset_robot();
+}
+
+// The speed loop against the simulated motors: one wheel under load falls behind open
+// loop and keeps up closed loop, and the counts show up in the status
+static void check_speed_control(void)
+{
+    char status[JSON_BUFFER_SIZE];
+    float open_loop[NUM_OF_WHEELS];
+
+    motor_plant_attach(true);
+    for (int closed = 0; closed <= 1; closed++)
+    {
+        reset_robot();
+        motor_plant[0].load = 0.3f;
+        for (int i = 1; i < NUM_OF_WHEELS; i++)
+            motor_plant[i].load = 0.05f;
+        speed_control_enabled = closed;
+
+        control_loop_post_drive(600, 0);
+        hold_ms(4000);
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+        {
+            if (!closed)
+                open_loop[i] = wheel_speeds[i].measured;
+            else
+                CHECK(fabsf(wheel_speeds[i].measured - 0.6f) < 0.03f &&
+                      fabsf(motor_plant_speed(i) - 0.6f) < 0.02f);
+        }
+    }
+    CHECK(open_loop[1] - open_loop[0] > 0.2f && fabsf(open_loop[1] - 0.55f) < 0.03f);
+    // The loaded wheel gets more duty than the others, within full scale
+    CHECK(wheels[0].duty > wheels[1].duty + DUTY_ONE / 5 && wheels[0].duty <= DUTY_ONE);
+    CHECK(wheels[0].speed == wheels[1].speed); // the command is unchanged
+
+    int len = http_control_format_status(status, sizeof(status), CMD_DRIVE);
+    CHECK(len > 0 && strstr(status, ", \"encoders\":[") != NULL);
+    char counts[64] = "[";
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        snprintf(counts + strlen(counts), sizeof(counts) - strlen(counts), "%ld%s",
+                 (long)wheel_speeds[i].count, i + 1 < NUM_OF_WHEELS ? "," : "]}");
+    CHECK(strstr(status, counts) != NULL && wheel_speeds[0].count > ENCODER_FULL_SPEED_CPS);
+
+    // STOP: no duty, and nothing wound up for the next command
+    control_loop_post(CMD_STOP);
+    tick();
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(wheels[i].duty == 0 && wheel_speeds[i].integral == 0.0f &&
+              hal_pwm_level(wheels[i].en_pin) == 0);
+
+    // Backward works the same way, mirrored
+    control_loop_post_drive(-600, 0);
+    hold_ms(4000);
+    CHECK(fabsf(wheel_speeds[0].measured + 0.6f) < 0.03f && wheels[0].duty < -DUTY_ONE * 6 / 10);
+
+    speed_control_enabled = false;
+    motor_plant_attach(false);
+    reset_robot();
+    CHECK(http_control_format_status(status, sizeof(status), CMD_NONE) > 0 &&
+          strstr(status, "encoders") == NULL);
+}
+
+// Velocity limits hold for both shapes, and the ramp lands on the target without overshoot
+static void check_motion_profile(void)
+{
+    const float dt = 1.0f / CONTROL_LOOP_HZ;
+    MotionLimits trapezoid = {MOTION_TRAPEZOIDAL, 0.5f, 1.0f, 2.0f};
+    MotionLimits scurve = {MOTION_SCURVE, 0.5f, 1.0f, 2.0f};
+    MotionProfile p;
+
+    motion_profile_reset(&p);
+    motion_profile_set_target(&p, 1.0f);
+    for (int i = 0; i < CONTROL_LOOP_HZ; i++)
+        motion_profile_step(&p, &trapezoid, dt);
+    CHECK(p.velocity > 0.499f && p.velocity < 0.501f);
+    for (int i = 0; i <= CONTROL_LOOP_HZ; i++)
+        motion_profile_step(&p, &trapezoid, dt);
+    CHECK(p.velocity == 1.0f && p.accel == 0.0f);
+
+    // Reversal: slows at the decel limit through zero, then speeds up at the accel limit
+    motion_profile_set_target(&p, -1.0f);
+    for (int i = 0; i < CONTROL_LOOP_HZ; i++)
+        motion_profile_step(&p, &trapezoid, dt);
+    CHECK(p.velocity > -0.001f && p.velocity < 0.001f);
+    for (int i = 0; i < CONTROL_LOOP_HZ; i++)
+        motion_profile_step(&p, &trapezoid, dt);
+    CHECK(p.velocity < -0.49f && p.velocity > -0.51f);
+
+    motion_profile_reset(&p);
+    motion_profile_set_target(&p, 1.0f);
+    float prev_v = 0.0f, prev_a = 0.0f;
+    bool within_limits = true;
+    int steps = 0;
+    while (p.velocity != 1.0f && steps < 10 * CONTROL_LOOP_HZ)
+    {
+        motion_profile_step(&p, &scurve, dt);
+        if (p.velocity < prev_v || p.velocity > 1.0f || fabsf(p.accel) > 0.5f + 1e-6f)
+            within_limits = false;
+        if (p.accel != 0.0f && fabsf(p.accel - prev_a) > 2.0f * dt + 1e-6f)
+            within_limits = false;
+        prev_v = p.velocity;
+        prev_a = p.accel;
+        steps++;
+    }
+    CHECK(within_limits);
+    // 2 s at full accel plus the jerk ramps in and out
+    CHECK(steps > 2 * CONTROL_LOOP_HZ && steps < 3 * CONTROL_LOOP_HZ);
+
+    // Short moves never reach the accel limit and still stop on the target
+    motion_profile_reset(&p);
+    motion_profile_set_target(&p, 0.05f);
+    for (int i = 0; i < CONTROL_LOOP_HZ; i++)
+        motion_profile_step(&p, &scurve, dt);
+    CHECK(p.velocity == 0.05f && p.accel == 0.0f);
+}
+
+static void check_acceleration(void)
+{
+    reset_robot();
+    CHECK(send("FWD") > 0);
+    CHECK(wheels[0].profile.velocity > 0.0f); // the S-curve starts gently
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(wheel_forward(i));
+
+    // The ramp depends on time, not on how often the button repeats
+    reset_robot();
+    hold("FWD", 300, 1200);
+    int slow_polls = wheels[0].speed;
+    reset_robot();
+    hold("FWD", 50, 1200);
+    CHECK(wheels[0].speed == slow_polls);
+    CHECK(slow_polls > 0 && slow_polls < SPEED_SCALE / 2);
+
+    // Per tick duty steps stay within the accel limit
+    reset_robot();
+    int prev = 0, max_step = 0;
+    send("FWD");
+    for (int i = 0; i < 4 * CONTROL_LOOP_HZ; i++)
+    {
+        if (i % (HEARTBEAT_MS * CONTROL_LOOP_HZ / 1000) == 0)
+            control_loop_post(CMD_HEARTBEAT);
+        tick();
+        if (wheels[0].speed - prev > max_step)
+            max_step = wheels[0].speed - prev;
+        prev = wheels[0].speed;
+    }
+    CHECK(max_step <= (int)(MOTION_MAX_ACCEL * SPEED_SCALE / CONTROL_LOOP_HZ) + 1);
+    CHECK(vehicle_speed == MAX_VEHICLE_SPEED);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == motor_pwm_timing.wrap + 1);
+}
+
+static void check_release_and_stop(void)
+{
+    reset_robot();
+    hold("BWD", 300, 3000);
+    int full = vehicle_speed;
+    CHECK(full > 5);
+
+    // Releasing ramps down at the decel limit, keeping the direction until the wheels stop
+    send("NON");
+    run_ms(500);
+    CHECK(vehicle_speed > 0 && vehicle_speed < full);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(wheel_backward(i));
+    run_ms(2000);
+    CHECK(vehicle_speed == 0);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == 0);
+
+    // STOP does not ramp
+    hold("FWD", 300, 3000);
+    CHECK(vehicle_speed > 5);
+    send("STP");
+    CHECK(vehicle_speed == 0);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == 0);
+}
+
+static void check_lease(void)
+{
+    // One command, then heartbeats: the wheels keep accelerating as long as they come
+    reset_robot();
+    uint32_t beats = control_loop_stats.heartbeats;
+    uint32_t expired = control_loop_stats.lease_expired;
+    send_as(3, "FWD");
+    run_ms(900);
+    CHECK(last_command == CMD_FWD);
+    for (int t = 0; t < 3000; t += 300)
+    {
+        send_as(3, "HBT");
+        run_ms(300);
+    }
+    CHECK(last_command == CMD_FWD && vehicle_speed > 5);
+    CHECK(control_loop_stats.heartbeats - beats == 10 && control_loop_stats.lease_expired - expired == 0);
+    CHECK(session_is_driver(SESSION_HTTP, 3, to_ms_since_boot(get_absolute_time())));
+
+    // Another page's heartbeats are not forwarded and do not keep the wheels going
+    for (int t = 0; t < COMMAND_LEASE_MS - 600; t += 300)
+    {
+        send_as(4, "HBT");
+        run_ms(300);
+    }
+    CHECK(last_command == CMD_FWD && control_loop_stats.heartbeats - beats == 10);
+
+    // When they stop, the loop releases the command by itself and the wheels ramp down
+    run_ms(300);
+    CHECK(last_command == CMD_NONE && control_loop_stats.lease_expired - expired == 1);
+    CHECK(vehicle_speed > 0);
+    run_ms(1500);
+    CHECK(vehicle_speed == 0 && control_loop_stats.lease_expired - expired == 1);
+
+    // Drive vectors are held the same way; a heartbeat alone never starts anything
+    httpd_shim_get("/drive.cgi?throttle=-400&turn=0&id=3", body, sizeof(body));
+    run_ms(COMMAND_LEASE_MS);
+    CHECK(last_command == CMD_DRIVE);
+    tick();
+    CHECK(last_command == CMD_NONE && control_loop_stats.lease_expired - expired == 2);
+    run_ms(1500);
+    send_as(5, "HBT");
+    run_ms(300);
+    CHECK(last_command == CMD_NONE && vehicle_speed == 0);
+    CHECK(!session_is_driver(SESSION_HTTP, 5, to_ms_since_boot(get_absolute_time())));
+}
+
+static void check_turns(void)
+{
+    reset_robot();
+    uint64_t first = hal_trace_count();
+    send("LFT");
+    // all direction pins change in one write, so IN1/IN2 never disagree between wheels
+    CHECK(hal_trace_count() - first == 1 + NUM_OF_WHEELS);
+    CHECK(hal_trace_at(first)->kind == HAL_GPIO_PUT_MASKED);
+    // right side backwards, left side forwards
+    CHECK(side_backward(0) && side_forward(1));
+
+    // Reversing every wheel only flips the pins once it has slowed through zero
+    hold("LFT", 300, 600);
+    send("RGT");
+    CHECK(side_backward(0));
+    hold("RGT", 300, 3000);
+    CHECK(side_forward(0) && side_backward(1));
+
+    // Soft turns run the inner side at half speed
+    reset_robot();
+    hold("FLT", 300, 4200);
+    CHECK(side_speed(1, SPEED_SCALE) && side_speed(0, SPEED_SCALE / 2));
+}
+
+// The mixing table of the layout the checks are built for (robot_check_* for the others)
+static void check_drivetrain(void)
+{
+    // The discrete commands are drive vectors: FLT is 3/4 throttle with 1/4 turn
+    reset_robot();
+    control_loop_post_drive(750, -250);
+    hold_ms(4200);
+    CHECK(side_speed(1, SPEED_SCALE) && side_speed(0, SPEED_SCALE / 2));
+
+    CHECK(vehicle_is_movement(CMD_FWD) && !vehicle_is_movement(CMD_STOP));
+    CHECK(!vehicle_is_movement(CMD_DRIVE) && !vehicle_is_movement(CMD_HEARTBEAT));
+    CHECK(vehicle_is_movement(CMD_SLT) == DRIVETRAIN_HAS_STRAFE);
+    CHECK(get_command_enum("SRT") == (DRIVETRAIN_HAS_STRAFE ? CMD_SRT : CMD_NONE));
+
+    reset_robot();
+    hold("SRT", 300, 4200);
+#if DRIVETRAIN_HAS_STRAFE
+    // Front left and back right forward, the other diagonal backward
+    CHECK(last_command == CMD_SRT && vehicle_speed == MAX_VEHICLE_SPEED);
+    CHECK(wheels[WHEEL_FRONT_LEFT].speed == SPEED_SCALE && wheel_forward(WHEEL_FRONT_LEFT));
+    CHECK(wheels[WHEEL_BACK_RIGHT].speed == SPEED_SCALE && wheel_forward(WHEEL_BACK_RIGHT));
+    CHECK(wheels[WHEEL_FRONT_RIGHT].speed == -SPEED_SCALE && wheel_backward(WHEEL_FRONT_RIGHT));
+    CHECK(wheels[WHEEL_BACK_LEFT].speed == -SPEED_SCALE && wheel_backward(WHEEL_BACK_LEFT));
+    hold("SLT", 300, 4200);
+    CHECK(wheels[WHEEL_FRONT_RIGHT].speed == SPEED_SCALE && wheel_forward(WHEEL_FRONT_RIGHT));
+    CHECK(wheels[WHEEL_FRONT_LEFT].speed == -SPEED_SCALE && wheel_backward(WHEEL_FRONT_LEFT));
+#else
+    // Not a command on a chassis that cannot strafe
+    CHECK(last_command == CMD_NONE && vehicle_speed == 0);
+#endif
+    reset_robot();
+}
+
+static void check_response(void)
+{
+    reset_robot();
+    hold("FWD", 300, 1200);
+    char expected[JSON_BUFFER_SIZE];
+    // the reply is built before the control loop has applied this request's command
+    snprintf(expected, sizeof(expected), "{\"status\":1, \"command\":\"2\", \"vehicle_speed\":\"%d\"}",
+             vehicle_speed);
+    int len = send("FWD");
+    CHECK(len > 0);
+    body[len > 0 ? len : 0] = '\0';
+    CHECK(strcmp(body, expected) == 0);
+
+    // unknown parameters and values are treated as NONE
+    CHECK(httpd_shim_get("/control.cgi?foo=bar", body, sizeof(body)) > 0);
+    tick();
+    CHECK(last_command == CMD_NONE);
+    send("FWD");
+    CHECK(httpd_shim_get("/control.cgi?command=XYZ", body, sizeof(body)) > 0);
+    tick();
+    CHECK(last_command == CMD_NONE);
+    CHECK(httpd_shim_get("/missing", body, sizeof(body)) == HTTPD_SHIM_NOT_FOUND);
+
+    // Overlapping requests each keep their own reply until httpd closes it; the last free
+    // slot is kept for a STOP
+    struct fs_file files[HTTP_RESPONSE_SLOTS + 1];
+    char uri[64];
+    CHECK(httpd_shim_open("/control.cgi?command=FWD&id=1", &files[0]));
+    tick();
+    CHECK(httpd_shim_open("/control.cgi?command=STP&id=2", &files[1]));
+    CHECK(strncmp(files[0].data, "{\"status\":1, \"command\":\"2\"", 26) == 0);
+    CHECK(strncmp(files[1].data, "{\"status\":1, \"command\":\"8\"", 26) == 0);
+    CHECK(files[0].len == (int)strlen(files[0].data));
+    for (int i = 2; i < HTTP_RESPONSE_SLOTS - 1; i++)
+    {
+        snprintf(uri, sizeof(uri), "/control.cgi?command=NON&id=%d", i + 1);
+        CHECK(httpd_shim_open(uri, &files[i]));
+    }
+    uint32_t exhausted = http_control_stats.slots_exhausted;
+    CHECK(!httpd_shim_open("/control.cgi?command=NON&id=9", &files[HTTP_RESPONSE_SLOTS]));
+    CHECK(http_control_stats.slots_exhausted == exhausted + 1);
+    CHECK(httpd_shim_open("/control.cgi?command=STP&id=9", &files[HTTP_RESPONSE_SLOTS - 1]));
+    CHECK(!httpd_shim_open("/control.cgi?command=STP&id=10", &files[HTTP_RESPONSE_SLOTS]));
+    fs_close_custom(&files[0]);
+    CHECK(!httpd_shim_open("/control.cgi?command=NON&id=11", &files[0]));
+    CHECK(httpd_shim_open("/control.cgi?command=STP&id=9", &files[0]));
+    for (int i = 0; i < HTTP_RESPONSE_SLOTS; i++)
+        fs_close_custom(&files[i]);
+    tick();
+
+    // Formatting never overruns, and reports what did not fit
+    char small[40];
+    CHECK(http_control_format_status(small, sizeof(small), CMD_FWD) == -1);
+    CHECK(http_control_format_status(body, sizeof(body), -12345) > 0);
+    CHECK(strstr(body, "\"command\":\"-12345\"") != NULL);
+}
+
+static void check_telemetry(void)
+{
+    reset_robot();
+    send("FWD"); // picked up by the next tick, one period after it was posted
+    CHECK(telemetry.requests == 1 && telemetry.parse_failures == 0);
+    CHECK(telemetry.cmd_to_pwm.count == 1 && telemetry.cmd_to_pwm.max_us == 1000000 / CONTROL_LOOP_HZ);
+    CHECK(telemetry.cmd_to_pwm.buckets[13] == 1); // 4096..8191 us
+    CHECK(telemetry.tick.count == 1 && telemetry.cgi.count == 1 && telemetry.fs_open.count == 1);
+
+    send("NON");
+    send("XYZ");
+    send("");
+    CHECK(httpd_shim_get("/drive.cgi?throttle=100", body, sizeof(body)) > 0);
+    CHECK(telemetry.requests == 5 && telemetry.parse_failures == 3);
+
+    // Requests per second over the last full second, at 20 per second
+    for (int i = 0; i < 60; i++)
+    {
+        send("FWD");
+        run_ms(45);
+    }
+    CHECK(telemetry.requests_per_s == 20);
+
+    static char stats[STATS_BUFFER_SIZE];
+    int len = httpd_shim_get("/stats", stats, sizeof(stats) - 1);
+    CHECK(len > 0);
+    stats[len > 0 ? len : 0] = '\0';
+    CHECK(strncmp(stats, "{\"uptime_ms\":", 13) == 0 && stats[len - 1] == '}');
+    CHECK(strstr(stats, "\"requests\":65,") != NULL);
+    CHECK(strstr(stats, "\"parse_failures\":3,") != NULL);
+    CHECK(strstr(stats, "\"cmd_to_pwm\":{\"count\":") != NULL);
+    CHECK(strstr(stats, "\"lwip\":{\"mem_used\":0,") != NULL);
+    CHECK(strstr(stats, "\"wifi\":{\"state\":\"idle\",") != NULL);
+    CHECK(strstr(stats, "\"pwm\":{\"hz\":20000,\"wrap\":7499,\"div\":1,") != NULL);
+
+    // One /stats reply at a time; fetching it is not a control request
+    struct fs_file file;
+    CHECK(httpd_shim_open("/stats", &file));
+    CHECK(httpd_shim_get("/stats", stats, sizeof(stats)) == HTTPD_SHIM_NOT_FOUND);
+    fs_close_custom(&file);
+    CHECK(httpd_shim_get("/stats", stats, sizeof(stats)) > 0);
+    CHECK(telemetry.requests == 65);
+
+    // A buffer too small is reported rather than sent truncated
+    TelemetryLwip lwip = {0};
+    CHECK(telemetry_format_json(stats, 200, &lwip, 0) == -1);
+
+    // Samples beyond the last bucket land in it
+    LatencyHistogram h = {0};
+    telemetry_record(&h, 0);
+    telemetry_record(&h, 1);
+    telemetry_record(&h, 3);
+    telemetry_record(&h, UINT32_MAX);
+    CHECK(h.buckets[0] == 1 && h.buckets[1] == 1 && h.buckets[2] == 1);
+    CHECK(h.buckets[TELEMETRY_BUCKETS - 1] == 1 && h.max_us == UINT32_MAX && h.count == 4);
+}
+
+// The header of a generated content file, or NULL; *body points past it
+static const char *content_header(const char *uri, char *buf, int len, const char **body,
+                                  int *body_len)
+{
+    int n = httpd_shim_get(uri, buf, len - 1);
+    if (n <= 0)
+        return NULL;
+    buf[n] = '\0';
+    char *end = strstr(buf, "\r\n\r\n");
+    if (end == NULL)
+        return NULL;
+    *body = end + 4;
+    *body_len = n - (int)(end + 4 - buf);
+    end[2] = '\0';
+    return buf;
+}
+
+static void check_content(void)
+{
+    static char page[4096];
+    const char *header, *body;
+    int body_len;
+    char length[32];
+
+    // The index page: gzip, revalidated on every load, and no longer pulling in jQuery
+    header = content_header("/", page, sizeof(page), &body, &body_len);
+    CHECK(header != NULL);
+    if (header == NULL)
+        return;
+    CHECK(strncmp(header, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    CHECK(strstr(header, "Content-Type: text/html\r\n") != NULL);
+    CHECK(strstr(header, "Content-Encoding: gzip\r\n") != NULL);
+    CHECK(strstr(header, "Cache-Control: no-cache\r\n") != NULL);
+    CHECK(strstr(header, "ETag: \"") != NULL);
+    snprintf(length, sizeof(length), "Content-Length: %d\r\n", body_len);
+    CHECK(strstr(header, length) != NULL);
+    CHECK((uint8_t)body[0] == 0x1f && (uint8_t)body[1] == 0x8b);
+
+    // The assets under their content-hashed names are cached for good
+    int assets = 0;
+    for (const struct fsdata_file *f = httpd_shim_fs_root; f != NULL; f = f->next)
+    {
+        const char *name = (const char *)f->name;
+        CHECK(f->flags & FS_FILE_FLAGS_HEADER_INCLUDED);
+        CHECK(strstr(name, "jquery") == NULL);
+        if (strstr(name, ".html") != NULL)
+            continue;
+        assets++;
+        header = content_header(name, page, sizeof(page), &body, &body_len);
+        CHECK(header != NULL && strncmp(name, "/app.", 5) == 0 && strlen(name) > 12);
+        if (header == NULL)
+            continue;
+        CHECK(strstr(header, "Cache-Control: public, max-age=31536000, immutable\r\n") != NULL);
+        CHECK(strstr(header, "Content-Encoding: gzip\r\n") != NULL);
+        snprintf(length, sizeof(length), "Content-Length: %d\r\n", body_len);
+        CHECK(strstr(header, length) != NULL);
+    }
+    CHECK(assets == 2 && httpd_shim_fs_files == 4);
+    CHECK(httpd_shim_get("/app.js", page, sizeof(page)) == HTTPD_SHIM_NOT_FOUND);
+
+    header = content_header("/404.html", page, sizeof(page), &body, &body_len);
+    CHECK(header != NULL && strncmp(header, "HTTP/1.0 404 ", 13) == 0);
+}
+
+static int stream_wakeups[EVENT_STREAM_MAX_CLIENTS];
+
+static void stream_wake(void *arg)
+{
+    stream_wakeups[(int *)arg - stream_wakeups]++;
+}
+
+// Read what a stream has to send until it has to wait, in chunks of at most count bytes
+static int read_stream(struct fs_file *file, char *buf, int len, int count)
+{
+    int total = 0, n;
+    while (len - total > 1 &&
+           (n = fs_read_async_custom(file, buf + total, count < len - total - 1 ? count : len - total - 1,
+                                     NULL, NULL)) > 0)
+        total += n;
+    buf[total] = '\0';
+    return total;
+}
+
+static void check_event_stream(void)
+{
+    struct fs_file files[EVENT_STREAM_MAX_CLIENTS + 1];
+    char buf[512];
+
+    reset_robot();
+    tick();
+    memset(stream_wakeups, 0, sizeof(stream_wakeups));
+    CHECK(!httpd_shim_run_timers()); // nothing runs without viewers
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+        CHECK(httpd_shim_open("/events", &files[i]));
+    CHECK(!httpd_shim_open("/events", &files[EVENT_STREAM_MAX_CLIENTS]));
+    CHECK(event_stream_stats.rejected == 1 && event_stream_clients() == EVENT_STREAM_MAX_CLIENTS);
+
+    // The header, then the current state, then nothing until the next tick
+    CHECK(files[0].data == NULL && (files[0].flags & FS_FILE_FLAGS_HEADER_INCLUDED));
+    read_stream(&files[0], buf, sizeof(buf), 512);
+    CHECK(strncmp(buf, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    CHECK(strstr(buf, "Content-Type: text/event-stream\r\n") != NULL);
+    CHECK(strstr(buf, "\r\n\r\nretry: 1000\n\ndata: {\"seq\":1,\"command\":9,") != NULL);
+    char idle[64] = "\"duty\":[0";
+    for (int i = 1; i < NUM_OF_WHEELS; i++)
+        strcat(idle, ",0");
+    strcat(idle, DRIVETRAIN_HAS_STRAFE ? "],\"script\":0,\"strafe\":1}\n\n" : "],\"script\":0}\n\n");
+    CHECK(strstr(buf, idle) != NULL);
+    CHECK(fs_read_async_custom(&files[0], buf, sizeof(buf), NULL, NULL) == FS_READ_DELAYED);
+    CHECK(!fs_canread_custom(&files[0]));
+    for (int i = 1; i < EVENT_STREAM_MAX_CLIENTS; i++)
+        read_stream(&files[i], buf, sizeof(buf), 7); // httpd may read in small pieces
+    CHECK(strstr(buf, "data: {\"seq\":1,") != NULL && buf[strlen(buf) - 1] == '\n');
+
+    // One event per period, formatted once and pushed to every waiting viewer
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+        CHECK(fs_wait_read_custom(&files[i], stream_wake, &stream_wakeups[i]));
+    send("FWD");
+    run_ms(1000 / EVENT_STREAM_HZ);
+    CHECK(httpd_shim_run_timers() == 1);
+    CHECK(event_stream_stats.events == 2 && event_stream_stats.pushes == EVENT_STREAM_MAX_CLIENTS);
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+    {
+        CHECK(stream_wakeups[i] == 1 && fs_canread_custom(&files[i]));
+        read_stream(&files[i], buf, sizeof(buf), 512);
+        CHECK(strstr(buf, "data: {\"seq\":2,\"command\":2,") == buf);
+    }
+    char duty[40];
+    snprintf(duty, sizeof(duty), "\"duty\":[%d,%d", wheels[0].speed, wheels[1].speed);
+    CHECK(wheels[0].speed > 0 && strstr(buf, duty) != NULL);
+
+    // A viewer that is slow to read skips to the latest state rather than queueing
+    run_ms(3000 / EVENT_STREAM_HZ);
+    CHECK(httpd_shim_run_timers() == 1);
+    run_ms(1000 / EVENT_STREAM_HZ);
+    CHECK(httpd_shim_run_timers() == 1);
+    read_stream(&files[0], buf, sizeof(buf), 512);
+    CHECK(strstr(buf, "data: {\"seq\":4,") == buf && strstr(buf + 1, "data:") == NULL);
+
+    // Other custom files are always ready; the last viewer leaving stops the timer
+    struct fs_file reply;
+    CHECK(httpd_shim_open("/control.cgi?command=NON", &reply) && fs_canread_custom(&reply));
+    fs_close_custom(&reply);
+    for (int i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+        fs_close_custom(&files[i]);
+    CHECK(event_stream_clients() == 0);
+    run_ms(1000);
+    CHECK(!httpd_shim_run_timers());
+    CHECK(httpd_shim_open("/events", &files[0]));
+    fs_close_custom(&files[0]);
+}
+
+static void check_script_parse(void)
+{
+    ScriptStep steps[SCRIPT_MAX_STEPS];
+    int count = 0;
+    ScriptResult r;
+
+    r = script_parse("FWD:2000:6,RGT:500,NON:250,STP", steps, &count);
+    CHECK(r.error == SCRIPT_OK && r.steps == 4 && count == 4 && r.duration_ms == 2750);
+    CHECK(steps[0].type == CMD_FWD && steps[0].scale == 600 && steps[0].ticks == 2 * CONTROL_LOOP_HZ);
+    CHECK(steps[1].type == CMD_RGT && steps[1].scale == DRIVE_SCALE);
+    CHECK(steps[2].type == CMD_NONE && steps[3].type == CMD_STOP && steps[3].ticks == 0);
+
+    // Errors name the first bad step, counting from 1
+    r = script_parse("", steps, &count);
+    CHECK(r.error == SCRIPT_EMPTY);
+    r = script_parse("FWD:100,XYZ:100", steps, &count);
+    CHECK(r.error == SCRIPT_BAD_COMMAND && r.steps == 2);
+    CHECK(script_parse("FWD", steps, &count).error == SCRIPT_BAD_DURATION);
+    CHECK(script_parse("FWD:", steps, &count).error == SCRIPT_BAD_DURATION);
+    CHECK(script_parse("FWD:60001", steps, &count).error == SCRIPT_BAD_DURATION);
+    CHECK(script_parse("FWD:99999999999", steps, &count).error == SCRIPT_BAD_DURATION);
+    CHECK(script_parse("FWD:100:0", steps, &count).error == SCRIPT_BAD_SPEED);
+    CHECK(script_parse("FWD:100:11", steps, &count).error == SCRIPT_BAD_SPEED);
+    CHECK(script_parse("NON:100:5", steps, &count).error == SCRIPT_BAD_SPEED);
+    CHECK(script_parse("FWD:100x", steps, &count).error == SCRIPT_BAD_COMMAND);
+    CHECK(script_parse("FWD:100,", steps, &count).error == SCRIPT_BAD_COMMAND);
+    CHECK(script_parse("FW", steps, &count).error == SCRIPT_BAD_COMMAND);
+    CHECK(script_parse("DRV:100", steps, &count).error == SCRIPT_BAD_COMMAND);
+
+    char text[SCRIPT_MAX_STEPS * 8 + 16] = "";
+    for (int i = 0; i <= SCRIPT_MAX_STEPS; i++)
+        strcat(text, i ? ",FWD:10" : "FWD:10");
+    r = script_parse(text, steps, &count);
+    CHECK(r.error == SCRIPT_TOO_MANY_STEPS && r.steps == SCRIPT_MAX_STEPS + 1);
+    text[strlen(text) - 7] = '\0';
+    CHECK(script_parse(text, steps, &count).error == SCRIPT_OK && count == SCRIPT_MAX_STEPS);
+}
+
+static void check_script(void)
+{
+    char reply[JSON_BUFFER_SIZE];
+    int len;
+
+    // One request drives the whole maneuver; the page's idle polls do not interrupt it
+    reset_robot();
+    len = httpd_shim_get("/script.cgi?steps=FWD:2000:5,RGT:500,STP&id=7", reply, sizeof(reply) - 1);
+    CHECK(len > 0);
+    reply[len > 0 ? len : 0] = '\0';
+    CHECK(strcmp(reply, "{\"status\":1, \"steps\":3, \"duration_ms\":2500}") == 0);
+    tick();
+    CHECK(script_running() && script_current_step() == 1 && last_command == CMD_FWD);
+    for (int t = 0; t < 1800; t += 300)
+    {
+        send_as(7, "NON");
+        run_ms(300);
+    }
+    CHECK(script_current_step() == 1 && script_stats.ignored > 0);
+    CHECK(abs(wheels[0].speed - SPEED_SCALE / 2) <= 1 && wheels[1].speed == wheels[0].speed);
+    run_ms(200); // 2 s after the first tick
+    CHECK(script_current_step() == 2 && last_command == CMD_RGT);
+    run_ms(500);
+    CHECK(!script_running() && last_command == CMD_STOP && wheels[0].speed == 0);
+    CHECK(script_stats.started == 1 && script_stats.completed == 1 && script_stats.aborted == 0);
+
+    // Without a final STOP the wheels are released and ramp down
+    reset_robot();
+    CHECK(httpd_shim_get("/script.cgi?steps=BWD:300", reply, sizeof(reply)) > 0);
+    run_ms(300);
+    CHECK(script_running());
+    tick();
+    CHECK(!script_running() && last_command == CMD_NONE && wheels[0].speed < 0);
+
+    // A manual STOP aborts it at once
+    reset_robot();
+    CHECK(httpd_shim_get("/script.cgi?steps=FWD:5000,BWD:5000", reply, sizeof(reply)) > 0);
+    run_ms(1000);
+    send("STP");
+    CHECK(!script_running() && script_stats.aborted == 1 && wheels[0].speed == 0);
+    run_ms(6000);
+    CHECK(last_command == CMD_STOP && wheels[0].speed == 0);
+
+    // Invalid scripts are rejected before anything moves; other drivers keep their lease
+    reset_robot();
+    len = httpd_shim_get("/script.cgi?steps=FWD:100,JMP:100", reply, sizeof(reply) - 1);
+    reply[len > 0 ? len : 0] = '\0';
+    CHECK(strcmp(reply, "{\"status\":0, \"error\":\"bad_command\", \"step\":2}") == 0);
+    CHECK(httpd_shim_get("/script.cgi", reply, sizeof(reply)) > 0 && strstr(reply, "empty") != NULL);
+    send_as(1, "FWD");
+    len = httpd_shim_get("/script.cgi?steps=FWD:100&id=2", reply, sizeof(reply) - 1);
+    reply[len > 0 ? len : 0] = '\0';
+    CHECK(strstr(reply, "\"error\":\"denied\"") != NULL);
+    tick();
+    CHECK(!script_running() && script_stats.rejected == 2 && script_stats.started == 0);
+}
+
+// Body of a trace download, after the HTTP header
+static uint8_t *download_trace(uint8_t *buf, int size, int *len)
+{
+    int n = httpd_shim_get("/trace.bin", (char *)buf, size);
+    uint8_t *end = n > 0 ? (uint8_t *)strstr((char *)buf, "\r\n\r\n") : NULL;
+    if (end == NULL)
+    {
+        *len = 0;
+        return buf;
+    }
+    *len = n - (int)(end + 4 - buf);
+    return end + 4;
+}
+
+static void check_trace(void)
+{
+    int size = 512 + TRACE_HEADER_SIZE + TRACE_SIZE * TRACE_RECORD_SIZE;
+    uint8_t *buf = malloc(size);
+    ReplayResult r;
+    TraceHeader header;
+    TraceRecord rec;
+    int len;
+
+    // A session of buttons, drive vectors and a script replays to the same outputs
+    reset_robot();
+    hold("FWD", 300, 1200);
+    hold("NON", 300, 900);
+    httpd_shim_get("/drive.cgi?throttle=600&turn=-300", body, sizeof(body));
+    run_ms(700);
+    hold("BWD", 300, 600);
+    send("STP");
+    httpd_shim_get("/script.cgi?steps=FWD:300:4,LFT:200", body, sizeof(body));
+    run_ms(1500);
+    CHECK(trace_stats.recorded > 10 && trace_stats.lost == 0);
+
+    uint8_t *data = download_trace(buf, size, &len);
+    CHECK(trace_decode_header(data, len, &header));
+    CHECK(header.count == trace_stats.recorded && header.loop_hz == CONTROL_LOOP_HZ);
+    CHECK(len == TRACE_HEADER_SIZE + (int)header.count * TRACE_RECORD_SIZE);
+    trace_decode(data + TRACE_HEADER_SIZE, &rec);
+    CHECK(rec.type == CMD_FWD && (rec.flags & TRACE_AT_REST));
+    CHECK(replay_trace(data, len, 0, &r, NULL));
+    CHECK(r.records == header.count && r.compared == r.records && r.skipped == 0);
+    CHECK(r.mismatches == 0 && r.ticks > 3 * CONTROL_LOOP_HZ);
+
+    // A change in the outputs is caught, and so is a trace from another vehicle
+    data[TRACE_HEADER_SIZE + TRACE_RECORD_SIZE + 16] ^= 0x40;
+    CHECK(replay_trace(data, len, 0, &r, NULL) && r.mismatches == 1);
+    CHECK(replay_trace(buf, size, 0, &r, NULL) && r.mismatches == 1); // with its HTTP header
+    data[10] = NUM_OF_WHEELS + 1;
+    CHECK(!replay_trace(data, len, 0, &r, NULL));
+
+    // Recording pauses while a download is open; the replay resyncs once at rest again
+    reset_robot();
+    send("FWD");
+    struct fs_file file;
+    CHECK(httpd_shim_open("/trace.bin", &file) && file.is_custom_file);
+    CHECK(!httpd_shim_open("/trace.bin", &(struct fs_file){0}));
+    send("FWD");
+    send("NON");
+    fs_close_custom(&file);
+    CHECK(trace_stats.recorded == 1 && trace_stats.lost == 2);
+    send("NON");
+    run_ms(1000);
+    send("RGT");
+    data = download_trace(buf, size, &len);
+    CHECK(trace_decode_header(data, len, &header) && header.count == 3 && header.lost == 2);
+    trace_decode(data + TRACE_HEADER_SIZE + TRACE_RECORD_SIZE, &rec);
+    CHECK(rec.type == CMD_NONE && (rec.flags & TRACE_GAP) && !(rec.flags & TRACE_AT_REST));
+    CHECK(replay_trace(data, len, 0, &r, NULL));
+    CHECK(r.compared == 2 && r.skipped == 1 && r.mismatches == 0);
+    free(buf);
+}
+
+static void check_wifi(void)
+{
+    wifi_link_init();
+
+    // Boot: join at once, come up, and report when
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, 0) == WIFI_DO_CONNECT);
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, 10) == WIFI_DO_NOTHING);
+    CHECK(wifi_link_poll(WIFI_LINK_JOINING, 900) == WIFI_DO_NOTHING);
+    CHECK(wifi_link_poll(WIFI_LINK_UP, 1800) == WIFI_DO_NOTHING);
+    CHECK(wifi_link_state() == WIFI_CONNECTED && wifi_link_stats.first_up_ms == 1800);
+
+    // A dropped link is left and rejoined after the minimum backoff
+    CHECK(wifi_link_poll(WIFI_LINK_UP, 60000) == WIFI_DO_NOTHING);
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, 60020) == WIFI_DO_LEAVE);
+    CHECK(wifi_link_state() == WIFI_BACKOFF && wifi_link_stats.drops == 1);
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, 60020 + WIFI_BACKOFF_MIN_MS - 1) == WIFI_DO_NOTHING);
+    uint32_t now = 60020 + WIFI_BACKOFF_MIN_MS;
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, now) == WIFI_DO_CONNECT);
+
+    // Failed and timed-out joins back off exponentially, up to the maximum
+    uint32_t expected = WIFI_BACKOFF_MIN_MS;
+    for (int i = 0; i < 12; i++)
+    {
+        WifiLinkStatus link = i % 2 ? WIFI_LINK_FAILED : WIFI_LINK_JOINING;
+        uint32_t fail_at = link == WIFI_LINK_FAILED ? now + 100 : now + WIFI_CONNECT_TIMEOUT_MS;
+        CHECK(wifi_link_poll(link, fail_at - 1) == (link == WIFI_LINK_FAILED ? WIFI_DO_LEAVE
+                                                                            : WIFI_DO_NOTHING));
+        if (link == WIFI_LINK_JOINING)
+            CHECK(wifi_link_poll(link, fail_at) == WIFI_DO_LEAVE);
+        else
+            fail_at--;
+        CHECK(wifi_link_poll(WIFI_LINK_DOWN, fail_at + expected - 1) == WIFI_DO_NOTHING);
+        now = fail_at + expected;
+        CHECK(wifi_link_poll(WIFI_LINK_DOWN, now) == WIFI_DO_CONNECT);
+        expected = expected * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : expected * 2;
+    }
+    CHECK(expected == WIFI_BACKOFF_MAX_MS && wifi_link_stats.failures == 12);
+
+    // Coming up again resets the backoff; first_up_ms keeps the boot figure
+    CHECK(wifi_link_poll(WIFI_LINK_UP, now + 3000) == WIFI_DO_NOTHING);
+    CHECK(wifi_link_stats.connects == 2 && wifi_link_stats.first_up_ms == 1800);
+    CHECK(wifi_link_poll(WIFI_LINK_FAILED, now + 4000) == WIFI_DO_LEAVE);
+    CHECK(wifi_link_poll(WIFI_LINK_DOWN, now + 4000 + WIFI_BACKOFF_MIN_MS) == WIFI_DO_CONNECT);
+
+    // Time to the first command is reported with the other counters
+    reset_robot();
+    hal_shim_advance_us(2500000);
+    CHECK(telemetry.first_command_ms == 0);
+    send("FWD");
+    uint32_t first = telemetry.first_command_ms;
+    CHECK(first >= 2500 && first < 2600);
+    send("STP");
+    CHECK(telemetry.first_command_ms == first);
+}
+
+static void check_power(void)
+{
+    const uint32_t ms = 1000;
+
+    // Quiet for POWER_IDLE_AFTER_MS: power save, then parked, with longer main loop waits
+    reset_robot();
+    CHECK(power_mode() == POWER_ACTIVE && power_wait_ms() == EVENT_LOG_DRAIN_MS);
+    CHECK(power_poll((POWER_IDLE_AFTER_MS - 1) * ms, false) == POWER_ACTIVE);
+    CHECK(power_poll(POWER_IDLE_AFTER_MS * ms, false) == POWER_IDLE);
+    CHECK(power_wait_ms() == POWER_IDLE_WAIT_MS);
+    CHECK(power_poll((POWER_PARKED_AFTER_MS - 1) * ms, false) == POWER_IDLE);
+    CHECK(power_poll(POWER_PARKED_AFTER_MS * ms, false) == POWER_PARKED);
+    CHECK(power_wait_ms() == POWER_PARKED_WAIT_MS);
+    CHECK(power_stats.ms[POWER_ACTIVE] == POWER_IDLE_AFTER_MS &&
+          power_stats.ms[POWER_IDLE] == POWER_PARKED_AFTER_MS - POWER_IDLE_AFTER_MS);
+    CHECK(power_stats.entered[POWER_IDLE] == 1 && power_stats.polls == 4);
+
+    // The next command, from any transport, wakes it; the delay until the main loop has
+    // the radio back is the wake penalty
+    hal_shim_advance_us((uint64_t)POWER_PARKED_AFTER_MS * ms + 123456);
+    send("FWD");
+    CHECK(power_mode() == POWER_PARKED);
+    uint32_t now_us = time_us_32();
+    CHECK(power_poll(now_us + 7000, false) == POWER_ACTIVE);
+    CHECK(power_stats.wakes == 1 && telemetry.wake.count == 1);
+    CHECK(telemetry.wake.max_us == 7000 + 1000000 / CONTROL_LOOP_HZ);
+
+    // Moving wheels keep it active without any traffic
+    for (uint32_t t = 1; t <= 3 * POWER_IDLE_AFTER_MS / 1000; t++)
+        CHECK(power_poll(now_us + t * 1000 * ms, true) == POWER_ACTIVE);
+    CHECK(power_poll(now_us + (3 * POWER_IDLE_AFTER_MS + POWER_IDLE_AFTER_MS) * ms, false) ==
+          POWER_IDLE);
+    CHECK(power_stats.wakes == 1);
+
+    // The control loop is idle while the wheels are at rest and nothing holds them
+    reset_robot();
+    tick();
+    CHECK(control_loop_idle());
+    send("FWD");
+    CHECK(!control_loop_idle());
+    hold_ms(1000);
+    send("NON");
+    run_ms(100);
+    CHECK(!control_loop_idle()); // still ramping down
+    run_ms(5000);
+    CHECK(control_loop_idle() && wheels[0].speed == 0);
+    send("STP");
+    CHECK(control_loop_idle());
+    control_loop_post(CMD_HEARTBEAT);
+    tick();
+    CHECK(control_loop_idle()); // a lease with nothing to hold keeps nothing awake
+    send("LFT");
+    CHECK(!control_loop_idle());
+    send("STP");
+    CHECK(control_loop_idle()); // STOP resets the profiles, nothing is left to settle
+
+    static char stats[STATS_BUFFER_SIZE];
+    int len = httpd_shim_get("/stats", stats, sizeof(stats) - 1);
+    stats[len > 0 ? len : 0] = '\0';
+    CHECK(strstr(stats, "\"power\":{\"mode\":\"active\",") != NULL);
+    CHECK(strstr(stats, "\"wake\":{\"count\":") != NULL);
+}
+
+static void check_drive(void)
+{
+    int v;
+    CHECK(parse_drive_value("-250", 4, &v) && v == -250);
+    CHECK(parse_drive_value("99999", 5, &v) && v == DRIVE_SCALE);
+    CHECK(!parse_drive_value("", 0, &v) && !parse_drive_value("-", 1, &v));
+    CHECK(!parse_drive_value("12a", 3, &v) && !parse_drive_value("123456", 6, &v));
+
+    // Straight ahead at 60 %
+    reset_robot();
+    CHECK(httpd_shim_get("/drive.cgi?throttle=600&turn=0", body, sizeof(body)) > 0);
+    hold_ms(3000);
+    CHECK(last_command == CMD_DRIVE);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(wheels[i].speed == 600 && wheel_forward(i));
+
+    // Arc: the right side gets throttle + turn, the left side throttle - turn
+    CHECK(httpd_shim_get("/drive.cgi?throttle=500&turn=-200", body, sizeof(body)) > 0);
+    hold_ms(3000);
+    CHECK(side_speed(0, 300) && side_speed(1, 700));
+
+    // Over full scale both sides shrink together, keeping the ratio
+    control_loop_post_drive(DRIVE_SCALE, DRIVE_SCALE / 2);
+    hold_ms(3000);
+    CHECK(wheels[0].speed == SPEED_SCALE && wheels[1].speed == SPEED_SCALE / 3);
+
+    // Pure turn matches RGT
+    control_loop_post_drive(0, DRIVE_SCALE);
+    hold_ms(4000);
+    CHECK(wheels[0].speed == SPEED_SCALE && wheels[1].speed == -SPEED_SCALE);
+    CHECK(wheel_forward(0) && wheel_backward(1));
+
+    // A malformed vector is a NONE: ramp down
+    CHECK(httpd_shim_get("/drive.cgi?throttle=500", body, sizeof(body)) > 0);
+    run_ms(3000);
+    CHECK(last_command == CMD_NONE && vehicle_speed == 0);
+
+    // STOP still cuts a drive at once
+    control_loop_post_drive(-DRIVE_SCALE, 0);
+    run_ms(1000);
+    CHECK(wheels[0].speed < 0);
+    send("STP");
+    CHECK(vehicle_speed == 0);
+}
+
+// Typed parameters of a route, on one with every type, and the custom file lookup
+static void check_routes(void)
+{
+    static const RouteParam params[] = {
+        ROUTE_PARAM_ID,
+        {"gain", ROUTE_FLOAT, -2, 2},
+        {"speed", ROUTE_INT, -100, 100},
+        {"command", ROUTE_COMMAND},
+    };
+    static const Route route = {"/test.cgi", NULL, params, 4, NULL};
+    RouteArgs args;
+
+    char *names[] = {"speed", "gain", "id", "x", "command", "speed"};
+    char *values[] = {"-250", "0.25", "4294967295", "1", "STP", "5"};
+    http_route_parse(&route, 6, names, values, &args);
+    CHECK(args.valid == 0xf);
+    CHECK(args.values[0].u == 4294967295u && args.values[1].f == 0.25f);
+    CHECK(args.values[2].i == -100); // clamped, and the second speed ignored
+    CHECK(args.values[3].command == CMD_STOP);
+
+    // In parts, as the dispatcher does around admission control: the same in the end
+    RouteArgs part = {.valid = 0};
+    http_route_parse_some(&route, 1u << 0 | 1u << 3, 6, names, values, &part);
+    CHECK(part.valid == (1u << 0 | 1u << 3) && part.values[3].command == CMD_STOP);
+    http_route_parse_some(&route, 1u << 1 | 1u << 2, 6, names, values, &part);
+    CHECK(part.valid == 0xf && part.values[0].u == args.values[0].u);
+    CHECK(part.values[1].f == args.values[1].f && part.values[2].i == args.values[2].i);
+
+    static const struct
+    {
+        const char *value;
+        bool valid;
+        float f;
+    } floats[] = {
+        {"1", true, 1.0f},      {"-1.5", true, -1.5f}, {"0.000001", true, 0.000001f},
+        {"7.25", true, 2.0f},   {"-9", true, -2.0f},   {"1.", false, 0},
+        {".5", false, 0},       {"1e3", false, 0},     {"nan", false, 0},
+        {"0.1234567", false, 0}, {"", false, 0},       {"-", false, 0},
+    };
+    for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++)
+    {
+        char *name = "gain";
+        char *value = (char *)floats[i].value;
+        http_route_parse(&route, 1, &name, &value, &args);
+        CHECK(route_has(&args, 1) == floats[i].valid);
+        CHECK(!floats[i].valid || args.values[1].f == floats[i].f);
+    }
+
+    // Values not of the type leave the parameter out; a repeated bad one stays out too
+    char *bad_names[] = {"id", "speed", "command", "speed", NULL};
+    char *bad_values[] = {"4294967296", "12a", "NOPE", "50", "1"};
+    http_route_parse(&route, 5, bad_names, bad_values, &args);
+    CHECK(args.valid == 0);
+
+    // Custom files by their perfect hash; other names go on to the file system
+    reset_robot();
+    struct fs_file file;
+    static const char *const custom[] = {"/429", "/stats", "/events", "/trace.bin"};
+    for (size_t i = 0; i < sizeof(custom) / sizeof(custom[0]); i++)
+    {
+        memset(&file, 0, sizeof(file));
+        CHECK(fs_open_custom(&file, custom[i]) == 1);
+        fs_close_custom(&file);
+    }
+    static const char *const other[] = {"/", "", "/4", "/42", "/stat", "/statsx", "/json",
+                                        "/index.html", "stats", "/json_response",
+                                        "/script_response", "/released"};
+    for (size_t i = 0; i < sizeof(other) / sizeof(other[0]); i++)
+    {
+        memset(&file, 0, sizeof(file));
+        CHECK(fs_open_custom(&file, other[i]) == 0);
+    }
+}
+
+// A reply file carries its own CGI call's command and client, once
+static void check_reply_context(void)
+{
+    struct fs_file file;
+    char reply[JSON_BUFFER_SIZE];
+
+    reset_robot();
+    CHECK(httpd_shim_open("/control.cgi?command=FWD&id=5", &file) == 1);
+    CHECK(file.len > 0 && memcmp(file.data, "{\"status\":1, \"command\":\"2\"", 26) == 0);
+    // Opened again without a CGI call, it is not there; nor is the script reply
+    struct fs_file again;
+    memset(&again, 0, sizeof(again));
+    CHECK(fs_open_custom(&again, "/json_response") == 0);
+    CHECK(fs_open_custom(&again, "/script_response") == 0);
+    // and a direct GET neither answers with the last command nor counts against client 5
+    CHECK(httpd_shim_get("/json_response", reply, sizeof(reply)) == HTTPD_SHIM_NOT_FOUND);
+    fs_close_custom(&file);
+    CHECK(httpd_shim_get("/control.cgi?command=BWD&id=5", reply, sizeof(reply)) > 0);
+    CHECK(admission_stats.busy == 0);
+
+    // A script call's reply is not a status reply
+    CHECK(httpd_shim_open("/script.cgi?steps=FWD:100&id=5", &file) == 1);
+    CHECK(memcmp(file.data, "{\"status\":1, \"steps\":1", 22) == 0);
+    fs_close_custom(&file);
+}
+
+// A driver holding FWD while two dashboards poll NON in between, every 300 ms each
+static void check_sessions(void)
+{
+    const uint32_t driver = 1111, viewer_a = 2222, viewer_b = 3333;
+
+    reset_robot();
+    for (int t = 0; t < 3000; t += 300)
+    {
+        send_as(viewer_a, "NON");
+        run_ms(100);
+        send_as(driver, "FWD");
+        run_ms(100);
+        send_as(viewer_b, "NON");
+        run_ms(100);
+    }
+    // the viewers' polls did not hold the robot back: same as a single client
+    int interleaved = wheels[0].speed;
+    reset_robot();
+    hold("FWD", 300, 3000);
+    CHECK(interleaved == wheels[0].speed && interleaved > SPEED_SCALE / 2);
+    reset_robot();
+    CHECK(session_submit(SESSION_HTTP, driver, &(VehicleCommand){CMD_FWD, 0, 0}, 0) == SESSION_DRIVER);
+    CHECK(session_is_driver(SESSION_HTTP, driver, 0));
+    CHECK(session_submit(SESSION_HTTP, viewer_a, &(VehicleCommand){CMD_NONE, 0, 0}, 100) ==
+          SESSION_OBSERVER);
+
+    // A viewer cannot steer while the lease is held, from any transport
+    CHECK(session_submit(SESSION_WS, 0, &(VehicleCommand){CMD_BWD, 0, 0}, 200) == SESSION_DENIED);
+    CHECK(session_submit(SESSION_HTTP, viewer_a, &(VehicleCommand){CMD_DRIVE, 0, 500}, 300) ==
+          SESSION_DENIED);
+    tick();
+    CHECK(last_command == CMD_FWD);
+
+    // The driver's release goes through and the lease lapses a while after
+    CHECK(session_submit(SESSION_HTTP, driver, &(VehicleCommand){CMD_NONE, 0, 0}, 400) == SESSION_DRIVER);
+    CHECK(session_submit(SESSION_HTTP, viewer_a, &(VehicleCommand){CMD_LFT, 0, 0}, 500) == SESSION_DENIED);
+    CHECK(session_submit(SESSION_HTTP, viewer_a, &(VehicleCommand){CMD_LFT, 0, 0},
+                         SESSION_LEASE_MS + 1) == SESSION_DRIVER);
+    CHECK(!session_is_driver(SESSION_HTTP, driver, SESSION_LEASE_MS + 1));
+
+    // STOP from anybody wins and frees the lease
+    CHECK(session_submit(SESSION_UDP, 42, &(VehicleCommand){CMD_STOP, 0, 0}, 1100) == SESSION_STOP);
+    tick();
+    CHECK(last_command == CMD_STOP && vehicle_speed == 0);
+    CHECK(session_submit(SESSION_HTTP, driver, &(VehicleCommand){CMD_FWD, 0, 0}, 1200) == SESSION_DRIVER);
+
+    // A driver that vanishes mid-move is released once someone else polls
+    CHECK(session_submit(SESSION_HTTP, viewer_b, &(VehicleCommand){CMD_NONE, 0, 0},
+                         1200 + SESSION_LEASE_MS + 1) == SESSION_OBSERVER);
+    tick();
+    CHECK(last_command == CMD_NONE);
+
+    // A closed WebSocket gives up its lease at once
+    CHECK(session_submit(SESSION_WS, 1, &(VehicleCommand){CMD_FWD, 0, 0}, 3000) == SESSION_DRIVER);
+    session_close(SESSION_WS, 1);
+    CHECK(session_submit(SESSION_HTTP, viewer_b, &(VehicleCommand){CMD_BWD, 0, 0}, 3001) == SESSION_DRIVER);
+
+    // More clients than slots: the quietest observer makes room, the driver keeps its lease
+    for (uint32_t id = 10; id < 10 + 2 * SESSION_MAX_CLIENTS; id++)
+        session_submit(SESSION_HTTP, id, &(VehicleCommand){CMD_NONE, 0, 0}, 3002 + id);
+    CHECK(session_stats.evicted > 0);
+    CHECK(session_is_driver(SESSION_HTTP, viewer_b, 3100));
+}
+
+static void check_admission(void)
+{
+    const uint32_t step_ms = 1000 / ADMISSION_RATE;
+    char reply[128];
+
+    // A client bursts, then keeps to the rate; STOP passes an empty bucket
+    reset_robot();
+    for (int i = 0; i < ADMISSION_BURST; i++)
+        CHECK(admission_check(7, false, 1000) == ADMISSION_OK);
+    CHECK(admission_check(7, false, 1000) == ADMISSION_LIMITED);
+    CHECK(admission_check(7, false, 1000 + step_ms) == ADMISSION_OK);
+    CHECK(admission_check(7, false, 1000 + step_ms) == ADMISSION_LIMITED);
+    CHECK(admission_check(7, true, 1000 + step_ms) == ADMISSION_PRIORITY);
+    CHECK(admission_stats.admitted == ADMISSION_BURST + 1 && admission_stats.rate_limited == 2);
+
+    // A long silence only fills the bucket up to the burst
+    for (int i = 0; i < ADMISSION_BURST; i++)
+        CHECK(admission_check(7, false, 0xf0000000u) == ADMISSION_OK);
+    CHECK(admission_check(7, false, 0xf0000000u) == ADMISSION_LIMITED);
+
+    // Every client has its own bucket, but new ones come in at ADMISSION_NEW_RATE
+    admission_init();
+    int admitted = 0;
+    for (uint32_t id = 1; id <= ADMISSION_NEW_BURST; id++)
+    {
+        for (int i = 0; i < ADMISSION_BURST; i++)
+            admitted += admission_check(id, false, 0) == ADMISSION_OK;
+    }
+    CHECK(admitted == ADMISSION_NEW_BURST * ADMISSION_BURST);
+    CHECK(admission_check(100, false, 0) == ADMISSION_LIMITED);
+    CHECK(admission_check(1, false, 1000 / ADMISSION_NEW_RATE) == ADMISSION_OK);
+    CHECK(admission_check(100, false, 1000 / ADMISSION_NEW_RATE) == ADMISSION_OK);
+    CHECK(admission_check(101, false, 1000 / ADMISSION_NEW_RATE) == ADMISSION_LIMITED);
+
+    // A refused request gets the constant 429 and never reaches the session or the loop
+    reset_robot();
+    for (int i = 0; i < ADMISSION_BURST; i++)
+        send_as(6, "FWD");
+    tick();
+    CHECK(last_command == CMD_FWD);
+    uint32_t cgi_calls = telemetry.cgi.count;
+    int len = httpd_shim_get("/control.cgi?command=BWD&id=6", reply, sizeof(reply) - 1);
+    reply[len > 0 ? len : 0] = '\0';
+    CHECK(strncmp(reply, "HTTP/1.0 429 Too Many Requests\r\n", 32) == 0);
+    CHECK(strstr(reply, "\r\n\r\n") == reply + len - 4);
+    CHECK(telemetry.cgi.count == cgi_calls + 1); // refused calls are timed too
+    CHECK(httpd_shim_get("/drive.cgi?throttle=0&turn=900&id=6", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "HTTP/1.0 429", 12) == 0);
+    CHECK(httpd_shim_get("/script.cgi?steps=BWD:500&id=6", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "HTTP/1.0 429", 12) == 0);
+    tick();
+    CHECK(last_command == CMD_FWD && telemetry.requests == ADMISSION_BURST);
+    send_as(6, "STP");
+    tick();
+    CHECK(last_command == CMD_STOP);
+
+    // At most ADMISSION_MAX_INFLIGHT replies per client are being sent
+    reset_robot();
+    struct fs_file files[ADMISSION_MAX_INFLIGHT];
+    for (int i = 0; i < ADMISSION_MAX_INFLIGHT; i++)
+        CHECK(httpd_shim_open("/control.cgi?command=NON&id=5", &files[i]) &&
+              files[i].pextension != NULL);
+    CHECK(httpd_shim_get("/control.cgi?command=NON&id=5", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "HTTP/1.0 429", 12) == 0);
+    CHECK(admission_stats.busy == 1);
+    CHECK(httpd_shim_get("/control.cgi?command=NON&id=4", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "{\"status\":1", 11) == 0);
+    CHECK(httpd_shim_get("/control.cgi?command=STP&id=5", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "{\"status\":1", 11) == 0);
+    fs_close_custom(&files[0]);
+    CHECK(httpd_shim_get("/control.cgi?command=NON&id=5", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "{\"status\":1", 11) == 0);
+    for (int i = 1; i < ADMISSION_MAX_INFLIGHT; i++)
+        fs_close_custom(&files[i]);
+
+    // The driver's release passes its own replies in flight and takes no slot; released,
+    // another NON waits its turn again
+    reset_robot();
+    for (int i = 0; i < ADMISSION_MAX_INFLIGHT; i++)
+        CHECK(httpd_shim_open("/control.cgi?command=FWD&id=5", &files[i]) &&
+              files[i].pextension != NULL);
+    tick();
+    CHECK(last_command == CMD_FWD);
+    len = httpd_shim_get("/control.cgi?command=NON&id=5", reply, sizeof(reply) - 1);
+    reply[len > 0 ? len : 0] = '\0';
+    CHECK(strncmp(reply, "HTTP/1.0 204 No Content\r\n", 25) == 0);
+    tick();
+    CHECK(last_command == CMD_NONE && admission_stats.priority == 1);
+    CHECK(httpd_shim_get("/control.cgi?command=NON&id=5", reply, sizeof(reply)) > 0 &&
+          strncmp(reply, "HTTP/1.0 429", 12) == 0);
+    for (int i = 0; i < ADMISSION_MAX_INFLIGHT; i++)
+        fs_close_custom(&files[i]);
+
+    // More clients than entries: the quietest make room, one with replies in flight stays
+    reset_robot();
+    for (int i = 0; i < ADMISSION_MAX_INFLIGHT; i++)
+        CHECK(httpd_shim_open("/control.cgi?command=NON&id=5", &files[i]));
+    for (uint32_t id = 10; id < 10 + 2 * ADMISSION_MAX_CLIENTS; id++)
+        CHECK(admission_check(id, false, 1000 * id / ADMISSION_NEW_RATE) == ADMISSION_OK);
+    CHECK(admission_stats.evicted == ADMISSION_MAX_CLIENTS + 1);
+    CHECK(admission_check(5, false, 100000) == ADMISSION_BUSY);
+    for (int i = 0; i < ADMISSION_MAX_INFLIGHT; i++)
+        fs_close_custom(&files[i]);
+
+    // Switched off, everything passes
+    admission_enabled = false;
+    for (int i = 0; i < 2 * ADMISSION_BURST; i++)
+        CHECK(admission_check(8, false, 0) == ADMISSION_OK);
+    admission_enabled = ADMISSION_CONTROL;
+
+    static char stats[STATS_BUFFER_SIZE];
+    len = httpd_shim_get("/stats", stats, sizeof(stats) - 1);
+    stats[len > 0 ? len : 0] = '\0';
+    CHECK(strstr(stats, "\"admission\":{\"enabled\":true,") != NULL);
+}
+
+// Mask a client frame the way a browser would
+static size_t ws_client_frame(uint8_t opcode, const char *payload, size_t len, uint8_t *out)
+{
+    static const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    out[0] = 0x80 | opcode;
+    out[1] = 0x80 | (uint8_t)len;
+    memcpy(out + 2, mask, 4);
+    for (size_t i = 0; i < len; i++)
+        out[6 + i] = payload[i] ^ mask[i & 3];
+    return 6 + len;
+}
+
+static void check_websocket(void)
+{
+    char response[256];
+    uint8_t buf[64];
+    size_t n;
+    uint8_t reply[WS_TX_BUFFER_SIZE];
+    int reply_len;
+    WsFrame frame;
+
+    // RFC 6455 section 1.3 example
+    static const char request[] = "GET /chat HTTP/1.1\r\n"
+                                  "Host: server.example.com\r\n"
+                                  "Upgrade: websocket\r\n"
+                                  "Connection: Upgrade\r\n"
+                                  "sec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                  "Sec-WebSocket-Version: 13\r\n\r\n";
+    CHECK(ws_handshake(request, sizeof(request) - 1, response, sizeof(response)) > 0);
+    CHECK(strstr(response, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL);
+    CHECK(ws_handshake(request, 40, response, sizeof(response)) == 0);
+    CHECK(ws_handshake("GET / HTTP/1.1\r\n\r\n", 18, response, sizeof(response)) ==
+          WS_HANDSHAKE_BAD_REQUEST);
+
+    // A key alone is not an upgrade; lists and case are fine, other versions are not
+    static const char *const upgrades[] = {
+        "GET / HTTP/1.1\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+        "GET / HTTP/1.1\r\nUpgrade: h2c\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: keep-alive\r\n"
+        "Sec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+        "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Version: 8\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+        "GET / HTTP/1.1\r\nupgrade: WebSocket\r\nconnection: keep-alive, upgrade\r\n"
+        "sec-websocket-version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n",
+    };
+    static const int expected[] = {WS_HANDSHAKE_BAD_REQUEST, WS_HANDSHAKE_BAD_REQUEST,
+                                   WS_HANDSHAKE_BAD_REQUEST, WS_HANDSHAKE_BAD_REQUEST,
+                                   WS_HANDSHAKE_BAD_VERSION, 1};
+    for (size_t i = 0; i < sizeof(upgrades) / sizeof(upgrades[0]); i++)
+    {
+        int result = ws_handshake(upgrades[i], strlen(upgrades[i]), response, sizeof(response));
+        CHECK(expected[i] > 0 ? result > 0 : result == expected[i]);
+    }
+
+    // RFC 6455 section 5.7 masked "Hello"
+    uint8_t hello[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58};
+    CHECK(ws_decode_frame(hello, 5, &frame) == 0);
+    CHECK(ws_decode_frame(hello, sizeof(hello), &frame) == (int)sizeof(hello));
+    CHECK(frame.opcode == WS_OPCODE_TEXT && frame.fin);
+    CHECK(frame.len == 5 && memcmp(frame.payload, "Hello", 5) == 0);
+    uint8_t unmasked[] = {0x81, 0x01, 'x'};
+    CHECK(ws_decode_frame(unmasked, sizeof(unmasked), &frame) == -1);
+
+    // Command frames drive the vehicle and answer with the status JSON
+    reset_robot();
+    for (int i = 0; i < 3; i++)
+    {
+        n = ws_client_frame(WS_OPCODE_TEXT, "FWD", 3, buf);
+        CHECK(ws_decode_frame(buf, n, &frame) == (int)n);
+        CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_BROADCAST);
+        tick();
+    }
+    CHECK(last_command == CMD_FWD && wheels[0].profile.velocity > 0.0f);
+    CHECK(reply_len > 2 && reply[0] == (0x80 | WS_OPCODE_TEXT));
+    CHECK(memcmp(reply + 2, "{\"status\":1, \"command\":\"2\", \"vehicle_speed\":\"0\"}",
+                 reply_len - 2) == 0);
+
+    // Drive vectors go as text
+    n = ws_client_frame(WS_OPCODE_TEXT, "DRV -300 100", 12, buf);
+    CHECK(ws_decode_frame(buf, n, &frame) == (int)n);
+    CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_BROADCAST);
+    hold_ms(3000);
+    CHECK(last_command == CMD_DRIVE && wheels[0].speed == -200 && wheels[1].speed == -400);
+    n = ws_client_frame(WS_OPCODE_TEXT, "DRV 300", 7, buf);
+    ws_decode_frame(buf, n, &frame);
+    ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len);
+    tick();
+    CHECK(last_command == CMD_NONE);
+
+    // Heartbeats are not answered: nothing changed
+    n = ws_client_frame(WS_OPCODE_TEXT, "HBT", 3, buf);
+    ws_decode_frame(buf, n, &frame);
+    CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_NONE);
+    CHECK(reply_len == 0);
+
+    char stop = CMD_STOP;
+    n = ws_client_frame(WS_OPCODE_BINARY, &stop, 1, buf);
+    ws_decode_frame(buf, n, &frame);
+    CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_BROADCAST);
+    tick();
+    CHECK(vehicle_speed == 0 && last_command == CMD_STOP);
+
+    n = ws_client_frame(WS_OPCODE_PING, "hi", 2, buf);
+    ws_decode_frame(buf, n, &frame);
+    CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_SENDER);
+    CHECK(reply_len == 4 && reply[0] == (0x80 | WS_OPCODE_PONG) && memcmp(reply + 2, "hi", 2) == 0);
+
+    n = ws_client_frame(WS_OPCODE_CLOSE, "", 0, buf);
+    ws_decode_frame(buf, n, &frame);
+    CHECK(ws_process_frame(0, &frame, reply, sizeof(reply), &reply_len) == WS_REPLY_CLOSE);
+}
+
+static UdpResult udp_deliver(UdpControlState *state, uint32_t peer, uint8_t flags, uint32_t seq,
+                             uint32_t sent_ms, uint32_t arrival_ms, uint8_t command)
+{
+    uint8_t packet[UDP_PACKET_SIZE];
+    uint8_t reply[UDP_PACKET_SIZE];
+    udp_control_encode_command(packet, flags, seq, sent_ms, command, 0);
+    UdpResult result = udp_control_receive(state, peer, packet, sizeof(packet), arrival_ms, reply);
+    tick();
+    return result;
+}
+
+static void check_udp(void)
+{
+    UdpControlState state;
+    uint8_t packet[UDP_PACKET_SIZE];
+    uint8_t reply[UDP_PACKET_SIZE];
+    const uint32_t peer = 0x0a000002, other = 0x0a000003;
+    const uint32_t clock_skew = 123456; // sender clock is unrelated to ours
+
+    reset_robot();
+    udp_control_reset(&state);
+
+    // Nothing is accepted before a session is opened
+    CHECK(udp_deliver(&state, peer, 0, 1, clock_skew, 1000, CMD_FWD) == UDP_DROPPED_PEER);
+
+    // Trace: sent every 20 ms, 10 ms path; #3 is lost, #5 overtakes #4, #7 stalls 400 ms
+    CHECK(udp_deliver(&state, peer, UDP_FLAG_SYNC, 1, clock_skew + 0, 10, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(udp_deliver(&state, peer, 0, 2, clock_skew + 20, 30, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(udp_deliver(&state, peer, 0, 5, clock_skew + 80, 90, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(udp_deliver(&state, peer, 0, 4, clock_skew + 60, 95, CMD_BWD) == UDP_DROPPED_OLD);
+    CHECK(udp_deliver(&state, peer, 0, 5, clock_skew + 80, 96, CMD_FWD) == UDP_DROPPED_OLD);
+    CHECK(udp_deliver(&state, peer, 0, 6, clock_skew + 100, 108, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(udp_deliver(&state, peer, 0, 7, clock_skew + 120, 520, CMD_BWD) == UDP_DROPPED_STALE);
+    CHECK(last_command == CMD_FWD && wheels[0].profile.velocity > 0.0f);
+
+    // Another sender cannot interleave unless it opens its own session
+    CHECK(udp_deliver(&state, other, 0, 100, 0, 530, CMD_STOP) == UDP_DROPPED_PEER);
+    CHECK(udp_deliver(&state, other, UDP_FLAG_SYNC, 0xfffffffeu, 0, 540, CMD_STOP) == UDP_ACCEPTED);
+    CHECK(vehicle_speed == 0);
+
+    // Sequence numbers may wrap
+    CHECK(udp_deliver(&state, other, 0, 0xffffffffu, 20, 560, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(udp_deliver(&state, other, 0, 0, 40, 580, CMD_FWD) == UDP_ACCEPTED);
+    CHECK(last_command == CMD_FWD && wheels[0].profile.velocity > 0.0f);
+
+    // Status reply
+    udp_control_encode_command(packet, 0, 1, 60, CMD_FWD, 0);
+    CHECK(udp_control_receive(&state, other, packet, sizeof(packet), 600, reply) == UDP_ACCEPTED);
+    CHECK(reply[0] == 'R' && reply[1] == 'S' && reply[3] == UDP_ACCEPTED);
+    CHECK(reply[4] == 1 && reply[8] == (600 & 0xff) && reply[9] == (600 >> 8));
+    CHECK(reply[12] == CMD_FWD && reply[13] == vehicle_speed);
+    uint32_t beats = control_loop_stats.heartbeats;
+    CHECK(udp_deliver(&state, other, 0, 2, 80, 620, CMD_HEARTBEAT) == UDP_ACCEPTED);
+    CHECK(control_loop_stats.heartbeats == beats + 1 && last_command == CMD_FWD);
+
+    // A drive vector, as /drive.cgi takes it: the arc of check_drive, then clamped
+    uint8_t drive[UDP_DRIVE_PACKET_SIZE];
+    udp_control_encode_drive(drive, 0, 3, 100, 500, -200, 0);
+    CHECK(udp_control_receive(&state, other, drive, sizeof(drive), 640, reply) == UDP_ACCEPTED);
+    hold_ms(3000);
+    CHECK(last_command == CMD_DRIVE && side_speed(0, 300) && side_speed(1, 700));
+    udp_control_encode_drive(drive, 0, 4, 120, -30000, 0, 0);
+    CHECK(udp_control_receive(&state, other, drive, sizeof(drive), 660, reply) == UDP_ACCEPTED);
+    hold_ms(5000);
+    CHECK(wheels[0].speed == -SPEED_SCALE && wheels[1].speed == -SPEED_SCALE);
+
+    // Malformed packets get no reply: a short one, an unknown command, a drive without
+    // its vector and a vector after another command
+    CHECK(udp_control_receive(&state, other, packet, sizeof(packet) - 1, 620, reply) == UDP_MALFORMED);
+    packet[12] = CMD_DRIVE;
+    CHECK(udp_control_receive(&state, other, packet, sizeof(packet), 680, reply) == UDP_MALFORMED);
+    drive[12] = CMD_FWD;
+    CHECK(udp_control_receive(&state, other, drive, sizeof(drive), 680, reply) == UDP_MALFORMED);
+    packet[12] = 42;
+    CHECK(udp_control_receive(&state, other, packet, sizeof(packet), 620, reply) == UDP_MALFORMED);
+}
+
+static uint32_t now_ms(void)
+{
+    return to_ms_since_boot(get_absolute_time());
+}
+
+// A fleet packet sent at sender time sent_ms that arrives now, path_ms after the fastest
+// one; the ack goes to ack
+static UdpResult fleet_deliver(UdpControlState *state, uint32_t peer, uint8_t flags, uint32_t seq,
+                               uint32_t sent_ms, uint16_t lead_ms, uint8_t command,
+                               uint8_t ack[UDP_PACKET_SIZE])
+{
+    uint8_t packet[UDP_PACKET_SIZE];
+    udp_control_encode_command(packet, UDP_FLAG_FLEET | flags, seq, sent_ms, command, lead_ms);
+    return udp_control_receive(state, peer, packet, sizeof(packet), now_ms(), ack);
+}
+
+static int16_t ack_wait(const uint8_t ack[UDP_PACKET_SIZE])
+{
+    return (int16_t)(ack[12] | (ack[13] << 8));
+}
+
+static void check_fleet(void)
+{
+    UdpControlState state;
+    uint8_t ack[UDP_PACKET_SIZE];
+    const uint32_t op = 0x0a0000fe, other = 0x0a000003;
+    // Sender clock: sender_ms() is what it reads now, over the fastest path
+    const uint32_t skew = 0x80000000u;
+#define sender_ms() (now_ms() + skew)
+
+    reset_robot();
+    udp_control_reset(&state);
+
+    // Opening beacon, 4 ms slower than the path turns out to be
+    CHECK(fleet_deliver(&state, op, UDP_FLAG_SYNC, 1, sender_ms() - 4, 0, CMD_HEARTBEAT, ack) ==
+          UDP_ACCEPTED);
+    CHECK(ack[0] == 'R' && ack[1] == 'A' && ack[3] == UDP_ACCEPTED && ack[4] == 1);
+    CHECK(ack_wait(ack) == 0 && ack[8] == (now_ms() & 0xff));
+    run_ms(50);
+    CHECK(fleet_deliver(&state, op, 0, 2, sender_ms(), 0, CMD_HEARTBEAT, ack) == UDP_ACCEPTED);
+
+    // Held until sender time + lead, as seen here: 2 ms slower than the best path
+    uint32_t sent = sender_ms() - 2;
+    CHECK(fleet_deliver(&state, op, 0, 3, sent, 100, CMD_FWD, ack) == UDP_SCHEDULED);
+    CHECK(ack[3] == UDP_SCHEDULED && ack_wait(ack) == 98);
+    CHECK(udp_control_next_due(&state, now_ms()) == 98);
+    run_ms(95);
+    CHECK(!udp_control_poll(&state, now_ms()) && last_command == CMD_NONE);
+    run_ms(5);
+    CHECK(udp_control_next_due(&state, now_ms()) == 0);
+    CHECK(udp_control_poll(&state, now_ms()) && udp_control_next_due(&state, now_ms()) == -1);
+    tick();
+    CHECK(last_command == CMD_FWD && udp_fleet_stats.scheduled == 1 && udp_fleet_stats.applied == 1);
+
+    // Duplicates, other senders and far-off targets are refused
+    CHECK(fleet_deliver(&state, op, 0, 3, sent, 100, CMD_BWD, ack) == UDP_DROPPED_OLD);
+    CHECK(fleet_deliver(&state, other, 0, 9, sender_ms(), 0, CMD_STOP, ack) == UDP_DROPPED_PEER);
+    CHECK(fleet_deliver(&state, op, 0, 4, sender_ms(), UDP_FLEET_MAX_LEAD_MS + 1, CMD_BWD, ack) ==
+          UDP_MALFORMED);
+    CHECK(last_command == CMD_FWD && ack[14] == 2);
+
+    // Past its target on arrival: applied at once, and the ack says how late
+    CHECK(fleet_deliver(&state, op, 0, 5, sender_ms() - 30, 10, CMD_RGT, ack) == UDP_ACCEPTED);
+    CHECK(ack_wait(ack) == -20 && udp_fleet_stats.late == 1 && udp_fleet_stats.max_late_ms == 20);
+    tick();
+    CHECK(last_command == CMD_RGT);
+
+    // A newer packet replaces the waiting one; STOP goes through at once and drops it
+    CHECK(fleet_deliver(&state, op, 0, 6, sender_ms(), 500, CMD_BWD, ack) == UDP_SCHEDULED);
+    CHECK(fleet_deliver(&state, op, 0, 7, sender_ms(), 200, CMD_FWD, ack) == UDP_SCHEDULED);
+    CHECK(udp_fleet_stats.superseded == 1 && udp_control_next_due(&state, now_ms()) == 200);
+    CHECK(fleet_deliver(&state, op, 0, 8, sender_ms(), 1000, CMD_STOP, ack) == UDP_ACCEPTED);
+    CHECK(ack_wait(ack) == 0 && udp_control_next_due(&state, now_ms()) == -1);
+    tick();
+    CHECK(last_command == CMD_STOP && vehicle_speed == 0);
+
+    // Stale: slower than the best path by more than UDP_MAX_PACKET_AGE_MS
+    CHECK(fleet_deliver(&state, op, 0, 9, sender_ms() - UDP_MAX_PACKET_AGE_MS - 1, 0, CMD_FWD,
+                        ack) == UDP_DROPPED_STALE);
+
+    // The sender's clock runs 1 ms/s slow: the minimum only spans the last two windows, so
+    // the targets trail by at most two windows' drift, not all of it
+    uint32_t seq = 10, lag = 0;
+    for (int s = 0; s < 2 * UDP_FLEET_SYNC_WINDOW_MS / 1000 + 1; s++)
+    {
+        run_ms(1000);
+        lag++;
+        CHECK(fleet_deliver(&state, op, 0, seq++, sender_ms() - lag, 0, CMD_HEARTBEAT, ack) ==
+              UDP_ACCEPTED);
+    }
+    CHECK(fleet_deliver(&state, op, 0, seq++, sender_ms() - lag, 100, CMD_FWD, ack) ==
+          UDP_SCHEDULED);
+    int trailing_ms = 100 - ack_wait(ack);
+    CHECK(trailing_ms < (int)lag && trailing_ms <= 2 * UDP_FLEET_SYNC_WINDOW_MS / 1000);
+
+    // A drive vector waits for its target time with its vector
+    uint8_t drive[UDP_DRIVE_PACKET_SIZE];
+    udp_control_encode_drive(drive, UDP_FLAG_FLEET, seq++, sender_ms() - lag, 0, 700, 50);
+    CHECK(udp_control_receive(&state, op, drive, sizeof(drive), now_ms(), ack) == UDP_SCHEDULED);
+    run_ms(200);
+    CHECK(udp_control_poll(&state, now_ms()));
+    tick();
+    CHECK(last_command == CMD_DRIVE && wheels[0].profile.target > 0.0f &&
+          wheels[1].profile.target < 0.0f);
+#undef sender_ms
+    reset_robot();
+}
+
+#define LOG_STRESS_COUNT 200000
+
+static void *log_producer(void *arg)
+{
+    int32_t producer = (int32_t)(intptr_t)arg;
+    for (int32_t i = 0; i < LOG_STRESS_COUNT; i++)
+    {
+        while (!event_log_write(EV_CONTROL_OVERRUN, producer, i, 0))
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void check_event_log(void)
+{
+    EventLogStats stats;
+
+    // Disabled levels cost nothing: a request at the default level writes no entry
+    event_log_init();
+    reset_robot();
+    send("FWD");
+    event_log_get_stats(&stats);
+    CHECK(EV_HTTP_COMMAND_LEVEL > EVENT_LOG_LEVEL && stats.written == 0);
+
+    // Entries come out in order with their arguments; overflow is counted and reported
+    for (int i = 0; i < EVENT_LOG_SIZE + 5; i++)
+        event_log_write(EV_WS_UPGRADED, i, 0, 0);
+    event_log_get_stats(&stats);
+    CHECK(stats.written == EVENT_LOG_SIZE && stats.dropped == 5);
+    uint64_t calls = hal_counters.stdio_calls;
+    CHECK(event_log_drain(10) == 10);
+    CHECK(hal_counters.stdio_calls - calls == 10 + 1); // one extra line for the drops
+    CHECK(event_log_drain(1000) == EVENT_LOG_SIZE - 10);
+    CHECK(event_log_drain(1000) == 0);
+
+    // Two producers (the network callbacks and core 1) against the draining main loop
+    event_log_init();
+    pthread_t producers[2];
+    int32_t next[2] = {0, 0};
+    bool ordered = true;
+    for (intptr_t p = 0; p < 2; p++)
+        pthread_create(&producers[p], NULL, log_producer, (void *)p);
+    while (next[0] < LOG_STRESS_COUNT || next[1] < LOG_STRESS_COUNT)
+    {
+        EventLogEntry entry;
+        if (!event_log_read(&entry))
+        {
+            sched_yield();
+            continue;
+        }
+        if (entry.args[0] < 0 || entry.args[0] > 1 || entry.args[1] != next[entry.args[0]])
+        {
+            ordered = false;
+            break;
+        }
+        next[entry.args[0]]++;
+    }
+    for (int p = 0; p < 2; p++)
+        pthread_join(producers[p], NULL);
+    CHECK(ordered);
+    event_log_init();
+}
+
+#define QUEUE_STRESS_COUNT 500000
+
+static CmdQueue stress_queue;
+
+// Both sides spin, yielding so the test also finishes on a single-CPU machine
+static void *queue_producer(void *arg)
+{
+    (void)arg;
+    for (unsigned i = 0; i < QUEUE_STRESS_COUNT; i++)
+    {
+        VehicleCommand cmd = {(uint8_t)(i % CMD_NONE), (int16_t)i, (int16_t)~i};
+        while (!cmd_queue_push(&stress_queue, &cmd))
+            sched_yield();
+    }
+    return NULL;
+}
+
+// Two threads hammering the SPSC ring: everything arrives, in order and untorn
+static void check_queue(void)
+{
+    const VehicleCommand fwd = {CMD_FWD, 0, 0};
+    VehicleCommand cmd;
+    pthread_t producer;
+    unsigned received = 0, out_of_order = 0;
+
+    cmd_queue_init(&stress_queue);
+    CHECK(!cmd_queue_pop(&stress_queue, &cmd));
+    for (int i = 0; i < CMD_QUEUE_SIZE; i++)
+        CHECK(cmd_queue_push(&stress_queue, &fwd));
+    CHECK(!cmd_queue_push(&stress_queue, &fwd));
+    while (cmd_queue_pop(&stress_queue, &cmd))
+        ;
+    CHECK(cmd_queue_empty(&stress_queue));
+
+    pthread_create(&producer, NULL, queue_producer, NULL);
+    while (received < QUEUE_STRESS_COUNT)
+    {
+        if (!cmd_queue_pop(&stress_queue, &cmd))
+        {
+            sched_yield();
+            continue;
+        }
+        if (cmd.type != received % CMD_NONE || cmd.throttle != (int16_t)received ||
+            cmd.turn != (int16_t)~received)
+            out_of_order++;
+        received++;
+    }
+    pthread_join(producer, NULL);
+    CHECK(out_of_order == 0);
+    CHECK(!cmd_queue_pop(&stress_queue, &cmd));
+
+    // A STOP is never lost, even when the loop has fallen behind and the queue is full
+    reset_robot();
+    for (int i = 0; i < CMD_QUEUE_SIZE; i++)
+        control_loop_post(CMD_FWD);
+    CHECK(!control_loop_post(CMD_FWD));
+    CHECK(control_loop_post(CMD_STOP));
+    tick();
+    CHECK(vehicle_speed == 0 && last_command == CMD_STOP);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        CHECK(hal_pwm_level(wheels[i].en_pin) == 0);
+}
+
+int run_checks(void)
+{
+    failures = 0;
+    http_control_init();
+
+    check_parse();
+    check_setup();
+    check_motor_pwm();
+    check_pwm_ramp();
+    check_speed_control();
+    check_motion_profile();
+    check_acceleration();
+    check_release_and_stop();
+    check_lease();
+    check_turns();
+    check_drivetrain();
+    check_response();
+    check_telemetry();
+    check_content();
+    check_event_stream();
+    check_script_parse();
+    check_script();
+    check_trace();
+    check_wifi();
+    check_power();
+    check_drive();
+    check_routes();
+    check_reply_context();
+    check_sessions();
+    check_admission();
+    check_websocket();
+    check_udp();
+    check_fleet();
+    check_queue();
+    check_event_log();
+
+    fprintf(stdout, "%d check failure(s)\n", failures);
+    return failures;
+}
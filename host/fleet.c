@@ -0,0 +1,353 @@
+// Fleet mode on loopback: several host-built robots, each a forked process with its own
+// firmware state and clock, joined to the fleet group on 127.0.0.1, and one operator
+// that multicasts the commands and collects the acks. Every robot reports the host time
+// at which its control loop applied each command, so the spread between robots and the
+// error against the operator's target time are measured on one clock.
+
+#define _GNU_SOURCE // ppoll
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "control_loop.h"
+#include "hal_shim.h"
+#include "script.h"
+#include "session.h"
+#include "trace.h"
+#include "udp_control.h"
+#include "vehicle.h"
+
+#define FLEET_MAX_ROBOTS 16
+#define FLEET_BEACON_MS 50  // heartbeats: the clock sync, and the lease of the commands
+#define FLEET_LEAD_MS 100   // target time of every command after it is sent
+#define FLEET_STEP_MS 300   // between commands
+#define FLEET_SLACK_MS 5    // scheduling noise of the host on top of a control loop tick
+#define FLEET_SKIP 77       // ctest SKIP_RETURN_CODE: no multicast on this host
+
+static const uint8_t fleet_commands[] = {CMD_FWD, CMD_RGT, CMD_BWD, CMD_STOP};
+#define FLEET_COMMANDS (int)(sizeof(fleet_commands) / sizeof(fleet_commands[0]))
+
+// Robot to operator, over a pipe: ready, then one report per command applied
+typedef struct
+{
+    int8_t robot;
+    uint8_t command; // CMD_NONE: ready
+    uint64_t t_ns;   // host clock
+} FleetReport;
+
+static struct in_addr robot_addr(int robot)
+{
+    struct in_addr a;
+    a.s_addr = htonl(INADDR_LOOPBACK + 2 + robot); // 127.0.0.2, 127.0.0.3, ...
+    return a;
+}
+
+// Move the robot's mock clock up to the host clock; returns the host time
+static uint64_t sync_clock(uint64_t *clock_ns)
+{
+    uint64_t now_ns = bench_now_ns();
+    uint64_t us = (now_ns - *clock_ns) / 1000;
+    hal_shim_advance_us(us);
+    *clock_ns += us * 1000;
+    return now_ns;
+}
+
+static void report(int fd, int robot, uint8_t command)
+{
+    FleetReport r = {(int8_t)robot, command, bench_now_ns()};
+    if (write(fd, &r, sizeof(r)) != sizeof(r))
+        _exit(1);
+}
+
+// One robot: the firmware's UDP path and control loop, run in real time
+static void run_robot(int robot, uint16_t port, int report_fd)
+{
+    hal_shim_reset();
+    setup_pwms();
+    script_init();
+    trace_init();
+    control_loop_init();
+    session_init();
+    vehicle_command(CMD_STOP);
+    push_command(CMD_NONE);
+    push_command(CMD_NONE);
+    // Robots boot at different times: their clocks have nothing to do with each other
+    hal_shim_advance_us((uint64_t)(robot + 1) * 7919000u);
+
+    UdpControlState state;
+    udp_control_reset(&state);
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    int one = 1;
+    struct sockaddr_in any = {.sin_family = AF_INET, .sin_port = htons(port)};
+    any.sin_addr.s_addr = htonl(INADDR_ANY);
+    struct sockaddr_in self = {.sin_family = AF_INET, .sin_addr = robot_addr(robot)};
+    struct ip_mreq join;
+    inet_aton(UDP_FLEET_GROUP, &join.imr_multiaddr);
+    join.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    if (rx < 0 || tx < 0 || setsockopt(rx, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(rx, (struct sockaddr *)&any, sizeof(any)) < 0 ||
+        setsockopt(rx, IPPROTO_IP, IP_ADD_MEMBERSHIP, &join, sizeof(join)) < 0 ||
+        bind(tx, (struct sockaddr *)&self, sizeof(self)) < 0)
+        _exit(FLEET_SKIP);
+    report(report_fd, robot, CMD_NONE);
+
+    const uint64_t period_ns = 1000000000u / CONTROL_LOOP_HZ;
+    uint64_t start_ns = bench_now_ns();
+    uint64_t clock_ns = start_ns; // host time the mock clock has been moved to
+    uint64_t next_tick_ns = start_ns + period_ns;
+    CommandType applied = last_command;
+
+    for (;;)
+    {
+        uint64_t now_ns = sync_clock(&clock_ns);
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+
+        udp_control_poll(&state, now_ms);
+        if (now_ns >= next_tick_ns)
+        {
+            control_loop_tick();
+            next_tick_ns += period_ns;
+            if (last_command != applied && last_command != CMD_NONE)
+                report(report_fd, robot, (uint8_t)last_command);
+            applied = last_command;
+        }
+
+        // Sleep until the next tick, the scheduled command or a packet
+        uint64_t wake_ns = next_tick_ns;
+        int32_t due_ms = udp_control_next_due(&state, now_ms);
+        if (due_ms >= 0 && now_ns + (uint64_t)due_ms * 1000000u < wake_ns)
+            wake_ns = now_ns + (uint64_t)due_ms * 1000000u;
+        struct timespec timeout = {0, 0};
+        if (wake_ns > now_ns)
+            timeout.tv_nsec = (long)(wake_ns - now_ns);
+        struct pollfd pfd = {rx, POLLIN, 0};
+        if (ppoll(&pfd, 1, &timeout, NULL) <= 0)
+            continue;
+
+        uint8_t packet[64];
+        uint8_t reply[UDP_PACKET_SIZE];
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(rx, packet, sizeof(packet), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0)
+            continue;
+        // Same peer identity as udp_server.c; the receive time is the clock sync's sample
+        uint32_t peer = ntohl(from.sin_addr.s_addr) ^ ((uint32_t)ntohs(from.sin_port) << 16);
+        sync_clock(&clock_ns);
+        now_ms = to_ms_since_boot(get_absolute_time());
+        if (udp_control_receive(&state, peer, packet, (size_t)len, now_ms, reply) != UDP_MALFORMED)
+            sendto(tx, reply, sizeof(reply), 0, (struct sockaddr *)&from, sizeof(from));
+    }
+}
+
+typedef struct
+{
+    uint32_t seq;
+    uint8_t command;
+    uint64_t sent_ns;
+    uint64_t target_ns; // commands: when every robot should apply it
+    int acks;
+    uint64_t max_rtt_ns;
+    int16_t wait_ms[FLEET_MAX_ROBOTS];
+    uint8_t result[FLEET_MAX_ROBOTS];
+    bool acked[FLEET_MAX_ROBOTS];
+} FleetPacket;
+
+static void take_ack(int sock, FleetPacket *packets, int sent, int robots)
+{
+    uint8_t ack[64];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t len = recvfrom(sock, ack, sizeof(ack), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+    uint64_t now_ns = bench_now_ns();
+    if (len != UDP_PACKET_SIZE || ack[0] != 'R' || ack[1] != 'A')
+        return;
+    int robot = (int)(ntohl(from.sin_addr.s_addr) - INADDR_LOOPBACK - 2);
+    uint32_t seq = (uint32_t)ack[4] | ((uint32_t)ack[5] << 8) | ((uint32_t)ack[6] << 16) |
+                   ((uint32_t)ack[7] << 24);
+    if (robot < 0 || robot >= robots || seq == 0 || seq > (uint32_t)sent)
+        return;
+    FleetPacket *p = &packets[seq - 1];
+    if (p->acked[robot])
+        return;
+    p->acked[robot] = true;
+    p->acks++;
+    p->result[robot] = ack[3];
+    p->wait_ms[robot] = (int16_t)(ack[12] | (ack[13] << 8));
+    if (now_ns - p->sent_ns > p->max_rtt_ns)
+        p->max_rtt_ns = now_ns - p->sent_ns;
+}
+
+// Receive acks until the host clock reaches until_ns
+static void collect_acks(int sock, FleetPacket *packets, int sent, int robots, uint64_t until_ns)
+{
+    for (uint64_t now = bench_now_ns(); now < until_ns; now = bench_now_ns())
+    {
+        struct pollfd pfd = {sock, POLLIN, 0};
+        struct timespec timeout = {0, (long)(until_ns - now)};
+        if (ppoll(&pfd, 1, &timeout, NULL) > 0)
+            take_ack(sock, packets, sent, robots);
+    }
+}
+
+int run_fleet(int robots, uint16_t port)
+{
+    if (robots < 1 || robots > FLEET_MAX_ROBOTS)
+    {
+        fprintf(stderr, "fleet: 1..%d robots\n", FLEET_MAX_ROBOTS);
+        return 2;
+    }
+
+    int pipe_fd[2];
+    pid_t pids[FLEET_MAX_ROBOTS];
+    if (pipe(pipe_fd) < 0)
+        return 1;
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < robots; i++)
+    {
+        pids[i] = fork();
+        if (pids[i] == 0)
+        {
+            close(pipe_fd[0]);
+            run_robot(i, port, pipe_fd[1]);
+            _exit(0);
+        }
+    }
+    close(pipe_fd[1]);
+
+    // Operator socket: multicast out on loopback, acks back to its own port
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct in_addr lo = {htonl(INADDR_LOOPBACK)};
+    struct sockaddr_in group = {.sin_family = AF_INET, .sin_port = htons(port)};
+    inet_aton(UDP_FLEET_GROUP, &group.sin_addr);
+    struct sockaddr_in self = {.sin_family = AF_INET, .sin_addr = lo};
+    unsigned char loop = 1;
+    bool ok = sock >= 0 && setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo)) == 0 &&
+              setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0 &&
+              bind(sock, (struct sockaddr *)&self, sizeof(self)) == 0;
+
+    // Wait for every robot to have joined
+    for (int ready = 0; ok && ready < robots;)
+    {
+        FleetReport r;
+        struct pollfd pfd = {pipe_fd[0], POLLIN, 0};
+        ok = poll(&pfd, 1, 2000) > 0 && read(pipe_fd[0], &r, sizeof(r)) == sizeof(r) &&
+             r.command == CMD_NONE;
+        ready++;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "fleet: no multicast on loopback, skipped\n");
+        for (int i = 0; i < robots; i++)
+            kill(pids[i], SIGTERM);
+        while (wait(NULL) > 0)
+            ;
+        return FLEET_SKIP;
+    }
+
+    // Beacons every FLEET_BEACON_MS, and a command every FLEET_STEP_MS after a settling
+    // period. The operator's clock is the host clock from an unrelated origin.
+    const uint64_t ms_ns = 1000000u;
+    const int settle = 5, per_step = FLEET_STEP_MS / FLEET_BEACON_MS;
+    const int total = settle + FLEET_COMMANDS * per_step;
+    FleetPacket *packets = calloc((size_t)total, sizeof(*packets));
+    uint64_t start_ns = bench_now_ns();
+    int sent = 0;
+    for (int i = 0; i < total; i++)
+    {
+        uint64_t at_ns = start_ns + (uint64_t)i * FLEET_BEACON_MS * ms_ns;
+        collect_acks(sock, packets, sent, robots, at_ns);
+
+        bool command = i >= settle && (i - settle) % per_step == 0;
+        FleetPacket *p = &packets[sent];
+        p->seq = (uint32_t)++sent;
+        p->command = command ? fleet_commands[(i - settle) / per_step] : CMD_HEARTBEAT;
+        p->sent_ns = bench_now_ns();
+        p->target_ns = p->sent_ns + FLEET_LEAD_MS * ms_ns;
+        uint8_t packet[UDP_PACKET_SIZE];
+        udp_control_encode_command(packet, UDP_FLAG_FLEET | (i == 0 ? UDP_FLAG_SYNC : 0), p->seq,
+                                   (uint32_t)(p->sent_ns / ms_ns + 3000000000u), p->command,
+                                   command && p->command != CMD_STOP ? FLEET_LEAD_MS : 0);
+        sendto(sock, packet, sizeof(packet), 0, (struct sockaddr *)&group, sizeof(group));
+    }
+    collect_acks(sock, packets, sent, robots, bench_now_ns() + FLEET_STEP_MS * ms_ns);
+    for (int i = 0; i < robots; i++)
+        kill(pids[i], SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+
+    // When each robot applied each command
+    uint64_t applied[FLEET_COMMANDS][FLEET_MAX_ROBOTS] = {{0}};
+    FleetReport r;
+    while (read(pipe_fd[0], &r, sizeof(r)) == sizeof(r))
+    {
+        for (int c = 0; c < FLEET_COMMANDS; c++)
+        {
+            if (fleet_commands[c] == r.command && applied[c][r.robot] == 0)
+                applied[c][r.robot] = r.t_ns;
+        }
+    }
+    close(pipe_fd[0]);
+    close(sock);
+
+    int acks = 0;
+    uint64_t max_rtt_ns = 0;
+    for (int i = 0; i < sent; i++)
+    {
+        acks += packets[i].acks;
+        if (packets[i].max_rtt_ns > max_rtt_ns)
+            max_rtt_ns = packets[i].max_rtt_ns;
+    }
+    fprintf(stdout, "fleet: %d robots, %d packets sent, %d/%d acks, max ack round trip %.3f ms\n",
+            robots, sent, acks, sent * robots, max_rtt_ns / 1e6);
+    fprintf(stdout, "%8s %8s %14s %14s %10s\n", "command", "lead_ms", "min_error_ms", "max_error_ms",
+            "spread_ms");
+
+    // A robot applies a command at its first control loop tick after the target time. Both
+    // clocks are read in whole milliseconds, so that can come up to 2 ms early.
+    const double tick_ms = 1000.0 / CONTROL_LOOP_HZ;
+    bool pass = acks == sent * robots;
+    for (int c = 0, i = settle; c < FLEET_COMMANDS; c++, i += per_step)
+    {
+        const FleetPacket *p = &packets[i];
+        bool stop = p->command == CMD_STOP;
+        double lo_ms = 1e9, hi_ms = -1e9;
+        for (int k = 0; k < robots; k++)
+        {
+            if (applied[c][k] == 0)
+            {
+                fprintf(stdout, "  robot %d never applied command %u\n", k, p->command);
+                pass = false;
+                continue;
+            }
+            // STOP is not scheduled: its error is against the send time
+            double error_ms =
+                ((double)applied[c][k] - (double)(stop ? p->sent_ns : p->target_ns)) / 1e6;
+            lo_ms = error_ms < lo_ms ? error_ms : lo_ms;
+            hi_ms = error_ms > hi_ms ? error_ms : hi_ms;
+            if (!stop && p->result[k] != UDP_SCHEDULED)
+                pass = false;
+        }
+        fprintf(stdout, "%8u %8d %14.3f %14.3f %10.3f\n", p->command, stop ? 0 : FLEET_LEAD_MS,
+                lo_ms, hi_ms, hi_ms - lo_ms);
+        if (lo_ms < -2.0 || hi_ms > tick_ms + FLEET_SLACK_MS || hi_ms - lo_ms > tick_ms + FLEET_SLACK_MS)
+            pass = false;
+    }
+    free(packets);
+    fprintf(stdout, "fleet: %s\n", pass ? "in step" : "FAILED");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,475 @@
+// Host implementation of the Pico SDK calls used by the controller.
+// Pin and PWM writes update a mock register file and are appended to a trace ring.
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal_shim.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pwm.h"
+#include "motor_plant.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+
+HalCounters hal_counters;
+
+static uint64_t mock_time_us;
+static bool stdio_echo;
+
+static uint64_t gpio_out;
+static uint64_t gpio_dir;
+static uint8_t gpio_fn[HAL_NUM_GPIOS];
+static uint16_t pwm_level[NUM_PWM_SLICES * 2];
+static uint16_t pwm_wrap[NUM_PWM_SLICES];
+static bool pwm_enabled[NUM_PWM_SLICES];
+static uint16_t pwm_div16[NUM_PWM_SLICES];
+static bool pwm_phase_correct[NUM_PWM_SLICES];
+static uint64_t pwm_next_wrap16[NUM_PWM_SLICES]; // in 1/16 system clock cycles since reset
+
+pwm_hw_t hal_pwm_hw;
+
+typedef struct
+{
+    bool claimed;
+    bool busy;
+    dma_channel_config config;
+    volatile uint32_t *write;
+    const volatile uint32_t *read;
+    dma_channel_hw_t hw;
+} DmaChannel;
+
+static DmaChannel dma[NUM_DMA_CHANNELS];
+
+static HalTraceEntry trace[HAL_TRACE_CAPACITY];
+static uint64_t trace_count;
+
+static void trace_write(HalWriteKind kind, uint pin, uint32_t value, uint32_t mask)
+{
+    HalTraceEntry *e = &trace[trace_count % HAL_TRACE_CAPACITY];
+    e->t_us = mock_time_us;
+    e->kind = (uint8_t)kind;
+    e->pin = (uint8_t)pin;
+    e->value = value;
+    e->mask = mask;
+    trace_count++;
+}
+
+void hal_shim_reset(void)
+{
+    mock_time_us = 0;
+    gpio_out = 0;
+    gpio_dir = 0;
+    memset(gpio_fn, GPIO_FUNC_NULL, sizeof(gpio_fn));
+    memset(pwm_level, 0, sizeof(pwm_level));
+    memset(pwm_wrap, 0xff, sizeof(pwm_wrap));
+    memset(pwm_enabled, 0, sizeof(pwm_enabled));
+    for (int i = 0; i < NUM_PWM_SLICES; i++)
+        pwm_div16[i] = 16;
+    memset(pwm_phase_correct, 0, sizeof(pwm_phase_correct));
+    memset(pwm_next_wrap16, 0, sizeof(pwm_next_wrap16));
+    memset(&hal_pwm_hw, 0, sizeof(hal_pwm_hw));
+    // Channels stay claimed, like the firmware's claims that are made once at boot
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+    {
+        dma[i].busy = false;
+        dma[i].hw.transfer_count = 0;
+    }
+    memset(&hal_counters, 0, sizeof(hal_counters));
+    trace_count = 0;
+}
+
+// Paced DMA: every wrap of a slice gives one transfer to each busy channel on its DREQ
+
+#define CYCLES16_PER_US (HAL_SYS_CLOCK_HZ / 1000000 * 16)
+
+static uint64_t pwm_period16(uint slice)
+{
+    return (uint64_t)pwm_div16[slice] * ((uint32_t)pwm_wrap[slice] + 1) *
+           (pwm_phase_correct[slice] ? 2 : 1);
+}
+
+static void pwm_write_cc(uint slice, uint32_t cc)
+{
+    hal_pwm_hw.slice[slice].cc = cc;
+    pwm_level[slice * 2] = (uint16_t)cc;
+    pwm_level[slice * 2 + 1] = (uint16_t)(cc >> 16);
+    trace_write(HAL_PWM_CC, slice, cc, 0);
+}
+
+static void dma_transfer(DmaChannel *ch)
+{
+    uint32_t value = *ch->read;
+    uintptr_t cc0 = (uintptr_t)&hal_pwm_hw.slice[0].cc;
+    uintptr_t target = (uintptr_t)ch->write;
+
+    if (target >= cc0 && (target - cc0) % sizeof(pwm_slice_hw_t) == 0 &&
+        (target - cc0) / sizeof(pwm_slice_hw_t) < NUM_PWM_SLICES)
+        pwm_write_cc((uint)((target - cc0) / sizeof(pwm_slice_hw_t)), value);
+    else
+        *ch->write = value;
+    if (ch->config.read_increment)
+        ch->read++;
+    if (ch->config.write_increment)
+        ch->write++;
+    hal_counters.dma_transfers++;
+    if (--ch->hw.transfer_count == 0)
+        ch->busy = false;
+}
+
+static int paced_slice(const DmaChannel *ch)
+{
+    if (!ch->busy || ch->config.dreq < DREQ_PWM_WRAP0 ||
+        ch->config.dreq >= DREQ_PWM_WRAP0 + NUM_PWM_SLICES)
+        return -1;
+    int slice = (int)(ch->config.dreq - DREQ_PWM_WRAP0);
+    return pwm_enabled[slice] ? slice : -1;
+}
+
+static void advance_to(uint64_t t_us)
+{
+    uint64_t start_us = mock_time_us;
+    uint64_t end16 = t_us * CYCLES16_PER_US;
+    while (true)
+    {
+        int slice = -1;
+        uint64_t at = UINT64_MAX;
+        for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+        {
+            int s = paced_slice(&dma[i]);
+            if (s >= 0 && pwm_next_wrap16[s] < at)
+            {
+                slice = s;
+                at = pwm_next_wrap16[s];
+            }
+        }
+        if (slice < 0 || at > end16)
+            break;
+        if (at / CYCLES16_PER_US > mock_time_us)
+            mock_time_us = at / CYCLES16_PER_US;
+        for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+        {
+            if (paced_slice(&dma[i]) == slice)
+                dma_transfer(&dma[i]);
+        }
+        pwm_next_wrap16[slice] += pwm_period16(slice);
+    }
+    mock_time_us = t_us;
+    motor_plant_advance((float)(t_us - start_us) * 1e-6f);
+}
+
+// The next wrap of a slice after now, for one that has been counting unobserved
+static void pwm_catch_up(uint slice)
+{
+    uint64_t now16 = mock_time_us * CYCLES16_PER_US;
+    if (pwm_next_wrap16[slice] <= now16)
+    {
+        uint64_t period = pwm_period16(slice);
+        pwm_next_wrap16[slice] += ((now16 - pwm_next_wrap16[slice]) / period + 1) * period;
+    }
+}
+
+void hal_shim_advance_us(uint64_t us)
+{
+    advance_to(mock_time_us + us);
+}
+
+void hal_shim_set_stdio_echo(bool echo)
+{
+    stdio_echo = echo;
+}
+
+bool hal_gpio_out(uint gpio)
+{
+    return (gpio_out >> gpio) & 1u;
+}
+
+uint16_t hal_pwm_level(uint gpio)
+{
+    return pwm_level[pwm_gpio_to_slice_num(gpio) * 2 + pwm_gpio_to_channel(gpio)];
+}
+
+uint16_t hal_pwm_wrap(uint slice_num)
+{
+    return pwm_wrap[slice_num];
+}
+
+uint16_t hal_pwm_clkdiv16(uint slice_num)
+{
+    return pwm_div16[slice_num];
+}
+
+bool hal_pwm_phase_correct(uint slice_num)
+{
+    return pwm_phase_correct[slice_num];
+}
+
+uint64_t hal_trace_count(void)
+{
+    return trace_count;
+}
+
+const HalTraceEntry *hal_trace_at(uint64_t seq)
+{
+    if (seq >= trace_count || trace_count - seq > HAL_TRACE_CAPACITY)
+        return NULL;
+    return &trace[seq % HAL_TRACE_CAPACITY];
+}
+
+void hal_trace_dump_csv(FILE *out)
+{
+    static const char *kind_names[] = {"gpio", "pwm_level", "pwm_wrap", "gpio_masked", "pwm_cc"};
+    uint64_t first = trace_count > HAL_TRACE_CAPACITY ? trace_count - HAL_TRACE_CAPACITY : 0;
+
+    fprintf(out, "seq,t_us,kind,pin,value,mask\n");
+    for (uint64_t seq = first; seq < trace_count; seq++)
+    {
+        const HalTraceEntry *e = hal_trace_at(seq);
+        fprintf(out, "%llu,%llu,%s,%u,%lu,0x%08lx\n", (unsigned long long)seq,
+                (unsigned long long)e->t_us, kind_names[e->kind], e->pin,
+                (unsigned long)e->value, (unsigned long)e->mask);
+    }
+}
+
+// hardware/timer.h, pico/time.h
+
+uint64_t time_us_64(void)
+{
+    return mock_time_us;
+}
+
+void sleep_us(uint64_t us)
+{
+    advance_to(mock_time_us + us);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    advance_to(mock_time_us + (uint64_t)ms * 1000);
+}
+
+void sleep_until(absolute_time_t target)
+{
+    if (target > mock_time_us)
+        advance_to(target);
+}
+
+// hardware/gpio.h
+
+void gpio_init(uint gpio)
+{
+    gpio_dir &= ~(1ull << gpio);
+    gpio_out &= ~(1ull << gpio);
+    gpio_fn[gpio] = GPIO_FUNC_SIO;
+}
+
+void gpio_set_function(uint gpio, gpio_function_t fn)
+{
+    gpio_fn[gpio] = (uint8_t)fn;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    if (out)
+        gpio_dir |= 1ull << gpio;
+    else
+        gpio_dir &= ~(1ull << gpio);
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    if (value)
+        gpio_out |= 1ull << gpio;
+    else
+        gpio_out &= ~(1ull << gpio);
+    hal_counters.gpio_writes++;
+    trace_write(HAL_GPIO_PUT, gpio, value, 1u << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    gpio_out = (gpio_out & ~(uint64_t)mask) | (value & mask);
+    hal_counters.gpio_writes++;
+    trace_write(HAL_GPIO_PUT_MASKED, 0, value & mask, mask);
+}
+
+bool gpio_get(uint gpio)
+{
+    return hal_gpio_out(gpio);
+}
+
+// hardware/pwm.h
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap)
+{
+    pwm_wrap[slice_num] = wrap;
+    trace_write(HAL_PWM_WRAP, slice_num, wrap, 0);
+}
+
+void pwm_set_clkdiv_int_frac4(uint slice_num, uint16_t div_int, uint8_t div_frac4)
+{
+    pwm_div16[slice_num] = (uint16_t)(div_int * 16 + (div_frac4 & 15));
+}
+
+void pwm_set_phase_correct(uint slice_num, bool phase_correct)
+{
+    pwm_phase_correct[slice_num] = phase_correct;
+}
+
+void pwm_set_enabled(uint slice_num, bool enabled)
+{
+    if (enabled && !pwm_enabled[slice_num])
+        pwm_next_wrap16[slice_num] = mock_time_us * CYCLES16_PER_US + pwm_period16(slice_num);
+    pwm_enabled[slice_num] = enabled;
+}
+
+void pwm_set_counter(uint slice_num, uint16_t c)
+{
+    hal_pwm_hw.slice[slice_num].ctr = c;
+    uint64_t period = pwm_period16(slice_num);
+    uint64_t done = (uint64_t)c * pwm_div16[slice_num] % period;
+    pwm_next_wrap16[slice_num] = mock_time_us * CYCLES16_PER_US + period - done;
+}
+
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level)
+{
+    pwm_level[slice_num * 2 + chan] = level;
+    volatile uint32_t *cc = &hal_pwm_hw.slice[slice_num].cc;
+    *cc = chan ? (*cc & 0xffffu) | (uint32_t)level << 16 : (*cc & 0xffff0000u) | level;
+    hal_counters.pwm_writes++;
+    trace_write(HAL_PWM_LEVEL, slice_num * 2 + chan, level, 0);
+}
+
+void pwm_set_gpio_level(uint gpio, uint16_t level)
+{
+    pwm_set_chan_level(pwm_gpio_to_slice_num(gpio), pwm_gpio_to_channel(gpio), level);
+}
+
+// hardware/dma.h
+
+int dma_claim_unused_channel(bool required)
+{
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+    {
+        if (!dma[i].claimed)
+        {
+            dma[i].claimed = true;
+            return i;
+        }
+    }
+    if (required)
+        abort();
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    dma[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config c = {DMA_SIZE_32, true, false, DREQ_FORCE};
+    return c;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+                           volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger)
+{
+    DmaChannel *ch = &dma[channel];
+    // Only word transfers are modelled
+    if (config->size != DMA_SIZE_32)
+        abort();
+    ch->config = *config;
+    ch->write = write_addr;
+    ch->read = read_addr;
+    ch->hw.transfer_count = transfer_count;
+    ch->busy = false;
+    if (trigger)
+        dma_start_channel_mask(1u << channel);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+    for (int i = 0; i < NUM_DMA_CHANNELS; i++)
+    {
+        DmaChannel *ch = &dma[i];
+        if (!(chan_mask & (1u << i)) || ch->hw.transfer_count == 0)
+            continue;
+        ch->busy = true;
+        int slice = paced_slice(ch);
+        if (slice >= 0)
+            pwm_catch_up((uint)slice);
+        else if (ch->config.dreq == DREQ_FORCE)
+            while (ch->busy)
+                dma_transfer(ch);
+    }
+}
+
+void dma_channel_abort(uint channel)
+{
+    dma[channel].busy = false;
+    dma[channel].hw.transfer_count = 0;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return dma[channel].busy;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel)
+{
+    return &dma[channel].hw;
+}
+
+// pico/multicore.h
+
+static void *core1_thread(void *arg)
+{
+    ((void (*)(void))arg)();
+    return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, core1_thread, (void *)entry);
+    pthread_detach(thread);
+}
+
+// stdio. Like pico_stdio, printf and puts are wrapped at link time; the text is formatted
+// (that cost is real on the device too) but only written out when echo is enabled.
+
+int __wrap_printf(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    hal_counters.stdio_calls++;
+    if (n > 0)
+        hal_counters.stdio_bytes += (uint64_t)n;
+    if (stdio_echo)
+        fputs(line, stdout);
+    return n;
+}
+
+int __wrap_puts(const char *s)
+{
+    size_t n = strlen(s) + 1;
+    hal_counters.stdio_calls++;
+    hal_counters.stdio_bytes += n;
+    if (stdio_echo)
+    {
+        fputs(s, stdout);
+        fputc('\n', stdout);
+    }
+    return (int)n;
+}
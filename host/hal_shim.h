@@ -0,0 +1,57 @@
+#ifndef HAL_SHIM_H
+#define HAL_SHIM_H
+
+// Inspection interface of the host HAL shim: mock clock, pin state and the write trace.
+
+#include <stdio.h>
+
+#include "pico/types.h"
+
+#define HAL_NUM_GPIOS 48
+#define HAL_TRACE_CAPACITY 65536
+
+typedef enum
+{
+    HAL_GPIO_PUT,        // pin, value = 0/1
+    HAL_PWM_LEVEL,       // pin = slice * 2 + channel, value = level
+    HAL_PWM_WRAP,        // pin = slice, value = wrap
+    HAL_GPIO_PUT_MASKED, // pin = 0, value = levels of the pins in mask
+    HAL_PWM_CC,          // pin = slice, value = both channel levels, written by DMA
+} HalWriteKind;
+
+typedef struct
+{
+    uint64_t t_us;  // mock clock when the write happened
+    uint32_t value;
+    uint32_t mask;
+    uint8_t kind;   // HalWriteKind
+    uint8_t pin;
+} HalTraceEntry;
+
+typedef struct
+{
+    uint64_t gpio_writes;
+    uint64_t pwm_writes;    // level writes by the CPU
+    uint64_t dma_transfers; // paced DMA transfers, see hardware/dma.h
+    uint64_t stdio_bytes; // bytes the firmware printed (printf is wrapped, see CMakeLists.txt)
+    uint64_t stdio_calls;
+} HalCounters;
+
+extern HalCounters hal_counters;
+
+void hal_shim_reset(void);
+void hal_shim_advance_us(uint64_t us);
+void hal_shim_set_stdio_echo(bool echo);
+
+bool hal_gpio_out(uint gpio);
+uint16_t hal_pwm_level(uint gpio);
+uint16_t hal_pwm_wrap(uint slice_num);
+uint16_t hal_pwm_clkdiv16(uint slice_num); // divider in 1/16ths
+bool hal_pwm_phase_correct(uint slice_num);
+
+// Trace entries are kept in a ring; the oldest are overwritten once it is full.
+uint64_t hal_trace_count(void);
+const HalTraceEntry *hal_trace_at(uint64_t seq);
+void hal_trace_dump_csv(FILE *out);
+
+#endif // HAL_SHIM_H
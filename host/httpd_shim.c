@@ -0,0 +1,183 @@
+#include <string.h>
+
+#include "httpd_shim.h"
+#include "lwip/apps/fs.h"
+#include "lwip/apps/httpd.h"
+#include "lwip/timeouts.h"
+#include "pico/time.h"
+
+// The file system tools/makefsdata.py generated from content/, as linked into httpd
+#include HTTPD_FSDATA_FILE
+
+const struct fsdata_file *const httpd_shim_fs_root = FS_ROOT;
+const int httpd_shim_fs_files = FS_NUMFILES;
+
+#define HTTPD_SHIM_URI_MAX 256
+#define HTTPD_SHIM_READ_CHUNK 512
+
+static const tCGI *cgi_table;
+static int cgi_count;
+
+void http_set_cgi_handlers(const tCGI *pCGIs, int iNumHandlers)
+{
+    cgi_table = pCGIs;
+    cgi_count = iNumHandlers;
+}
+
+void httpd_init(void)
+{
+}
+
+#define HTTPD_SHIM_TIMEOUTS 8
+
+static struct
+{
+    sys_timeout_handler handler;
+    void *arg;
+    uint64_t due_us;
+} timeouts[HTTPD_SHIM_TIMEOUTS];
+
+void sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
+{
+    for (int i = 0; i < HTTPD_SHIM_TIMEOUTS; i++)
+    {
+        if (timeouts[i].handler == NULL)
+        {
+            timeouts[i].handler = handler;
+            timeouts[i].arg = arg;
+            timeouts[i].due_us = time_us_64() + (uint64_t)msecs * 1000;
+            return;
+        }
+    }
+}
+
+void sys_untimeout(sys_timeout_handler handler, void *arg)
+{
+    for (int i = 0; i < HTTPD_SHIM_TIMEOUTS; i++)
+    {
+        if (timeouts[i].handler == handler && timeouts[i].arg == arg)
+            timeouts[i].handler = NULL;
+    }
+}
+
+int httpd_shim_run_timers(void)
+{
+    int fired = 0;
+    for (int i = 0; i < HTTPD_SHIM_TIMEOUTS; i++)
+    {
+        if (timeouts[i].handler != NULL && timeouts[i].due_us <= time_us_64())
+        {
+            // One-shot: the handler may re-arm itself into this or another entry
+            sys_timeout_handler handler = timeouts[i].handler;
+            timeouts[i].handler = NULL;
+            handler(timeouts[i].arg);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+// Same splitting as httpd.c's extract_uri_parameters(): no URL decoding, '&' separated.
+static int extract_uri_parameters(char *params, char *param_names[], char *param_values[])
+{
+    int n = 0;
+    char *pair = params;
+
+    while (pair && *pair && n < LWIP_HTTPD_MAX_CGI_PARAMETERS)
+    {
+        param_names[n] = pair;
+        char *next = strchr(pair, '&');
+        if (next)
+            *next++ = '\0';
+        char *equals = strchr(pair, '=');
+        if (equals)
+        {
+            *equals = '\0';
+            param_values[n] = equals + 1;
+        }
+        else
+        {
+            param_values[n] = NULL;
+        }
+        n++;
+        pair = next;
+    }
+    return n;
+}
+
+int httpd_shim_open(const char *uri, struct fs_file *file)
+{
+    char buf[HTTPD_SHIM_URI_MAX];
+    char *param_names[LWIP_HTTPD_MAX_CGI_PARAMETERS] = {NULL};
+    char *param_values[LWIP_HTTPD_MAX_CGI_PARAMETERS] = {NULL};
+
+    strncpy(buf, uri, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *params = strchr(buf, '?');
+    if (params)
+        *params++ = '\0';
+
+    const char *file_name = buf;
+    for (int i = 0; i < cgi_count; i++)
+    {
+        if (strcmp(buf, cgi_table[i].pcCGIName) == 0)
+        {
+            int n = extract_uri_parameters(params, param_names, param_values);
+            file_name = cgi_table[i].pfnCGIHandler(i, n, param_names, param_values);
+            break;
+        }
+    }
+
+    // fs_open(): custom files first, then the generated file system; "/" is the index page
+    memset(file, 0, sizeof(*file));
+    if (fs_open_custom(file, file_name))
+    {
+        file->is_custom_file = 1;
+        return 1;
+    }
+    if (strcmp(file_name, "/") == 0)
+        file_name = "/index.html";
+    for (const struct fsdata_file *f = FS_ROOT; f != NULL; f = f->next)
+    {
+        if (strcmp(file_name, (const char *)f->name) == 0)
+        {
+            file->data = (const char *)f->data;
+            file->len = f->len;
+            file->index = f->len;
+            file->flags = f->flags;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int httpd_shim_get(const char *uri, char *body, int body_len)
+{
+    struct fs_file file;
+    if (!httpd_shim_open(uri, &file))
+        return HTTPD_SHIM_NOT_FOUND;
+
+    int len = 0;
+    if (file.data != NULL)
+    {
+        // httpd sends file->data directly when it is set
+        len = file.len < body_len ? file.len : body_len;
+        memcpy(body, file.data, len);
+    }
+    else
+    {
+        int n;
+        while (len < body_len)
+        {
+            int chunk = body_len - len < HTTPD_SHIM_READ_CHUNK ? body_len - len : HTTPD_SHIM_READ_CHUNK;
+            n = fs_read_async_custom(&file, body + len, chunk, NULL, NULL);
+            if (n <= 0)
+                break;
+            len += n;
+        }
+    }
+    if (file.is_custom_file)
+        fs_close_custom(&file);
+    return len;
+}
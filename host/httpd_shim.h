@@ -0,0 +1,32 @@
+#ifndef HTTPD_SHIM_H
+#define HTTPD_SHIM_H
+
+// Minimal stand-in for lwIP's httpd request path: URI parameter extraction, CGI dispatch
+// and serving the returned file through the fs_*_custom callbacks or the generated
+// file system.
+
+#include "lwip/apps/fs.h"
+
+#define HTTPD_SHIM_NOT_FOUND -404
+
+// The generated file system: its first file (FS_ROOT) and the number of files
+extern const struct fsdata_file *const httpd_shim_fs_root;
+extern const int httpd_shim_fs_files;
+
+// First half of a GET: run the CGI handler, if any, and open the file it names, as httpd
+// does when a request arrives. Returns 0 if there is no such file. The caller reads
+// file->data and calls fs_close_custom() if file->is_custom_file, so several requests can
+// be in flight at once.
+int httpd_shim_open(const char *uri, struct fs_file *file);
+
+// Fire the lwIP timeouts (sys_timeout) that are due on the mock clock. Returns how many
+// fired.
+int httpd_shim_run_timers(void);
+
+// Perform a GET of uri (e.g. "/control.cgi?command=FWD") and copy the response body into
+// body. Returns the body length, or HTTPD_SHIM_NOT_FOUND. Generated content files carry
+// their HTTP header, so for those body holds the whole response. A file that has to wait
+// for data (an event stream) is read up to that point.
+int httpd_shim_get(const char *uri, char *body, int body_len);
+
+#endif // HTTPD_SHIM_H
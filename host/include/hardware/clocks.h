@@ -0,0 +1,21 @@
+#ifndef _HARDWARE_CLOCKS_H
+#define _HARDWARE_CLOCKS_H
+
+// Host stand-in for hardware/clocks.h: the RP2350's default 150 MHz system clock
+
+#include "pico/types.h"
+
+#define HAL_SYS_CLOCK_HZ 150000000u
+
+typedef enum
+{
+    clk_sys = 5,
+} clock_handle_t;
+
+static inline uint32_t clock_get_hz(clock_handle_t clock)
+{
+    (void)clock;
+    return HAL_SYS_CLOCK_HZ;
+}
+
+#endif
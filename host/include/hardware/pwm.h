@@ -0,0 +1,54 @@
+#ifndef _HARDWARE_PWM_H
+#define _HARDWARE_PWM_H
+
+// Host stand-in for hardware/pwm.h. Every level write is recorded by hal_shim.c.
+
+#include "hardware/gpio.h"
+#include "pico/types.h"
+
+#define NUM_PWM_SLICES 12
+#define DREQ_PWM_WRAP0 32
+
+// The slice registers, so DMA can be pointed at them. CPU writes go through the
+// functions below; hal_shim.c maps DMA writes to cc onto the channel levels.
+typedef struct
+{
+    volatile uint32_t csr;
+    volatile uint32_t div;
+    volatile uint32_t ctr;
+    volatile uint32_t cc;
+    volatile uint32_t top;
+} pwm_slice_hw_t;
+
+typedef struct
+{
+    pwm_slice_hw_t slice[NUM_PWM_SLICES];
+} pwm_hw_t;
+
+extern pwm_hw_t hal_pwm_hw;
+#define pwm_hw (&hal_pwm_hw)
+
+static inline uint pwm_gpio_to_slice_num(uint gpio)
+{
+    return (gpio >> 1u) % NUM_PWM_SLICES;
+}
+
+static inline uint pwm_gpio_to_channel(uint gpio)
+{
+    return gpio & 1u;
+}
+
+static inline uint pwm_get_dreq(uint slice_num)
+{
+    return DREQ_PWM_WRAP0 + slice_num;
+}
+
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+void pwm_set_clkdiv_int_frac4(uint slice_num, uint16_t div_int, uint8_t div_frac4);
+void pwm_set_phase_correct(uint slice_num, bool phase_correct);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_counter(uint slice_num, uint16_t c);
+void pwm_set_chan_level(uint slice_num, uint chan, uint16_t level);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+// Host stand-in for hardware/sync.h: core 1 is a thread that never waits for events.
+
+static inline void __sev(void)
+{
+}
+
+#endif
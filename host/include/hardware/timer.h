@@ -0,0 +1,16 @@
+#ifndef _HARDWARE_TIMER_H
+#define _HARDWARE_TIMER_H
+
+// Host stand-in for hardware/timer.h. The timer is a mock clock that only moves when
+// sleep_*() is called or the harness advances it, so runs are deterministic.
+
+#include "pico/types.h"
+
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef LWIP_HDR_APPS_FS_H
+#define LWIP_HDR_APPS_FS_H
+
+// Host stand-in for lwIP's httpd file-system interface (lwIP 2.1 layout).
+
+#include "lwip/def.h"
+
+#define FS_READ_EOF -1
+#define FS_READ_DELAYED -2
+
+#define FS_FILE_FLAGS_HEADER_INCLUDED 0x01
+#define FS_FILE_FLAGS_HEADER_PERSISTENT 0x02
+#define FS_FILE_FLAGS_HEADER_HTTPVER_1_1 0x04
+#define FS_FILE_FLAGS_SSI 0x08
+
+struct fs_file
+{
+    const char *data;
+    int len;
+    int index;
+    void *pextension;
+    u8_t flags;
+    u8_t is_custom_file;
+};
+
+// One entry of the generated file system (HTTPD_FSDATA_FILE), linked from FS_ROOT
+struct fsdata_file
+{
+    const struct fsdata_file *next;
+    const unsigned char *name;
+    const unsigned char *data;
+    int len;
+    u8_t flags;
+};
+
+typedef void (*fs_wait_cb)(void *arg);
+
+// LWIP_HTTPD_CUSTOM_FILES with LWIP_HTTPD_FS_ASYNC_READ
+int fs_open_custom(struct fs_file *file, const char *name);
+void fs_close_custom(struct fs_file *file);
+u8_t fs_canread_custom(struct fs_file *file);
+u8_t fs_wait_read_custom(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg);
+int fs_read_async_custom(struct fs_file *file, char *buffer, int count, fs_wait_cb callback_fn,
+                         void *callback_arg);
+
+#endif
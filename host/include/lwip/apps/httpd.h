@@ -0,0 +1,21 @@
+#ifndef LWIP_HDR_APPS_HTTPD_H
+#define LWIP_HDR_APPS_HTTPD_H
+
+// Host stand-in for lwIP's httpd CGI interface. Requests are dispatched by httpd_shim.c.
+
+#include "lwip/def.h"
+
+#define LWIP_HTTPD_MAX_CGI_PARAMETERS 16
+
+typedef const char *(*tCGIHandler)(int iIndex, int iNumParams, char *pcParam[], char *pcValue[]);
+
+typedef struct
+{
+    const char *pcCGIName;
+    tCGIHandler pfnCGIHandler;
+} tCGI;
+
+void http_set_cgi_handlers(const tCGI *pCGIs, int iNumHandlers);
+void httpd_init(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LWIP_HDR_DEF_H
+#define LWIP_HDR_DEF_H
+
+// Host stand-in for the few lwIP definitions the controller sources use.
+
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+typedef s8_t err_t;
+
+#define ERR_OK 0
+
+#define LWIP_ARRAYSIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define LWIP_UNUSED_ARG(x) (void)x
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef LWIP_HDR_TIMEOUTS_H
+#define LWIP_HDR_TIMEOUTS_H
+
+// Host stand-in for lwIP's one-shot timers. They fire from httpd_shim_run_timers(), on
+// the mock clock.
+
+#include "lwip/def.h"
+
+typedef void (*sys_timeout_handler)(void *arg);
+
+void sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg);
+void sys_untimeout(sys_timeout_handler handler, void *arg);
+
+#endif
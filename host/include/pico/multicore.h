@@ -0,0 +1,8 @@
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+// Host stand-in for pico/multicore.h: core 1 is a thread.
+
+void multicore_launch_core1(void (*entry)(void));
+
+#endif
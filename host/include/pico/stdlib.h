@@ -0,0 +1,17 @@
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+// Host stand-in for pico/stdlib.h: only the pieces the controller uses.
+
+#include <stdlib.h>
+
+#include "hardware/gpio.h"
+#include "pico/time.h"
+#include "pico/types.h"
+
+// pico/platform.h: body of a busy-wait loop
+static inline void tight_loop_contents(void)
+{
+}
+
+#endif
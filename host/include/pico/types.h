@@ -0,0 +1,14 @@
+#ifndef _PICO_TYPES_H
+#define _PICO_TYPES_H
+
+// Host stand-in for the Pico SDK base types.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+typedef uint64_t absolute_time_t;
+
+#endif
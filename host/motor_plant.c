@@ -0,0 +1,96 @@
+#include <math.h>
+#include <string.h>
+
+#include "custom.h"
+#include "encoder.h"
+#include "hal_shim.h"
+#include "hardware/pwm.h"
+#include "motor_plant.h"
+
+#define PLANT_STEP_S 0.0005f // integration step, well under any tau
+
+MotorPlantWheel motor_plant[NUM_OF_WHEELS];
+
+static bool attached;
+static float speed[NUM_OF_WHEELS];
+static double position[NUM_OF_WHEELS]; // in encoder counts
+
+#define PLANT_PIN(name, pin) MOTOR_##name##_##pin,
+#define PLANT_ENA(name, throttle, turn, strafe) PLANT_PIN(name, ENA)
+#define PLANT_IN1(name, throttle, turn, strafe) PLANT_PIN(name, IN1)
+#define PLANT_IN2(name, throttle, turn, strafe) PLANT_PIN(name, IN2)
+static const uint en_pins[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(PLANT_ENA)};
+static const uint in1_pins[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(PLANT_IN1)};
+static const uint in2_pins[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(PLANT_IN2)};
+static const int8_t encoder_sign[] = ENCODER_SIGN;
+
+void motor_plant_attach(bool attach)
+{
+    attached = attach;
+    memset(speed, 0, sizeof(speed));
+    memset(position, 0, sizeof(position));
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        motor_plant[i] = (MotorPlantWheel){0.08f, 0.0f, 0.05f};
+}
+
+float motor_plant_speed(int wheel)
+{
+    return speed[wheel];
+}
+
+// Signed duty the driver puts on the motor: ENA level over the period, direction from IN1/IN2
+static float drive(int wheel)
+{
+    uint slice = pwm_gpio_to_slice_num(en_pins[wheel]);
+    float duty = (float)hal_pwm_level(en_pins[wheel]) / ((float)hal_pwm_wrap(slice) + 1.0f);
+    if (duty > 1.0f)
+        duty = 1.0f;
+    bool forward = hal_gpio_out(in1_pins[wheel]);
+    bool backward = hal_gpio_out(in2_pins[wheel]);
+    return forward == backward ? 0.0f : forward ? duty : -duty; // both equal: brake/coast
+}
+
+void motor_plant_advance(float dt_s)
+{
+    if (!attached)
+        return;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        const MotorPlantWheel *m = &motor_plant[i];
+        float u = drive(i);
+        for (float t = 0.0f; t < dt_s; t += PLANT_STEP_S)
+        {
+            float h = fminf(PLANT_STEP_S, dt_s - t);
+            float target;
+            if (speed[i] == 0.0f && fabsf(u) < m->stiction)
+                target = 0.0f;
+            else if (fabsf(u) <= m->load)
+                target = 0.0f;
+            else
+                target = u - copysignf(m->load, u);
+
+            float next = speed[i] + (target - speed[i]) * h / m->tau_s;
+            if (target == 0.0f && (next * speed[i] <= 0.0f || fabsf(next) < 1e-3f))
+                next = 0.0f; // friction holds it once stopped
+            speed[i] = next;
+            position[i] += (double)speed[i] * ENCODER_FULL_SPEED_CPS * h;
+        }
+    }
+}
+
+// encoder.h
+
+void encoder_init(void)
+{
+}
+
+bool encoder_present(void)
+{
+    return attached;
+}
+
+int32_t encoder_count(int wheel)
+{
+    return attached ? encoder_sign[wheel] * (int32_t)floor(position[wheel] * encoder_sign[wheel])
+                    : 0;
+}
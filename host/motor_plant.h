@@ -0,0 +1,31 @@
+#ifndef MOTOR_PLANT_H
+#define MOTOR_PLANT_H
+
+// Simulated motors and encoders for the host build. Each wheel is a first-order DC motor
+// driven by what the firmware wrote to its ENA level and direction pins: its speed moves
+// toward (duty - load) with time constant tau, and it does not start below the stiction
+// duty. Speeds are full scale (1.0 = full duty with no load), and the encoder counts
+// ENCODER_FULL_SPEED_CPS per second at 1.0. The mock clock integrates it as it advances,
+// and it implements encoder.h while attached.
+
+#include <stdbool.h>
+
+typedef struct
+{
+    float tau_s;    // time constant of the speed response
+    float load;     // duty lost to friction and load while turning
+    float stiction; // least duty that starts the wheel from rest
+} MotorPlantWheel;
+
+extern MotorPlantWheel motor_plant[NUM_OF_WHEELS];
+
+// Attach (encoders present, counts from zero, wheels at rest) or detach the plant. The
+// wheel parameters are reset to the defaults on attach.
+void motor_plant_attach(bool attached);
+
+float motor_plant_speed(int wheel);
+
+// Integrate over dt_s from the current pin state; called by the mock clock
+void motor_plant_advance(float dt_s);
+
+#endif // MOTOR_PLANT_H
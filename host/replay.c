@@ -0,0 +1,154 @@
+// Replay of command traces recorded by the firmware (trace.h) through the same vehicle
+// code, for regression-testing control changes against captured sessions.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "custom.h"
+#include "trace.h"
+#include "vehicle.h"
+
+// A trace saved with its HTTP response header (curl -i, nc) starts at the blank line
+static const uint8_t *skip_http_header(const uint8_t *data, size_t *len)
+{
+    if (*len < 5 || memcmp(data, "HTTP/", 5) != 0)
+        return data;
+    for (size_t i = 0; i + 4 <= *len; i++)
+    {
+        if (memcmp(data + i, "\r\n\r\n", 4) == 0)
+        {
+            *len -= i + 4;
+            return data + i + 4;
+        }
+    }
+    return data;
+}
+
+static void apply(const TraceRecord *r)
+{
+    if (r->type == CMD_DRIVE)
+        vehicle_drive(r->a, r->b);
+    else
+        vehicle_command_scaled((CommandType)r->type, r->a);
+}
+
+static bool outputs_match(const TraceRecord *r, int tolerance)
+{
+    for (int w = 0; w < NUM_OF_WHEELS; w++)
+    {
+        if (abs(wheels[w].speed - r->speed[w]) > tolerance)
+            return false;
+    }
+    return abs(vehicle_speed - r->vehicle_speed) <= tolerance;
+}
+
+static void print_diff(FILE *diffs, const TraceRecord *r)
+{
+    fprintf(diffs, "tick %lu command %d (%d, %d): recorded", (unsigned long)r->tick, r->type,
+            r->a, r->b);
+    for (int w = 0; w < NUM_OF_WHEELS; w++)
+        fprintf(diffs, " %d", r->speed[w]);
+    fprintf(diffs, " speed %d, replayed", r->vehicle_speed);
+    for (int w = 0; w < NUM_OF_WHEELS; w++)
+        fprintf(diffs, " %d", wheels[w].speed);
+    fprintf(diffs, " speed %d\n", vehicle_speed);
+}
+
+bool replay_trace(const uint8_t *data, size_t len, int tolerance, ReplayResult *result,
+                  FILE *diffs)
+{
+    TraceHeader header;
+
+    memset(result, 0, sizeof(*result));
+    data = skip_http_header(data, &len);
+    if (!trace_decode_header(data, len, &header))
+    {
+        if (diffs)
+            fprintf(diffs, "not a version %d trace\n", TRACE_VERSION);
+        return false;
+    }
+    if (header.record_size != TRACE_RECORD_SIZE || header.wheels != NUM_OF_WHEELS ||
+        header.speed_scale != SPEED_SCALE || header.max_vehicle_speed != MAX_VEHICLE_SPEED ||
+        header.loop_hz == 0)
+    {
+        if (diffs)
+            fprintf(diffs, "trace of a different vehicle: %d wheels, SPEED_SCALE %d\n",
+                    header.wheels, header.speed_scale);
+        return false;
+    }
+    if (len < TRACE_HEADER_SIZE + (size_t)header.count * TRACE_RECORD_SIZE)
+    {
+        if (diffs)
+            fprintf(diffs, "trace truncated: %lu records announced\n",
+                    (unsigned long)header.count);
+        return false;
+    }
+
+    // The recorded firmware's ramps, not this build's
+    MotionLimits saved_limits = motion_limits;
+    motion_limits = header.limits;
+    float dt = 1.0f / header.loop_hz;
+
+    const uint8_t *records = data + TRACE_HEADER_SIZE;
+    bool synced = false;
+    uint32_t tick = 0; // last tick simulated
+    uint32_t i = 0;
+
+    result->records = header.count;
+    while (i < header.count)
+    {
+        TraceRecord r;
+        trace_decode(records + (size_t)i * TRACE_RECORD_SIZE, &r);
+
+        if (!synced || (r.flags & TRACE_GAP))
+        {
+            // The state before a record is only known when the vehicle was at rest
+            if (!(r.flags & TRACE_AT_REST))
+            {
+                synced = false;
+                result->skipped++;
+                i++;
+                continue;
+            }
+            vehicle_command(CMD_STOP);
+            synced = true;
+        }
+        else
+        {
+            for (; tick + 1 < r.tick; tick++, result->ticks++)
+                vehicle_step(dt);
+        }
+
+        // Every command of the tick, then the tick's step, then the outputs
+        uint32_t end = i;
+        while (end < header.count)
+        {
+            TraceRecord next;
+            trace_decode(records + (size_t)end * TRACE_RECORD_SIZE, &next);
+            if (next.tick != r.tick || (end > i && (next.flags & TRACE_GAP)))
+                break;
+            apply(&next);
+            end++;
+        }
+        vehicle_step(dt);
+        tick = r.tick;
+        result->ticks++;
+
+        for (; i < end; i++)
+        {
+            TraceRecord done;
+            trace_decode(records + (size_t)i * TRACE_RECORD_SIZE, &done);
+            result->compared++;
+            if (!outputs_match(&done, tolerance))
+            {
+                if (diffs && result->mismatches < 10)
+                    print_diff(diffs, &done);
+                result->mismatches++;
+            }
+        }
+    }
+
+    motion_limits = saved_limits;
+    return true;
+}
@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+#include "custom.h"
+#include "encoder.h"
+#include "event_log.h"
+#include "event_stream.h"
+#include "http_control.h"
+#include "http_route.h"
+#include "key3.h"
+#include "lwip/apps/fs.h"
+#include "lwip/apps/httpd.h"
+#if LWIP_STATS
+#include "lwip/stats.h"
+#endif
+#include "pico/time.h"
+#include "script.h"
+#include "session.h"
+#include "speed_control.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "vehicle.h"
+
+// Replies of requests httpd is still sending; one is taken in fs_open_custom and given
+// back in fs_close_custom, so overlapping requests never share a buffer
+typedef struct
+{
+    bool used;
+    uint32_t client; // counted in flight for admission until the slot is closed
+    char json[JSON_BUFFER_SIZE];
+} ResponseSlot;
+
+static ResponseSlot response_slots[HTTP_RESPONSE_SLOTS];
+
+// The /stats reply is large and rarely fetched, so there is one buffer; a second request
+// while it is being sent gets a 404
+static char stats_json[STATS_BUFFER_SIZE];
+static bool stats_busy;
+
+// Command of the CGI call whose reply httpd opens next. httpd opens the file the handler
+// names right after it returns, in the same lwIP callback, so one is enough.
+static int pending_command = CMD_NONE;
+
+// Outcome of the /script.cgi call whose reply httpd opens next, likewise
+static ScriptResult pending_script;
+
+// Client of that call, and whether it was a STOP or a release let past admission control
+static uint32_t pending_client;
+static bool pending_priority;
+
+// The reply that call named, until httpd opens it. The context above is good for that
+// one open only: a GET of a reply file without its CGI call finds none and gets a 404.
+static const char *pending_reply;
+
+// The answer to a refused request: a complete response, sent as it is, with no slot
+static const char too_many_requests[] = "HTTP/1.0 429 Too Many Requests\r\n"
+                                        "Content-Length: 0\r\n"
+                                        "Retry-After: 1\r\n"
+                                        "\r\n";
+
+// The answer to the driver's release, which skips admission control: constant too, so a
+// slow reader cannot keep a slot with it
+static const char released[] = "HTTP/1.0 204 No Content\r\n"
+                               "Content-Length: 0\r\n"
+                               "\r\n";
+
+HttpControlStats http_control_stats;
+
+// The status JSON around its numbers; the encoder counts only with encoders fitted
+static const char status_head[] = "{\"status\":1, \"command\":\"";
+static const char status_middle[] = "\", \"vehicle_speed\":\"";
+static const char status_encoders[] = "\", \"encoders\":[";
+static const char status_tail[] = "\"}";
+
+static char *put_text(char *p, const char *end, const char *text, size_t len)
+{
+    if (p == NULL || (size_t)(end - p) < len)
+        return NULL;
+    memcpy(p, text, len);
+    return p + len;
+}
+
+static char *put_int(char *p, const char *end, int value)
+{
+    char digits[12];
+    int n = 0;
+    unsigned v = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+
+    do
+    {
+        digits[sizeof(digits) - 1 - n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0)
+        digits[sizeof(digits) - 1 - n++] = '-';
+    return put_text(p, end, digits + sizeof(digits) - n, n);
+}
+
+int http_control_format_status(char *buf, size_t len, int command)
+{
+    const char *end = buf + len - 1; // room for the terminator
+    char *p = buf;
+
+    if (len == 0)
+        return -1;
+    p = put_text(p, end, status_head, sizeof(status_head) - 1);
+    p = put_int(p, end, command);
+    p = put_text(p, end, status_middle, sizeof(status_middle) - 1);
+    p = put_int(p, end, vehicle_speed);
+    if (encoder_present())
+    {
+        p = put_text(p, end, status_encoders, sizeof(status_encoders) - 1);
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+        {
+            if (i > 0)
+                p = put_text(p, end, ",", 1);
+            p = put_int(p, end, (int)wheel_speeds[i].count);
+        }
+        p = put_text(p, end, "]}", 2);
+    }
+    else
+        p = put_text(p, end, status_tail, sizeof(status_tail) - 1);
+    if (p == NULL)
+        return -1;
+    *p = '\0';
+    return (int)(p - buf);
+}
+
+// Admission control (admission.h), before any handler runs. A refused request gets the
+// 429 and goes no further.
+static bool admit(uint32_t client, bool priority)
+{
+    pending_client = client;
+    pending_priority = priority;
+    AdmissionResult result =
+        admission_check(pending_client, priority, to_ms_since_boot(get_absolute_time()));
+    if (result == ADMISSION_LIMITED || result == ADMISSION_BUSY)
+    {
+        EVENT_LOG(EV_HTTP_REFUSED, pending_client, result, 0);
+        return false;
+    }
+    return true;
+}
+
+static void submit(const VehicleCommand *cmd)
+{
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    telemetry_count_request(now_ms);
+    session_submit(SESSION_HTTP, pending_client, cmd, now_ms);
+}
+
+// /control.cgi?command=<CMD>. An unknown or missing command is treated as NONE.
+enum
+{
+    CONTROL_ID,
+    CONTROL_COMMAND
+};
+static const RouteParam control_params[] = {
+    ROUTE_PARAM_ID,
+    {"command", ROUTE_COMMAND},
+};
+
+// STOP, and the release of the movement the client is driving: a refused release would
+// leave the robot driving until its lease ran out. Any other NON waits its turn, so a
+// client gets one priority release per movement it was admitted for.
+static bool control_halts(const RouteArgs *args)
+{
+    if (!route_has(args, CONTROL_COMMAND))
+        return false;
+    CommandType command = args->values[CONTROL_COMMAND].command;
+    return command == CMD_STOP ||
+           (command == CMD_NONE && route_has(args, CONTROL_ID) &&
+            session_holds_movement(SESSION_HTTP, args->values[CONTROL_ID].u,
+                                   to_ms_since_boot(get_absolute_time())));
+}
+
+static const char *cgi_control(const RouteArgs *args)
+{
+    // Fail-safe: anything but a known command is CMD_NONE
+    CommandType command = CMD_NONE;
+    if (route_has(args, CONTROL_COMMAND))
+        command = args->values[CONTROL_COMMAND].command;
+    else
+        telemetry.parse_failures++;
+    VehicleCommand cmd = {(uint8_t)command, 0, 0};
+    submit(&cmd);
+    if (pending_priority && command == CMD_NONE)
+    {
+        EVENT_LOG(EV_HTTP_COMMAND, command, pending_client, vehicle_speed);
+        return "/released";
+    }
+
+    // The reply is built when httpd opens it; it reports the state as of the last control
+    // loop tick
+    pending_command = command;
+
+    EVENT_LOG(EV_HTTP_COMMAND, command, pending_client, vehicle_speed);
+    return "/json_response";
+}
+
+// /drive.cgi?throttle=<t>&turn=<r>, components in -DRIVE_SCALE..DRIVE_SCALE. A request
+// without a valid vector is treated as NONE, like an unknown command.
+enum
+{
+    DRIVE_ID,
+    DRIVE_THROTTLE,
+    DRIVE_TURN
+};
+static const RouteParam drive_params[] = {
+    ROUTE_PARAM_ID,
+    {"throttle", ROUTE_INT, -DRIVE_SCALE, DRIVE_SCALE},
+    {"turn", ROUTE_INT, -DRIVE_SCALE, DRIVE_SCALE},
+};
+
+static const char *cgi_drive(const RouteArgs *args)
+{
+    int throttle = 0, turn = 0;
+    CommandType command = CMD_NONE;
+
+    if (route_has(args, DRIVE_THROTTLE) && route_has(args, DRIVE_TURN))
+    {
+        throttle = args->values[DRIVE_THROTTLE].i;
+        turn = args->values[DRIVE_TURN].i;
+        command = CMD_DRIVE;
+    }
+    else
+        telemetry.parse_failures++;
+    VehicleCommand cmd = {(uint8_t)command, (int16_t)throttle, (int16_t)turn};
+    submit(&cmd);
+
+    pending_command = command;
+    EVENT_LOG(EV_HTTP_DRIVE, throttle, turn, pending_client);
+    return "/json_response";
+}
+
+// /script.cgi?steps=FWD:2000:6,RGT:500,STP - load a script (see script.h) and start it
+// like a movement command. The reply reports the steps and total duration, or the first
+// invalid step.
+enum
+{
+    SCRIPT_ID,
+    SCRIPT_STEPS
+};
+static const RouteParam script_params[] = {
+    ROUTE_PARAM_ID,
+    {"steps", ROUTE_TEXT},
+};
+
+static const char *cgi_script(const RouteArgs *args)
+{
+    const char *steps = route_has(args, SCRIPT_STEPS) ? args->values[SCRIPT_STEPS].text : "";
+
+    telemetry_count_request(to_ms_since_boot(get_absolute_time()));
+    pending_script = script_load(steps);
+    if (pending_script.error == SCRIPT_OK)
+    {
+        VehicleCommand cmd = {CMD_SCRIPT, 0, 0};
+        if (session_submit(SESSION_HTTP, pending_client, &cmd,
+                           to_ms_since_boot(get_absolute_time())) ==
+            SESSION_DENIED)
+            pending_script.error = SCRIPT_DENIED;
+    }
+    else
+    {
+        telemetry.parse_failures++;
+    }
+    EVENT_LOG(EV_HTTP_SCRIPT, pending_script.error, pending_script.steps,
+              pending_script.duration_ms);
+    return "/script_response";
+}
+
+// The CGI endpoints: path, handler, parameters, priority and the parameters the priority
+// check reads, which are parsed before admission with the id. A new endpoint is one more
+// line here and its handler; httpd hands the dispatcher the index of the match.
+#define HTTP_ROUTES(X)                                                                    \
+    X("/control.cgi", cgi_control, control_params, control_halts, 1u << CONTROL_COMMAND)  \
+    X("/drive.cgi", cgi_drive, drive_params, NULL, 0)                                     \
+    X("/script.cgi", cgi_script, script_params, NULL, 0)
+
+#define ROUTE_ENTRY(path, handler, params, priority, priority_params)                     \
+    {path, handler, params, LWIP_ARRAYSIZE(params), priority, priority_params},
+static const Route routes[] = {HTTP_ROUTES(ROUTE_ENTRY)};
+
+// Admit the request on its id and what its priority check reads, then parse the rest as
+// its route's and hand it to the route's handler
+static const char *cgi_dispatch(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+{
+    uint32_t start_us = time_us_32();
+    const Route *route = &routes[iIndex];
+    uint8_t early = (uint8_t)(1u << 0 | route->priority_params);
+    RouteArgs args = {.valid = 0};
+
+    pending_reply = NULL;
+    http_route_parse_some(route, early, iNumParams, pcParam, pcValue, &args);
+    uint32_t client = route_has(&args, 0) ? args.values[0].u : 0;
+    if (!admit(client, route->priority != NULL && route->priority(&args)))
+    {
+        telemetry_record(&telemetry.cgi, time_us_32() - start_us);
+        return "/429";
+    }
+    http_route_parse_some(route, (uint8_t)~early, iNumParams, pcParam, pcValue, &args);
+    const char *file = route->handler(&args);
+    pending_reply = file;
+    telemetry_record(&telemetry.cgi, time_us_32() - start_us);
+    return file;
+}
+
+static void get_lwip_stats(TelemetryLwip *out)
+{
+    memset(out, 0, sizeof(*out));
+#if LWIP_STATS && MEM_STATS
+    out->mem_used = lwip_stats.mem.used;
+    out->mem_max = lwip_stats.mem.max;
+    out->mem_err = lwip_stats.mem.err;
+#endif
+#if LWIP_STATS && MEMP_STATS
+    out->pbuf_pool_used = lwip_stats.memp[MEMP_PBUF_POOL]->used;
+    out->pbuf_pool_max = lwip_stats.memp[MEMP_PBUF_POOL]->max;
+    out->pbuf_pool_err = lwip_stats.memp[MEMP_PBUF_POOL]->err;
+    out->tcp_pcb_used = lwip_stats.memp[MEMP_TCP_PCB]->used;
+    out->tcp_pcb_max = lwip_stats.memp[MEMP_TCP_PCB]->max;
+    out->tcp_seg_max = lwip_stats.memp[MEMP_TCP_SEG]->max;
+#endif
+}
+
+static int open_stats(struct fs_file *file)
+{
+    TelemetryLwip lwip;
+
+    if (stats_busy)
+        return 0;
+    get_lwip_stats(&lwip);
+    int len = telemetry_format_json(stats_json, sizeof(stats_json), &lwip,
+                                    to_ms_since_boot(get_absolute_time()));
+    if (len < 0)
+        return 0;
+    stats_busy = true;
+    file->data = stats_json;
+    file->len = len;
+    file->index = 0;
+    file->pextension = stats_json;
+    return 1;
+}
+
+// The last free slot is kept for a STOP, so a STOP is answered however many replies the
+// other clients hold. A release let past admission takes no slot at all.
+static ResponseSlot *take_slot(void)
+{
+    ResponseSlot *slot = NULL;
+    int free_slots = 0;
+    for (int i = 0; i < HTTP_RESPONSE_SLOTS; i++)
+    {
+        if (!response_slots[i].used)
+        {
+            if (slot == NULL)
+                slot = &response_slots[i];
+            free_slots++;
+        }
+    }
+    if (free_slots == 1 && !pending_priority)
+        slot = NULL;
+    if (slot == NULL)
+    {
+        http_control_stats.slots_exhausted++;
+        EVENT_LOG(EV_HTTP_NO_SLOT, 0, 0, 0);
+    }
+    return slot;
+}
+
+static int open_slot(struct fs_file *file, ResponseSlot *slot, int len)
+{
+    if (len < 0 || len >= (int)sizeof(slot->json))
+        return 0;
+    slot->used = true;
+    slot->client = pending_client;
+    admission_open(slot->client);
+    file->data = slot->json; // httpd sends straight from the slot until fs_close_custom
+    file->len = len;
+    file->index = 0;
+    file->pextension = slot;
+    return 1;
+}
+
+// Whether the last CGI call named this reply; either way its context is used up
+static bool take_pending(const char *name)
+{
+    bool fresh = pending_reply != NULL && strcmp(pending_reply, name) == 0;
+    pending_reply = NULL;
+    return fresh;
+}
+
+static int open_status(struct fs_file *file)
+{
+    if (!take_pending("/json_response"))
+        return 0;
+    ResponseSlot *slot = take_slot();
+    if (slot == NULL)
+        return 0;
+    return open_slot(file, slot,
+                     http_control_format_status(slot->json, sizeof(slot->json), pending_command));
+}
+
+static int open_script_reply(struct fs_file *file)
+{
+    if (!take_pending("/script_response"))
+        return 0;
+    ResponseSlot *slot = take_slot();
+    if (slot == NULL)
+        return 0;
+    const ScriptResult *r = &pending_script;
+    int len;
+    if (r->error == SCRIPT_OK)
+        len = snprintf(slot->json, sizeof(slot->json),
+                       "{\"status\":1, \"steps\":%d, \"duration_ms\":%lu}", r->steps,
+                       (unsigned long)r->duration_ms);
+    else
+        len = snprintf(slot->json, sizeof(slot->json),
+                       "{\"status\":0, \"error\":\"%s\", \"step\":%d}",
+                       script_error_name(r->error), r->steps);
+    return open_slot(file, slot, len);
+}
+
+// Constant and complete, header included: nothing to build or give back
+static int open_constant(struct fs_file *file, const char *response, size_t len)
+{
+    file->data = response;
+    file->len = (int)len;
+    file->index = 0;
+    file->flags |= FS_FILE_FLAGS_HEADER_INCLUDED;
+    file->pextension = NULL;
+    return 1;
+}
+
+static int open_refused(struct fs_file *file)
+{
+    return open_constant(file, too_many_requests, sizeof(too_many_requests) - 1);
+}
+
+static int open_released(struct fs_file *file)
+{
+    if (!take_pending("/released"))
+        return 0;
+    return open_constant(file, released, sizeof(released) - 1);
+}
+
+// The custom files, perfect-hashed by the three characters after the '/' (key3.h). httpd
+// asks here first for every file, so a page or an asset costs one lookup and at most one
+// string compare before it goes to the generated file system.
+#define CUSTOM_FILE_HASH_BITS 4
+#define CUSTOM_FILE_HASH_MUL 0x9e3779b1u
+#define CUSTOM_FILE(a, b, c, path, open, timed)                                           \
+    [KEY3_SLOT(KEY3(a, b, c), CUSTOM_FILE_HASH_MUL, CUSTOM_FILE_HASH_BITS)] = {path, open, timed}
+
+static const struct
+{
+    const char *name; // NULL in an empty slot
+    int (*open)(struct fs_file *file);
+    bool timed; // recorded in the fs_open histogram
+} custom_files[1 << CUSTOM_FILE_HASH_BITS] = {
+    CUSTOM_FILE('4', '2', '9', "/429", open_refused, false),
+    CUSTOM_FILE('r', 'e', 'l', "/released", open_released, false),
+    CUSTOM_FILE('j', 's', 'o', "/json_response", open_status, true),
+    CUSTOM_FILE('s', 'c', 'r', "/script_response", open_script_reply, true),
+    CUSTOM_FILE('s', 't', 'a', "/stats", open_stats, true),
+    CUSTOM_FILE('e', 'v', 'e', "/events", event_stream_open, true),
+    CUSTOM_FILE('t', 'r', 'a', "/trace.bin", trace_download_open, true),
+};
+
+int fs_open_custom(struct fs_file *file, const char *name)
+{
+    uint32_t start_us = time_us_32();
+
+    if (name[0] != '/')
+        return 0;
+    uint32_t slot = KEY3_SLOT(key3_prefix(name + 1), CUSTOM_FILE_HASH_MUL, CUSTOM_FILE_HASH_BITS);
+    if (custom_files[slot].name == NULL || strcmp(custom_files[slot].name, name) != 0)
+        return 0; // File not found
+    int found = custom_files[slot].open(file);
+    if (custom_files[slot].timed)
+        telemetry_record(&telemetry.fs_open, time_us_32() - start_us);
+    return found;
+}
+
+// httpd only reads custom files without data: the event streams and the trace download.
+// Replies and /stats are always ready.
+u8_t fs_canread_custom(struct fs_file *file)
+{
+    return file->data != NULL || event_stream_can_read(file) || trace_download_can_read(file);
+}
+
+u8_t fs_wait_read_custom(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg)
+{
+    return event_stream_wait(file, callback_fn, callback_arg);
+}
+
+int fs_read_async_custom(struct fs_file *file, char *buffer, int count, fs_wait_cb callback_fn,
+                         void *callback_arg)
+{
+    (void)callback_fn;
+    (void)callback_arg;
+    if (trace_download_can_read(file))
+        return trace_download_read(file, buffer, count);
+    return event_stream_read(file, buffer, count);
+}
+
+void fs_close_custom(struct fs_file *file)
+{
+    ResponseSlot *slot = (ResponseSlot *)file->pextension;
+    if (event_stream_close(file) || trace_download_close(file))
+        return;
+    if (file->pextension == stats_json)
+    {
+        stats_busy = false;
+        file->pextension = NULL;
+    }
+    else if (slot != NULL)
+    {
+        slot->used = false;
+        admission_close(slot->client);
+        file->pextension = NULL;
+    }
+}
+
+#define CGI_ENTRY(path, handler, params, priority, priority_params)                       \
+    {path, cgi_dispatch},
+static const tCGI cgi_handlers[] = {HTTP_ROUTES(CGI_ENTRY)};
+
+void http_control_init(void)
+{
+    http_set_cgi_handlers(cgi_handlers, LWIP_ARRAYSIZE(cgi_handlers));
+}
@@ -0,0 +1,22 @@
+#ifndef HTTP_CONTROL_H
+#define HTTP_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t slots_exhausted; // replies refused because every response slot was in use
+} HttpControlStats;
+
+extern HttpControlStats http_control_stats;
+
+// Register the control CGI handlers with lwIP's httpd.
+// The custom-file callbacks (fs_open_custom & co.) are picked up by httpd at link time.
+void http_control_init(void);
+
+// Write the status JSON sent back to clients after a command. Returns its length, or -1
+// if it does not fit.
+int http_control_format_status(char *buf, size_t len, int command);
+
+#endif // HTTP_CONTROL_H
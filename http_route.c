@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "http_route.h"
+
+// Up to max_digits decimal digits at *s; at least one. Leaves *s after them.
+static bool parse_digits(const char **s, int max_digits, uint64_t *value, int *digits)
+{
+    uint64_t v = 0;
+    int n = 0;
+    while (**s >= '0' && **s <= '9')
+    {
+        if (++n > max_digits)
+            return false;
+        v = v * 10 + (uint64_t)(*(*s)++ - '0');
+    }
+    *value = v;
+    *digits = n;
+    return n > 0;
+}
+
+static int32_t clamp(int64_t v, int32_t min, int32_t max)
+{
+    return v < min ? min : v > max ? max : (int32_t)v;
+}
+
+static bool parse_value(const RouteParam *param, const char *s, RouteValue *out)
+{
+    bool negative = false;
+    uint64_t whole, fraction = 0;
+    int digits, fraction_digits = 0;
+
+    switch (param->type)
+    {
+    case ROUTE_TEXT:
+        out->text = s;
+        return true;
+    case ROUTE_COMMAND:
+        return vehicle_parse_command(s, strlen(s), &out->command);
+    case ROUTE_UINT:
+        if (!parse_digits(&s, 10, &whole, &digits) || *s != '\0' || whole > UINT32_MAX)
+            return false;
+        out->u = (uint32_t)whole;
+        return true;
+    case ROUTE_INT:
+    case ROUTE_FLOAT:
+        break;
+    }
+
+    if (*s == '-')
+    {
+        negative = true;
+        s++;
+    }
+    if (!parse_digits(&s, 9, &whole, &digits))
+        return false;
+    if (param->type == ROUTE_INT)
+    {
+        if (*s != '\0')
+            return false;
+        out->i = clamp(negative ? -(int64_t)whole : (int64_t)whole, param->min, param->max);
+        return true;
+    }
+
+    // Whole and fraction digits rather than strtof, which would also take exponents, hex
+    // and "nan"
+    if (*s == '.')
+    {
+        s++;
+        if (!parse_digits(&s, 6, &fraction, &fraction_digits))
+            return false;
+    }
+    if (*s != '\0')
+        return false;
+    float v = (float)whole;
+    if (fraction_digits > 0)
+    {
+        static const float scale[] = {1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f};
+        v += (float)fraction / scale[fraction_digits - 1];
+    }
+    if (negative)
+        v = -v;
+    out->f = v < (float)param->min ? (float)param->min
+           : v > (float)param->max ? (float)param->max
+                                   : v;
+    return true;
+}
+
+void http_route_parse(const Route *route, int num, char *names[], char *values[],
+                      RouteArgs *args)
+{
+    args->valid = 0;
+    http_route_parse_some(route, ROUTE_ALL_PARAMS, num, names, values, args);
+}
+
+void http_route_parse_some(const Route *route, uint8_t params, int num, char *names[],
+                           char *values[], RouteArgs *args)
+{
+    // Parameters not asked for (or not the route's) count as seen, so no name is compared
+    // against them, and the scan ends once every one asked for has been found
+    uint8_t seen = (uint8_t)~(params & ((1u << route->num_params) - 1));
+
+    for (int i = 0; i < num && seen != 0xff; i++)
+    {
+        if (names[i] == NULL || values[i] == NULL)
+            continue;
+        for (int p = 0; p < route->num_params; p++)
+        {
+            if ((seen >> p) & 1 || strcmp(names[i], route->params[p].name) != 0)
+                continue;
+            seen |= 1u << p;
+            if (parse_value(&route->params[p], values[i], &args->values[p]))
+                args->valid |= 1u << p;
+            break;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef HTTP_ROUTE_H
+#define HTTP_ROUTE_H
+
+// The CGI endpoints as a table fixed at compile time (http_control.c). Every route names
+// its parameters and their types; one dispatcher parses a request's values into a
+// RouteArgs on the stack before the route's handler sees them, so a handler never scans
+// pcParam itself. Only the id and what the priority check reads are parsed before
+// admission control; a refused request costs nothing more. httpd passes the index of the matched route, so finding the route costs
+// nothing once httpd has matched the path, however many routes there are.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vehicle.h"
+
+typedef enum
+{
+    ROUTE_INT,     // an optional '-' and up to 9 digits, clamped to min..max
+    ROUTE_UINT,    // up to 10 digits, 0..UINT32_MAX; min and max unused
+    ROUTE_FLOAT,   // ROUTE_INT with an optional fraction, clamped to min..max
+    ROUTE_COMMAND, // a command name, "NON" included (vehicle_parse_command)
+    ROUTE_TEXT,    // the value as it is, valid until the handler returns
+} RouteParamType;
+
+typedef struct
+{
+    const char *name;
+    RouteParamType type;
+    int32_t min, max;
+} RouteParam;
+
+// The client id the page sends with every request, first parameter of every route so the
+// dispatcher can find it for admission control
+#define ROUTE_PARAM_ID {"id", ROUTE_UINT, 0, 0}
+
+#define ROUTE_MAX_PARAMS 4
+#define ROUTE_ALL_PARAMS ((1u << ROUTE_MAX_PARAMS) - 1)
+
+typedef union
+{
+    int32_t i;
+    uint32_t u;
+    float f;
+    CommandType command;
+    const char *text;
+} RouteValue;
+
+typedef struct
+{
+    RouteValue values[ROUTE_MAX_PARAMS]; // in the order of the route's parameters
+    uint8_t valid; // bit i: parameter i was given, with a value of its type
+} RouteArgs;
+
+typedef struct
+{
+    const char *path;
+    // Parses nothing, just acts on args; returns the file httpd sends back
+    const char *(*handler)(const RouteArgs *args);
+    const RouteParam *params;
+    uint8_t num_params; // up to ROUTE_MAX_PARAMS
+    // Whether the request goes ahead of admission control (a STOP); NULL for never
+    bool (*priority)(const RouteArgs *args);
+    // Bit i: priority reads parameter i. These and the id are all it can see.
+    uint8_t priority_params;
+} Route;
+
+static inline bool route_has(const RouteArgs *args, int param)
+{
+    return (args->valid >> param) & 1;
+}
+
+// Parse a request's parameters as the route's. The first occurrence of a name counts,
+// later ones, unknown names and values not of the type are ignored. Takes at most
+// num * route->num_params name compares, and no allocation.
+void http_route_parse(const Route *route, int num, char *names[], char *values[],
+                      RouteArgs *args);
+
+// Parse only the route's parameters whose bits are set in params, adding them to args;
+// the others stay as they were, so a request can be parsed in parts
+void http_route_parse_some(const Route *route, uint8_t params, int num, char *names[],
+                           char *values[], RouteArgs *args);
+
+#endif // HTTP_ROUTE_H
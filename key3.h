@@ -0,0 +1,34 @@
+#ifndef KEY3_H
+#define KEY3_H
+
+// Perfect-hash lookup of short names by their first three characters, packed into one
+// 32-bit key. A table has 1 << bits slots and is filled at compile time with designated
+// initializers, each entry at KEY3_SLOT of its own key, so a lookup is one multiply, one
+// load and one compare whatever the number of names. tools/key3_hash.py finds the
+// multiplier that gives every name of a table its own slot; the host checks look every
+// name up again, so a collision (one entry overriding another) fails there.
+
+#include <stdint.h>
+
+#define KEY3(a, b, c) ((uint32_t)(uint8_t)(a) | (uint32_t)(uint8_t)(b) << 8 | \
+                       (uint32_t)(uint8_t)(c) << 16)
+
+#define KEY3_SLOT(key, multiplier, bits) ((uint32_t)((key) * (multiplier)) >> (32 - (bits)))
+
+// Key of a name known to have at least three characters
+static inline uint32_t key3(const char *s)
+{
+    return KEY3(s[0], s[1], s[2]);
+}
+
+// Key of the first three characters of a string, or fewer up to its terminator
+static inline uint32_t key3_prefix(const char *s)
+{
+    if (s[0] == '\0')
+        return 0;
+    if (s[1] == '\0')
+        return KEY3(s[0], 0, 0);
+    return KEY3(s[0], s[1], s[2]);
+}
+
+#endif // KEY3_H
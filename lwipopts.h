@@ -19,9 +19,20 @@
 #define MEM_LIBC_MALLOC             0
 #endif
 #define MEM_ALIGNMENT               4
-#define MEM_SIZE                    4000
+// The heap (custom.h is force-included ahead of this): every open event stream, and the
+// one /trace.bin download, holds an httpd send buffer of HTTPD_WRITE_LEN and has up to
+// one more write's copy in flight, and
+// every reply slot its JSON copy with headers; the 4000 bytes that used to be all of it
+// are left for /stats, the pages' headers, WebSocket and UDP replies and DHCP.
+#define HTTPD_OPEN_STREAMS          (EVENT_STREAM_MAX_CLIENTS + 1)
+#define MEM_SIZE                    (HTTPD_OPEN_STREAMS * 2 * HTTPD_WRITE_LEN + \
+                                     HTTP_RESPONSE_SLOTS * 256 + 4000)
 #define MEMP_NUM_TCP_SEG            32
 #define MEMP_NUM_ARP_QUEUE          10
+// Connections: the reply slots, /stats, the open streams, the WebSocket clients, and two
+// for loading the page and its assets
+#define MEMP_NUM_TCP_PCB            (HTTP_RESPONSE_SLOTS + 1 + HTTPD_OPEN_STREAMS + \
+                                     WS_MAX_CLIENTS + 2)
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
 #define LWIP_ETHERNET               1
@@ -35,9 +46,10 @@
 #define LWIP_NETIF_LINK_CALLBACK    1
 #define LWIP_NETIF_HOSTNAME         1
 #define LWIP_NETCONN                0
-#define MEM_STATS                   0
+#define LWIP_STATS                  1
+#define MEM_STATS                   1  // heap and pool high-water marks for /stats
 #define SYS_STATS                   0
-#define MEMP_STATS                  0
+#define MEMP_STATS                  1
 #define LINK_STATS                  0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM       3
@@ -45,6 +57,7 @@
 #define LWIP_IPV4                   1
 #define LWIP_TCP                    1
 #define LWIP_UDP                    1
+#define LWIP_IGMP                   1  // fleet mode: the UDP_FLEET_GROUP multicast group
 #define LWIP_DNS                    1
 #define LWIP_TCP_KEEPALIVE          1
 #define LWIP_NETIF_TX_SINGLE_PBUF   1
@@ -54,7 +67,6 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG                  1
-#define LWIP_STATS                  1
 #define LWIP_STATS_DISPLAY          1
 #endif
 
@@ -0,0 +1,66 @@
+#include <math.h>
+
+#include "custom.h"
+#include "motion_profile.h"
+
+MotionLimits motion_limits = {
+    MOTION_PROFILE_SCURVE ? MOTION_SCURVE : MOTION_TRAPEZOIDAL,
+    MOTION_MAX_ACCEL,
+    MOTION_MAX_DECEL,
+    MOTION_MAX_JERK,
+};
+
+void motion_profile_reset(MotionProfile *p)
+{
+    p->velocity = 0.0f;
+    p->accel = 0.0f;
+    p->target = 0.0f;
+}
+
+float motion_profile_step(MotionProfile *p, const MotionLimits *limits, float dt)
+{
+    float err = p->target - p->velocity;
+    if (err == 0.0f && p->accel == 0.0f)
+        return p->velocity;
+
+    // Heading toward zero (slowing down, or the first half of a reversal) uses the decel limit
+    float limit = p->velocity * err < 0.0f ? limits->max_decel : limits->max_accel;
+
+    if (limits->shape == MOTION_TRAPEZOIDAL)
+    {
+        float dv = limit * dt;
+        if (fabsf(err) <= dv)
+        {
+            p->velocity = p->target;
+            p->accel = 0.0f;
+        }
+        else
+        {
+            p->accel = copysignf(limit, err);
+            p->velocity += p->accel * dt;
+        }
+        return p->velocity;
+    }
+
+    // S-curve: aim for the largest acceleration from which ramping it back to zero at the
+    // jerk limit still lands exactly on the target (v = a^2 / 2j), and move toward that
+    // acceleration by at most one jerk step.
+    float jerk_step = limits->max_jerk * dt;
+    float wanted = copysignf(fminf(limit, sqrtf(2.0f * limits->max_jerk * fabsf(err))), err);
+    if (wanted > p->accel + jerk_step)
+        p->accel += jerk_step;
+    else if (wanted < p->accel - jerk_step)
+        p->accel -= jerk_step;
+    else
+        p->accel = wanted;
+
+    float next = p->velocity + p->accel * dt;
+    if ((p->target - next) * err <= 0.0f)
+    {
+        // Reached or crossed the target
+        next = p->target;
+        p->accel = 0.0f;
+    }
+    p->velocity = next;
+    return p->velocity;
+}
@@ -0,0 +1,43 @@
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+// Time-based velocity ramps. Each wheel has a profile that moves its velocity toward a
+// target under acceleration (and, for S-curves, jerk) limits; the control loop steps every
+// profile once per tick with a fixed dt, so the response does not depend on how often or
+// from how many clients commands arrive.
+
+typedef enum
+{
+    MOTION_TRAPEZOIDAL, // constant acceleration: velocity ramps linearly
+    MOTION_SCURVE,      // acceleration itself ramps with the jerk limit
+} MotionShape;
+
+typedef struct
+{
+    MotionShape shape;
+    float max_accel; // full scale / s, speeding up
+    float max_decel; // full scale / s, slowing down or reversing
+    float max_jerk;  // full scale / s^2
+} MotionLimits;
+
+typedef struct
+{
+    float velocity; // signed, full scale = 1.0
+    float accel;
+    float target;
+} MotionProfile;
+
+// Limits used by the vehicle, initialised from custom.h
+extern MotionLimits motion_limits;
+
+void motion_profile_reset(MotionProfile *p);
+
+static inline void motion_profile_set_target(MotionProfile *p, float target)
+{
+    p->target = target;
+}
+
+// Advance by dt seconds and return the new velocity
+float motion_profile_step(MotionProfile *p, const MotionLimits *limits, float dt);
+
+#endif // MOTION_PROFILE_H
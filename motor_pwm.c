@@ -0,0 +1,110 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "custom.h"
+#include "hardware/clocks.h"
+#include "hardware/pwm.h"
+#include "motor_pwm.h"
+
+#define DIV_MIN (1 * 16)       // clock divider in 1/16ths
+#define DIV_MAX (256 * 16 - 1) // 255 + 15/16
+#define MIN_STEPS 100          // fewer duty steps than this does not count as reachable
+
+MotorPwmTiming motor_pwm_timing;
+MotorPwmTrim motor_pwm_trim[NUM_OF_WHEELS];
+
+static const uint16_t default_trim[] = MOTOR_TRIM;
+static const uint16_t default_deadband[] = MOTOR_DEADBAND;
+_Static_assert(sizeof(default_trim) / sizeof(default_trim[0]) >= NUM_OF_WHEELS &&
+                   sizeof(default_deadband) / sizeof(default_deadband[0]) >= NUM_OF_WHEELS,
+               "MOTOR_TRIM and MOTOR_DEADBAND need an entry per wheel");
+
+bool motor_pwm_plan(uint32_t sys_hz, uint32_t freq_hz, bool phase_correct, MotorPwmTiming *out)
+{
+    // One period in sixteenths of a system clock; phase-correct counts up and back down
+    uint64_t per_period = (uint64_t)freq_hz * (phase_correct ? 2 : 1);
+    uint64_t period16 = freq_hz ? ((uint64_t)sys_hz * 16 + per_period / 2) / per_period : 0;
+
+    // The smallest divider leaves the most counts, so the finest duty steps
+    uint64_t div16 = (period16 + DUTY_ONE - 1) / DUTY_ONE;
+    if (div16 < DIV_MIN)
+        div16 = DIV_MIN;
+    if (div16 > DIV_MAX)
+        div16 = DIV_MAX;
+    uint64_t steps = (period16 + div16 / 2) / div16;
+
+    bool ok = steps >= MIN_STEPS && steps <= DUTY_ONE;
+    if (steps < 2)
+        steps = 2;
+    if (steps > DUTY_ONE)
+        steps = DUTY_ONE;
+
+    out->wrap = (uint16_t)(steps - 1);
+    out->div_int = (uint8_t)(div16 / 16);
+    out->div_frac = (uint8_t)(div16 % 16);
+    out->phase_correct = phase_correct;
+    out->frequency_hz =
+        (uint32_t)(((uint64_t)sys_hz * 16) / (div16 * steps * (phase_correct ? 2 : 1)));
+    return ok;
+}
+
+void motor_pwm_init(void)
+{
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+    if (!motor_pwm_plan(sys_hz, PWM_FREQUENCY_HZ, PWM_PHASE_CORRECT, &motor_pwm_timing))
+        printf("PWM: %u Hz out of reach at %lu Hz system clock, using %lu Hz\n",
+               (unsigned)PWM_FREQUENCY_HZ, (unsigned long)sys_hz,
+               (unsigned long)motor_pwm_timing.frequency_hz);
+
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        motor_pwm_set_trim(i, default_trim[i], default_deadband[i]);
+}
+
+void motor_pwm_setup_pin(uint pin)
+{
+    // Set PWM function for ENA pins (NO NEED for gpio_init or set_dir)
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+    uint slice = pwm_gpio_to_slice_num(pin);
+    pwm_set_clkdiv_int_frac4(slice, motor_pwm_timing.div_int, motor_pwm_timing.div_frac);
+    pwm_set_wrap(slice, motor_pwm_timing.wrap);
+    pwm_set_phase_correct(slice, motor_pwm_timing.phase_correct);
+    pwm_set_gpio_level(pin, 0);
+    pwm_set_enabled(slice, true);
+}
+
+bool motor_pwm_set_trim(int wheel, int trim, int deadband)
+{
+    if (wheel < 0 || wheel >= NUM_OF_WHEELS || trim < 0 || trim > 1000 || deadband < 0 ||
+        deadband > 1000)
+        return false;
+    motor_pwm_trim[wheel].trim = (uint16_t)trim;
+    motor_pwm_trim[wheel].deadband = (uint16_t)deadband;
+    return true;
+}
+
+int32_t motor_pwm_duty(float velocity)
+{
+    float v = velocity > 1.0f ? 1.0f : velocity < -1.0f ? -1.0f : velocity;
+    return (int32_t)lroundf(v * DUTY_ONE);
+}
+
+uint16_t motor_pwm_level(int wheel, int32_t duty)
+{
+    // Called for every wheel on every tick, so written to compile without branches: the
+    // clamps are selects, and a stopped wheel masks the deadband out
+    uint32_t magnitude = duty < 0 ? -(uint32_t)duty : (uint32_t)duty;
+    magnitude = magnitude > DUTY_ONE ? DUTY_ONE : magnitude;
+
+    // Trimmed duty spread over what is above the deadband
+    const MotorPwmTrim *t = &motor_pwm_trim[wheel];
+    uint32_t base = (t->deadband * DUTY_ONE / 1000) & -(uint32_t)(magnitude != 0);
+    uint32_t trimmed = magnitude * t->trim / 1000;
+    uint32_t applied = base + (uint32_t)(((uint64_t)trimmed * (DUTY_ONE - base)) / DUTY_ONE);
+
+    // Full duty is wrap + 1, which holds the output high for the whole period; with a
+    // 16-bit wrap that does not fit the level register, and full is one step short
+    uint32_t level =
+        (uint32_t)(((uint64_t)applied * (motor_pwm_timing.wrap + 1u) + DUTY_ONE / 2) / DUTY_ONE);
+    return level > UINT16_MAX ? UINT16_MAX : (uint16_t)level;
+}
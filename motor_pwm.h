@@ -0,0 +1,62 @@
+#ifndef MOTOR_PWM_H
+#define MOTOR_PWM_H
+
+// PWM generation on the ENA pins. The clock divider and counter top (wrap) are picked for
+// PWM_FREQUENCY_HZ from the system clock, with the smallest divider that fits the period
+// in the 16-bit counter, so the duty gets the finest steps the frequency allows: all 16
+// bits up to about 2.3 kHz, 7500 steps at 20 kHz from 150 MHz, half of that in
+// phase-correct mode.
+//
+// Wheel.duty is a signed 16-bit duty fraction (DUTY_ONE is full duty), fine enough for
+// every counter step at any frequency; Wheel.speed keeps the coarser SPEED_SCALE only for
+// reporting. motor_pwm_level() turns the duty into counter levels, applying each wheel's
+// trim (a motor that runs faster than the others is scaled down to match) and deadband
+// (the duty any nonzero speed starts from, so the bottom of the range is not spent on
+// duties too low to turn the motor against friction and the L298N's voltage drop).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+#define DUTY_ONE 65536 // full duty as a 16-bit fraction
+
+typedef struct
+{
+    uint32_t frequency_hz; // actually achieved, after rounding wrap and divider
+    uint16_t wrap;         // counter top; full duty is level wrap + 1
+    uint8_t div_int;       // clock divider div_int + div_frac / 16, 1.0 .. 255 + 15/16
+    uint8_t div_frac;
+    bool phase_correct;
+} MotorPwmTiming;
+
+typedef struct
+{
+    uint16_t trim;     // per mille of the commanded duty, 0..1000
+    uint16_t deadband; // per mille of full duty, 0..1000
+} MotorPwmTrim;
+
+extern MotorPwmTiming motor_pwm_timing;
+extern MotorPwmTrim motor_pwm_trim[NUM_OF_WHEELS];
+
+// Divider and wrap for freq_hz from a sys_hz clock. Returns false if the frequency is out
+// of reach; out then holds the nearest timing the hardware can do.
+bool motor_pwm_plan(uint32_t sys_hz, uint32_t freq_hz, bool phase_correct, MotorPwmTiming *out);
+
+// Plan PWM_FREQUENCY_HZ from the current system clock and load the MOTOR_TRIM and
+// MOTOR_DEADBAND defaults
+void motor_pwm_init(void);
+
+// Route an ENA pin to its slice and start it with motor_pwm_timing
+void motor_pwm_setup_pin(uint pin);
+
+// Returns false for an out-of-range wheel or value. Takes effect at the next apply.
+bool motor_pwm_set_trim(int wheel, int trim, int deadband);
+
+// Signed duty, -DUTY_ONE..DUTY_ONE, of a velocity in full scale units
+int32_t motor_pwm_duty(float velocity);
+
+// Counter level for a wheel's signed duty; the sign is the direction pins' business
+uint16_t motor_pwm_level(int wheel, int32_t duty);
+
+#endif // MOTOR_PWM_H
@@ -9,88 +9,32 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "admission.h"
+#include "control_loop.h"
 #include "custom.h"
-#include "hardware/pwm.h"
+#include "event_log.h"
+#include "event_stream.h"
+#include "http_control.h"
 #include "lwip/ip4_addr.h"
 #include "pico/cyw43_arch.h"
 #include "pico/stdlib.h"
 // #include "lwip/apps/mdns.h"
 #include "lwip/apps/fs.h"
 #include "lwip/apps/httpd.h"
+#include "lwip/dhcp.h"
 #include "lwip/init.h"
-
-typedef enum
-{
-    CMD_FLT,  // Front Left
-    CMD_FRT,  // Front Right
-    CMD_FWD,  // Go Front
-    CMD_LFT,  // Left
-    CMD_RGT,  // Right
-    CMD_BLT,  // Back Left
-    CMD_BWD,  // Go Back
-    CMD_BRT,  // Back Right
-    CMD_STOP, // Stop all motors immediately
-    CMD_NONE  // No command has been received
-} CommandType;
-
-typedef struct
-{
-    uint en_pin;  // PWM enable pin
-    uint in1_pin; // Direction pin 1
-    uint in2_pin; // Direction pin 2
-    int speed;    // Speed (0 to +10)
-    float coef;   // Speed coefficient for this wheel
-} Wheel;
-
-Wheel wheels[] = {
-    {MOTOR_FRONT_RIGHT_ENA, MOTOR_FRONT_RIGHT_IN1, MOTOR_FRONT_RIGHT_IN2,0,1.0},                                                                   // Front right, index=0
-    {MOTOR_FRONT_LEFT_ENA, MOTOR_FRONT_LEFT_IN1, MOTOR_FRONT_LEFT_IN2, 0,1.0}, // Front left, index=1
-    {MOTOR_BACK_RIGHT_ENA, MOTOR_BACK_RIGHT_IN1, MOTOR_BACK_RIGHT_IN2, 0,1.0}, // Back right, index=2
-    {MOTOR_BACK_LEFT_ENA, MOTOR_BACK_LEFT_IN1, MOTOR_BACK_LEFT_IN2, 0, 1.0}     // Back left, index=3
-};
-
-int vehicle_speed = 0;
-
-/* Requires MAX_VEHICLE_SPEED defined in custom.h.
- * increase_vehicle_speed()  -> increase magnitude by 1 (clamped to MAX_VEHICLE_SPEED)
- * decrease_vehicle_speed()  -> decrease magnitude by 1 (clamped to 0)
- * Both preserve the current direction (sign) of vehicle_speed.
- */
-static inline void increase_vehicle_speed(void)
-{
-    if (vehicle_speed < MAX_VEHICLE_SPEED) {
-            vehicle_speed++;
-    }
-}
-
-static inline void decrease_vehicle_speed(void)
-{
-    if (vehicle_speed > 0)
-    {
-        vehicle_speed--;
-    }
-}
-
-// Create a virtual file to write the json report
-static char json_response[JSON_BUFFER_SIZE]; // Adjust size as needed
+#include "power.h"
+#include "script.h"
+#include "session.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "udp_server.h"
+#include "vehicle.h"
+#include "wifi_link.h"
+#include "ws_server.h"
 
 void httpd_init(void);
 
-static absolute_time_t wifi_connected_time;
-
-// store current and previous commands:
-// last_commands[0] = current, last_commands[1] = previous
-static CommandType last_commands[2] = {CMD_NONE, CMD_NONE};
-
-#define last_command (last_commands[0])
-#define prev_command (last_commands[1])
-
-static inline void push_command(CommandType cmd)
-{
-    last_commands[1] = last_commands[0];
-    last_commands[0] = cmd;
-}
-
 #if LWIP_MDNS_RESPONDER
 static void srv_txt(struct mdns_service *service, void *txt_userdata)
 {
@@ -122,332 +66,131 @@ static size_t get_mac_ascii(int idx, size_t chr_off, size_t chr_len, char *dest_
     return dest - dest_in;
 }
 
-CommandType get_command_enum(const char *command)
-{
-    if (strcmp(command, "FLT") == 0)
-        return CMD_FLT;
-    if (strcmp(command, "FRT") == 0)
-        return CMD_FRT;
-    if (strcmp(command, "FWD") == 0)
-        return CMD_FWD;
-    if (strcmp(command, "LFT") == 0)
-        return CMD_LFT;
-    if (strcmp(command, "RGT") == 0)
-        return CMD_RGT;
-    if (strcmp(command, "BLT") == 0)
-        return CMD_BLT;
-    if (strcmp(command, "BWD") == 0)
-        return CMD_BWD;
-    if (strcmp(command, "BRT") == 0)
-        return CMD_BRT;
-    if (strcmp(command, "STP") == 0)
-        return CMD_STOP;
-    return CMD_NONE; // Default if no match
-}
-
-// Setup pwms
-void setup_pwms()
+// cyw43's view of the station interface, for the connection state machine
+static WifiLinkStatus wifi_link_status(void)
 {
-    for (int i = 0; i < NUM_OF_WHEELS; i++)
-    {
-        // Set PWM function for ENA pins (NO NEED for gpio_init or set_dir)
-        gpio_set_function(wheels[i].en_pin, GPIO_FUNC_PWM);
-        uint slice = pwm_gpio_to_slice_num(wheels[i].en_pin);
-        pwm_set_wrap(slice, 1000);
-        pwm_set_enabled(slice, true);
-
-        // Initialize IN1 and IN2 pins as OUTPUT (needed for direction control)
-        gpio_init(wheels[i].in1_pin);
-        gpio_set_dir(wheels[i].in1_pin, GPIO_OUT);
-        gpio_put(wheels[i].in1_pin, 0); // Set to LOW initially
-
-        gpio_init(wheels[i].in2_pin);
-        gpio_set_dir(wheels[i].in2_pin, GPIO_OUT);
-        gpio_put(wheels[i].in2_pin, 0); // Set to LOW initially
-    }
-}
-
-// Helpers to classify commands
-static inline int is_forward_cmd(CommandType c)
-{
-    return (c == CMD_FWD || c == CMD_FLT || c == CMD_FRT);
-}
-
-static inline int is_backward_cmd(CommandType c)
-{
-    return (c == CMD_BWD || c == CMD_BLT || c == CMD_BRT);
-}
-
-// Update the vehicle direction and speed according to command history
-// Implements:
-// - If the current command equals the previous command -> increase speed magnitude by 1 (cap 10)
-// - If the current command is NONE and previous was a movement -> decrease speed magnitude by 1 toward 0
-// - If a new non-NONE command arrives -> start at magnitude 1 in the appropriate direction
-// The function also maps commands to individual wheel speeds.
-void update_vehicle()
-{
-    CommandType cmd = last_command;
-    CommandType prev = prev_command;
-
-    
-    // Handle immediate STOP
-    if (cmd == CMD_STOP)
-    {
-        vehicle_speed = 0;
-    }
-    else if (cmd == CMD_NONE)
-    {
-        // Ramp down toward 0 if coming from a previous command
-        if (prev != CMD_NONE)
-        {
-            // do nothing - keep the speed the same
-        }
-        else
-        {
-            decrease_vehicle_speed(); // ramp down if no previous command
-        }
-    }
-    else
-    {
-        // Non-NONE command incoming
-        if (cmd == prev)
-        {
-            // Repeat of the same command -> accelerate in current direction
-            increase_vehicle_speed();
-        }
-        else
-        {
-            vehicle_speed = 1; // start at magnitude 1 for new command
-
-            // update the forward/backward direction of each pin
-            switch (cmd)
-            {
-            case CMD_FWD:
-                wheels[0].coef = 1.0;  // front right
-                wheels[2].coef = 1.0;  // back right
-                wheels[1].coef = 1.0; // front left
-                wheels[3].coef = 1.0; // back left
-                break;
-            case CMD_BWD:
-                wheels[0].coef = -1.0;  // front right
-                wheels[2].coef = -1.0;  // back right
-                wheels[1].coef = -1.0; // front left
-                wheels[3].coef = -1.0; // back left
-                break;
-            case CMD_FLT:
-                wheels[0].coef = 0.5;  // front right
-                wheels[2].coef = 0.5;  // back right
-                wheels[1].coef = 1; // front left
-                wheels[3].coef = 1; // back left
-                break;
-            case CMD_FRT:
-                wheels[0].coef = 1.0;  // front right
-                wheels[2].coef = 1.0;  // back right
-                wheels[1].coef = 0.5; // front left
-                wheels[3].coef = 0.5; // back left
-                break;
-            case CMD_BLT:
-                wheels[0].coef = -0.5;  // front right
-                wheels[2].coef = -0.5;  // back right
-                wheels[1].coef = -1.0; // front left
-                wheels[3].coef = -1.0; // back left
-                break;
-            case CMD_BRT:
-                wheels[0].coef = -1.0;  // front right
-                wheels[2].coef = -1.0;  // back right
-                wheels[1].coef = -0.5; // front left
-                wheels[3].coef = -0.5; // back left
-                break;
-            case CMD_LFT:
-                wheels[0].coef = -1.0;  // front right
-                wheels[2].coef = -1.0;  // back right
-                wheels[1].coef = 1.0; // front left
-                wheels[3].coef = 1.0; // back left
-                break;
-            case CMD_RGT:
-                wheels[0].coef = 1.0;  // front right
-                wheels[2].coef = 1.0;  // back right
-                wheels[1].coef = -1.0; // front left
-                wheels[3].coef = -1.0; // back left
-                break;
-            default:
-                wheels[0].coef = 1.0;  // front right
-                wheels[2].coef = 1.0;  // back right
-                wheels[1].coef = 1.0; // front left
-                wheels[3].coef = 1.0; // back left
-                break;
-            }
-        }
-    }
-
-
-
-    // Apply to hardware: direction pins and PWM
-    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    switch (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA))
     {
-        
-        if (wheels[i].coef > 0)
-        { // Forward
-            gpio_put(wheels[i].in1_pin, 1);
-            gpio_put(wheels[i].in2_pin, 0);
-        }
-        else if (wheels[i].coef < 0)
-        { // Backward
-            gpio_put(wheels[i].in1_pin, 0);
-            gpio_put(wheels[i].in2_pin, 1);
-        }
-
-        wheels[i].speed = (int)(vehicle_speed * abs(wheels[i].coef));
-
-        int duty = (wheels[i].speed * 1000) / 10; // negative values handled by sign of speed
-        // pwm_set_gpio_level expects unsigned duty; ensure sign handled by direction pins
-        if (duty < 0)
-            duty = -duty;
-        pwm_set_gpio_level(wheels[i].en_pin, duty);
+    case CYW43_LINK_UP:
+        return WIFI_LINK_UP;
+    case CYW43_LINK_JOIN:
+    case CYW43_LINK_NOIP:
+        return WIFI_LINK_JOINING;
+    case CYW43_LINK_DOWN:
+        return WIFI_LINK_DOWN;
+    default:
+        return WIFI_LINK_FAILED; // CYW43_LINK_FAIL, _NONET, _BADAUTH
     }
 }
 
-static const char *cgi_control(int iIndex, int iNumParams, char *pcParam[], char *pcValue[])
+// Run the connection state machine once; called from the main loop, never blocks
+static void wifi_service(void)
 {
+    static bool join_refused;
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    WifiState before = wifi_link_state();
 
-    // Fail-safe parsing: default to CMD_NONE and only set if a valid, non-empty value is found.
-    CommandType command = CMD_NONE;
-
-    if (iNumParams > 0 && pcParam != NULL && pcValue != NULL)
-    {
-        for (int i = 0; i < iNumParams; i++)
-        {
-            const char *param = pcParam[i];
-            const char *value = pcValue[i];
-            if (param == NULL || value == NULL)
-                continue;
-            if (strcmp(param, "command") == 0 && value[0] != '\0')
-            {
-                CommandType parsed = get_command_enum(value);
-                if (parsed != CMD_NONE)
-                {
-                    command = parsed; // only accept known commands
-                }
-                break;
-            }
-        }
-    }
-
-    push_command(command);
-    update_vehicle();
-
-    // Update JSON response
-    snprintf(json_response, JSON_BUFFER_SIZE,
-             "{\"status\":1, \"command\":\"%d\", \"vehicle_speed\":\"%d\"}", command,
-             vehicle_speed);
-
-    // Log received parameters for debugging
-    printf("Command received. iIndex:%d iNumParams:%d pcParam1:%s pcValue1:%s\n", iIndex,
-           iNumParams, pcParam[0], pcValue[0]);
-    printf("Vehicle new status. Speed: %d, last_command: %d\n", vehicle_speed, last_command);
-
-    return "/json_response";
-}
-
-int fs_open_custom(struct fs_file *file, const char *name)
-{
-    if (strcmp(name, "/json_response") == 0)
-    {
-        printf("Read json_response file\n");
-        extern char json_response[];       // Reference the global variable
-        file->data = json_response;        // Set file data to the virtual file string
-        file->len = strlen(json_response); // Set file length
-        file->index = 0;                   // Start reading from the beginning
-        return 1;                          // Success
-    }
-    return 0; // File not found
+    cyw43_arch_lwip_begin();
+    WifiLinkStatus link = join_refused ? WIFI_LINK_FAILED : wifi_link_status();
+    cyw43_arch_lwip_end();
+    join_refused = false;
+
+    switch (wifi_link_poll(link, now_ms))
+    {
+    case WIFI_DO_CONNECT:
+        printf("Connecting to WiFi (attempt %lu)...\n", (unsigned long)wifi_link_stats.attempts);
+        if (cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK))
+            join_refused = true;
+        break;
+    case WIFI_DO_LEAVE:
+        cyw43_arch_lwip_begin();
+        cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+        cyw43_arch_lwip_end();
+        break;
+    case WIFI_DO_NOTHING:
+        break;
+    }
+
+    WifiState after = wifi_link_state();
+    if (after == before)
+        return;
+    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, after == WIFI_CONNECTED);
+    if (after == WIFI_CONNECTED)
+        printf("Connected after %lu ms, running httpd at %s\n", (unsigned long)now_ms,
+               ip4addr_ntoa(netif_ip4_addr(&cyw43_state.netif[CYW43_ITF_STA])));
+    else if (before == WIFI_CONNECTED)
+        printf("WiFi link lost, reconnecting\n");
+    else if (after == WIFI_BACKOFF)
+        printf("WiFi join failed (status %d), retrying\n", (int)link);
 }
 
-int fs_read_custom(struct fs_file *file, char *buffer, int count)
+// Follow the robot's activity with the radio's power management (power.h). A new link
+// starts in the driver's default mode, so the mode is set again after every join.
+static void power_service(void)
 {
-    // Ensure the file is valid and points to the virtual file
-    if (!file || file->data != json_response)
-    {
-        printf("Error: Invalid file or not a virtual file\n");
-        return -1; // Return error
-    }
+    static const uint32_t radio_pm[POWER_MODES] = {POWER_PM_ACTIVE, POWER_PM_IDLE,
+                                                   POWER_PM_PARKED};
+    static int radio_mode = -1; // as set on the radio; -1 while the link is down
 
-    // Calculate the remaining bytes to read
-    int available = file->len - file->index;
-    if (available <= 0)
+    PowerMode mode = power_poll(time_us_32(), !control_loop_idle());
+    if (wifi_link_state() != WIFI_CONNECTED)
     {
-        printf("No more data to read.\n");
-        return 0; // No data left to read
+        radio_mode = -1;
+        return;
     }
-
-    // Determine how many bytes to read
-    int to_read = (count < available) ? count : available;
-
-    // Copy the data to the provided buffer
-    memcpy(buffer, json_response + file->index, to_read);
-
-    // Update the file's read index
-    file->index += to_read;
-    printf("Read %d bytes from virtual file.\n", to_read);
-
-    return to_read; // Return the number of bytes read
-}
-
-void fs_close_custom(struct fs_file *file)
-{
-    if (file && file->data == json_response)
-    {
-        // Clear the contents of the virtual_file
-        memset(json_response, 0, sizeof(json_response));
-        printf("Cleared virtual file contents.\n");
-    }
-
-    // Log closure for debugging
-    printf("Closed virtual file: %p\n", file);
+    if ((int)mode == radio_mode)
+        return;
+    cyw43_arch_lwip_begin();
+    cyw43_wifi_pm(&cyw43_state, radio_pm[mode]);
+    cyw43_arch_lwip_end();
+    radio_mode = (int)mode;
 }
 
-static tCGI cgi_handlers[] = {{"/control.cgi", cgi_control}};
-
 int main()
 {
     stdio_init_all();
 
-    // Initialize all wheels
+    // Initialize all wheels and hand them over to the control loop on core 1
+    event_log_init();
+    telemetry_init();
     setup_pwms();
+    script_init();
+    trace_init();
+    control_loop_init();
+    control_loop_start();
 
-    // Wait some seconds before starting the web server
-    sleep_ms(5000);
-
+    // The network comes up in the background (wifi_service), so the wheels are held
+    // stopped by the control loop even if the radio never does
     if (cyw43_arch_init())
     {
         printf("failed to initialise\n");
-        return 1;
+        while (true)
+        {
+            event_log_drain(EVENT_LOG_SIZE);
+            sleep_ms(EVENT_LOG_DRAIN_MS);
+        }
     }
     cyw43_arch_enable_sta_mode();
 
-    cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-
     char hostname[sizeof(CYW43_HOST_NAME) + 4];
     memcpy(&hostname[0], CYW43_HOST_NAME, sizeof(CYW43_HOST_NAME) - 1);
     get_mac_ascii(CYW43_HAL_MAC_WLAN0, 8, 4, &hostname[sizeof(CYW43_HOST_NAME) - 1]);
     hostname[sizeof(hostname) - 1] = '\0';
     netif_set_hostname(&cyw43_state.netif[CYW43_ITF_STA], hostname);
 
-    printf("Connecting to WiFi...\n");
-    if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK,
-                                           30000))
-    {
-        printf("failed to connect.\n");
-        exit(1);
-    }
-    else
-    {
-        printf("Connected.\n");
-    }
-    printf("\nReady, running httpd at %s\n", ip4addr_ntoa(netif_ip4_addr(netif_list)));
-
-    // start http server
-    wifi_connected_time = get_absolute_time();
+#ifdef WIFI_STATIC_IP
+    // The address is usable as soon as the join completes, without a DHCP exchange
+    ip4_addr_t ip, netmask, gateway;
+    ip4addr_aton(WIFI_STATIC_IP, &ip);
+    ip4addr_aton(WIFI_STATIC_NETMASK, &netmask);
+    ip4addr_aton(WIFI_STATIC_GATEWAY, &gateway);
+    cyw43_arch_lwip_begin();
+    dhcp_stop(&cyw43_state.netif[CYW43_ITF_STA]);
+    netif_set_addr(&cyw43_state.netif[CYW43_ITF_STA], &ip, &netmask, &gateway);
+    cyw43_arch_lwip_end();
+#endif
+    wifi_link_init();
+    power_init(time_us_32());
 
 #if LWIP_MDNS_RESPONDER
     // Setup mdns
@@ -467,17 +210,31 @@ int main()
 #endif
     // setup http server
     cyw43_arch_lwip_begin();
-    http_set_cgi_handlers(cgi_handlers, LWIP_ARRAYSIZE(cgi_handlers));
+    session_init();
+    admission_init();
+    http_control_init();
+    event_stream_init();
     httpd_init();
+    ws_server_init();
+    udp_server_init();
     cyw43_arch_lwip_end();
 
     while (true)
     {
+        // Idle work: keep the network up, set the radio's power mode and print what the
+        // network callbacks and the control loop logged
+        wifi_service();
+        power_service();
+        event_log_drain(EVENT_LOG_SIZE);
+
+        // Then sleep until the mode's wait is up, or an interrupt (the radio, lwIP's
+        // timers) comes first
+        absolute_time_t until = make_timeout_time_ms(power_wait_ms());
 #if PICO_CYW43_ARCH_POLL
         cyw43_arch_poll();
-        cyw43_arch_wait_for_work_until(led_time);
+        cyw43_arch_wait_for_work_until(until);
 #else
-        sleep_ms(1000);
+        best_effort_wfe_or_timeout(until);
 #endif
     }
 #if LWIP_MDNS_RESPONDER
@@ -0,0 +1,110 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "custom.h"
+#include "power.h"
+#include "telemetry.h"
+
+PowerStats power_stats;
+
+// PowerMode; written by the main loop only, read by the lwIP context too
+static atomic_int mode;
+static uint32_t last_poll_us;
+// Written from the lwIP context, which can interrupt the main loop or run on the other
+// core. Times in us wrap after 71 minutes, which only matters before PARKED, and the
+// main loop polls far more often than that.
+static atomic_uint_least32_t last_activity_us;
+static atomic_uint_least32_t wake_from_us; // first command since leaving ACTIVE
+static atomic_bool wake_pending;           // set after wake_from_us, cleared by the poll
+
+static void enter(PowerMode next)
+{
+    atomic_store(&mode, next);
+    power_stats.entered[next]++;
+}
+
+// Back to ACTIVE if a command asked for it since the last poll
+static bool take_wake(uint32_t now_us)
+{
+    if (!atomic_exchange_explicit(&wake_pending, false, memory_order_acquire))
+        return false;
+    uint32_t from_us = atomic_load_explicit(&wake_from_us, memory_order_relaxed);
+    telemetry_record(&telemetry.wake, now_us - from_us);
+    power_stats.wakes++;
+    enter(POWER_ACTIVE);
+    return true;
+}
+
+void power_init(uint32_t now_us)
+{
+    memset(&power_stats, 0, sizeof(power_stats));
+    last_poll_us = now_us;
+    atomic_store(&last_activity_us, now_us);
+    atomic_store(&wake_pending, false);
+    enter(POWER_ACTIVE);
+}
+
+void power_note_activity(uint32_t now_us)
+{
+    // Stamp first, then look at the mode: a poll dropping the mode meanwhile stores the
+    // mode first and then looks at the stamp, so one of the two sees the other
+    atomic_store(&last_activity_us, now_us);
+    if (atomic_load(&mode) != POWER_ACTIVE &&
+        !atomic_load_explicit(&wake_pending, memory_order_relaxed))
+    {
+        atomic_store_explicit(&wake_from_us, now_us, memory_order_relaxed);
+        atomic_store_explicit(&wake_pending, true, memory_order_release);
+    }
+}
+
+PowerMode power_poll(uint32_t now_us, bool moving)
+{
+    // Whole milliseconds go to the mode they were spent in, the rest to the next poll
+    uint32_t elapsed_ms = (now_us - last_poll_us) / 1000;
+    power_stats.ms[mode] += elapsed_ms;
+    last_poll_us += elapsed_ms * 1000;
+    power_stats.polls++;
+
+    if (moving)
+        atomic_store(&last_activity_us, now_us);
+    if (take_wake(now_us))
+        return POWER_ACTIVE;
+
+    uint32_t activity_us = atomic_load(&last_activity_us);
+    uint32_t quiet_ms = (now_us - activity_us) / 1000;
+    PowerMode current = (PowerMode)atomic_load_explicit(&mode, memory_order_relaxed);
+    if (current == POWER_ACTIVE && quiet_ms >= POWER_IDLE_AFTER_MS)
+        enter(POWER_IDLE);
+    else if (current == POWER_IDLE && quiet_ms >= POWER_PARKED_AFTER_MS)
+        enter(POWER_PARKED);
+    else if (current != POWER_ACTIVE && moving)
+        enter(POWER_ACTIVE); // not by a command: a script or ramp still running
+
+    // A command stamped after activity_us may have seen the mode before it dropped and
+    // asked for no wake: ask for it here
+    uint32_t latest_us = atomic_load(&last_activity_us);
+    if (power_mode() != POWER_ACTIVE && latest_us != activity_us)
+    {
+        power_note_activity(latest_us);
+        take_wake(now_us);
+    }
+    return power_mode();
+}
+
+PowerMode power_mode(void)
+{
+    return (PowerMode)atomic_load_explicit(&mode, memory_order_relaxed);
+}
+
+const char *power_mode_name(PowerMode m)
+{
+    static const char *const names[] = {"active", "idle", "parked"};
+    return (unsigned)m < POWER_MODES ? names[m] : "?";
+}
+
+uint32_t power_wait_ms(void)
+{
+    static const uint32_t wait_ms[] = {EVENT_LOG_DRAIN_MS, POWER_IDLE_WAIT_MS,
+                                       POWER_PARKED_WAIT_MS};
+    return wait_ms[mode];
+}
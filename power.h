@@ -0,0 +1,59 @@
+#ifndef POWER_H
+#define POWER_H
+
+// Activity-aware power management. Commands (session.c) and moving wheels keep the robot
+// ACTIVE: the radio in its performance mode, the main loop draining the event log every
+// EVENT_LOG_DRAIN_MS. After POWER_IDLE_AFTER_MS without either it goes IDLE, where the
+// radio dozes between beacons and the main loop only wakes for an interrupt or every
+// POWER_IDLE_WAIT_MS, and after POWER_PARKED_AFTER_MS PARKED, with the radio's longest
+// sleep. The next command brings it back to ACTIVE at once. Meanwhile core 1 sleeps
+// between slow ticks for as long as the wheels are at rest (control_loop.h).
+//
+// Power save costs latency once: the access point holds frames for a dozing radio until
+// the next beacon it listens to, so the first command after idle can arrive up to one
+// beacon interval (about 100 ms) late. The telemetry has the part that can be measured
+// here, from that command to the radio back in its performance mode. The radio calls
+// stay in pico_httpd.c, as for wifi_link.h, so the state machine also runs in the host
+// build.
+//
+// power_note_activity() is called from the lwIP context, everything else from the main
+// loop (core 0). They share only C11 atomics, so a command noted while the poll drops the
+// mode still wakes it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    POWER_ACTIVE,
+    POWER_IDLE,
+    POWER_PARKED,
+    POWER_MODES
+} PowerMode;
+
+typedef struct
+{
+    uint32_t entered[POWER_MODES]; // times each mode was entered
+    uint32_t ms[POWER_MODES];      // time spent in each mode, up to the last poll
+    uint32_t wakes;                // back to ACTIVE from IDLE or PARKED
+    uint32_t polls;                // main loop passes
+} PowerStats;
+
+extern PowerStats power_stats;
+
+void power_init(uint32_t now_us);
+
+// A command arrived. Called for every command, so it only takes the time.
+void power_note_activity(uint32_t now_us);
+
+// Advance the state machine once per main loop pass; moving while the control loop is not
+// idle. Returns the mode the radio should be in.
+PowerMode power_poll(uint32_t now_us, bool moving);
+
+PowerMode power_mode(void);
+const char *power_mode_name(PowerMode mode);
+
+// Longest the main loop sleeps in the current mode when no interrupt wakes it
+uint32_t power_wait_ms(void);
+
+#endif // POWER_H
@@ -0,0 +1,191 @@
+#include <math.h>
+#include <string.h>
+
+#include "custom.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pwm.h"
+#include "motion_profile.h"
+#include "motor_pwm.h"
+#include "pwm_ramp.h"
+#include "speed_control.h"
+#include "vehicle.h"
+
+PwmRampStats pwm_ramp_stats;
+bool pwm_ramp_enabled = PWM_DMA_RAMP;
+
+// One buffer of CC values per wheel, since each DMA channel reads its own
+static uint32_t ramp_cc[NUM_OF_WHEELS][PWM_RAMP_STEPS];
+
+static int channels[NUM_OF_WHEELS];
+static uint32_t channel_mask;
+static uint wheel_slice[NUM_OF_WHEELS];
+static bool claimed;
+static bool usable; // a slice per wheel, and the pacer slice free
+// A ramp was started and not yet handed back: the outputs are the DMA's until then
+static bool active;
+// The wheel profiles as of the ramp's last sample, which the loop takes over
+static MotionProfile ramp_end[NUM_OF_WHEELS];
+
+void pwm_ramp_init(void)
+{
+    if (!claimed)
+    {
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+        {
+            channels[i] = dma_claim_unused_channel(true);
+            channel_mask |= 1u << channels[i];
+        }
+        claimed = true;
+    }
+    pwm_ramp_stop();
+    memset(&pwm_ramp_stats, 0, sizeof(pwm_ramp_stats));
+
+    usable = true;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        wheel_slice[i] = pwm_gpio_to_slice_num(wheels[i].en_pin);
+        if (wheel_slice[i] == PWM_RAMP_PACER_SLICE)
+            usable = false;
+        for (int j = 0; j < i; j++)
+        {
+            if (wheel_slice[j] == wheel_slice[i])
+                usable = false;
+        }
+    }
+
+    // The pacer only counts: its wraps are the DREQ, no pin is routed to it
+    MotorPwmTiming pacer;
+    motor_pwm_plan(clock_get_hz(clk_sys), PWM_RAMP_HZ, false, &pacer);
+    pwm_set_enabled(PWM_RAMP_PACER_SLICE, false);
+    pwm_set_clkdiv_int_frac4(PWM_RAMP_PACER_SLICE, pacer.div_int, pacer.div_frac);
+    pwm_set_wrap(PWM_RAMP_PACER_SLICE, pacer.wrap);
+    pwm_set_phase_correct(PWM_RAMP_PACER_SLICE, false);
+    pwm_set_enabled(PWM_RAMP_PACER_SLICE, true);
+}
+
+// Samples of the ramp from the current profiles until every wheel has settled, at most
+// PWM_RAMP_STEPS; -1 if a wheel changes direction on the way
+static int plan(int8_t sign[NUM_OF_WHEELS])
+{
+    MotionProfile p[NUM_OF_WHEELS];
+    const float dt = 1.0f / PWM_RAMP_HZ;
+    int n = 0;
+
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        p[i] = wheels[i].profile;
+        float heading = p[i].velocity != 0.0f ? p[i].velocity : p[i].target;
+        sign[i] = heading > 0.0f ? 1 : heading < 0.0f ? -1 : 0;
+    }
+
+    while (n < PWM_RAMP_STEPS)
+    {
+        bool settled = true;
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+            settled &= p[i].velocity == p[i].target && p[i].accel == 0.0f;
+        if (settled)
+            break;
+
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+        {
+            float v = motion_profile_step(&p[i], &motion_limits, dt);
+            if (v * sign[i] < 0.0f)
+                return -1;
+            uint16_t level = motor_pwm_level(i, motor_pwm_duty(v));
+            ramp_cc[i][n] = (uint32_t)level << (pwm_gpio_to_channel(wheels[i].en_pin) ? 16 : 0);
+        }
+        n++;
+    }
+    memcpy(ramp_end, p, sizeof(ramp_end));
+    return n;
+}
+
+bool pwm_ramp_start(void)
+{
+    pwm_ramp_stop();
+    // A closed speed loop changes the duty every tick, so it is never precomputed
+    if (!pwm_ramp_enabled || !usable || speed_control_active())
+        return false;
+
+    uint32_t start_us = time_us_32();
+    int8_t sign[NUM_OF_WHEELS];
+    int n = plan(sign);
+    uint32_t plan_us = time_us_32() - start_us;
+    if (plan_us > pwm_ramp_stats.max_plan_us)
+        pwm_ramp_stats.max_plan_us = plan_us;
+    if (n < 0)
+    {
+        pwm_ramp_stats.fallbacks++;
+        return false;
+    }
+    if (n == 0)
+        return false;
+
+    // A wheel starting from rest gets its direction now; the others keep theirs
+    vehicle_set_directions(sign);
+
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        dma_channel_config c = dma_channel_get_default_config(channels[i]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, true);
+        channel_config_set_write_increment(&c, false);
+        channel_config_set_dreq(&c, pwm_get_dreq(PWM_RAMP_PACER_SLICE));
+        dma_channel_configure(channels[i], &c, &pwm_hw->slice[wheel_slice[i]].cc, ramp_cc[i],
+                              n, false);
+    }
+    // First sample one full pacer period from now, all wheels on the same wrap
+    pwm_set_counter(PWM_RAMP_PACER_SLICE, 0);
+    dma_start_channel_mask(channel_mask);
+
+    active = true;
+    pwm_ramp_stats.started++;
+    pwm_ramp_stats.samples += n;
+    return true;
+}
+
+void pwm_ramp_stop(void)
+{
+    active = false;
+    if (!pwm_ramp_playing())
+        return;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        dma_channel_abort(channels[i]);
+    pwm_ramp_stats.aborted++;
+}
+
+bool pwm_ramp_playing(void)
+{
+    if (!claimed)
+        return false;
+    // The channels start together on the same DREQ, so they finish together too
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        if (dma_channel_is_busy(channels[i]))
+            return true;
+    }
+    return false;
+}
+
+void pwm_ramp_sync(void)
+{
+    if (!active || pwm_ramp_playing())
+        return;
+    // The loop stepped its own copies at CONTROL_LOOP_HZ meanwhile; the outputs are at the
+    // ramp's end, so that is where the profiles go on from
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        wheels[i].profile = ramp_end[i];
+    active = false;
+    pwm_ramp_stats.completed++;
+}
+
+bool pwm_ramp_owns_outputs(void)
+{
+    return active;
+}
+
+uint32_t pwm_ramp_remaining(void)
+{
+    return pwm_ramp_playing() ? dma_channel_hw_addr(channels[0])->transfer_count : 0;
+}
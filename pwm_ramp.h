@@ -0,0 +1,63 @@
+#ifndef PWM_RAMP_H
+#define PWM_RAMP_H
+
+// DMA playback of speed ramps. When a command changes the wheel targets, the control
+// loop precomputes the whole ramp from the current wheel state, PWM_RAMP_HZ samples a
+// second, as compare values of the four ENA slices, and one DMA channel per wheel streams
+// them into the slices' CC registers. The channels are paced by the wrap DREQ of a spare
+// slice (PWM_RAMP_PACER_SLICE, running at PWM_RAMP_HZ with no pin), so the duty steps
+// land on exact clock cycles however late a tick or how busy the network is, and the
+// CPU makes no PWM writes until the ramp is over. The control loop keeps stepping the
+// same profiles for the status, the trace and the lease, and when the ramp is over takes
+// the profiles from its last sample, so the CPU goes on from the duty the DMA left.
+//
+// The direction pins are SIO registers, which DMA cannot reach, so a ramp through zero
+// (a reversal) stays on the CPU path, as does the part of a ramp longer than
+// PWM_RAMP_STEPS. A DMA ramp also needs a slice per wheel, since it writes whole CC
+// registers, and is not used while the speed loop (speed_control.h) is closed. Core 1
+// only.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t started;   // ramps handed to DMA
+    uint32_t aborted;   // replaced or stopped while playing
+    uint32_t completed; // played to the end and handed back
+    uint32_t fallbacks; // ramps left to the CPU because they change direction
+    uint32_t samples;   // compare values queued, per wheel
+    uint32_t max_plan_us; // longest precomputation
+} PwmRampStats;
+
+extern PwmRampStats pwm_ramp_stats;
+
+// Off by default (PWM_DMA_RAMP); settable at run time
+extern bool pwm_ramp_enabled;
+
+// Claim the DMA channels (once) and start the pacer. Call after motor_pwm_init().
+void pwm_ramp_init(void);
+
+// Precompute the ramp from the current wheel profiles and start playing it. Returns
+// false, leaving the wheels to apply_vehicle(), if disabled, already settled or not
+// playable by DMA.
+bool pwm_ramp_start(void);
+
+// Stop a ramp in progress, and hand the ENA levels back to apply_vehicle()
+void pwm_ramp_stop(void);
+
+// True while DMA is writing the ENA levels
+bool pwm_ramp_playing(void);
+
+// Once a ramp has played to the end, set the wheel profiles to its last sample and hand
+// the ENA levels back to apply_vehicle(). Call every tick before vehicle_step().
+void pwm_ramp_sync(void);
+
+// True from pwm_ramp_start() until pwm_ramp_sync() or pwm_ramp_stop() hands the ENA
+// levels back; apply_vehicle() leaves them alone meanwhile, and trim changes wait.
+bool pwm_ramp_owns_outputs(void);
+
+// Samples of the current ramp not yet written
+uint32_t pwm_ramp_remaining(void);
+
+#endif // PWM_RAMP_H
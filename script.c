@@ -0,0 +1,239 @@
+#include <stdatomic.h>
+#include <string.h>
+
+#include "custom.h"
+#include "script.h"
+#include "trace.h"
+
+// Handoff of a loaded script from the network side to the control loop. The network side
+// only writes `pending` between FILLING and READY, the control loop only reads it between
+// TAKING and EMPTY.
+enum
+{
+    PENDING_EMPTY,
+    PENDING_FILLING,
+    PENDING_READY,
+    PENDING_TAKING,
+};
+
+static atomic_int pending_state;
+static ScriptStep pending[SCRIPT_MAX_STEPS];
+static int pending_count;
+
+// Owned by the control loop
+static ScriptStep running[SCRIPT_MAX_STEPS];
+static int running_count;
+static bool active;
+static int step;            // index of the current step
+static uint32_t ticks_left; // of the current step
+static volatile int current_step;
+
+ScriptStats script_stats;
+
+void script_init(void)
+{
+    atomic_init(&pending_state, PENDING_EMPTY);
+    pending_count = 0;
+    running_count = 0;
+    active = false;
+    current_step = 0;
+    memset(&script_stats, 0, sizeof(script_stats));
+}
+
+static const char *const error_names[] = {
+    [SCRIPT_OK] = "ok",
+    [SCRIPT_EMPTY] = "empty",
+    [SCRIPT_TOO_MANY_STEPS] = "too_many_steps",
+    [SCRIPT_BAD_COMMAND] = "bad_command",
+    [SCRIPT_BAD_DURATION] = "bad_duration",
+    [SCRIPT_BAD_SPEED] = "bad_speed",
+    [SCRIPT_BUSY] = "busy",
+    [SCRIPT_DENIED] = "denied",
+};
+
+const char *script_error_name(ScriptError error)
+{
+    return (unsigned)error < sizeof(error_names) / sizeof(error_names[0]) ? error_names[error]
+                                                                         : "unknown";
+}
+
+// Decimal number up to max; advances *p past it
+static bool parse_number(const char **p, uint32_t max, uint32_t *value)
+{
+    const char *s = *p;
+    uint32_t v = 0;
+
+    if (*s < '0' || *s > '9')
+        return false;
+    while (*s >= '0' && *s <= '9')
+    {
+        v = v * 10 + (uint32_t)(*s++ - '0');
+        if (v > max)
+            return false;
+    }
+    *p = s;
+    *value = v;
+    return true;
+}
+
+static ScriptError parse_step(const char **p, ScriptStep *out, uint32_t *ms)
+{
+    const char *s = *p;
+    uint32_t speed = MAX_VEHICLE_SPEED;
+    CommandType type;
+
+    if (s[0] == '\0' || s[1] == '\0' || s[2] == '\0')
+        return SCRIPT_BAD_COMMAND;
+    if (!vehicle_parse_command(s, 3, &type) || type == CMD_HEARTBEAT)
+        return SCRIPT_BAD_COMMAND;
+    s += 3;
+
+    *ms = 0;
+    if (*s == ':')
+    {
+        s++;
+        if (!parse_number(&s, SCRIPT_MAX_STEP_MS, ms))
+            return SCRIPT_BAD_DURATION;
+    }
+    else if (type != CMD_STOP)
+    {
+        return SCRIPT_BAD_DURATION;
+    }
+    if (*s == ':')
+    {
+        s++;
+        // NONE and STOP have no speed
+        if (!vehicle_is_movement(type) || !parse_number(&s, MAX_VEHICLE_SPEED, &speed) || speed == 0)
+            return SCRIPT_BAD_SPEED;
+    }
+    if (*s != ',' && *s != '\0')
+        return SCRIPT_BAD_COMMAND;
+
+    out->type = (uint8_t)type;
+    out->scale = (uint16_t)(speed * DRIVE_SCALE / MAX_VEHICLE_SPEED);
+    out->ticks = (*ms * CONTROL_LOOP_HZ + 500) / 1000;
+    *p = s;
+    return SCRIPT_OK;
+}
+
+ScriptResult script_parse(const char *text, ScriptStep *steps, int *count)
+{
+    ScriptResult result = {SCRIPT_OK, 0, 0};
+    const char *p = text;
+    int n = 0;
+
+    if (*p == '\0')
+    {
+        result.error = SCRIPT_EMPTY;
+        return result;
+    }
+    while (true)
+    {
+        uint32_t ms;
+        result.steps = n + 1; // the step an error refers to
+        if (n == SCRIPT_MAX_STEPS)
+            result.error = SCRIPT_TOO_MANY_STEPS;
+        else
+            result.error = parse_step(&p, &steps[n], &ms);
+        if (result.error != SCRIPT_OK)
+            return result;
+        result.duration_ms += ms;
+        n++;
+        if (*p++ == '\0')
+            break;
+    }
+    *count = n;
+    result.steps = n;
+    return result;
+}
+
+ScriptResult script_load(const char *text)
+{
+    ScriptStep steps[SCRIPT_MAX_STEPS];
+    int count = 0;
+    ScriptResult result = script_parse(text, steps, &count);
+
+    if (result.error == SCRIPT_OK)
+    {
+        // A script loaded but never started (its CMD_SCRIPT was refused) is replaced
+        int state = atomic_load_explicit(&pending_state, memory_order_acquire);
+        if ((state == PENDING_EMPTY || state == PENDING_READY) &&
+            atomic_compare_exchange_strong(&pending_state, &state, PENDING_FILLING))
+        {
+            memcpy(pending, steps, count * sizeof(steps[0]));
+            pending_count = count;
+            atomic_store_explicit(&pending_state, PENDING_READY, memory_order_release);
+        }
+        else
+        {
+            result.error = SCRIPT_BUSY;
+        }
+    }
+    if (result.error == SCRIPT_OK)
+        script_stats.loaded++;
+    else
+        script_stats.rejected++;
+    return result;
+}
+
+void script_start(void)
+{
+    int expected = PENDING_READY;
+    if (!atomic_compare_exchange_strong(&pending_state, &expected, PENDING_TAKING))
+        return; // nothing loaded, or the network side is loading a newer one
+    memcpy(running, pending, pending_count * sizeof(pending[0]));
+    running_count = pending_count;
+    atomic_store_explicit(&pending_state, PENDING_EMPTY, memory_order_release);
+
+    if (active)
+        script_stats.aborted++; // replaced by the new one
+    active = true;
+    step = -1;
+    ticks_left = 0;
+    script_stats.started++;
+}
+
+void script_abort(void)
+{
+    if (!active)
+        return;
+    active = false;
+    current_step = 0;
+    script_stats.aborted++;
+}
+
+bool script_running(void)
+{
+    return active;
+}
+
+void script_tick(void)
+{
+    if (!active)
+        return;
+    while (ticks_left == 0)
+    {
+        if (++step == running_count)
+        {
+            active = false;
+            current_step = 0;
+            if (running[running_count - 1].type != CMD_STOP)
+            {
+                vehicle_command(CMD_NONE);
+                trace_command(CMD_NONE, DRIVE_SCALE, 0);
+            }
+            script_stats.completed++;
+            return;
+        }
+        vehicle_command_scaled((CommandType)running[step].type, running[step].scale);
+        trace_command(running[step].type, running[step].scale, 0);
+        ticks_left = running[step].ticks;
+        current_step = step + 1;
+    }
+    ticks_left--;
+}
+
+int script_current_step(void)
+{
+    return current_step;
+}
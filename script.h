@@ -0,0 +1,81 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+// On-device command scripts: a batch of timed steps ("FWD 2 s at speed 6, RGT 0.5 s,
+// STOP") uploaded in one request and played back by the control loop, so a scripted run
+// does not depend on network round trips.
+//
+// The network side validates a script and loads it with script_load(), then submits a
+// CMD_SCRIPT through the session layer like any movement command. When the control loop
+// pops that CMD_SCRIPT it takes the script over and applies one step after another through
+// vehicle_command_scaled(). While a script runs, queued commands other than STOP are
+// ignored (the page's idle polls would otherwise stop it); STOP aborts it. A script that
+// does not end in STOP releases the wheels (NONE) after its last step.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vehicle.h"
+
+typedef enum
+{
+    SCRIPT_OK,
+    SCRIPT_EMPTY,
+    SCRIPT_TOO_MANY_STEPS, // more than SCRIPT_MAX_STEPS
+    SCRIPT_BAD_COMMAND,    // not a movement command, NON or STP
+    SCRIPT_BAD_DURATION,   // missing (except for STP) or above SCRIPT_MAX_STEP_MS
+    SCRIPT_BAD_SPEED,      // not 1..MAX_VEHICLE_SPEED, or given for NON/STP
+    SCRIPT_BUSY,           // the control loop is taking the previous script over
+    SCRIPT_DENIED,         // valid, but another client holds the controller lease
+} ScriptError;
+
+typedef struct
+{
+    uint8_t type;   // CommandType: a movement command, CMD_NONE or CMD_STOP
+    uint16_t scale; // speed, 0..DRIVE_SCALE
+    uint32_t ticks; // duration in control loop ticks
+} ScriptStep;
+
+typedef struct
+{
+    ScriptError error;
+    int steps;       // on success: number of steps; on error: the offending step, from 1
+    uint32_t duration_ms;
+} ScriptResult;
+
+typedef struct
+{
+    // network side
+    uint32_t loaded;
+    uint32_t rejected;
+    // control loop
+    uint32_t started;
+    uint32_t completed;
+    uint32_t aborted;
+    uint32_t ignored; // commands dropped while a script was running
+} ScriptStats;
+
+extern ScriptStats script_stats;
+
+void script_init(void);
+
+// Parse "CMD:ms[:speed],..." where CMD is a three-letter command, ms the step duration and
+// speed 1..MAX_VEHICLE_SPEED (full speed if omitted). STP may omit the duration.
+// Pure; steps must hold SCRIPT_MAX_STEPS.
+ScriptResult script_parse(const char *text, ScriptStep *steps, int *count);
+
+// Network side: parse and hand the script to the control loop for the next CMD_SCRIPT
+ScriptResult script_load(const char *text);
+
+const char *script_error_name(ScriptError error);
+
+// Control loop side (core 1)
+void script_start(void);  // on CMD_SCRIPT
+void script_abort(void);  // on STOP
+bool script_running(void);
+void script_tick(void);   // apply the current step; once per control loop tick
+
+// Current step from 1, or 0 when no script runs. Readable from core 0.
+int script_current_step(void);
+
+#endif // SCRIPT_H
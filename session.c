@@ -0,0 +1,183 @@
+#include <stdbool.h>
+
+#include "control_loop.h"
+#include "custom.h"
+#include "pico/time.h"
+#include "power.h"
+#include "session.h"
+#include "telemetry.h"
+
+typedef struct
+{
+    bool used;
+    uint8_t transport;
+    uint32_t client;
+    uint32_t last_seen_ms;
+    uint8_t last_cmd; // CommandType of the client's last command
+} Session;
+
+SessionStats session_stats;
+
+static Session sessions[SESSION_MAX_CLIENTS];
+
+// Slot of the driver, or -1; the lease is valid until lease_until_ms
+static int driver = -1;
+static uint32_t lease_until_ms;
+
+void session_init(void)
+{
+    for (int i = 0; i < SESSION_MAX_CLIENTS; i++)
+        sessions[i].used = false;
+    driver = -1;
+    session_stats = (SessionStats){0};
+}
+
+static int session_find(SessionTransport transport, uint32_t client)
+{
+    for (int i = 0; i < SESSION_MAX_CLIENTS; i++)
+    {
+        if (sessions[i].used && sessions[i].transport == transport &&
+            sessions[i].client == client)
+            return i;
+    }
+    return -1;
+}
+
+static bool lease_held(uint32_t now_ms)
+{
+    return driver >= 0 && (int32_t)(lease_until_ms - now_ms) > 0;
+}
+
+// Find the client's session, or take a free slot, or the longest silent observer's
+static int session_lookup(SessionTransport transport, uint32_t client, uint32_t now_ms)
+{
+    int slot = session_find(transport, client);
+    if (slot >= 0)
+        return slot;
+
+    int oldest = -1;
+    for (int i = 0; i < SESSION_MAX_CLIENTS; i++)
+    {
+        if (!sessions[i].used)
+        {
+            oldest = i;
+            break;
+        }
+        if (i == driver && lease_held(now_ms))
+            continue;
+        if (oldest < 0 ||
+            (int32_t)(sessions[i].last_seen_ms - sessions[oldest].last_seen_ms) < 0)
+            oldest = i;
+    }
+    if (oldest < 0)
+        return -1;
+    if (sessions[oldest].used)
+        session_stats.evicted++;
+    if (oldest == driver)
+        driver = -1;
+
+    sessions[oldest].used = true;
+    sessions[oldest].transport = (uint8_t)transport;
+    sessions[oldest].client = client;
+    sessions[oldest].last_cmd = CMD_NONE;
+    return oldest;
+}
+
+static void forward(const VehicleCommand *cmd, uint32_t now_ms)
+{
+    if (telemetry.first_command_ms == 0)
+        telemetry.first_command_ms = now_ms ? now_ms : 1; // boot to drivable
+    if (cmd->type == CMD_DRIVE)
+        control_loop_post_drive(cmd->throttle, cmd->turn);
+    else
+        control_loop_post((CommandType)cmd->type);
+    session_stats.forwarded++;
+}
+
+SessionResult session_submit(SessionTransport transport, uint32_t client,
+                             const VehicleCommand *cmd, uint32_t now_ms)
+{
+    power_note_activity(time_us_32());
+
+    // STOP wins regardless of sessions, even with the table full
+    if (cmd->type == CMD_STOP)
+    {
+        forward(cmd, now_ms);
+        driver = -1;
+        int slot = session_find(transport, client);
+        if (slot >= 0)
+        {
+            sessions[slot].last_seen_ms = now_ms;
+            sessions[slot].last_cmd = CMD_STOP;
+        }
+        return SESSION_STOP;
+    }
+
+    int slot = session_lookup(transport, client, now_ms);
+    if (slot < 0)
+    {
+        session_stats.denied++;
+        return SESSION_DENIED;
+    }
+    Session *s = &sessions[slot];
+    bool heartbeat = cmd->type == CMD_HEARTBEAT;
+    s->last_seen_ms = now_ms;
+    if (!heartbeat)
+        s->last_cmd = cmd->type; // a heartbeat keeps holding the last command
+
+    bool moving = cmd->type != CMD_NONE && !heartbeat;
+    if (!lease_held(now_ms))
+    {
+        if (driver >= 0 && driver != slot)
+        {
+            // The driver went quiet in the middle of a movement: release it so the
+            // wheels ramp down instead of following a command nobody repeats
+            if (sessions[driver].last_cmd != CMD_NONE)
+            {
+                VehicleCommand release = {CMD_NONE, 0, 0};
+                forward(&release, now_ms);
+            }
+            driver = -1;
+        }
+        if (moving)
+            driver = slot;
+    }
+
+    if (slot != driver)
+    {
+        if (moving)
+        {
+            session_stats.denied++;
+            return SESSION_DENIED;
+        }
+        session_stats.observer_polls++;
+        return SESSION_OBSERVER;
+    }
+
+    if (moving || heartbeat)
+        lease_until_ms = now_ms + SESSION_LEASE_MS;
+    forward(cmd, now_ms);
+    return SESSION_DRIVER;
+}
+
+void session_close(SessionTransport transport, uint32_t client)
+{
+    int slot = session_find(transport, client);
+    if (slot < 0)
+        return;
+    sessions[slot].used = false;
+    if (slot == driver)
+        driver = -1;
+}
+
+bool session_is_driver(SessionTransport transport, uint32_t client, uint32_t now_ms)
+{
+    int slot = session_find(transport, client);
+    return slot >= 0 && slot == driver && lease_held(now_ms);
+}
+
+bool session_holds_movement(SessionTransport transport, uint32_t client, uint32_t now_ms)
+{
+    return session_is_driver(transport, client, now_ms) &&
+           sessions[driver].last_cmd != CMD_NONE;
+}
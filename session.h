@@ -0,0 +1,60 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+// Per-client control sessions and arbitration between them.
+//
+// Every transport submits its commands here instead of posting them to the control loop
+// directly. One client at a time holds the controller lease (the driver); everybody else
+// is an observer whose idle NON polls are not forwarded and whose movement commands are
+// refused, so an open dashboard cannot interrupt the driver. The lease goes to the first
+// client that sends a movement command while it is free, and lapses SESSION_LEASE_MS after
+// the driver's last movement command or heartbeat. STOP from any client is always
+// forwarded and frees the lease. Heartbeats of other clients are not forwarded.
+//
+// Network side (core 0, lwIP context) only.
+
+#include <stdint.h>
+
+#include "vehicle.h"
+
+typedef enum
+{
+    SESSION_HTTP, // client = id parameter sent by the page (0 if absent)
+    SESSION_WS,   // client = connection slot
+    SESSION_UDP,  // client = peer key from udp_server.c
+} SessionTransport;
+
+typedef enum
+{
+    SESSION_DRIVER,   // forwarded: the sender holds the lease
+    SESSION_STOP,     // forwarded: STOP overrides the lease
+    SESSION_OBSERVER, // not forwarded: idle poll from a client without the lease
+    SESSION_DENIED,   // not forwarded: movement while another client holds the lease
+} SessionResult;
+
+typedef struct
+{
+    uint32_t forwarded;
+    uint32_t observer_polls;
+    uint32_t denied;
+    uint32_t evicted; // sessions dropped to make room for a new client
+} SessionStats;
+
+extern SessionStats session_stats;
+
+void session_init(void);
+
+// Arbitrate one command of a client and forward it to the control loop if it wins
+SessionResult session_submit(SessionTransport transport, uint32_t client,
+                             const VehicleCommand *cmd, uint32_t now_ms);
+
+// The client went away (WebSocket closed); frees its slot and, if it drove, the lease
+void session_close(SessionTransport transport, uint32_t client);
+
+// True if the client currently holds the lease
+bool session_is_driver(SessionTransport transport, uint32_t client, uint32_t now_ms);
+
+// True if the client holds the lease with a movement it has not released yet
+bool session_holds_movement(SessionTransport transport, uint32_t client, uint32_t now_ms);
+
+#endif // SESSION_H
@@ -0,0 +1,71 @@
+#include <math.h>
+#include <string.h>
+
+#include "custom.h"
+#include "encoder.h"
+#include "motor_pwm.h"
+#include "speed_control.h"
+#include "vehicle.h"
+
+SpeedGains speed_gains = {SPEED_CONTROL_KP, SPEED_CONTROL_KI, SPEED_CONTROL_KD, SPEED_FILTER};
+WheelSpeed wheel_speeds[NUM_OF_WHEELS];
+bool speed_control_enabled = SPEED_CONTROL;
+
+void speed_control_init(void)
+{
+    memset(wheel_speeds, 0, sizeof(wheel_speeds));
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        wheel_speeds[i].count = encoder_count(i);
+}
+
+bool speed_control_active(void)
+{
+    return speed_control_enabled && encoder_present();
+}
+
+static float clampf(float v, float lo, float hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+void speed_control_step(float dt)
+{
+    if (!encoder_present())
+        return;
+
+    bool active = speed_control_active();
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        WheelSpeed *w = &wheel_speeds[i];
+        int32_t count = encoder_count(i);
+        float raw = (float)(count - w->count) / (dt * ENCODER_FULL_SPEED_CPS);
+        float previous = w->measured;
+        w->count = count;
+        w->measured += speed_gains.filter * (raw - w->measured);
+
+        float setpoint = wheels[i].profile.velocity;
+        if (!active || setpoint == 0.0f)
+        {
+            w->integral = 0.0f;
+            w->output = setpoint;
+            continue;
+        }
+
+        // Feed-forward plus PID, derivative on the measurement so a new setpoint gives no kick
+        float error = setpoint - w->measured;
+        float derivative = -(w->measured - previous) / dt;
+        float integral = w->integral + error * dt;
+        float out = setpoint + speed_gains.kp * error + speed_gains.ki * integral +
+                    speed_gains.kd * derivative;
+
+        // Within the command's own direction, up to full duty
+        float lo = setpoint > 0.0f ? 0.0f : -1.0f;
+        float hi = setpoint > 0.0f ? 1.0f : 0.0f;
+        float clamped = clampf(out, lo, hi);
+        // Anti-windup: only integrate while the output is not pinned
+        if (clamped == out || (out > hi && error < 0.0f) || (out < lo && error > 0.0f))
+            w->integral = integral;
+        w->output = clamped;
+        wheels[i].duty = motor_pwm_duty(clamped);
+    }
+}
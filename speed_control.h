@@ -0,0 +1,46 @@
+#ifndef SPEED_CONTROL_H
+#define SPEED_CONTROL_H
+
+// Closed-loop wheel speed. Every control loop tick the encoder counts give each wheel's
+// measured speed, and a PID per wheel servos it to the ramped velocity the motion profile
+// commands (the wheel's mix times the vehicle's target speed). The commanded velocity is
+// also the feed-forward duty, so the PID only makes up what load and motor differences
+// take away, and with the loop off the duty is exactly the open-loop one.
+//
+// The output keeps the sign of the command: the loop speeds a wheel up or lets it coast,
+// it does not reverse it, so the direction pins still follow the motion profile. Core 1.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    float kp;
+    float ki;
+    float kd;
+    float filter; // weight of each new speed sample
+} SpeedGains;
+
+typedef struct
+{
+    int32_t count;    // last encoder count
+    float measured;   // filtered speed, full scale = ENCODER_FULL_SPEED_CPS
+    float integral;
+    float output;     // duty, full scale
+} WheelSpeed;
+
+extern SpeedGains speed_gains;
+extern WheelSpeed wheel_speeds[NUM_OF_WHEELS];
+
+// Off by default (SPEED_CONTROL); settable at run time. Only acts with encoders fitted.
+extern bool speed_control_enabled;
+
+void speed_control_init(void);
+
+bool speed_control_active(void);
+
+// Read the encoders and, when active, replace each wheel's duty with the PID output.
+// Call after vehicle_step() with the same dt.
+void speed_control_step(float dt);
+
+#endif // SPEED_CONTROL_H
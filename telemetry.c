@@ -0,0 +1,165 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "admission.h"
+#include "control_loop.h"
+#include "custom.h"
+#include "event_log.h"
+#include "event_stream.h"
+#include "http_control.h"
+#include "motor_pwm.h"
+#include "power.h"
+#include "pwm_ramp.h"
+#include "script.h"
+#include "session.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "udp_control.h"
+#include "wifi_link.h"
+
+Telemetry telemetry;
+
+void telemetry_init(void)
+{
+    memset(&telemetry, 0, sizeof(telemetry));
+}
+
+void telemetry_count_request(uint32_t now_ms)
+{
+    telemetry.requests++;
+    uint32_t elapsed = now_ms - telemetry.window_start_ms;
+    if (elapsed >= 1000)
+    {
+        // A gap of more than a second means nothing arrived in between
+        telemetry.requests_per_s = elapsed < 2000 ? telemetry.window_requests : 0;
+        telemetry.window_start_ms = now_ms;
+        telemetry.window_requests = 0;
+    }
+    telemetry.window_requests++;
+}
+
+// snprintf that appends at *pos and remembers if anything did not fit
+static void append(char *buf, size_t len, size_t *pos, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = *pos < len ? vsnprintf(buf + *pos, len - *pos, format, args) : -1;
+    va_end(args);
+    *pos = (n < 0 || *pos + n >= len) ? len : *pos + n;
+}
+
+static void append_histogram(char *buf, size_t len, size_t *pos, const char *name,
+                             const LatencyHistogram *h)
+{
+    append(buf, len, pos, "\"%s\":{\"count\":%lu,\"max\":%lu,\"buckets\":[", name,
+           (unsigned long)h->count, (unsigned long)h->max_us);
+    for (int i = 0; i < TELEMETRY_BUCKETS; i++)
+        append(buf, len, pos, i ? ",%lu" : "%lu", (unsigned long)h->buckets[i]);
+    append(buf, len, pos, "]}");
+}
+
+int telemetry_format_json(char *buf, size_t len, const TelemetryLwip *lwip, uint32_t now_ms)
+{
+    EventLogStats log;
+    size_t pos = 0;
+
+    event_log_get_stats(&log);
+    append(buf, len, &pos,
+           "{\"uptime_ms\":%lu,\"drivetrain\":\"%s\",\"requests\":%lu,\"requests_per_s\":%lu,\"parse_failures\":%lu,"
+           "\"response_slots_exhausted\":%lu,\"log_dropped\":%lu,\"first_command_ms\":%lu,",
+           (unsigned long)now_ms, DRIVETRAIN_NAME, (unsigned long)telemetry.requests,
+           (unsigned long)telemetry.requests_per_s, (unsigned long)telemetry.parse_failures,
+           (unsigned long)http_control_stats.slots_exhausted, (unsigned long)log.dropped,
+           (unsigned long)telemetry.first_command_ms);
+    append(buf, len, &pos,
+           "\"wifi\":{\"state\":\"%s\",\"first_up_ms\":%lu,\"up_since_ms\":%lu,\"attempts\":%lu,"
+           "\"failures\":%lu,\"drops\":%lu},",
+           wifi_link_state_name(wifi_link_state()), (unsigned long)wifi_link_stats.first_up_ms,
+           (unsigned long)wifi_link_stats.up_since_ms, (unsigned long)wifi_link_stats.attempts,
+           (unsigned long)wifi_link_stats.failures, (unsigned long)wifi_link_stats.drops);
+    append(buf, len, &pos,
+           "\"pwm\":{\"hz\":%lu,\"wrap\":%u,\"div\":%u,\"div_frac\":%u,\"phase_correct\":%s,"
+           "\"trim\":[",
+           (unsigned long)motor_pwm_timing.frequency_hz, motor_pwm_timing.wrap,
+           motor_pwm_timing.div_int, motor_pwm_timing.div_frac,
+           motor_pwm_timing.phase_correct ? "true" : "false");
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        append(buf, len, &pos, "%s%u", i ? "," : "", motor_pwm_trim[i].trim);
+    append(buf, len, &pos, "],\"deadband\":[");
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        append(buf, len, &pos, "%s%u", i ? "," : "", motor_pwm_trim[i].deadband);
+    append(buf, len, &pos, "]},");
+    append(buf, len, &pos,
+           "\"ramp\":{\"enabled\":%s,\"playing\":%s,\"remaining\":%lu,\"started\":%lu,"
+           "\"aborted\":%lu,\"completed\":%lu,\"fallbacks\":%lu,\"samples\":%lu,"
+           "\"max_plan_us\":%lu},",
+           pwm_ramp_enabled ? "true" : "false", pwm_ramp_playing() ? "true" : "false",
+           (unsigned long)pwm_ramp_remaining(), (unsigned long)pwm_ramp_stats.started,
+           (unsigned long)pwm_ramp_stats.aborted, (unsigned long)pwm_ramp_stats.completed,
+           (unsigned long)pwm_ramp_stats.fallbacks,
+           (unsigned long)pwm_ramp_stats.samples, (unsigned long)pwm_ramp_stats.max_plan_us);
+    append(buf, len, &pos,
+           "\"control\":{\"ticks\":%lu,\"commands\":%lu,\"overruns\":%lu,\"max_late_us\":%lu,"
+           "\"queue_full\":%lu,\"heartbeats\":%lu,\"lease_expired\":%lu},",
+           (unsigned long)control_loop_stats.ticks, (unsigned long)control_loop_stats.commands,
+           (unsigned long)control_loop_stats.overruns,
+           (unsigned long)control_loop_stats.max_late_us,
+           (unsigned long)control_loop_stats.queue_full,
+           (unsigned long)control_loop_stats.heartbeats,
+           (unsigned long)control_loop_stats.lease_expired);
+    append(buf, len, &pos,
+           "\"power\":{\"mode\":\"%s\",\"active_ms\":%lu,\"idle_ms\":%lu,\"parked_ms\":%lu,"
+           "\"wakes\":%lu,\"polls\":%lu,\"idle_sleeps\":%lu},",
+           power_mode_name(power_mode()), (unsigned long)power_stats.ms[POWER_ACTIVE],
+           (unsigned long)power_stats.ms[POWER_IDLE], (unsigned long)power_stats.ms[POWER_PARKED],
+           (unsigned long)power_stats.wakes, (unsigned long)power_stats.polls,
+           (unsigned long)control_loop_stats.idle_sleeps);
+    append(buf, len, &pos, "\"sessions\":{\"forwarded\":%lu,\"observer_polls\":%lu,\"denied\":%lu},",
+           (unsigned long)session_stats.forwarded, (unsigned long)session_stats.observer_polls,
+           (unsigned long)session_stats.denied);
+    append(buf, len, &pos,
+           "\"admission\":{\"enabled\":%s,\"admitted\":%lu,\"priority\":%lu,"
+           "\"rate_limited\":%lu,\"busy\":%lu},",
+           admission_enabled ? "true" : "false", (unsigned long)admission_stats.admitted,
+           (unsigned long)admission_stats.priority, (unsigned long)admission_stats.rate_limited,
+           (unsigned long)admission_stats.busy);
+    append(buf, len, &pos,
+           "\"script\":{\"loaded\":%lu,\"rejected\":%lu,\"completed\":%lu,\"aborted\":%lu},",
+           (unsigned long)script_stats.loaded, (unsigned long)script_stats.rejected,
+           (unsigned long)script_stats.completed, (unsigned long)script_stats.aborted);
+    append(buf, len, &pos,
+           "\"stream\":{\"clients\":%d,\"events\":%lu,\"pushes\":%lu,\"rejected\":%lu},",
+           event_stream_clients(), (unsigned long)event_stream_stats.events,
+           (unsigned long)event_stream_stats.pushes, (unsigned long)event_stream_stats.rejected);
+    append(buf, len, &pos,
+           "\"fleet\":{\"scheduled\":%lu,\"applied\":%lu,\"late\":%lu,\"superseded\":%lu,"
+           "\"denied\":%lu,\"max_late_ms\":%lu},",
+           (unsigned long)udp_fleet_stats.scheduled, (unsigned long)udp_fleet_stats.applied,
+           (unsigned long)udp_fleet_stats.late, (unsigned long)udp_fleet_stats.superseded,
+           (unsigned long)udp_fleet_stats.denied, (unsigned long)udp_fleet_stats.max_late_ms);
+    append(buf, len, &pos, "\"trace\":{\"recorded\":%lu,\"lost\":%lu,\"downloads\":%lu},",
+           (unsigned long)trace_stats.recorded, (unsigned long)trace_stats.lost,
+           (unsigned long)trace_stats.downloads);
+    append(buf, len, &pos,
+           "\"lwip\":{\"mem_used\":%lu,\"mem_max\":%lu,\"mem_err\":%lu,\"pbuf_pool_used\":%lu,"
+           "\"pbuf_pool_max\":%lu,\"pbuf_pool_err\":%lu,\"tcp_pcb_used\":%lu,"
+           "\"tcp_pcb_max\":%lu,\"tcp_seg_max\":%lu},",
+           (unsigned long)lwip->mem_used, (unsigned long)lwip->mem_max,
+           (unsigned long)lwip->mem_err, (unsigned long)lwip->pbuf_pool_used,
+           (unsigned long)lwip->pbuf_pool_max, (unsigned long)lwip->pbuf_pool_err,
+           (unsigned long)lwip->tcp_pcb_used, (unsigned long)lwip->tcp_pcb_max,
+           (unsigned long)lwip->tcp_seg_max);
+    append(buf, len, &pos, "\"latency_us\":{");
+    append_histogram(buf, len, &pos, "cgi", &telemetry.cgi);
+    append(buf, len, &pos, ",");
+    append_histogram(buf, len, &pos, "fs_open", &telemetry.fs_open);
+    append(buf, len, &pos, ",");
+    append_histogram(buf, len, &pos, "tick", &telemetry.tick);
+    append(buf, len, &pos, ",");
+    append_histogram(buf, len, &pos, "cmd_to_pwm", &telemetry.cmd_to_pwm);
+    append(buf, len, &pos, ",");
+    append_histogram(buf, len, &pos, "wake", &telemetry.wake);
+    append(buf, len, &pos, "}}");
+    return pos >= len ? -1 : (int)pos;
+}
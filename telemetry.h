@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// On-device latency histograms and request counters, served as JSON from /stats.
+// Each histogram has a single writer (noted per field); readers may see a sample half
+// recorded, which is fine for monitoring.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_BUCKETS 16
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max_us;
+    // bucket i holds samples of i significant bits: [2^(i-1), 2^i) us, bucket 0 is 0 us,
+    // and the last bucket also takes everything longer
+    uint32_t buckets[TELEMETRY_BUCKETS];
+} LatencyHistogram;
+
+typedef struct
+{
+    LatencyHistogram cgi;        // CGI call, refused ones included, core 0
+    LatencyHistogram fs_open;    // building a reply in fs_open_custom, core 0
+    LatencyHistogram tick;       // control_loop_tick: update_vehicle, ramps and PWM, core 1
+    LatencyHistogram cmd_to_pwm; // control_loop_post until the PWM level is written, core 1
+    LatencyHistogram wake;       // first command after idle until the radio is back in its
+                                 // performance mode (power.h), main loop
+    uint32_t requests;           // CGI requests
+    uint32_t parse_failures;     // requests without a valid command or vector
+    uint32_t requests_per_s;     // over the last full second
+    uint32_t window_start_ms;
+    uint32_t window_requests;
+    uint32_t first_command_ms;   // since boot, of the first command forwarded; 0 until then
+} Telemetry;
+
+// lwIP pool usage, gathered by the caller of telemetry_format_json (zero without lwIP stats)
+typedef struct
+{
+    uint32_t mem_used, mem_max, mem_err;
+    uint32_t pbuf_pool_used, pbuf_pool_max, pbuf_pool_err;
+    uint32_t tcp_pcb_used, tcp_pcb_max;
+    uint32_t tcp_seg_max;
+} TelemetryLwip;
+
+extern Telemetry telemetry;
+
+void telemetry_init(void);
+
+static inline void telemetry_record(LatencyHistogram *h, uint32_t us)
+{
+    unsigned bucket = us ? 32 - __builtin_clz(us) : 0;
+    if (bucket >= TELEMETRY_BUCKETS)
+        bucket = TELEMETRY_BUCKETS - 1;
+    h->buckets[bucket]++;
+    h->count++;
+    if (us > h->max_us)
+        h->max_us = us;
+}
+
+// Count a request and roll the requests/s window
+void telemetry_count_request(uint32_t now_ms);
+
+// Write the /stats JSON: these counters plus the stats of the other modules. Returns its
+// length, or -1 if it does not fit.
+int telemetry_format_json(char *buf, size_t len, const TelemetryLwip *lwip, uint32_t now_ms);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Find the multiplier of a perfect-hash table of three-character keys (key3.h).
+
+The firmware looks up command names and custom file names by their first three
+characters packed into one key, hashed as (key * multiplier) >> (32 - bits). This finds
+the first odd multiplier from the golden ratio on that gives every name its own slot:
+
+    key3_hash.py --bits 5 FLT FRT FWD LFT RGT BLT BWD BRT STP HBT SLT SRT NON
+    key3_hash.py --bits 4 429 rel jso scr sta eve tra
+
+A name shorter than three characters is padded with NULs, as key3_prefix() reads it.
+"""
+
+import argparse
+import sys
+
+GOLDEN = 0x9E3779B1
+
+
+def key3(name):
+    data = name.encode('ascii')[:3].ljust(3, b'\0')
+    return data[0] | data[1] << 8 | data[2] << 16
+
+
+def find_multiplier(keys, bits, tries):
+    multiplier = GOLDEN
+    for _ in range(tries):
+        slots = {((k * multiplier) & 0xFFFFFFFF) >> (32 - bits) for k in keys}
+        if len(slots) == len(keys):
+            return multiplier
+        multiplier = (multiplier + 2) & 0xFFFFFFFF
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--bits', type=int, required=True, help='log2 of the table size')
+    parser.add_argument('--tries', type=int, default=1 << 24)
+    parser.add_argument('names', nargs='+')
+    args = parser.parse_args()
+
+    keys = [key3(n) for n in args.names]
+    if len(set(keys)) != len(keys):
+        sys.exit('names share their first three characters')
+    if len(keys) > 1 << args.bits:
+        sys.exit('more names than slots')
+    multiplier = find_multiplier(keys, args.bits, args.tries)
+    if multiplier is None:
+        sys.exit('no multiplier found, try more bits')
+    print('0x%08x' % multiplier)
+    for name, key in zip(args.names, keys):
+        print('  %-4s slot %d' % (name, ((key * multiplier) & 0xFFFFFFFF) >> (32 - args.bits)))
+
+
+if __name__ == '__main__':
+    main()
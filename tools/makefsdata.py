@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Build the httpd file system (pico_fsdata.inc) from content/.
+
+Replaces the SDK's makefsdata step so the pages cost as little flash and airtime as
+possible:
+
+  * HTML, CSS and JS are minified (conservatively: indentation, blank lines and whole-line
+    comments) and stored gzip-compressed with "Content-Encoding: gzip". httpd cannot look
+    at Accept-Encoding, so every client gets the gzip variant; all browsers accept it.
+  * Assets other than HTML are renamed to include a hash of their content
+    (/app.js -> /app.1a2b3c4d.js) and the HTML references are rewritten. They are sent
+    with "Cache-Control: immutable", so a repeat load fetches only the small page.
+  * Every file gets a strong ETag. httpd does not pass request headers to the file
+    system, so it cannot answer If-None-Match with a 304; the page itself is therefore
+    "no-cache" and the long-lived caching is done through the hashed asset names.
+
+Headers are stored with the data (FS_FILE_FLAGS_HEADER_INCLUDED), as the SDK tool does.
+
+    makefsdata.py -o pico_fsdata.inc content/index.html content/app.js ...
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+CONTENT_TYPES = {
+    '.html': 'text/html',
+    '.css': 'text/css',
+    '.js': 'application/javascript',
+    '.png': 'image/png',
+    '.ico': 'image/x-icon',
+    '.svg': 'image/svg+xml',
+}
+
+COMPRESSIBLE = ('.html', '.css', '.js', '.svg')
+
+CACHE_PAGE = 'no-cache'
+CACHE_ASSET = 'public, max-age=31536000, immutable'
+
+
+def minify_html(text):
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    return '\n'.join(line.strip() for line in text.splitlines() if line.strip()) + '\n'
+
+
+def minify_css(text):
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    text = re.sub(r'\s+', ' ', text)
+    text = re.sub(r'\s*([{};:,>])\s*', r'\1', text)
+    return text.replace(';}', '}').strip() + '\n'
+
+
+def minify_js(text):
+    # Only whole-line comments are dropped: a '//' later on a line may be inside a string
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line and not line.startswith('//')) + '\n'
+
+
+MINIFIERS = {'.html': minify_html, '.css': minify_css, '.js': minify_js}
+
+
+def hashed_name(name, data):
+    root, ext = os.path.splitext(name)
+    return '%s.%s%s' % (root, hashlib.sha256(data).hexdigest()[:8], ext)
+
+
+def build(paths):
+    """Return [(url, headers, body, minified size)] sorted by url, 404.html last."""
+    sources = {}
+    for path in paths:
+        name = '/' + os.path.basename(path)
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES:
+            sys.exit('makefsdata: no content type for %s' % path)
+        with open(path, 'rb') as f:
+            data = f.read()
+        if ext in MINIFIERS:
+            data = MINIFIERS[ext](data.decode('utf-8')).encode('utf-8')
+        sources[name] = data
+
+    # Assets first, so the pages can be rewritten to their hashed names
+    renames = {}
+    for name, data in sources.items():
+        if not name.endswith('.html'):
+            renames[name] = hashed_name(name, data)
+
+    files = []
+    for name, data in sources.items():
+        ext = os.path.splitext(name)[1]
+        if ext == '.html':
+            text = data.decode('utf-8')
+            for old, new in renames.items():
+                text = text.replace('"%s"' % old, '"%s"' % new)
+            data = text.encode('utf-8')
+        if ext in COMPRESSIBLE:
+            body = gzip.compress(data, 9, mtime=0)
+            if gzip.decompress(body) != data:
+                sys.exit('makefsdata: gzip round trip failed for %s' % name)
+        else:
+            body = data
+
+        status = '404 File not found' if name == '/404.html' else '200 OK'
+        headers = ['HTTP/1.0 ' + status,
+                   'Server: lwIP/pico',
+                   'Content-Length: %d' % len(body),
+                   'Content-Type: ' + CONTENT_TYPES[ext]]
+        if ext in COMPRESSIBLE:
+            headers += ['Content-Encoding: gzip', 'Vary: Accept-Encoding']
+        if name == '/404.html':
+            headers.append('Cache-Control: no-store')
+        else:
+            headers.append('Cache-Control: ' + (CACHE_PAGE if ext == '.html' else CACHE_ASSET))
+            headers.append('ETag: "%s"' % hashlib.sha256(body).hexdigest()[:16])
+        url = renames.get(name, name)
+        files.append((url, ('\r\n'.join(headers) + '\r\n\r\n').encode('ascii'), body, len(data)))
+
+    # Every hashed name must be referenced by some page, or the rewrite missed it
+    pages = b''.join(gzip.decompress(f[2]) for f in files if f[0].endswith('.html'))
+    for new in renames.values():
+        if ('"%s"' % new).encode('ascii') not in pages:
+            sys.exit('makefsdata: %s is not referenced by any page' % new)
+
+    files.sort(key=lambda f: (f[0] == '/404.html', f[0]))
+    return files
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(''.join('0x%02x,' % b for b in data[i:i + 16]))
+    return '\n'.join(lines)
+
+
+def c_ident(url):
+    return re.sub(r'[^A-Za-z0-9]', '_', url)
+
+
+def write_fsdata(files, out):
+    out.write('// Generated by tools/makefsdata.py, do not edit.\n')
+    out.write('// url: stored bytes (minified size)\n')
+    for url, headers, body, size in files:
+        out.write('//   %s: %d (%d)\n' % (url, len(body), size))
+    out.write('\n#include "lwip/apps/fs.h"\n#include "lwip/def.h"\n\n')
+    out.write('#define file_NULL (struct fsdata_file *) NULL\n\n')
+    out.write('#ifndef FSDATA_ALIGN_PRE\n#define FSDATA_ALIGN_PRE\n#endif\n')
+    out.write('#ifndef FSDATA_ALIGN_POST\n#define FSDATA_ALIGN_POST\n#endif\n\n')
+
+    previous = 'file_NULL'
+    for url, headers, body, size in reversed(files):
+        ident = c_ident(url)
+        name = url.encode('ascii') + b'\0'
+        out.write('static const unsigned char FSDATA_ALIGN_PRE data_%s[] FSDATA_ALIGN_POST = {\n'
+                  % ident)
+        out.write('/* %s (%d chars) */\n%s\n' % (url, len(name), c_bytes(name)))
+        out.write('/* HTTP header */\n%s\n' % c_bytes(headers))
+        out.write('/* body */\n%s\n};\n\n' % c_bytes(body))
+        out.write('const struct fsdata_file file_%s[] = {{\n' % ident)
+        out.write('    %s,\n    data_%s,\n    data_%s + %d,\n    sizeof(data_%s) - %d,\n'
+                  % (previous, ident, ident, len(name), ident, len(name)))
+        out.write('    FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,\n}};\n\n')
+        previous = 'file_' + ident
+
+    out.write('#define FS_ROOT %s\n#define FS_NUMFILES %d\n' % (previous, len(files)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('-o', '--output', required=True)
+    parser.add_argument('files', nargs='+')
+    args = parser.parse_args()
+
+    files = build(args.files)
+    with open(args.output, 'w', newline='\n') as out:
+        write_fsdata(files, out)
+
+
+if __name__ == '__main__':
+    main()
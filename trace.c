@@ -0,0 +1,294 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "custom.h"
+#include "pico/stdlib.h"
+#include "trace.h"
+#include "vehicle.h"
+
+#if (TRACE_SIZE & (TRACE_SIZE - 1)) != 0
+#error "TRACE_SIZE must be a power of two"
+#endif
+
+TraceStats trace_stats;
+
+static TraceRecord ring[TRACE_SIZE];
+static atomic_uint head; // records written since trace_init()
+
+// Commands of the tick in progress; they get the wheel outputs at trace_end_tick().
+// A tick applies at most the queued commands, an overflowed STOP and a script step.
+#define TRACE_STAGE_SIZE (CMD_QUEUE_SIZE + 2)
+static TraceRecord staged[TRACE_STAGE_SIZE];
+static int staged_count;
+static uint32_t tick_number;
+static uint32_t tick_start_us;
+static uint8_t tick_flags;
+static bool gap; // core 1 only: records were lost since the last one written
+
+// A download sets frozen and then waits for writing to clear; the recorder sets writing
+// and then checks frozen. Either the download sees the write in progress or the recorder
+// sees the freeze, so the ring never changes under a download.
+static atomic_bool frozen;
+static atomic_bool writing;
+
+typedef struct
+{
+    bool used;
+    uint32_t first; // head value of the oldest record sent
+    uint32_t count;
+    int header_len;
+    char header[192 + TRACE_HEADER_SIZE];
+} TraceDownload;
+
+static TraceDownload download;
+
+void trace_init(void)
+{
+    atomic_init(&head, 0);
+    atomic_init(&frozen, false);
+    atomic_init(&writing, false);
+    staged_count = 0;
+    gap = false;
+    memset(&download, 0, sizeof(download));
+    memset(&trace_stats, 0, sizeof(trace_stats));
+}
+
+void trace_begin_tick(uint32_t tick, uint32_t time_us)
+{
+    tick_number = tick;
+    tick_start_us = time_us;
+    tick_flags = vehicle_at_rest() ? TRACE_AT_REST : 0;
+    staged_count = 0;
+}
+
+void trace_command(int type, int a, int b)
+{
+    if (staged_count == TRACE_STAGE_SIZE)
+        return;
+    TraceRecord *r = &staged[staged_count++];
+    r->tick = tick_number;
+    r->time_us = tick_start_us;
+    r->type = (uint8_t)type;
+    r->flags = tick_flags;
+    r->a = (int16_t)a;
+    r->b = (int16_t)b;
+}
+
+void trace_end_tick(void)
+{
+    if (staged_count == 0)
+        return;
+
+    atomic_store(&writing, true);
+    if (atomic_load(&frozen))
+    {
+        trace_stats.lost += staged_count;
+        gap = true;
+    }
+    else
+    {
+        unsigned h = atomic_load_explicit(&head, memory_order_relaxed);
+        for (int i = 0; i < staged_count; i++)
+        {
+            TraceRecord *r = &ring[h++ % TRACE_SIZE];
+            *r = staged[i];
+            for (int w = 0; w < NUM_OF_WHEELS; w++)
+                r->speed[w] = (int16_t)wheels[w].speed;
+            r->vehicle_speed = (int16_t)vehicle_speed;
+            if (gap)
+            {
+                r->flags |= TRACE_GAP;
+                gap = false;
+            }
+        }
+        atomic_store_explicit(&head, h, memory_order_release);
+        trace_stats.recorded += staged_count;
+    }
+    atomic_store(&writing, false);
+    staged_count = 0;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    put_u16(p, (uint16_t)v);
+    put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put_float(uint8_t *p, float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    put_u32(p, v);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return get_u16(p) | (uint32_t)get_u16(p + 2) << 16;
+}
+
+static float get_float(const uint8_t *p)
+{
+    uint32_t v = get_u32(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+void trace_encode_header(uint8_t *out, uint32_t count, uint32_t lost)
+{
+    put_u32(out, TRACE_MAGIC);
+    put_u16(out + 4, TRACE_VERSION);
+    put_u16(out + 6, TRACE_RECORD_SIZE);
+    put_u16(out + 8, CONTROL_LOOP_HZ);
+    out[10] = NUM_OF_WHEELS;
+    out[11] = (uint8_t)motion_limits.shape;
+    put_u16(out + 12, SPEED_SCALE);
+    put_u16(out + 14, MAX_VEHICLE_SPEED);
+    put_u32(out + 16, count);
+    put_u32(out + 20, lost);
+    put_float(out + 24, motion_limits.max_accel);
+    put_float(out + 28, motion_limits.max_decel);
+    put_float(out + 32, motion_limits.max_jerk);
+}
+
+bool trace_decode_header(const uint8_t *data, size_t len, TraceHeader *header)
+{
+    if (len < TRACE_HEADER_SIZE || get_u32(data) != TRACE_MAGIC ||
+        get_u16(data + 4) != TRACE_VERSION)
+        return false;
+    header->version = get_u16(data + 4);
+    header->record_size = get_u16(data + 6);
+    header->loop_hz = get_u16(data + 8);
+    header->wheels = data[10];
+    header->limits.shape = (MotionShape)data[11];
+    header->speed_scale = get_u16(data + 12);
+    header->max_vehicle_speed = get_u16(data + 14);
+    header->count = get_u32(data + 16);
+    header->lost = get_u32(data + 20);
+    header->limits.max_accel = get_float(data + 24);
+    header->limits.max_decel = get_float(data + 28);
+    header->limits.max_jerk = get_float(data + 32);
+    return true;
+}
+
+void trace_encode(const TraceRecord *r, uint8_t *out)
+{
+    put_u32(out, r->tick);
+    put_u32(out + 4, r->time_us);
+    out[8] = r->type;
+    out[9] = r->flags;
+    put_u16(out + 10, (uint16_t)r->a);
+    put_u16(out + 12, (uint16_t)r->b);
+    put_u16(out + 14, (uint16_t)r->vehicle_speed);
+    for (int w = 0; w < NUM_OF_WHEELS; w++)
+        put_u16(out + 16 + 2 * w, (uint16_t)r->speed[w]);
+}
+
+void trace_decode(const uint8_t *in, TraceRecord *r)
+{
+    r->tick = get_u32(in);
+    r->time_us = get_u32(in + 4);
+    r->type = in[8];
+    r->flags = in[9];
+    r->a = (int16_t)get_u16(in + 10);
+    r->b = (int16_t)get_u16(in + 12);
+    r->vehicle_speed = (int16_t)get_u16(in + 14);
+    for (int w = 0; w < NUM_OF_WHEELS; w++)
+        r->speed[w] = (int16_t)get_u16(in + 16 + 2 * w);
+}
+
+int trace_download_open(struct fs_file *file)
+{
+    if (download.used)
+        return 0;
+
+    atomic_store(&frozen, true);
+    while (atomic_load(&writing))
+        tight_loop_contents();
+    unsigned h = atomic_load_explicit(&head, memory_order_acquire);
+
+    download.used = true;
+    download.first = h > TRACE_SIZE ? h - TRACE_SIZE : 0;
+    download.count = h - download.first;
+    uint32_t body_len = TRACE_HEADER_SIZE + download.count * TRACE_RECORD_SIZE;
+    int n = snprintf(download.header, sizeof(download.header) - TRACE_HEADER_SIZE,
+                     "HTTP/1.0 200 OK\r\n"
+                     "Server: lwIP/pico\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: %lu\r\n"
+                     "Content-Disposition: attachment; filename=\"trace.bin\"\r\n"
+                     "Cache-Control: no-store\r\n\r\n",
+                     (unsigned long)body_len);
+    trace_encode_header((uint8_t *)download.header + n, download.count, trace_stats.lost);
+    download.header_len = n + TRACE_HEADER_SIZE;
+    trace_stats.downloads++;
+
+    // Read through trace_download_read(), which encodes the records as they are sent
+    file->data = NULL;
+    file->len = download.header_len + (int)(download.count * TRACE_RECORD_SIZE);
+    file->index = 0;
+    file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+    file->pextension = &download;
+    return 1;
+}
+
+bool trace_download_can_read(struct fs_file *file)
+{
+    return file->pextension == &download;
+}
+
+int trace_download_read(struct fs_file *file, char *buffer, int count)
+{
+    if (file->pextension != &download || file->index >= file->len)
+        return FS_READ_EOF;
+
+    int n = 0;
+    while (n < count && file->index < file->len)
+    {
+        int pos = file->index;
+        int chunk;
+        if (pos < download.header_len)
+        {
+            chunk = download.header_len - pos;
+            if (chunk > count - n)
+                chunk = count - n;
+            memcpy(buffer + n, download.header + pos, chunk);
+        }
+        else
+        {
+            uint8_t record[TRACE_RECORD_SIZE];
+            int k = (pos - download.header_len) / TRACE_RECORD_SIZE;
+            int offset = (pos - download.header_len) % TRACE_RECORD_SIZE;
+            trace_encode(&ring[(download.first + k) % TRACE_SIZE], record);
+            chunk = TRACE_RECORD_SIZE - offset;
+            if (chunk > count - n)
+                chunk = count - n;
+            memcpy(buffer + n, record + offset, chunk);
+        }
+        n += chunk;
+        file->index += chunk;
+    }
+    return n;
+}
+
+bool trace_download_close(struct fs_file *file)
+{
+    if (file->pextension != &download)
+        return false;
+    download.used = false;
+    file->pextension = NULL;
+    atomic_store(&frozen, false);
+    return true;
+}
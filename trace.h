@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Command trace: a RAM ring of every command the control loop applied, with the control
+// loop tick it was applied in and the wheel outputs at the end of that tick. It is
+// downloaded as a binary file from GET /trace.bin, and the host harness replays it
+// through the same vehicle code (robot_bench --replay) to compare the outputs.
+//
+// Core 1 records (trace_begin_tick/trace_command/trace_end_tick, from the control loop
+// and the script runner); core 0 downloads. While a download is open recording pauses,
+// so the records being sent cannot be overwritten; the first record after the pause
+// carries TRACE_GAP.
+//
+// File layout, all little-endian: a TRACE_HEADER_SIZE header (see trace_encode_header)
+// followed by the records, oldest first, TRACE_RECORD_SIZE bytes each.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/apps/fs.h"
+#include "motion_profile.h"
+
+#define TRACE_MAGIC 0x43525452u // "RTRC"
+#define TRACE_VERSION 1
+
+#define TRACE_HEADER_SIZE 36
+#define TRACE_RECORD_SIZE (16 + 2 * NUM_OF_WHEELS)
+
+// TraceRecord.flags
+#define TRACE_AT_REST 0x01 // the vehicle was at rest with no target when the tick began
+#define TRACE_GAP 0x02     // records were lost just before this one
+
+typedef struct
+{
+    uint32_t tick;    // control loop tick the command was applied in
+    uint32_t time_us; // time_us_32() at the start of that tick
+    uint8_t type;     // CommandType
+    uint8_t flags;    // TRACE_*
+    int16_t a;        // CMD_DRIVE: throttle; otherwise the scale, 0..DRIVE_SCALE
+    int16_t b;        // CMD_DRIVE: turn; otherwise 0
+    int16_t speed[NUM_OF_WHEELS]; // Wheel.speed at the end of the tick
+    int16_t vehicle_speed;        // vehicle_speed at the end of the tick
+} TraceRecord;
+
+// What a trace file says about the firmware that recorded it
+typedef struct
+{
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t loop_hz;
+    uint8_t wheels;
+    uint16_t speed_scale;
+    uint16_t max_vehicle_speed;
+    uint32_t count; // records in the file
+    uint32_t lost;  // records dropped since boot because a download was open
+    MotionLimits limits;
+} TraceHeader;
+
+typedef struct
+{
+    uint32_t recorded;
+    uint32_t lost;
+    uint32_t downloads;
+} TraceStats;
+
+extern TraceStats trace_stats;
+
+void trace_init(void);
+
+// Control loop side (core 1). Commands applied between begin and end share the tick.
+void trace_begin_tick(uint32_t tick, uint32_t time_us);
+void trace_command(int type, int a, int b);
+void trace_end_tick(void);
+
+// fs_*_custom back end of /trace.bin. Only one download at a time; the others return
+// false (or FS_READ_EOF) for files that are not the trace download.
+int trace_download_open(struct fs_file *file);
+bool trace_download_can_read(struct fs_file *file);
+int trace_download_read(struct fs_file *file, char *buffer, int count);
+bool trace_download_close(struct fs_file *file);
+
+// Serialization of the file format, shared by the download and the host replay
+void trace_encode_header(uint8_t *out, uint32_t count, uint32_t lost);
+void trace_encode(const TraceRecord *r, uint8_t *out);
+// Returns false if data does not start with a trace header of this version
+bool trace_decode_header(const uint8_t *data, size_t len, TraceHeader *header);
+void trace_decode(const uint8_t *in, TraceRecord *r);
+
+#endif // TRACE_H
@@ -0,0 +1,314 @@
+#include <string.h>
+
+#include "custom.h"
+#include "session.h"
+#include "udp_control.h"
+#include "vehicle.h"
+
+UdpFleetStats udp_fleet_stats;
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+void udp_control_reset(UdpControlState *state)
+{
+    memset(state, 0, sizeof(*state));
+    memset(&udp_fleet_stats, 0, sizeof(udp_fleet_stats));
+}
+
+void udp_control_encode_command(uint8_t out[UDP_PACKET_SIZE], uint8_t flags, uint32_t seq,
+                                uint32_t time_ms, uint8_t command, uint16_t lead_ms)
+{
+    memset(out, 0, UDP_PACKET_SIZE);
+    out[0] = 'R';
+    out[1] = 'C';
+    out[2] = UDP_PROTOCOL_VERSION;
+    out[3] = flags;
+    put_u32(out + 4, seq);
+    put_u32(out + 8, time_ms);
+    out[12] = command;
+    put_u16(out + 14, lead_ms);
+}
+
+void udp_control_encode_drive(uint8_t out[UDP_DRIVE_PACKET_SIZE], uint8_t flags, uint32_t seq,
+                              uint32_t time_ms, int16_t throttle, int16_t turn, uint16_t lead_ms)
+{
+    udp_control_encode_command(out, flags, seq, time_ms, CMD_DRIVE, lead_ms);
+    put_u16(out + 16, (uint16_t)throttle);
+    put_u16(out + 18, (uint16_t)turn);
+}
+
+static int16_t get_component(const uint8_t *p)
+{
+    int v = (int16_t)get_u16(p);
+    return (int16_t)(v > DRIVE_SCALE ? DRIVE_SCALE : v < -DRIVE_SCALE ? -DRIVE_SCALE : v);
+}
+
+// The command of a packet already checked for its size, with the vector of a drive packet
+static VehicleCommand packet_command(const uint8_t *packet)
+{
+    VehicleCommand cmd = {packet[12], 0, 0};
+    if (packet[12] == CMD_DRIVE)
+    {
+        cmd.throttle = get_component(packet + 16);
+        cmd.turn = get_component(packet + 18);
+    }
+    return cmd;
+}
+
+static void encode_status(uint8_t out[UDP_PACKET_SIZE], UdpResult result, uint32_t seq,
+                          uint32_t now_ms, const UdpControlState *state)
+{
+    out[0] = 'R';
+    out[1] = 'S';
+    out[2] = UDP_PROTOCOL_VERSION;
+    out[3] = (uint8_t)result;
+    put_u32(out + 4, seq);
+    put_u32(out + 8, now_ms);
+    out[12] = (uint8_t)last_command;
+    out[13] = (uint8_t)(int8_t)vehicle_speed;
+    out[14] = (uint8_t)state->dropped;
+    out[15] = (uint8_t)(state->dropped >> 8);
+}
+
+static UdpResult drop(UdpControlState *state, UdpResult result)
+{
+    if (state->dropped < UINT16_MAX)
+        state->dropped++;
+    return result;
+}
+
+static UdpResult check_packet(UdpControlState *state, uint32_t peer, uint8_t flags, uint32_t seq,
+                              uint32_t offset_ms)
+{
+    if (flags & UDP_FLAG_SYNC)
+    {
+        // A (re)starting sender always takes over; its first packet defines the baseline
+        if (!state->active || state->peer != peer || (int32_t)(seq - state->last_seq) <= 0)
+        {
+            state->active = true;
+            state->peer = peer;
+            state->dropped = 0;
+            state->min_offset_ms = offset_ms;
+            state->last_seq = seq;
+            return UDP_ACCEPTED;
+        }
+    }
+    if (!state->active || state->peer != peer)
+        return drop(state, UDP_DROPPED_PEER);
+
+    // Serial number arithmetic so seq may wrap
+    if ((int32_t)(seq - state->last_seq) <= 0)
+        return drop(state, UDP_DROPPED_OLD);
+
+    // Offsets are compared modulo 2^32 so either clock may wrap
+    int32_t age_ms = (int32_t)(offset_ms - state->min_offset_ms);
+    if (age_ms < 0)
+        state->min_offset_ms = offset_ms;
+    else if (age_ms > UDP_MAX_PACKET_AGE_MS)
+        return drop(state, UDP_DROPPED_STALE);
+
+    state->last_seq = seq;
+    return UDP_ACCEPTED;
+}
+
+static void encode_ack(uint8_t out[UDP_PACKET_SIZE], UdpResult result, uint32_t seq,
+                       uint32_t now_ms, int32_t wait_ms, const UdpFleetState *fleet)
+{
+    int16_t wait = wait_ms > INT16_MAX ? INT16_MAX : wait_ms < INT16_MIN ? INT16_MIN : (int16_t)wait_ms;
+    out[0] = 'R';
+    out[1] = 'A';
+    out[2] = UDP_PROTOCOL_VERSION;
+    out[3] = (uint8_t)result;
+    put_u32(out + 4, seq);
+    put_u32(out + 8, now_ms);
+    out[12] = (uint8_t)(uint16_t)wait;
+    out[13] = (uint8_t)((uint16_t)wait >> 8);
+    out[14] = (uint8_t)fleet->dropped;
+    out[15] = (uint8_t)(fleet->dropped >> 8);
+}
+
+static UdpResult fleet_drop(UdpFleetState *fleet, UdpResult result)
+{
+    if (fleet->dropped < UINT16_MAX)
+        fleet->dropped++;
+    return result;
+}
+
+// Fastest path over the last two windows. Offsets are compared modulo 2^32.
+static uint32_t fleet_offset(const UdpFleetState *fleet)
+{
+    return (int32_t)(fleet->window_min_ms - fleet->prev_min_ms) < 0 ? fleet->window_min_ms
+                                                                     : fleet->prev_min_ms;
+}
+
+static void fleet_sample(UdpFleetState *fleet, uint32_t offset_ms, uint32_t now_ms)
+{
+    if (now_ms - fleet->window_start_ms >= UDP_FLEET_SYNC_WINDOW_MS)
+    {
+        fleet->prev_min_ms = fleet->window_min_ms;
+        fleet->window_min_ms = offset_ms;
+        fleet->window_start_ms = now_ms;
+    }
+    else if ((int32_t)(offset_ms - fleet->window_min_ms) < 0)
+        fleet->window_min_ms = offset_ms;
+}
+
+static UdpResult fleet_check(UdpFleetState *fleet, uint32_t peer, uint8_t flags, uint32_t seq,
+                             uint32_t offset_ms, uint32_t now_ms)
+{
+    if ((flags & UDP_FLAG_SYNC) &&
+        (!fleet->active || fleet->peer != peer || (int32_t)(seq - fleet->last_seq) <= 0))
+    {
+        // A (re)starting sender takes over; its first packet is the first time beacon
+        fleet->active = true;
+        fleet->peer = peer;
+        fleet->last_seq = seq;
+        fleet->dropped = 0;
+        fleet->pending = false;
+        fleet->window_start_ms = now_ms;
+        fleet->window_min_ms = fleet->prev_min_ms = offset_ms;
+        return UDP_ACCEPTED;
+    }
+    if (!fleet->active || fleet->peer != peer)
+        return fleet_drop(fleet, UDP_DROPPED_PEER);
+    if ((int32_t)(seq - fleet->last_seq) <= 0)
+        return fleet_drop(fleet, UDP_DROPPED_OLD);
+
+    fleet_sample(fleet, offset_ms, now_ms);
+    if ((int32_t)(offset_ms - fleet_offset(fleet)) > UDP_MAX_PACKET_AGE_MS)
+        return fleet_drop(fleet, UDP_DROPPED_STALE);
+    fleet->last_seq = seq;
+    return UDP_ACCEPTED;
+}
+
+static void fleet_apply(const UdpFleetState *fleet, VehicleCommand cmd, uint32_t now_ms)
+{
+    if (session_submit(SESSION_UDP, fleet->peer, &cmd, now_ms) == SESSION_DENIED)
+        udp_fleet_stats.denied++;
+}
+
+static UdpResult fleet_receive(UdpFleetState *fleet, uint32_t peer, const uint8_t *packet,
+                               uint32_t now_ms, uint8_t reply[UDP_PACKET_SIZE])
+{
+    uint32_t seq = get_u32(packet + 4);
+    uint32_t sent_ms = get_u32(packet + 8);
+    VehicleCommand command = packet_command(packet);
+    uint16_t lead_ms = get_u16(packet + 14);
+    int32_t wait_ms = 0;
+
+    UdpResult result = fleet_check(fleet, peer, packet[3], seq, now_ms - sent_ms, now_ms);
+    if (result == UDP_ACCEPTED)
+    {
+        uint32_t due_ms = sent_ms + lead_ms + fleet_offset(fleet);
+        if (command.type == CMD_STOP || command.type == CMD_HEARTBEAT)
+        {
+            // Never held back; a STOP also drops what was waiting
+            if (command.type == CMD_STOP)
+                fleet->pending = false;
+            fleet_apply(fleet, command, now_ms);
+        }
+        else
+        {
+            wait_ms = (int32_t)(due_ms - now_ms);
+            if (fleet->pending)
+                udp_fleet_stats.superseded++;
+            fleet->pending = false;
+            if (wait_ms > 0)
+            {
+                fleet->pending = true;
+                fleet->pending_command = command;
+                fleet->due_ms = due_ms;
+                udp_fleet_stats.scheduled++;
+                result = UDP_SCHEDULED;
+            }
+            else
+            {
+                if (wait_ms < 0)
+                {
+                    udp_fleet_stats.late++;
+                    if ((uint32_t)-wait_ms > udp_fleet_stats.max_late_ms)
+                        udp_fleet_stats.max_late_ms = (uint32_t)-wait_ms;
+                }
+                fleet_apply(fleet, command, now_ms);
+            }
+        }
+    }
+
+    encode_ack(reply, result, seq, now_ms, wait_ms, fleet);
+    return result;
+}
+
+bool udp_control_poll(UdpControlState *state, uint32_t now_ms)
+{
+    UdpFleetState *fleet = &state->fleet;
+    if (!fleet->pending || (int32_t)(now_ms - fleet->due_ms) < 0)
+        return false;
+    fleet->pending = false;
+    udp_fleet_stats.applied++;
+    fleet_apply(fleet, fleet->pending_command, now_ms);
+    return true;
+}
+
+int32_t udp_control_next_due(const UdpControlState *state, uint32_t now_ms)
+{
+    if (!state->fleet.pending)
+        return -1;
+    int32_t wait_ms = (int32_t)(state->fleet.due_ms - now_ms);
+    return wait_ms > 0 ? wait_ms : 0;
+}
+
+UdpResult udp_control_receive(UdpControlState *state, uint32_t peer, const uint8_t *packet,
+                              size_t len, uint32_t now_ms, uint8_t reply[UDP_PACKET_SIZE])
+{
+    bool drive = len == UDP_DRIVE_PACKET_SIZE;
+    if ((len != UDP_PACKET_SIZE && !drive) || packet[0] != 'R' || packet[1] != 'C' ||
+        packet[2] != UDP_PROTOCOL_VERSION || (packet[12] == CMD_DRIVE) != drive ||
+        !(packet[12] == CMD_STOP || packet[12] == CMD_NONE || packet[12] == CMD_HEARTBEAT ||
+          packet[12] == CMD_DRIVE || vehicle_is_movement((CommandType)packet[12])))
+        return UDP_MALFORMED;
+
+    uint8_t flags = packet[3];
+    if (flags & UDP_FLAG_FLEET)
+    {
+        // A target further out than this is a broken sender, not a plan
+        if (get_u16(packet + 14) > UDP_FLEET_MAX_LEAD_MS)
+            return UDP_MALFORMED;
+        return fleet_receive(&state->fleet, peer, packet, now_ms, reply);
+    }
+    uint32_t seq = get_u32(packet + 4);
+    uint32_t offset_ms = now_ms - get_u32(packet + 8);
+
+    UdpResult result = check_packet(state, peer, flags, seq, offset_ms);
+    if (result == UDP_ACCEPTED)
+    {
+        VehicleCommand cmd = packet_command(packet);
+        SessionResult arbitration = session_submit(SESSION_UDP, peer, &cmd, now_ms);
+        if (arbitration == SESSION_DENIED)
+            result = UDP_DROPPED_LEASE;
+    }
+
+    encode_status(reply, result, seq, now_ms, state);
+    return result;
+}
@@ -0,0 +1,145 @@
+#ifndef UDP_CONTROL_H
+#define UDP_CONTROL_H
+
+// Binary UDP control protocol. Independent of lwIP; udp_server.c does the socket side.
+//
+// Command packet, 16 bytes, little endian:
+//   0  'R' 'C'       magic
+//   2  u8  version   UDP_PROTOCOL_VERSION
+//   3  u8  flags     UDP_FLAG_*
+//   4  u32 seq       incremented by the sender for every packet
+//   8  u32 time_ms   sender clock when the packet was sent
+//   12 u8  command   CommandType: a movement command, STOP, NONE, HEARTBEAT or DRIVE
+//   13 u8  reserved
+//   14 u16 lead_ms   fleet packets: execute at time_ms + lead_ms on the sender clock;
+//                    otherwise reserved (0)
+//
+// Drive packet, 20 bytes: a command packet with CMD_DRIVE, followed by the vector, as
+// /drive.cgi takes it (vehicle_drive()):
+//   16 s16 throttle  -DRIVE_SCALE..DRIVE_SCALE, clamped
+//   18 s16 turn      -DRIVE_SCALE..DRIVE_SCALE, clamped
+// A CMD_DRIVE packet of any other size, or another command in 20 bytes, is malformed.
+//
+// Status packet, 16 bytes, little endian, sent back for every command packet:
+//   0  'R' 'S'       magic
+//   2  u8  version
+//   3  u8  result    UdpResult for the packet being answered
+//   4  u32 seq       seq of the packet being answered
+//   8  u32 time_ms   robot clock
+//   12 u8  command   last applied command
+//   13 s8  speed     vehicle_speed as of the last control loop tick
+//   14 u16 dropped   packets dropped since the session started (saturating)
+//
+// A packet is applied only if its seq is newer than the last applied one and it did not
+// spend more than UDP_MAX_PACKET_AGE_MS in flight. One-way delay is not measurable without
+// synchronised clocks, so age is taken relative to the fastest packet seen so far: the
+// smallest (robot time - sender time) offset is the best-case path, anything slower than
+// that by more than the limit is stale.
+//
+// Fleet mode: an operator multicasts one packet per command to UDP_FLEET_GROUP with
+// UDP_FLAG_FLEET, and every robot in the group applies it at the same target time. Fleet
+// packets have a session of their own, next to the unicast one. The same fastest-path
+// offset is the clock sync: every fleet packet, heartbeats included, is a time beacon,
+// and sender time + offset is the moment the sender's clock read that time, as seen on
+// this robot, one best-case path late. All robots on a LAN see about the same path, so
+// they line up with each other to a control loop tick. The minimum is taken over the
+// last two UDP_FLEET_SYNC_WINDOW_MS windows, so it follows the drift between the clocks.
+// STOP and heartbeats are applied on arrival; a command whose target time has passed is
+// applied at once too, and the ack says how late.
+//
+// Fleet ack, 16 bytes, little endian, sent back to the sender for every fleet packet:
+//   0  'R' 'A'       magic
+//   2  u8  version
+//   3  u8  result    UdpResult
+//   4  u32 seq       seq of the packet being answered
+//   8  u32 time_ms   robot clock at receipt
+//   12 s16 wait_ms   robot time from receipt to execution: negative if late, 0 on arrival
+//   14 u16 dropped   fleet packets dropped since the fleet session started (saturating)
+//
+// From an ack the sender can tell when the robot believes the packet was sent: the
+// target time minus lead_ms is time_ms + wait_ms on the robot clock. Comparing that with
+// its own send and ack times gives each robot's round trip and sync error.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vehicle.h"
+
+#define UDP_PROTOCOL_VERSION 1
+#define UDP_PACKET_SIZE 16
+#define UDP_DRIVE_PACKET_SIZE 20
+
+#define UDP_FLAG_SYNC 0x01  // first packet of a session: resets seq tracking and takes control
+#define UDP_FLAG_FLEET 0x02 // fleet packet, applied at time_ms + lead_ms
+
+typedef enum
+{
+    UDP_ACCEPTED,
+    UDP_DROPPED_OLD,   // seq not newer than the last applied one (duplicate or reordered)
+    UDP_DROPPED_STALE, // delayed in flight longer than UDP_MAX_PACKET_AGE_MS
+    UDP_DROPPED_PEER,  // another sender owns the session and this one did not send SYNC
+    UDP_MALFORMED,     // wrong size, magic, version or command; no reply is sent
+    UDP_DROPPED_LEASE, // valid, but another client holds the controller lease (session.h)
+    UDP_SCHEDULED,     // fleet: held until its target time
+} UdpResult;
+
+// Fleet session: the offset windows and the one command waiting for its target time
+typedef struct
+{
+    bool active;
+    uint32_t peer;
+    uint32_t last_seq;
+    uint32_t window_start_ms; // robot clock
+    uint32_t window_min_ms;   // smallest robot time - sender time in the current window
+    uint32_t prev_min_ms;     // the same for the window before
+    bool pending;
+    VehicleCommand pending_command;
+    uint32_t due_ms; // robot clock
+    uint16_t dropped;
+} UdpFleetState;
+
+typedef struct
+{
+    uint32_t scheduled; // commands held for their target time
+    uint32_t applied;   // scheduled commands applied when due
+    uint32_t late;      // commands that arrived after their target time
+    uint32_t superseded; // scheduled commands replaced by a newer packet before they were due
+    uint32_t denied;    // applied, but the lease was someone else's
+    uint32_t max_late_ms;
+} UdpFleetStats;
+
+extern UdpFleetStats udp_fleet_stats;
+
+typedef struct
+{
+    bool active;
+    uint32_t peer;       // opaque sender identity (address/port hash from udp_server.c)
+    uint32_t last_seq;
+    uint32_t min_offset_ms; // smallest robot time - sender time seen in this session
+    uint16_t dropped;
+    UdpFleetState fleet;
+} UdpControlState;
+
+void udp_control_reset(UdpControlState *state);
+
+// Handle one datagram from peer. Writes the status packet, or the ack of a fleet packet,
+// to reply (UDP_PACKET_SIZE bytes) unless the result is UDP_MALFORMED.
+UdpResult udp_control_receive(UdpControlState *state, uint32_t peer, const uint8_t *packet,
+                              size_t len, uint32_t now_ms, uint8_t reply[UDP_PACKET_SIZE]);
+
+// Apply the scheduled fleet command if it is due. Returns true if it was.
+bool udp_control_poll(UdpControlState *state, uint32_t now_ms);
+
+// Milliseconds until the scheduled fleet command is due (0 if it is), -1 if none
+int32_t udp_control_next_due(const UdpControlState *state, uint32_t now_ms);
+
+// Build a command packet, as a sender would. lead_ms only counts with UDP_FLAG_FLEET.
+void udp_control_encode_command(uint8_t out[UDP_PACKET_SIZE], uint8_t flags, uint32_t seq,
+                                uint32_t time_ms, uint8_t command, uint16_t lead_ms);
+
+// The same for a drive vector
+void udp_control_encode_drive(uint8_t out[UDP_DRIVE_PACKET_SIZE], uint8_t flags, uint32_t seq,
+                              uint32_t time_ms, int16_t throttle, int16_t turn, uint16_t lead_ms);
+
+#endif // UDP_CONTROL_H
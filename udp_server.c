@@ -0,0 +1,91 @@
+// lwIP raw-API side of the UDP control protocol: one pcb, one reply per command packet.
+// The pcb also takes the fleet packets multicast to UDP_FLEET_GROUP, and an lwIP timeout
+// posts a scheduled fleet command when its target time comes.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "custom.h"
+#include "lwip/igmp.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "pico/stdlib.h"
+#include "udp_control.h"
+#include "udp_server.h"
+
+static struct udp_pcb *udp_control_pcb;
+static UdpControlState udp_state;
+
+static void fleet_due(void *arg)
+{
+    LWIP_UNUSED_ARG(arg);
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    udp_control_poll(&udp_state, now_ms);
+    // Still waiting if the timeout fired early, or a newer command replaced it
+    int32_t wait_ms = udp_control_next_due(&udp_state, now_ms);
+    if (wait_ms >= 0)
+        sys_timeout((u32_t)wait_ms, fleet_due, NULL);
+}
+
+static void udp_control_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
+                             u16_t port)
+{
+    uint8_t packet[UDP_DRIVE_PACKET_SIZE];
+    uint8_t reply[UDP_PACKET_SIZE];
+    LWIP_UNUSED_ARG(arg);
+
+    size_t len = p->tot_len;
+    if (len <= sizeof(packet))
+        pbuf_copy_partial(p, packet, (u16_t)len, 0);
+    pbuf_free(p);
+
+    uint32_t peer = ip4_addr_get_u32(ip_2_ip4(addr)) ^ ((uint32_t)port << 16);
+    uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    UdpResult result = udp_control_receive(&udp_state, peer, packet, len, now_ms, reply);
+    if (result == UDP_MALFORMED)
+        return;
+    if (result == UDP_SCHEDULED)
+    {
+        sys_untimeout(fleet_due, NULL);
+        sys_timeout((u32_t)udp_control_next_due(&udp_state, now_ms), fleet_due, NULL);
+    }
+
+    struct pbuf *out = pbuf_alloc(PBUF_TRANSPORT, UDP_PACKET_SIZE, PBUF_RAM);
+    if (out == NULL)
+        return;
+    memcpy(out->payload, reply, UDP_PACKET_SIZE);
+    udp_sendto(pcb, out, addr, port);
+    pbuf_free(out);
+}
+
+void udp_server_init(void)
+{
+    udp_control_reset(&udp_state);
+
+    udp_control_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (udp_control_pcb == NULL)
+    {
+        printf("udp: failed to create pcb\n");
+        return;
+    }
+    if (udp_bind(udp_control_pcb, IP_ANY_TYPE, UDP_CONTROL_PORT) != ERR_OK)
+    {
+        printf("udp: failed to bind port %d\n", UDP_CONTROL_PORT);
+        udp_remove(udp_control_pcb);
+        udp_control_pcb = NULL;
+        return;
+    }
+    udp_recv(udp_control_pcb, udp_control_recv, NULL);
+    printf("udp: listening on port %d\n", UDP_CONTROL_PORT);
+
+#ifdef UDP_FLEET_GROUP
+    // Joined on every netif; lwIP reports the membership again whenever the link comes up
+    ip4_addr_t group;
+    ip4addr_aton(UDP_FLEET_GROUP, &group);
+    if (igmp_joingroup(IP4_ADDR_ANY4, &group) == ERR_OK)
+        printf("udp: fleet group %s\n", UDP_FLEET_GROUP);
+    else
+        printf("udp: failed to join fleet group %s\n", UDP_FLEET_GROUP);
+#endif
+}
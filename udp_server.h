@@ -0,0 +1,8 @@
+#ifndef UDP_SERVER_H
+#define UDP_SERVER_H
+
+// Start listening for binary UDP control packets on UDP_CONTROL_PORT.
+// Call with the lwIP lock held (between cyw43_arch_lwip_begin/end).
+void udp_server_init(void);
+
+#endif // UDP_SERVER_H
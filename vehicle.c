@@ -0,0 +1,290 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "custom.h"
+#include "hardware/pwm.h"
+#include "key3.h"
+#include "motion_profile.h"
+#include "motor_pwm.h"
+#include "pwm_ramp.h"
+#include "pico/stdlib.h"
+#include "vehicle.h"
+
+#define WHEEL_INIT(name, throttle, turn, strafe)                                          \
+    {MOTOR_##name##_ENA, MOTOR_##name##_IN1, MOTOR_##name##_IN2, 0, MIX_ONE},
+Wheel wheels[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(WHEEL_INIT)};
+
+// Drive vector of each fixed-direction command, full scale DRIVE_SCALE: the turns run one
+// side at half the speed of the other, the strafes only exist on a mecanum chassis
+static const int16_t command_vector[CMD_SRT + 1][3] = {
+    [CMD_FLT] = {750, -250, 0},  [CMD_FRT] = {750, 250, 0},    [CMD_FWD] = {1000, 0, 0},
+    [CMD_LFT] = {0, -1000, 0},   [CMD_RGT] = {0, 1000, 0},     [CMD_BLT] = {-750, 250, 0},
+    [CMD_BWD] = {-1000, 0, 0},   [CMD_BRT] = {-750, -250, 0},  [CMD_SLT] = {0, 0, -1000},
+    [CMD_SRT] = {0, 0, 1000},
+};
+
+// Direction pins: IN1 high drives forward, IN2 high backward. All of them are written
+// together with one masked write of the SIO output register.
+#define PIN_BIT(pin) (1u << (pin))
+#define WHEEL_DIRECTION_PINS(name, throttle, turn, strafe)                                \
+    PIN_BIT(MOTOR_##name##_IN1) | PIN_BIT(MOTOR_##name##_IN2) |
+#define DIRECTION_PIN_MASK (DRIVETRAIN_WHEELS(WHEEL_DIRECTION_PINS) 0u)
+
+// Levels last written to the direction pins; a stopped wheel keeps its direction
+static uint32_t direction_levels = 0;
+
+int vehicle_speed = 0;
+
+CommandType last_commands[2] = {CMD_NONE, CMD_NONE};
+
+// Bumped whenever the wheel targets are set, see vehicle_target_seq()
+static uint32_t target_seq = 0;
+
+// Full-scale speed the wheels ramp toward while a movement command is held
+static float target_speed = 0.0f;
+
+// Speed of the current movement command, 1.0 unless set by vehicle_command_scaled()
+static float command_speed = 1.0f;
+
+void push_command(CommandType cmd)
+{
+    last_commands[1] = last_commands[0];
+    last_commands[0] = cmd;
+}
+
+void vehicle_command(CommandType cmd)
+{
+    vehicle_command_scaled(cmd, DRIVE_SCALE);
+}
+
+void vehicle_command_scaled(CommandType cmd, int scale)
+{
+    push_command(cmd);
+    command_speed = (float)scale / DRIVE_SCALE;
+    update_vehicle();
+}
+
+// Set the wheel mixes from a drive vector. Expanded per wheel from the drivetrain table,
+// so the coefficients are constants and the zero terms drop out.
+static void mix_vector(int throttle, int turn, int strafe)
+{
+#define WHEEL_RAW(name, t, r, s) (t) * throttle + (r) * turn + (s) * strafe,
+    const int raw[NUM_OF_WHEELS] = {DRIVETRAIN_WHEELS(WHEEL_RAW)};
+    int peak = DRIVE_SCALE;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        int magnitude = abs(raw[i]);
+        peak = magnitude > peak ? magnitude : peak;
+    }
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        wheels[i].mix = (int16_t)(raw[i] * MIX_ONE / peak);
+}
+
+void vehicle_drive(int throttle, int turn)
+{
+    push_command(CMD_DRIVE);
+    target_speed = 1.0f;
+    mix_vector(throttle, turn, 0);
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        motion_profile_set_target(&wheels[i].profile, wheels[i].mix * (target_speed / MIX_ONE));
+    target_seq++;
+}
+
+bool parse_drive_value(const char *s, size_t len, int *value)
+{
+    size_t i = 0;
+    bool negative = len > 0 && s[0] == '-';
+    int v = 0;
+
+    if (negative)
+        i++;
+    if (i == len || len - i > 5)
+        return false;
+    for (; i < len; i++)
+    {
+        if (s[i] < '0' || s[i] > '9')
+            return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    if (v > DRIVE_SCALE)
+        v = DRIVE_SCALE;
+    *value = negative ? -v : v;
+    return true;
+}
+
+// Every command name, perfect-hashed by its packed key (key3.h). A new name needs a new
+// COMMAND_HASH_MUL from tools/key3_hash.py if it lands in a taken slot.
+#define COMMAND_HASH_BITS 5
+#define COMMAND_HASH_MUL 0x9e377a47u
+#define COMMAND_NAME(a, b, c, cmd)                                                        \
+    [KEY3_SLOT(KEY3(a, b, c), COMMAND_HASH_MUL, COMMAND_HASH_BITS)] = {KEY3(a, b, c), cmd}
+
+static const struct
+{
+    uint32_t key; // 0 in an empty slot, which no three letters pack to
+    uint8_t cmd;
+} command_names[1 << COMMAND_HASH_BITS] = {
+    COMMAND_NAME('F', 'L', 'T', CMD_FLT),  COMMAND_NAME('F', 'R', 'T', CMD_FRT),
+    COMMAND_NAME('F', 'W', 'D', CMD_FWD),  COMMAND_NAME('L', 'F', 'T', CMD_LFT),
+    COMMAND_NAME('R', 'G', 'T', CMD_RGT),  COMMAND_NAME('B', 'L', 'T', CMD_BLT),
+    COMMAND_NAME('B', 'W', 'D', CMD_BWD),  COMMAND_NAME('B', 'R', 'T', CMD_BRT),
+    COMMAND_NAME('S', 'T', 'P', CMD_STOP), COMMAND_NAME('N', 'O', 'N', CMD_NONE),
+    COMMAND_NAME('H', 'B', 'T', CMD_HEARTBEAT), COMMAND_NAME('S', 'L', 'T', CMD_SLT),
+    COMMAND_NAME('S', 'R', 'T', CMD_SRT),
+};
+
+bool vehicle_parse_command(const char *name, size_t len, CommandType *cmd)
+{
+    if (len != 3)
+        return false;
+    uint32_t key = key3(name);
+    uint32_t slot = KEY3_SLOT(key, COMMAND_HASH_MUL, COMMAND_HASH_BITS);
+    if (command_names[slot].key != key || key == 0)
+        return false;
+    CommandType found = (CommandType)command_names[slot].cmd;
+    if (!DRIVETRAIN_HAS_STRAFE && (found == CMD_SLT || found == CMD_SRT))
+        return false;
+    *cmd = found;
+    return true;
+}
+
+CommandType get_command_enum(const char *command)
+{
+    CommandType cmd;
+    // Anything but exactly three characters is not a command; no strlen needed for that
+    if (command[0] == '\0' || command[1] == '\0' || command[2] == '\0' || command[3] != '\0')
+        return CMD_NONE;
+    return vehicle_parse_command(command, 3, &cmd) ? cmd : CMD_NONE;
+}
+
+// Setup pwms
+void setup_pwms()
+{
+    motor_pwm_init();
+    pwm_ramp_init();
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        motor_pwm_setup_pin(wheels[i].en_pin);
+
+        // Initialize IN1 and IN2 pins as OUTPUT (needed for direction control)
+        gpio_init(wheels[i].in1_pin);
+        gpio_set_dir(wheels[i].in1_pin, GPIO_OUT);
+        gpio_put(wheels[i].in1_pin, 0); // Set to LOW initially
+
+        gpio_init(wheels[i].in2_pin);
+        gpio_set_dir(wheels[i].in2_pin, GPIO_OUT);
+        gpio_put(wheels[i].in2_pin, 0); // Set to LOW initially
+    }
+    direction_levels = 0;
+}
+
+// Update the wheel targets according to the current command
+// Implements:
+// - STOP -> stop all wheels immediately
+// - NONE -> ramp all wheels down to 0
+// - a movement command -> mix the command's vector from command_vector and ramp toward
+//   full speed (or the speed given to vehicle_command_scaled())
+// The ramps themselves run in vehicle_step() on every control loop tick, so holding a
+// command accelerates at the same rate however often (and by however many clients) it
+// is repeated.
+void update_vehicle()
+{
+    CommandType cmd = last_command;
+
+    if (cmd == CMD_STOP)
+    {
+        target_speed = 0.0f;
+        for (int i = 0; i < NUM_OF_WHEELS; i++)
+            motion_profile_reset(&wheels[i].profile);
+    }
+    else if (cmd == CMD_NONE)
+    {
+        target_speed = 0.0f; // released: ramp down, keeping the current mix
+    }
+    else if (vehicle_is_movement(cmd))
+    {
+        target_speed = command_speed;
+        mix_vector(command_vector[cmd][0], command_vector[cmd][1], command_vector[cmd][2]);
+    }
+
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+        motion_profile_set_target(&wheels[i].profile, wheels[i].mix * (target_speed / MIX_ONE));
+    target_seq++;
+}
+
+uint32_t vehicle_target_seq(void)
+{
+    return target_seq;
+}
+
+// Advance the wheel profiles by one control loop period
+void vehicle_step(float dt)
+{
+    float fastest = 0.0f;
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        float v = motion_profile_step(&wheels[i].profile, &motion_limits, dt);
+        wheels[i].speed = (int)lroundf(v * SPEED_SCALE);
+        wheels[i].duty = motor_pwm_duty(v);
+        if (fabsf(v) > fastest)
+            fastest = fabsf(v);
+    }
+    vehicle_speed = (int)lroundf(fastest * MAX_VEHICLE_SPEED);
+}
+
+// Point a wheel's direction pins forward or backward, or leave them as they are when it
+// is neither, without a branch: the conditions become all-ones or all-zero masks
+static inline uint32_t steer(uint32_t levels, uint32_t in1, uint32_t in2, bool forward,
+                             bool backward)
+{
+    uint32_t fwd = -(uint32_t)forward;
+    uint32_t bwd = -(uint32_t)backward;
+    return (levels & ~((in1 | in2) & (fwd | bwd))) | (in1 & fwd) | (in2 & bwd);
+}
+
+// Apply the current wheel state to the hardware: direction pins and PWM. Both passes are
+// expanded per wheel from the drivetrain table, with the pins as constants.
+void apply_vehicle()
+{
+    // Direction follows the ramped velocity, so a reversal only flips the pins once the
+    // wheel has slowed through zero
+    uint32_t levels = direction_levels;
+#define WHEEL_STEER(name, throttle, turn, strafe)                                         \
+    levels = steer(levels, PIN_BIT(MOTOR_##name##_IN1), PIN_BIT(MOTOR_##name##_IN2),      \
+                   wheels[WHEEL_##name].profile.velocity > 0.0f,                          \
+                   wheels[WHEEL_##name].profile.velocity < 0.0f);
+    DRIVETRAIN_WHEELS(WHEEL_STEER)
+    direction_levels = levels;
+    gpio_put_masked(DIRECTION_PIN_MASK, levels);
+
+    // The sign is handled by the direction pins; a DMA ramp writes the levels itself
+    if (pwm_ramp_owns_outputs())
+        return;
+#define WHEEL_LEVEL(name, throttle, turn, strafe)                                         \
+    pwm_set_gpio_level(MOTOR_##name##_ENA,                                                \
+                       motor_pwm_level(WHEEL_##name, wheels[WHEEL_##name].duty));
+    DRIVETRAIN_WHEELS(WHEEL_LEVEL)
+}
+
+void vehicle_set_directions(const int8_t sign[NUM_OF_WHEELS])
+{
+    uint32_t levels = direction_levels;
+#define WHEEL_SIGN(name, throttle, turn, strafe)                                          \
+    levels = steer(levels, PIN_BIT(MOTOR_##name##_IN1), PIN_BIT(MOTOR_##name##_IN2),      \
+                   sign[WHEEL_##name] > 0, sign[WHEEL_##name] < 0);
+    DRIVETRAIN_WHEELS(WHEEL_SIGN)
+    direction_levels = levels;
+    gpio_put_masked(DIRECTION_PIN_MASK, levels);
+}
+
+bool vehicle_at_rest(void)
+{
+    for (int i = 0; i < NUM_OF_WHEELS; i++)
+    {
+        const MotionProfile *p = &wheels[i].profile;
+        if (p->velocity != 0.0f || p->accel != 0.0f || p->target != 0.0f)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef VEHICLE_H
+#define VEHICLE_H
+
+#include "motion_profile.h"
+#include "pico/stdlib.h"
+
+typedef enum
+{
+    CMD_FLT,  // Front Left
+    CMD_FRT,  // Front Right
+    CMD_FWD,  // Go Front
+    CMD_LFT,  // Left
+    CMD_RGT,  // Right
+    CMD_BLT,  // Back Left
+    CMD_BWD,  // Go Back
+    CMD_BRT,  // Back Right
+    CMD_STOP, // Stop all motors immediately
+    CMD_NONE, // No command has been received
+    CMD_DRIVE, // Continuous throttle/turn vector, see vehicle_drive()
+    CMD_SCRIPT, // Start the script loaded with script_load(), see script.h
+    CMD_HEARTBEAT, // Keep holding the current command, see control_loop.h
+    CMD_SLT,  // Strafe Left, mecanum only (DRIVETRAIN_HAS_STRAFE)
+    CMD_SRT   // Strafe Right, mecanum only
+} CommandType;
+
+// A command that sets the wheels going in a fixed direction: the eight of the control pad,
+// plus the strafes where the drivetrain has them. The values are on the wire (UDP, binary
+// WebSocket frames, traces), so new ones go at the end of the enum.
+static inline bool vehicle_is_movement(CommandType cmd)
+{
+    return cmd < CMD_STOP || (DRIVETRAIN_HAS_STRAFE && (cmd == CMD_SLT || cmd == CMD_SRT));
+}
+
+// Wheel indices in wheels[] order, WHEEL_FRONT_RIGHT and so on (drivetrain.h)
+#define WHEEL_INDEX(name, throttle, turn, strafe) WHEEL_##name,
+enum
+{
+    DRIVETRAIN_WHEELS(WHEEL_INDEX)
+};
+
+// Full scale of each drive vector component
+#define DRIVE_SCALE 1000
+
+// A command as queued for the control loop: the type, plus the vector of a CMD_DRIVE
+typedef struct
+{
+    uint8_t type;     // CommandType
+    int16_t throttle; // forward when positive, -DRIVE_SCALE..DRIVE_SCALE
+    int16_t turn;     // toward the RGT direction when positive, -DRIVE_SCALE..DRIVE_SCALE
+    uint32_t posted_us; // time_us_32() when queued, for the command-to-PWM latency
+} VehicleCommand;
+
+// Fixed-point scale of Wheel.mix: MIX_ONE is full speed forward
+#define MIX_ONE (1 << 14)
+
+typedef struct
+{
+    uint en_pin;  // PWM enable pin
+    uint in1_pin; // Direction pin 1
+    uint in2_pin; // Direction pin 2
+    int speed;    // Commanded speed as signed duty, -SPEED_SCALE to +SPEED_SCALE
+    int16_t mix;  // Share of the target speed for this wheel, MIX_ONE = 1.0
+    MotionProfile profile; // Ramp of the wheel velocity toward mix * target speed
+    int32_t duty; // Duty applied, -DUTY_ONE..DUTY_ONE: speed, or the speed_control.h output
+} Wheel;
+
+extern Wheel wheels[NUM_OF_WHEELS];
+extern int vehicle_speed;
+
+// store current and previous commands:
+// last_commands[0] = current, last_commands[1] = previous
+extern CommandType last_commands[2];
+
+#define last_command (last_commands[0])
+#define prev_command (last_commands[1])
+
+// The command named by a three-letter string such as "FWD", or CMD_NONE if there is none
+CommandType get_command_enum(const char *command);
+
+// Look up the command named by the len characters at name, "NON" included, in constant
+// time (key3.h). Returns false for any other name, and for the strafes on a chassis
+// without them.
+bool vehicle_parse_command(const char *name, size_t len, CommandType *cmd);
+
+// Parse one drive vector component: an optional '-' and up to 5 digits, clamped to
+// +-DRIVE_SCALE. Returns false on anything else.
+bool parse_drive_value(const char *s, size_t len, int *value);
+void push_command(CommandType cmd);
+
+// Record the command and update the vehicle state. Only the control loop calls this;
+// network transports post commands with control_loop_post().
+void vehicle_command(CommandType cmd);
+
+// vehicle_command() at a share of full speed, 0..DRIVE_SCALE, for movement commands
+void vehicle_command_scaled(CommandType cmd, int scale);
+
+// Mix a (throttle, turn) vector into per-wheel targets through the drivetrain's mixing
+// table: on a 4WD chassis the right side gets throttle + turn, the left side
+// throttle - turn, scaled down together when any wheel would exceed full scale. Like
+// vehicle_command(), control loop only.
+void vehicle_drive(int throttle, int turn);
+
+void setup_pwms(void);
+void update_vehicle(void);
+// Advance the wheel ramps by dt seconds and refresh speed/duty/vehicle_speed
+void vehicle_step(float dt);
+void apply_vehicle(void);
+
+// Incremented every time a command sets the wheel targets, so the control loop can tell
+// whether a tick changed them
+uint32_t vehicle_target_seq(void);
+
+// Point the direction pins of the wheels with a nonzero sign forward (+) or backward (-);
+// the others keep theirs. Written with one masked write.
+void vehicle_set_directions(const int8_t sign[NUM_OF_WHEELS]);
+
+// True when every wheel is stopped, with no ramp in progress and no target to ramp to
+bool vehicle_at_rest(void);
+
+#endif // VEHICLE_H
@@ -0,0 +1,90 @@
+#include <string.h>
+
+#include "custom.h"
+#include "wifi_link.h"
+
+WifiLinkStats wifi_link_stats;
+
+static WifiState state;
+static uint32_t deadline_ms; // CONNECTING: give up; BACKOFF: retry
+static uint32_t backoff_ms;
+
+void wifi_link_init(void)
+{
+    state = WIFI_IDLE;
+    backoff_ms = WIFI_BACKOFF_MIN_MS;
+    memset(&wifi_link_stats, 0, sizeof(wifi_link_stats));
+}
+
+static WifiAction connect(uint32_t now_ms)
+{
+    state = WIFI_CONNECTING;
+    deadline_ms = now_ms + WIFI_CONNECT_TIMEOUT_MS;
+    wifi_link_stats.attempts++;
+    return WIFI_DO_CONNECT;
+}
+
+static WifiAction retry_later(uint32_t now_ms, uint32_t delay_ms)
+{
+    state = WIFI_BACKOFF;
+    deadline_ms = now_ms + delay_ms;
+    return WIFI_DO_LEAVE;
+}
+
+WifiAction wifi_link_poll(WifiLinkStatus link, uint32_t now_ms)
+{
+    switch (state)
+    {
+    case WIFI_IDLE:
+        return connect(now_ms);
+
+    case WIFI_CONNECTING:
+        if (link == WIFI_LINK_UP)
+        {
+            state = WIFI_CONNECTED;
+            backoff_ms = WIFI_BACKOFF_MIN_MS;
+            wifi_link_stats.connects++;
+            wifi_link_stats.up_since_ms = now_ms;
+            if (wifi_link_stats.first_up_ms == 0)
+                wifi_link_stats.first_up_ms = now_ms ? now_ms : 1;
+            return WIFI_DO_NOTHING;
+        }
+        // DOWN is normal until the radio has started the join
+        if (link == WIFI_LINK_FAILED || (int32_t)(now_ms - deadline_ms) >= 0)
+        {
+            wifi_link_stats.failures++;
+            WifiAction action = retry_later(now_ms, backoff_ms);
+            backoff_ms = backoff_ms * 2 > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : backoff_ms * 2;
+            return action;
+        }
+        return WIFI_DO_NOTHING;
+
+    case WIFI_CONNECTED:
+        if (link == WIFI_LINK_UP)
+            return WIFI_DO_NOTHING;
+        wifi_link_stats.drops++;
+        return retry_later(now_ms, WIFI_BACKOFF_MIN_MS);
+
+    case WIFI_BACKOFF:
+        if ((int32_t)(now_ms - deadline_ms) >= 0)
+            return connect(now_ms);
+        return WIFI_DO_NOTHING;
+    }
+    return WIFI_DO_NOTHING;
+}
+
+WifiState wifi_link_state(void)
+{
+    return state;
+}
+
+const char *wifi_link_state_name(WifiState s)
+{
+    static const char *const names[] = {
+        [WIFI_IDLE] = "idle",
+        [WIFI_CONNECTING] = "connecting",
+        [WIFI_CONNECTED] = "connected",
+        [WIFI_BACKOFF] = "backoff",
+    };
+    return (unsigned)s < sizeof(names) / sizeof(names[0]) ? names[s] : "?";
+}
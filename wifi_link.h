@@ -0,0 +1,60 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+// Background Wi-Fi connection management. The motors and httpd come up at boot without
+// waiting for the network; the main loop polls this state machine with the radio's link
+// status, and carries out what it returns (start an asynchronous join, or leave). A join
+// that fails or takes longer than WIFI_CONNECT_TIMEOUT_MS is retried after a backoff that
+// doubles from WIFI_BACKOFF_MIN_MS up to WIFI_BACKOFF_MAX_MS; a dropped link is rejoined
+// after the minimum backoff. The radio calls themselves stay in pico_httpd.c, so the
+// state machine also runs in the host build.
+//
+// Main loop (core 0) only.
+
+#include <stdint.h>
+
+// What the radio reports (cyw43_tcpip_link_status, mapped by the caller)
+typedef enum
+{
+    WIFI_LINK_DOWN,
+    WIFI_LINK_JOINING, // associating, or waiting for an address
+    WIFI_LINK_UP,      // joined with an IP address
+    WIFI_LINK_FAILED,  // join failed: no network, bad password, ...
+} WifiLinkStatus;
+
+typedef enum
+{
+    WIFI_IDLE, // not started
+    WIFI_CONNECTING,
+    WIFI_CONNECTED,
+    WIFI_BACKOFF, // waiting to retry
+} WifiState;
+
+typedef enum
+{
+    WIFI_DO_NOTHING,
+    WIFI_DO_CONNECT, // start an asynchronous join
+    WIFI_DO_LEAVE,   // abandon the current join or association
+} WifiAction;
+
+typedef struct
+{
+    uint32_t attempts;    // joins started
+    uint32_t connects;    // joins that came up
+    uint32_t failures;    // joins that failed or timed out
+    uint32_t drops;       // links lost after coming up
+    uint32_t first_up_ms; // time since boot the link first came up, 0 until then
+    uint32_t up_since_ms; // start of the current connection
+} WifiLinkStats;
+
+extern WifiLinkStats wifi_link_stats;
+
+void wifi_link_init(void);
+
+// Advance the state machine; the caller performs the returned action right away
+WifiAction wifi_link_poll(WifiLinkStatus link, uint32_t now_ms);
+
+WifiState wifi_link_state(void);
+const char *wifi_link_state_name(WifiState state);
+
+#endif // WIFI_LINK_H
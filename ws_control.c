@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "custom.h"
+#include "http_control.h"
+#include "pico/time.h"
+#include "session.h"
+#include "vehicle.h"
+#include "ws_control.h"
+
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// SHA-1 is only needed once per connection for Sec-WebSocket-Accept, so this favours size
+// over speed.
+static uint32_t rol32(uint32_t x, int n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t block[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++)
+        w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = rol32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol32(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+// msg_len must be < 56 * 2 bytes, which covers a 24 char key plus the GUID
+static void sha1_short(const uint8_t *msg, size_t msg_len, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint8_t block[128] = {0};
+    size_t blocks = (msg_len + 8) / 64 + 1;
+
+    memcpy(block, msg, msg_len);
+    block[msg_len] = 0x80;
+    uint64_t bits = (uint64_t)msg_len * 8;
+    for (int i = 0; i < 8; i++)
+        block[blocks * 64 - 1 - i] = (uint8_t)(bits >> (8 * i));
+    for (size_t i = 0; i < blocks; i++)
+        sha1_block(h, block + i * 64);
+
+    for (int i = 0; i < 5; i++)
+    {
+        digest[i * 4] = (uint8_t)(h[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(h[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(h[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)h[i];
+    }
+}
+
+static size_t base64_encode(const uint8_t *in, size_t len, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *p = out;
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len)
+            v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len)
+            v |= in[i + 2];
+        *p++ = table[(v >> 18) & 0x3f];
+        *p++ = table[(v >> 12) & 0x3f];
+        *p++ = i + 1 < len ? table[(v >> 6) & 0x3f] : '=';
+        *p++ = i + 2 < len ? table[v & 0x3f] : '=';
+    }
+    *p = '\0';
+    return p - out;
+}
+
+// Value of the header name (with its colon) between request and end, trimmed, or NULL.
+// Header names are case-insensitive.
+static const char *find_header(const char *request, const char *end, const char *name,
+                               size_t *value_len)
+{
+    size_t name_len = strlen(name);
+    for (const char *line = request; line < end;)
+    {
+        const char *eol = line;
+        while (eol < end && *eol != '\r')
+            eol++;
+        if ((size_t)(eol - line) >= name_len && strncasecmp(line, name, name_len) == 0)
+        {
+            const char *value = line + name_len;
+            while (value < eol && *value == ' ')
+                value++;
+            size_t len = eol - value;
+            while (len && value[len - 1] == ' ')
+                len--;
+            *value_len = len;
+            return value;
+        }
+        line = eol + 2;
+    }
+    return NULL;
+}
+
+// Whether a comma-separated header value lists token, case-insensitively
+// ("Connection: keep-alive, Upgrade")
+static bool has_token(const char *value, size_t len, const char *token)
+{
+    size_t token_len = strlen(token);
+    const char *end = value + len;
+    while (value < end)
+    {
+        while (value < end && (*value == ' ' || *value == ','))
+            value++;
+        const char *stop = value;
+        while (stop < end && *stop != ',')
+            stop++;
+        const char *last = stop;
+        while (last > value && last[-1] == ' ')
+            last--;
+        if ((size_t)(last - value) == token_len && strncasecmp(value, token, token_len) == 0)
+            return true;
+        value = stop;
+    }
+    return false;
+}
+
+int ws_handshake(const char *request, size_t request_len, char *out, size_t out_len)
+{
+    const char *end = NULL;
+    for (size_t i = 0; i + 3 < request_len; i++)
+    {
+        if (memcmp(request + i, "\r\n\r\n", 4) == 0)
+        {
+            end = request + i;
+            break;
+        }
+    }
+    if (end == NULL)
+        return 0;
+    if (request_len < 4 || memcmp(request, "GET ", 4) != 0)
+        return WS_HANDSHAKE_BAD_REQUEST;
+
+    // RFC 6455 section 4.2.1: an upgrade to websocket, version 13, with a key
+    size_t len;
+    const char *value = find_header(request, end, "Upgrade:", &len);
+    if (value == NULL || !has_token(value, len, "websocket"))
+        return WS_HANDSHAKE_BAD_REQUEST;
+    value = find_header(request, end, "Connection:", &len);
+    if (value == NULL || !has_token(value, len, "Upgrade"))
+        return WS_HANDSHAKE_BAD_REQUEST;
+    value = find_header(request, end, "Sec-WebSocket-Version:", &len);
+    if (value == NULL)
+        return WS_HANDSHAKE_BAD_REQUEST;
+    if (len != 2 || memcmp(value, "13", 2) != 0)
+        return WS_HANDSHAKE_BAD_VERSION;
+    size_t key_len;
+    const char *key = find_header(request, end, "Sec-WebSocket-Key:", &key_len);
+    if (key == NULL || key_len == 0 || key_len > 32)
+        return WS_HANDSHAKE_BAD_REQUEST;
+
+    uint8_t concat[32 + sizeof(WS_GUID)];
+    uint8_t digest[20];
+    char accept[29];
+    memcpy(concat, key, key_len);
+    memcpy(concat + key_len, WS_GUID, sizeof(WS_GUID) - 1);
+    sha1_short(concat, key_len + sizeof(WS_GUID) - 1, digest);
+    base64_encode(digest, sizeof(digest), accept);
+
+    int n = snprintf(out, out_len,
+                     "HTTP/1.1 101 Switching Protocols\r\n"
+                     "Upgrade: websocket\r\n"
+                     "Connection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n\r\n",
+                     accept);
+    return (n < 0 || (size_t)n >= out_len) ? WS_HANDSHAKE_BAD_REQUEST : n;
+}
+
+int ws_decode_frame(uint8_t *buf, size_t len, WsFrame *frame)
+{
+    if (len < 2)
+        return 0;
+
+    bool masked = buf[1] & 0x80;
+    size_t payload_len = buf[1] & 0x7f;
+    size_t header_len = 2;
+
+    // Clients must mask, and 64-bit lengths are far beyond anything a command needs
+    if (!masked || payload_len == 127 || (buf[0] & 0x70))
+        return -1;
+    if (payload_len == 126)
+    {
+        if (len < 4)
+            return 0;
+        payload_len = ((size_t)buf[2] << 8) | buf[3];
+        header_len = 4;
+    }
+    if (len < header_len + 4 + payload_len)
+        return 0;
+
+    const uint8_t *mask = buf + header_len;
+    uint8_t *payload = buf + header_len + 4;
+    for (size_t i = 0; i < payload_len; i++)
+        payload[i] ^= mask[i & 3];
+
+    frame->fin = buf[0] & 0x80;
+    frame->opcode = buf[0] & 0x0f;
+    frame->payload = payload;
+    frame->len = payload_len;
+    return (int)(header_len + 4 + payload_len);
+}
+
+int ws_encode_frame(uint8_t opcode, const void *payload, size_t len, uint8_t *out, size_t out_len)
+{
+    size_t header_len = len < 126 ? 2 : 4;
+    if (len > 0xffff || header_len + len > out_len)
+        return -1;
+
+    out[0] = 0x80 | opcode;
+    if (len < 126)
+    {
+        out[1] = (uint8_t)len;
+    }
+    else
+    {
+        out[1] = 126;
+        out[2] = (uint8_t)(len >> 8);
+        out[3] = (uint8_t)len;
+    }
+    if (len)
+        memcpy(out + header_len, payload, len);
+    return (int)(header_len + len);
+}
+
+// Map a command frame to a command; anything unrecognised is CMD_NONE like in /control.cgi
+static CommandType frame_command(const WsFrame *frame)
+{
+    if (frame->opcode == WS_OPCODE_BINARY)
+    {
+        uint8_t value = frame->len == 1 ? frame->payload[0] : CMD_NONE;
+        if (value == CMD_STOP || value == CMD_NONE || value == CMD_HEARTBEAT ||
+            vehicle_is_movement((CommandType)value))
+            return (CommandType)value;
+        return CMD_NONE;
+    }
+
+    CommandType cmd;
+    return vehicle_parse_command((const char *)frame->payload, frame->len, &cmd) ? cmd
+                                                                                : CMD_NONE;
+}
+
+// "DRV <throttle> <turn>" text frame
+static bool frame_drive(const WsFrame *frame, int *throttle, int *turn)
+{
+    const char *p = (const char *)frame->payload;
+    const char *end = p + frame->len;
+
+    if (frame->opcode != WS_OPCODE_TEXT || frame->len < 7 || memcmp(p, "DRV ", 4) != 0)
+        return false;
+    p += 4;
+    const char *space = memchr(p, ' ', end - p);
+    if (space == NULL)
+        return false;
+    return parse_drive_value(p, space - p, throttle) &&
+           parse_drive_value(space + 1, end - space - 1, turn);
+}
+
+WsReply ws_process_frame(uint32_t client, const WsFrame *frame, uint8_t *out, size_t out_len,
+                         int *out_frame_len)
+{
+    *out_frame_len = 0;
+
+    switch (frame->opcode)
+    {
+    case WS_OPCODE_TEXT:
+    case WS_OPCODE_BINARY:
+    {
+        // Commands are a few bytes; fragmented messages are not part of the protocol
+        if (!frame->fin)
+            break;
+        VehicleCommand cmd = {CMD_DRIVE, 0, 0};
+        int throttle, turn;
+        if (frame_drive(frame, &throttle, &turn))
+        {
+            cmd.throttle = (int16_t)throttle;
+            cmd.turn = (int16_t)turn;
+        }
+        else
+        {
+            cmd.type = (uint8_t)frame_command(frame);
+        }
+        session_submit(SESSION_WS, client, &cmd, to_ms_since_boot(get_absolute_time()));
+        CommandType command = (CommandType)cmd.type;
+        if (command == CMD_HEARTBEAT)
+            return WS_REPLY_NONE; // nothing changed, so there is no status to broadcast
+
+        char status[WS_TX_BUFFER_SIZE - 4];
+        int len = http_control_format_status(status, sizeof(status), command);
+        if (len < 0 || (size_t)len >= sizeof(status))
+            return WS_REPLY_NONE;
+        *out_frame_len = ws_encode_frame(WS_OPCODE_TEXT, status, len, out, out_len);
+        return *out_frame_len > 0 ? WS_REPLY_BROADCAST : WS_REPLY_NONE;
+    }
+    case WS_OPCODE_PING:
+        *out_frame_len = ws_encode_frame(WS_OPCODE_PONG, frame->payload, frame->len, out, out_len);
+        return *out_frame_len > 0 ? WS_REPLY_SENDER : WS_REPLY_NONE;
+    case WS_OPCODE_PONG:
+        return WS_REPLY_NONE;
+    default:
+        break;
+    }
+
+    // Close request, or something we do not speak: echo a close frame and hang up
+    *out_frame_len = ws_encode_frame(WS_OPCODE_CLOSE, NULL, 0, out, out_len);
+    return WS_REPLY_CLOSE;
+}
@@ -0,0 +1,61 @@
+#ifndef WS_CONTROL_H
+#define WS_CONTROL_H
+
+// WebSocket (RFC 6455) framing and the control protocol spoken over it.
+// Independent of lwIP so it can be exercised on the host; ws_server.c does the TCP side.
+//
+// Client -> robot: a text frame holding a command ("FWD", "STP", "NON", ...) or a binary
+//                  frame holding one byte with the CommandType value, or a drive vector
+//                  as text: "DRV <throttle> <turn>" (see vehicle_drive()). A held command
+//                  is kept alive with "HBT" heartbeats (see control_loop.h).
+// Robot -> client: a text frame with the same status JSON /control.cgi returns, for every
+//                  command except heartbeats.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WS_OPCODE_CONTINUATION 0x0
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+typedef struct
+{
+    uint8_t opcode;
+    bool fin;
+    uint8_t *payload; // points into the decode buffer, already unmasked
+    size_t len;
+} WsFrame;
+
+typedef enum
+{
+    WS_REPLY_NONE,      // nothing to send
+    WS_REPLY_SENDER,    // send the reply to the client the frame came from
+    WS_REPLY_BROADCAST, // send the reply to every connected client
+    WS_REPLY_CLOSE,     // send the reply, then close the connection
+} WsReply;
+
+#define WS_HANDSHAKE_BAD_REQUEST -1 // not a valid WebSocket upgrade: answer 400
+#define WS_HANDSHAKE_BAD_VERSION -2 // a version other than 13: answer 426
+
+// Build the 101 response for an HTTP upgrade request. Returns its length, 0 if the
+// request headers are not complete yet, or one of the WS_HANDSHAKE_ errors. The request
+// needs Upgrade: websocket, Connection: Upgrade, Sec-WebSocket-Version: 13 and a key.
+int ws_handshake(const char *request, size_t request_len, char *out, size_t out_len);
+
+// Decode one client frame at the start of buf, unmasking the payload in place.
+// Returns the number of bytes consumed, 0 if more data is needed, -1 on a protocol error.
+int ws_decode_frame(uint8_t *buf, size_t len, WsFrame *frame);
+
+// Write an unmasked server frame. Returns its length or -1 if out is too small.
+int ws_encode_frame(uint8_t opcode, const void *payload, size_t len, uint8_t *out, size_t out_len);
+
+// Act on a decoded frame of a client (its session key, see session.h) and build the frame
+// to send back into out.
+WsReply ws_process_frame(uint32_t client, const WsFrame *frame, uint8_t *out, size_t out_len,
+                         int *out_frame_len);
+
+#endif // WS_CONTROL_H
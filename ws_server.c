@@ -0,0 +1,218 @@
+// lwIP raw-API side of the WebSocket control channel: accepts up to WS_MAX_CLIENTS
+// long-lived connections, performs the HTTP upgrade and feeds frames to ws_control.c.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "custom.h"
+#include "event_log.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "session.h"
+#include "ws_control.h"
+#include "ws_server.h"
+
+typedef struct
+{
+    struct tcp_pcb *pcb;
+    bool upgraded;
+    uint16_t rx_len;
+    uint8_t rx[WS_RX_BUFFER_SIZE];
+} WsClient;
+
+static WsClient ws_clients[WS_MAX_CLIENTS];
+
+static void ws_client_release(WsClient *client)
+{
+    if (client->upgraded)
+        session_close(SESSION_WS, (uint32_t)(client - ws_clients));
+    client->pcb = NULL;
+    client->upgraded = false;
+    client->rx_len = 0;
+}
+
+// Returns ERR_ABRT if the pcb had to be aborted, which must be passed back to lwIP
+static err_t ws_client_close(WsClient *client)
+{
+    struct tcp_pcb *pcb = client->pcb;
+    err_t err = ERR_OK;
+    if (pcb == NULL)
+        return ERR_OK;
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK)
+    {
+        tcp_abort(pcb);
+        err = ERR_ABRT;
+    }
+    ws_client_release(client);
+    return err;
+}
+
+static void ws_send(WsClient *client, const void *data, int len)
+{
+    if (client->pcb == NULL || len <= 0)
+        return;
+    if (tcp_write(client->pcb, data, len, TCP_WRITE_FLAG_COPY) == ERR_OK)
+        tcp_output(client->pcb);
+}
+
+static err_t ws_handle_frames(WsClient *client)
+{
+    uint8_t reply[WS_TX_BUFFER_SIZE];
+    uint16_t offset = 0;
+
+    while (offset < client->rx_len)
+    {
+        WsFrame frame;
+        int used = ws_decode_frame(client->rx + offset, client->rx_len - offset, &frame);
+        if (used == 0)
+            break;
+        if (used < 0)
+            return ws_client_close(client);
+        offset += used;
+
+        int reply_len;
+        switch (ws_process_frame((uint32_t)(client - ws_clients), &frame, reply, sizeof(reply),
+                                 &reply_len))
+        {
+        case WS_REPLY_SENDER:
+            ws_send(client, reply, reply_len);
+            break;
+        case WS_REPLY_BROADCAST:
+            for (int i = 0; i < WS_MAX_CLIENTS; i++)
+            {
+                if (ws_clients[i].upgraded)
+                    ws_send(&ws_clients[i], reply, reply_len);
+            }
+            break;
+        case WS_REPLY_CLOSE:
+            ws_send(client, reply, reply_len);
+            return ws_client_close(client);
+        case WS_REPLY_NONE:
+            break;
+        }
+    }
+
+    // Keep a partial frame for the next segment
+    memmove(client->rx, client->rx + offset, client->rx_len - offset);
+    client->rx_len -= offset;
+    return ERR_OK;
+}
+
+static err_t ws_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    WsClient *client = (WsClient *)arg;
+
+    if (p == NULL || err != ERR_OK || client == NULL)
+    {
+        if (p)
+            pbuf_free(p);
+        return client ? ws_client_close(client) : ERR_OK;
+    }
+
+    tcp_recved(pcb, p->tot_len);
+    if (p->tot_len > sizeof(client->rx) - client->rx_len)
+    {
+        EVENT_LOG(EV_WS_RX_OVERFLOW, client - ws_clients, 0, 0);
+        pbuf_free(p);
+        return ws_client_close(client);
+    }
+    client->rx_len += pbuf_copy_partial(p, client->rx + client->rx_len, p->tot_len, 0);
+    pbuf_free(p);
+
+    if (!client->upgraded)
+    {
+        char response[160];
+        int len = ws_handshake((const char *)client->rx, client->rx_len, response, sizeof(response));
+        if (len == 0)
+            return ERR_OK; // headers not complete yet
+        if (len < 0)
+        {
+            static const char bad_request[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+            static const char bad_version[] = "HTTP/1.1 426 Upgrade Required\r\n"
+                                              "Sec-WebSocket-Version: 13\r\n"
+                                              "Content-Length: 0\r\n\r\n";
+            if (len == WS_HANDSHAKE_BAD_VERSION)
+                ws_send(client, bad_version, sizeof(bad_version) - 1);
+            else
+                ws_send(client, bad_request, sizeof(bad_request) - 1);
+            return ws_client_close(client);
+        }
+        ws_send(client, response, len);
+        client->upgraded = true;
+        client->rx_len = 0; // a client must wait for the 101 before sending frames
+        EVENT_LOG(EV_WS_UPGRADED, client - ws_clients, 0, 0);
+        return ERR_OK;
+    }
+
+    return ws_handle_frames(client);
+}
+
+static void ws_error(void *arg, err_t err)
+{
+    // The pcb is already freed by lwIP when this is called
+    WsClient *client = (WsClient *)arg;
+    if (client)
+        ws_client_release(client);
+}
+
+static err_t ws_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+    if (err != ERR_OK || pcb == NULL)
+        return ERR_VAL;
+
+    WsClient *client = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (ws_clients[i].pcb == NULL)
+        {
+            client = &ws_clients[i];
+            break;
+        }
+    }
+    if (client == NULL)
+    {
+        EVENT_LOG(EV_WS_NO_SLOT, 0, 0, 0);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+
+    client->pcb = pcb;
+    client->upgraded = false;
+    client->rx_len = 0;
+
+    // Commands are tiny and latency-critical: do not let Nagle hold them back
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, client);
+    tcp_recv(pcb, ws_recv);
+    tcp_err(pcb, ws_error);
+    return ERR_OK;
+}
+
+void ws_server_init(void)
+{
+    struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb == NULL)
+    {
+        printf("ws: failed to create pcb\n");
+        return;
+    }
+    if (tcp_bind(pcb, IP_ANY_TYPE, WS_PORT) != ERR_OK)
+    {
+        printf("ws: failed to bind port %d\n", WS_PORT);
+        tcp_close(pcb);
+        return;
+    }
+    struct tcp_pcb *listen_pcb = tcp_listen_with_backlog(pcb, WS_MAX_CLIENTS);
+    if (listen_pcb == NULL)
+    {
+        printf("ws: failed to listen\n");
+        tcp_close(pcb);
+        return;
+    }
+    tcp_accept(listen_pcb, ws_accept);
+    printf("ws: listening on port %d\n", WS_PORT);
+}
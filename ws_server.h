@@ -0,0 +1,8 @@
+#ifndef WS_SERVER_H
+#define WS_SERVER_H
+
+// Start listening for WebSocket control connections on WS_PORT.
+// Call with the lwIP lock held (between cyw43_arch_lwip_begin/end).
+void ws_server_init(void);
+
+#endif // WS_SERVER_H